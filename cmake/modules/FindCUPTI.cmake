@@ -21,6 +21,15 @@ find_library(CUPTI_LIBRARY cupti
     HINTS ${CUPTI_ROOT_DIR} ${CUDA_TOOLKIT_ROOT_DIR}/extras/CUPTI
     PATH_SUFFIXES lib lib64 lib lib64 x64)
 
+# the range profiler (Perfworks) libraries ship with CUPTI from CUDA 10.0 on
+find_library(CUPTI_NVPERF_HOST_LIBRARY nvperf_host
+    HINTS ${CUPTI_ROOT_DIR} ${CUDA_TOOLKIT_ROOT_DIR}/extras/CUPTI
+    PATH_SUFFIXES lib lib64 lib lib64 x64)
+
+find_library(CUPTI_NVPERF_TARGET_LIBRARY nvperf_target
+    HINTS ${CUPTI_ROOT_DIR} ${CUDA_TOOLKIT_ROOT_DIR}/extras/CUPTI
+    PATH_SUFFIXES lib lib64 lib lib64 x64)
+
 find_package_handle_standard_args(
     CUPTI DEFAULT_MSG CUPTI_INCLUDE_DIR CUPTI_LIBRARY)
 
@@ -49,5 +58,10 @@ if(CUPTI_FOUND)
   set(CUPTI_INCLUDE_DIRS ${CUPTI_INCLUDE_DIR})
   set(CUPTI_LIBRARIES ${CUPTI_LIBRARY})
   message(STATUS "Found CUPTI: v${CUPTI_VERSION}  (include: ${CUPTI_INCLUDE_DIR}, library: ${CUPTI_LIBRARY})")
-  mark_as_advanced(CUPTI_ROOT_DIR CUPTI_LIBRARY CUPTI_INCLUDE_DIR)
+  if(CUPTI_NVPERF_HOST_LIBRARY AND CUPTI_NVPERF_TARGET_LIBRARY AND EXISTS ${CUPTI_INCLUDE_DIR}/cupti_profiler_target.h)
+    set(CUPTI_RANGE_PROFILER_FOUND TRUE)
+    set(CUPTI_RANGE_PROFILER_LIBRARIES ${CUPTI_NVPERF_HOST_LIBRARY} ${CUPTI_NVPERF_TARGET_LIBRARY})
+    message(STATUS "Found CUPTI range profiler: ${CUPTI_RANGE_PROFILER_LIBRARIES}")
+  endif()
+  mark_as_advanced(CUPTI_ROOT_DIR CUPTI_LIBRARY CUPTI_INCLUDE_DIR CUPTI_NVPERF_HOST_LIBRARY CUPTI_NVPERF_TARGET_LIBRARY)
 endif()
\ No newline at end of file
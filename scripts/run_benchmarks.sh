@@ -36,6 +36,7 @@ do
   cmake .. ${CMAKE_OPTIONS} -DCUDNN_BATCH_SIZE=${BATCH_SIZE}
   make VERBOSE=1 -j4
   ./scope --benchmark_out_format=json --benchmark_out=${RESULTS_DIR}/${BATCH_SIZE}.json
+  ./scope --store=${RESULTS_DIR}/../results.store --store_import=${RESULTS_DIR}/${BATCH_SIZE}.json
   popd
 done
 
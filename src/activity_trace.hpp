@@ -0,0 +1,436 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef ENABLE_CUDNN_CUPTI
+#include <cupti.h>
+#endif // ENABLE_CUDNN_CUPTI
+
+// Kernel tracing through the CUPTI activity API.
+//
+// CUPTI hands out activity buffers through a "requested" callback and returns
+// them filled through a "completed" callback, possibly from its own thread.
+// The buffers come from a fixed pool and travel through lock-free queues:
+//
+//   free queue -> CUPTI -> completed queue -> drain thread (parse) -> free queue
+//
+// so neither callback allocates or takes a lock. The drain thread turns the
+// records into kernel_record_t and hands them to a collector that the
+// benchmark reads once per iteration. Only tracer depends on CUPTI; the pool
+// and the drain thread work on any buffer and parser.
+namespace activity_trace {
+
+// Bounded multi-producer multi-consumer queue (Vyukov). The capacity is rounded up to a power of two.
+template <typename T>
+class mpmc_queue {
+public:
+  explicit mpmc_queue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    m_mask  = size - 1;
+    m_cells = std::unique_ptr<cell_t[]>(new cell_t[size]);
+    for (size_t ii = 0; ii < size; ii++) {
+      m_cells[ii].sequence.store(ii, std::memory_order_relaxed);
+    }
+  }
+
+  bool push(const T &value) {
+    auto pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      auto &cell     = m_cells[pos & m_mask];
+      const auto seq = cell.sequence.load(std::memory_order_acquire);
+      const auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (dif == 0) {
+        if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.value = value;
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (dif < 0) {
+        // full
+        return false;
+      } else {
+        pos = m_enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool pop(T &value) {
+    auto pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      auto &cell     = m_cells[pos & m_mask];
+      const auto seq = cell.sequence.load(std::memory_order_acquire);
+      const auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (dif == 0) {
+        if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          value = cell.value;
+          cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (dif < 0) {
+        // empty
+        return false;
+      } else {
+        pos = m_dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+private:
+  struct cell_t {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<cell_t[]> m_cells{};
+  size_t m_mask{0};
+  alignas(64) std::atomic<size_t> m_enqueue_pos{0};
+  alignas(64) std::atomic<size_t> m_dequeue_pos{0};
+};
+
+// A fixed set of equally sized buffers. CUPTI requires 8 byte alignment.
+class buffer_pool {
+public:
+  static const size_t alignment = 8;
+
+  buffer_pool(size_t num_buffers, size_t buffer_bytes)
+      : m_buffer_bytes((buffer_bytes + alignment - 1) / alignment * alignment), m_free(num_buffers) {
+    for (size_t ii = 0; ii < num_buffers; ii++) {
+      auto buffer = static_cast<uint8_t *>(aligned_alloc(alignment, m_buffer_bytes));
+      if (buffer == nullptr) {
+        throw std::bad_alloc();
+      }
+      m_buffers.emplace_back(buffer);
+      m_free.push(buffer);
+    }
+  }
+
+  ~buffer_pool() {
+    for (auto buffer : m_buffers) {
+      free(buffer);
+    }
+  }
+
+  buffer_pool(const buffer_pool &) = delete;
+  buffer_pool &operator=(const buffer_pool &) = delete;
+
+  // Returns nullptr when every buffer is in flight.
+  uint8_t *acquire() {
+    uint8_t *buffer = nullptr;
+    if (!m_free.pop(buffer)) {
+      m_num_exhausted.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return buffer;
+  }
+
+  void release(uint8_t *buffer) {
+    m_free.push(buffer);
+  }
+
+  // Whether the buffer is one of the pool's; a linear scan, the pools are small.
+  bool owns(const uint8_t *buffer) const {
+    return std::find(m_buffers.begin(), m_buffers.end(), buffer) != m_buffers.end();
+  }
+
+  size_t buffer_bytes() const {
+    return m_buffer_bytes;
+  }
+
+  size_t num_buffers() const {
+    return m_buffers.size();
+  }
+
+  // number of requests that could not be served, i.e. dropped activity buffers
+  size_t num_exhausted() const {
+    return m_num_exhausted.load(std::memory_order_relaxed);
+  }
+
+private:
+  size_t m_buffer_bytes{0};
+  std::vector<uint8_t *> m_buffers{};
+  mpmc_queue<uint8_t *> m_free;
+  std::atomic<size_t> m_num_exhausted{0};
+};
+
+// Parses completed buffers on a background thread and returns them to the pool.
+// Buffers the pool did not hand out are parsed like the others and then freed.
+class drainer {
+public:
+  using parser_t = std::function<void(uint8_t *data, size_t valid_size)>;
+
+  drainer(buffer_pool &pool, parser_t parser)
+      : m_pool(pool), m_parser(std::move(parser)), m_completed(pool.num_buffers()) {
+    m_thread = std::thread([this]() { run(); });
+  }
+
+  ~drainer() {
+    m_running.store(false, std::memory_order_release);
+    m_thread.join();
+  }
+
+  drainer(const drainer &) = delete;
+  drainer &operator=(const drainer &) = delete;
+
+  void complete(uint8_t *data, size_t valid_size) {
+    m_pending.fetch_add(1, std::memory_order_acq_rel);
+    // the queue holds every buffer of the pool, so this only fails for foreign ones
+    if (!m_completed.push(completed_t{data, valid_size})) {
+      drain(completed_t{data, valid_size});
+    }
+  }
+
+  // Blocks until every completed buffer has been parsed.
+  void flush() const {
+    while (m_pending.load(std::memory_order_acquire) != 0) {
+      std::this_thread::yield();
+    }
+  }
+
+private:
+  struct completed_t {
+    uint8_t *data;
+    size_t valid_size;
+  };
+
+  void drain(const completed_t &buffer) {
+    if (buffer.valid_size > 0) {
+      m_parser(buffer.data, buffer.valid_size);
+    }
+    if (m_pool.owns(buffer.data)) {
+      m_pool.release(buffer.data);
+    } else {
+      free(buffer.data);
+    }
+    m_pending.fetch_sub(1, std::memory_order_acq_rel);
+  }
+
+  void run() {
+    auto idle = std::chrono::microseconds(10);
+    for (;;) {
+      completed_t buffer;
+      if (m_completed.pop(buffer)) {
+        drain(buffer);
+        idle = std::chrono::microseconds(10);
+        continue;
+      }
+      if (!m_running.load(std::memory_order_acquire)) {
+        return;
+      }
+      std::this_thread::sleep_for(idle);
+      idle = std::min(idle * 2, std::chrono::microseconds(1000));
+    }
+  }
+
+  buffer_pool &m_pool;
+  parser_t m_parser;
+  mpmc_queue<completed_t> m_completed;
+  std::atomic<size_t> m_pending{0};
+  std::atomic<bool> m_running{true};
+  std::thread m_thread{};
+};
+
+struct kernel_record_t {
+  std::string name{""};
+  uint32_t correlation_id{0};
+  uint32_t stream_id{0};
+  uint64_t start_ns{0};
+  uint64_t end_ns{0};
+  uint32_t grid[3]{0, 0, 0};
+  uint32_t block[3]{0, 0, 0};
+  uint32_t registers_per_thread{0};
+  uint32_t static_shared_bytes{0};
+  uint32_t dynamic_shared_bytes{0};
+
+  uint64_t duration_ns() const {
+    return end_ns > start_ns ? end_ns - start_ns : 0;
+  }
+};
+
+// Kernel records parsed since the last take(). Only the drain thread adds.
+class collector {
+public:
+  void add(kernel_record_t record) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_records.emplace_back(std::move(record));
+  }
+
+  // Returns the records ordered by start time and clears the collector.
+  std::vector<kernel_record_t> take() {
+    std::vector<kernel_record_t> res;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      res.swap(m_records);
+    }
+    std::sort(res.begin(), res.end(),
+              [](const kernel_record_t &a, const kernel_record_t &b) { return a.start_ns < b.start_ns; });
+    return res;
+  }
+
+private:
+  std::mutex m_mutex{};
+  std::vector<kernel_record_t> m_records{};
+};
+
+// The kernel record layout (the N of CUpti_ActivityKernelN) written by a
+// CUPTI API version: CUpti_ActivityKernel4 from version 10 (CUDA 9.0) to 12
+// (CUDA 10.2), CUpti_ActivityKernel5 for versions 13 (CUDA 11.0) and 14
+// (CUDA 11.1). Later versions added fields in new layouts, so they, like
+// unknown versions, are not supported (0) until their layout is listed here.
+inline int kernel_record_layout(uint32_t api_version) {
+  switch (api_version) {
+    case 10:
+    case 11:
+    case 12:
+      return 4;
+    case 13:
+    case 14:
+      return 5;
+    default:
+      return 0;
+  }
+}
+
+#ifdef ENABLE_CUDNN_CUPTI
+class tracer {
+public:
+  static tracer &instance() {
+    static tracer t;
+    return t;
+  }
+
+  // Throws std::runtime_error if CUPTI refuses the callbacks or writes records
+  // in a layout the headers do not describe.
+  void enable(size_t num_buffers, size_t buffer_bytes) {
+    if (m_enabled) {
+      return;
+    }
+    check_version();
+    m_pool    = std::unique_ptr<buffer_pool>(new buffer_pool(num_buffers, buffer_bytes));
+    m_drainer = std::unique_ptr<drainer>(
+        new drainer(*m_pool, [this](uint8_t *data, size_t valid_size) { parse(data, valid_size); }));
+    check(cuptiActivityRegisterCallbacks(buffer_requested, buffer_completed), "cuptiActivityRegisterCallbacks");
+    check(cuptiActivityEnable(CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL), "cuptiActivityEnable");
+    m_enabled = true;
+  }
+
+  bool is_enabled() const {
+    return m_enabled;
+  }
+
+  // Discards the records of kernels launched before the iteration.
+  void begin_iteration() {
+    cuptiActivityFlushAll(0);
+    m_drainer->flush();
+    m_collector.take();
+  }
+
+  // Call after the iteration synchronized.
+  std::vector<kernel_record_t> end_iteration() {
+    cuptiActivityFlushAll(0);
+    m_drainer->flush();
+    return m_collector.take();
+  }
+
+  size_t num_dropped_buffers() const {
+    return m_pool ? m_pool->num_exhausted() : 0;
+  }
+
+private:
+  static void check(CUptiResult status, const char *call) {
+    if (status != CUPTI_SUCCESS) {
+      const char *errstr;
+      cuptiGetResultString(status, &errstr);
+      throw std::runtime_error(std::string(call) + " failed with error " + errstr);
+    }
+  }
+
+  static void CUPTIAPI buffer_requested(uint8_t **buffer, size_t *size, size_t *max_num_records) {
+    auto &self       = instance();
+    *buffer          = self.m_pool->acquire();
+    *size            = *buffer == nullptr ? 0 : self.m_pool->buffer_bytes();
+    *max_num_records = 0;
+  }
+
+  static void CUPTIAPI buffer_completed(CUcontext /* ctx */, uint32_t /* stream_id */, uint8_t *buffer,
+                                        size_t /* size */, size_t valid_size) {
+    if (buffer != nullptr) {
+      instance().m_drainer->complete(buffer, valid_size);
+    }
+  }
+
+#if CUPTI_API_VERSION == 13 || CUPTI_API_VERSION == 14
+  using kernel_activity_t = CUpti_ActivityKernel5;
+#else  // CUPTI_API_VERSION == 13 || CUPTI_API_VERSION == 14
+  using kernel_activity_t = CUpti_ActivityKernel4;
+#endif // CUPTI_API_VERSION == 13 || CUPTI_API_VERSION == 14
+
+  // CUPTI writes the records in the layout of the library that is loaded,
+  // which is not necessarily the one of the headers this was built with.
+  static void check_version() {
+    uint32_t version = 0;
+    check(cuptiGetVersion(&version), "cuptiGetVersion");
+    const auto layout = kernel_record_layout(version);
+    if (layout == 0 || layout != kernel_record_layout(CUPTI_API_VERSION)) {
+      throw std::runtime_error("the kernel records of CUPTI API version " + std::to_string(version) +
+                               " do not have the layout of the headers (API version " +
+                               std::to_string(CUPTI_API_VERSION) + ")");
+    }
+  }
+
+  template <typename Kernel>
+  static kernel_record_t to_kernel_record(const CUpti_Activity *record) {
+    const auto kernel = reinterpret_cast<const Kernel *>(record);
+    kernel_record_t r;
+    r.name                 = kernel->name == nullptr ? "" : kernel->name;
+    r.correlation_id       = kernel->correlationId;
+    r.stream_id            = kernel->streamId;
+    r.start_ns             = kernel->start;
+    r.end_ns               = kernel->end;
+    r.grid[0]              = kernel->gridX;
+    r.grid[1]              = kernel->gridY;
+    r.grid[2]              = kernel->gridZ;
+    r.block[0]             = kernel->blockX;
+    r.block[1]             = kernel->blockY;
+    r.block[2]             = kernel->blockZ;
+    r.registers_per_thread = kernel->registersPerThread;
+    r.static_shared_bytes  = kernel->staticSharedMemory;
+    r.dynamic_shared_bytes = kernel->dynamicSharedMemory;
+    return r;
+  }
+
+  void parse(uint8_t *data, size_t valid_size) {
+    CUpti_Activity *record = nullptr;
+    while (cuptiActivityGetNextRecord(data, valid_size, &record) == CUPTI_SUCCESS) {
+      switch (record->kind) {
+        case CUPTI_ACTIVITY_KIND_KERNEL:
+        case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
+          m_collector.add(to_kernel_record<kernel_activity_t>(record));
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  bool m_enabled{false};
+  std::unique_ptr<buffer_pool> m_pool{nullptr};
+  std::unique_ptr<drainer> m_drainer{nullptr};
+  collector m_collector{};
+};
+#endif // ENABLE_CUDNN_CUPTI
+
+} // namespace activity_trace
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <unistd.h>
+
+#include "json.hpp"
+
+#ifdef ENABLE_CUDNN_NVTX
+#include <nvToolsExt.h>
+#endif // ENABLE_CUDNN_NVTX
+
+// Named ranges around the phases of a benchmark.
+//
+// Descriptor setup, allocation, Find, warmup and the timed iterations are
+// wrapped in annotate::range objects. The ranges go to the installed sink:
+// nothing (the default), NVTX so they show up in nsys/nvvp, or a chrome
+// trace event file that can be opened in chrome://tracing or Perfetto to see
+// where the wall time of a sweep goes outside the kernels.
+//
+// Range names must outlive the sink; names that are not string literals are
+// copied once through intern().
+namespace annotate {
+
+class sink {
+public:
+  virtual ~sink() {
+  }
+  virtual void push(const char *name) = 0;
+  virtual void pop()                  = 0;
+  virtual void flush() {
+  }
+};
+
+#ifdef ENABLE_CUDNN_NVTX
+class nvtx_sink : public sink {
+public:
+  void push(const char *name) override {
+    nvtxRangePushA(name);
+  }
+  void pop() override {
+    nvtxRangePop();
+  }
+};
+#endif // ENABLE_CUDNN_NVTX
+
+// Writes complete ("X") trace events. Every thread records into its own
+// buffer without locking; a buffer is appended to the file once it holds
+// events_per_flush events, and the remaining ones on flush(). flush() and the
+// destructor must not race with threads that still record ranges. Times are
+// written in microseconds since epoch with the nanoseconds as three decimals.
+class chrome_trace_sink : public sink {
+public:
+  chrome_trace_sink(const std::string &path, size_t events_per_flush = 4096,
+                    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now())
+      : m_events_per_flush(std::max<size_t>(events_per_flush, 1)), m_id(next_id()), m_epoch(epoch) {
+    m_stream.open(path, std::ios::out | std::ios::trunc);
+    if (!m_stream.is_open()) {
+      throw std::runtime_error("unable to open " + path);
+    }
+    m_stream << "{\"traceEvents\":[";
+  }
+
+  ~chrome_trace_sink() {
+    flush();
+    m_stream << "\n]}\n";
+  }
+
+  void push(const char *name) override {
+    auto &buffer = thread_buffer();
+    buffer.open.push_back({name, now_ns()});
+  }
+
+  void pop() override {
+    auto &buffer = thread_buffer();
+    if (buffer.open.empty()) {
+      return;
+    }
+    const auto end = now_ns();
+    const auto top = buffer.open.back();
+    buffer.open.pop_back();
+    buffer.events.push_back({top.name, top.start_ns, end - top.start_ns});
+    if (buffer.events.size() >= m_events_per_flush) {
+      write(buffer);
+    }
+  }
+
+  void flush() override {
+    std::lock_guard<std::mutex> lock(m_buffers_mutex);
+    for (auto &buffer : m_buffers) {
+      write(*buffer);
+    }
+    std::lock_guard<std::mutex> stream_lock(m_stream_mutex);
+    m_stream.flush();
+  }
+
+  size_t num_written() const {
+    return m_num_written;
+  }
+
+private:
+  struct open_t {
+    const char *name;
+    uint64_t start_ns;
+  };
+
+  struct event_t {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+  };
+
+  struct buffer_t {
+    uint32_t tid{0};
+    std::vector<open_t> open{};
+    std::vector<event_t> events{};
+  };
+
+  static uint64_t next_id() {
+    static std::atomic<uint64_t> id{0};
+    return ++id;
+  }
+
+  uint64_t now_ns() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+  }
+
+  // The buffer of the calling thread, registered on first use.
+  buffer_t &thread_buffer() {
+    thread_local uint64_t owner   = 0;
+    thread_local buffer_t *buffer = nullptr;
+    if (owner == m_id) {
+      return *buffer;
+    }
+    std::lock_guard<std::mutex> lock(m_buffers_mutex);
+    m_buffers.emplace_back(new buffer_t);
+    buffer      = m_buffers.back().get();
+    buffer->tid = static_cast<uint32_t>(m_buffers.size());
+    buffer->events.reserve(m_events_per_flush);
+    owner = m_id;
+    return *buffer;
+  }
+
+  // Integer microseconds and the remainder, so the resolution does not depend
+  // on how long the trace runs (a double at the default precision is 10 us
+  // after a second).
+  static void write_us(std::ostream &stream, uint64_t ns) {
+    const auto remainder = ns % 1000;
+    stream << ns / 1000 << (remainder < 10 ? ".00" : remainder < 100 ? ".0" : ".") << remainder;
+  }
+
+  void write(buffer_t &buffer) {
+    if (buffer.events.empty()) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(m_stream_mutex);
+    for (const auto &event : buffer.events) {
+      m_stream << (m_num_written++ == 0 ? "\n" : ",\n") << "{\"name\":" << nlohmann::json(event.name).dump()
+               << ",\"ph\":\"X\",\"pid\":" << m_pid << ",\"tid\":" << buffer.tid << ",\"ts\":";
+      write_us(m_stream, event.start_ns);
+      m_stream << ",\"dur\":";
+      write_us(m_stream, event.duration_ns);
+      m_stream << "}";
+    }
+    buffer.events.clear();
+  }
+
+  const size_t m_events_per_flush;
+  const uint64_t m_id;
+  const std::chrono::steady_clock::time_point m_epoch;
+  const int m_pid{static_cast<int>(getpid())};
+  std::mutex m_buffers_mutex{};
+  std::vector<std::unique_ptr<buffer_t>> m_buffers{};
+  std::mutex m_stream_mutex{};
+  std::ofstream m_stream{};
+  size_t m_num_written{0};
+};
+
+namespace detail {
+  inline std::unique_ptr<sink> &installed() {
+    static std::unique_ptr<sink> instance{nullptr};
+    return instance;
+  }
+
+  inline std::atomic<sink *> &current() {
+    static std::atomic<sink *> instance{nullptr};
+    return instance;
+  }
+} // namespace detail
+
+// Installs the sink of all ranges, nullptr disables the annotations. Must be
+// called before ranges are recorded, i.e. during initialization.
+inline void set_sink(std::unique_ptr<sink> s) {
+  detail::current().store(s.get());
+  if (detail::installed() != nullptr) {
+    detail::installed()->flush();
+  }
+  detail::installed() = std::move(s);
+}
+
+inline bool is_enabled() {
+  return detail::current().load(std::memory_order_relaxed) != nullptr;
+}
+
+inline void flush() {
+  auto s = detail::current().load();
+  if (s != nullptr) {
+    s->flush();
+  }
+}
+
+// Returns a copy of name that lives until the end of the process.
+inline const char *intern(const std::string &name) {
+  static std::mutex mutex;
+  static std::unordered_set<std::string> names;
+  std::lock_guard<std::mutex> lock(mutex);
+  return names.insert(name).first->c_str();
+}
+
+class range {
+public:
+  explicit range(const char *name) : m_sink(detail::current().load(std::memory_order_relaxed)) {
+    if (m_sink != nullptr) {
+      m_sink->push(name);
+    }
+  }
+
+  explicit range(const std::string &name) : m_sink(detail::current().load(std::memory_order_relaxed)) {
+    if (m_sink != nullptr) {
+      m_sink->push(intern(name));
+    }
+  }
+
+  range(const range &) = delete;
+  range &operator=(const range &) = delete;
+
+  ~range() {
+    end();
+  }
+
+  // Closes the range before the end of the scope.
+  void end() {
+    if (m_sink != nullptr) {
+      m_sink->pop();
+      m_sink = nullptr;
+    }
+  }
+
+private:
+  sink *m_sink{nullptr};
+};
+
+} // namespace annotate
+
+#define ANNOTATE_CONCAT_1(a, b) a##b
+#define ANNOTATE_CONCAT(a, b) ANNOTATE_CONCAT_1(a, b)
+#define ANNOTATE_RANGE(name) const annotate::range ANNOTATE_CONCAT(annotate_range_, __LINE__)(name)
@@ -2,9 +2,17 @@
 
 // from https://github.com/baidu-research/DeepBench/blob/master/code/kernels/conv_problems.h
 
+// The problems run with 1, 2, 4, ... up to CUDNN_MAX_THREADS host threads
+// launching the layer concurrently, each with its own handles and stream
+// (see handle_pool.hpp).
+#ifndef CUDNN_MAX_THREADS
+#define CUDNN_MAX_THREADS 1
+#endif // CUDNN_MAX_THREADS
+
 #define CONV_ARG_NAMES()                                                                                               \
-  Threads(1)->ArgNames({"W", "H", "C", "N", "K", "filter_w(s)", "filter_h(r)", "pad_w", "pad_h", "stride_w",           \
-                        "stride_h", "dilation_w", "dilation_h", "group"})
+  ThreadRange(1, CUDNN_MAX_THREADS)                                                                                    \
+      ->ArgNames({"W", "H", "C", "N", "K", "filter_w(s)", "filter_h(r)", "pad_w", "pad_h", "stride_w", "stride_h",     \
+                  "dilation_w", "dilation_h", "group"})
 
 #define INFERENCE_DEVICE_CONV_PROBLEMS()                                                                               \
   CONV_ARG_NAMES()                                                                                                     \
@@ -143,3 +151,110 @@
       ->Args({14, 14, 1024, 2, 2048, 1, 1, 0, 0, 2, 2})                                                                \
       ->Args({7, 7, 2048, 2, 512, 1, 1, 0, 0, 1, 1})
 #endif
+
+// 3-D problems (see conv_nd.hpp); a pad of 0 is no padding, any other 0 picks 1.
+#define CONV_ND_ARG_NAMES()                                                                                            \
+  ThreadRange(1, CUDNN_MAX_THREADS)                                                                                    \
+      ->ArgNames({"N", "C", "D", "H", "W", "K", "T", "R", "S", "pad_d", "pad_h", "pad_w", "stride_d", "stride_h",      \
+                  "stride_w", "dilation_d", "dilation_h", "dilation_w", "group"})
+
+// c3d, r(2+1)d, i3d and 3-D u-net layers
+#define CONV_3D_PROBLEMS()                                                                                             \
+  CONV_ND_ARG_NAMES()                                                                                                  \
+      ->Args({1, 3, 16, 112, 112, 64, 3, 3, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0})                                          \
+      ->Args({1, 64, 16, 56, 56, 128, 3, 3, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0})                                          \
+      ->Args({1, 64, 8, 56, 56, 144, 1, 3, 3, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0})                                           \
+      ->Args({1, 144, 8, 56, 56, 64, 3, 1, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1, 0})                                           \
+      ->Args({1, 3, 32, 224, 224, 64, 7, 7, 7, 3, 3, 3, 2, 2, 2, 1, 1, 1, 0})                                          \
+      ->Args({1, 32, 64, 64, 64, 64, 3, 3, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0})                                           \
+      ->Args({1, 128, 16, 16, 16, 128, 3, 3, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0})
+
+// The 2-D args in the order the conv Impls read them (see conv_nd::problem_2d);
+// a pad of 0 is no padding, any other 0 picks 1.
+#define CONV_NCHW_ARG_NAMES()                                                                                          \
+  ThreadRange(1, CUDNN_MAX_THREADS)                                                                                    \
+      ->ArgNames({"N", "C", "H", "W", "K", "filter_h(r)", "filter_w(s)", "pad_h", "pad_w", "stride_h", "stride_w",     \
+                  "dilation_h", "dilation_w", "group"})
+
+// the depthwise layers (group == C) of mobilenet-v2
+#define DEPTHWISE_CONV_PROBLEMS()                                                                                      \
+  CONV_NCHW_ARG_NAMES()                                                                                                \
+      ->Args({1, 32, 112, 112, 32, 3, 3, 1, 1, 1, 1, 1, 1, 32})                                                        \
+      ->Args({1, 96, 112, 112, 96, 3, 3, 1, 1, 2, 2, 1, 1, 96})                                                        \
+      ->Args({1, 144, 56, 56, 144, 3, 3, 1, 1, 1, 1, 1, 1, 144})                                                       \
+      ->Args({1, 144, 56, 56, 144, 3, 3, 1, 1, 2, 2, 1, 1, 144})                                                       \
+      ->Args({1, 192, 28, 28, 192, 3, 3, 1, 1, 1, 1, 1, 1, 192})                                                       \
+      ->Args({1, 192, 28, 28, 192, 3, 3, 1, 1, 2, 2, 1, 1, 192})                                                       \
+      ->Args({1, 384, 14, 14, 384, 3, 3, 1, 1, 1, 1, 1, 1, 384})                                                       \
+      ->Args({1, 576, 14, 14, 576, 3, 3, 1, 1, 1, 1, 1, 1, 576})                                                       \
+      ->Args({1, 576, 14, 14, 576, 3, 3, 1, 1, 2, 2, 1, 1, 576})                                                       \
+      ->Args({1, 960, 7, 7, 960, 3, 3, 1, 1, 1, 1, 1, 1, 960})
+
+// resnet-50 layers at a training batch size
+#define CONV_TRAIN_STEP_PROBLEMS()                                                                                     \
+  CONV_NCHW_ARG_NAMES()                                                                                                \
+      ->Args({32, 3, 224, 224, 64, 7, 7, 3, 3, 2, 2, 1, 1, 1})                                                         \
+      ->Args({32, 64, 56, 56, 64, 1, 1, 0, 0, 1, 1, 1, 1, 1})                                                          \
+      ->Args({32, 64, 56, 56, 64, 3, 3, 1, 1, 1, 1, 1, 1, 1})                                                          \
+      ->Args({32, 256, 56, 56, 128, 1, 1, 0, 0, 1, 1, 1, 1, 1})                                                        \
+      ->Args({32, 128, 28, 28, 128, 3, 3, 1, 1, 1, 1, 1, 1, 1})                                                        \
+      ->Args({32, 256, 14, 14, 256, 3, 3, 1, 1, 1, 1, 1, 1, 1})                                                        \
+      ->Args({32, 1024, 14, 14, 2048, 1, 1, 0, 0, 2, 2, 1, 1, 1})                                                      \
+      ->Args({32, 512, 7, 7, 512, 3, 3, 1, 1, 1, 1, 1, 1, 1})
+
+// Transposed convolution problems (see deconv.hpp); a pad or output pad of 0 is
+// no padding, any other 0 picks 1.
+#define DECONV_ARG_NAMES()                                                                                             \
+  ThreadRange(1, CUDNN_MAX_THREADS)                                                                                    \
+      ->ArgNames({"N", "C", "H", "W", "K", "R", "S", "pad_h", "pad_w", "stride_h", "stride_w", "output_pad_h",         \
+                  "output_pad_w", "dilation_h", "dilation_w", "group"})
+
+// dcgan generator, u-net up-convolutions, a resnet decoder and the fcn-8s
+// bilinear upsampling (one filter per class)
+#define DECONV_PROBLEMS()                                                                                              \
+  DECONV_ARG_NAMES()                                                                                                   \
+      ->Args({64, 512, 4, 4, 256, 4, 4, 1, 1, 2, 2, 0, 0, 1, 1, 1})                                                    \
+      ->Args({64, 256, 8, 8, 128, 4, 4, 1, 1, 2, 2, 0, 0, 1, 1, 1})                                                    \
+      ->Args({64, 128, 16, 16, 64, 4, 4, 1, 1, 2, 2, 0, 0, 1, 1, 1})                                                   \
+      ->Args({64, 64, 32, 32, 3, 4, 4, 1, 1, 2, 2, 0, 0, 1, 1, 1})                                                     \
+      ->Args({1, 1024, 28, 28, 512, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 1})                                                  \
+      ->Args({1, 512, 52, 52, 256, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 1})                                                   \
+      ->Args({1, 256, 100, 100, 128, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 1})                                                 \
+      ->Args({1, 128, 196, 196, 64, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 1})                                                  \
+      ->Args({8, 256, 32, 32, 128, 3, 3, 1, 1, 2, 2, 1, 1, 1, 1, 1})                                                   \
+      ->Args({1, 21, 34, 34, 21, 16, 16, 4, 4, 8, 8, 0, 0, 1, 1, 21})
+
+// Layer, group and instance normalization problems (see norm.hpp); a group or
+// begin axis of 0 picks 1.
+#define NORM_ARG_NAMES()                                                                                               \
+  ThreadRange(1, CUDNN_MAX_THREADS)->ArgNames({"N", "C", "H", "W", "group", "begin_axis"})
+
+// the tokens x hidden size of bert-base, bert-large and gpt-2 large training
+// batches and of a decoding step, then layer norms over C x H x W and H x W
+#define LAYERNORM_PROBLEMS()                                                                                           \
+  NORM_ARG_NAMES()                                                                                                     \
+      ->Args({4096, 768, 1, 1, 0, 1})                                                                                  \
+      ->Args({4096, 1024, 1, 1, 0, 1})                                                                                 \
+      ->Args({8192, 1280, 1, 1, 0, 1})                                                                                 \
+      ->Args({16, 4096, 1, 1, 0, 1})                                                                                   \
+      ->Args({32, 256, 14, 14, 0, 1})                                                                                  \
+      ->Args({32, 256, 14, 14, 0, 2})
+
+// the 32 groups of mask r-cnn fpn levels and of a resnet-50 at a small batch
+#define GROUPNORM_PROBLEMS()                                                                                           \
+  NORM_ARG_NAMES()                                                                                                     \
+      ->Args({2, 256, 200, 272, 32, 0})                                                                                \
+      ->Args({2, 256, 100, 136, 32, 0})                                                                                \
+      ->Args({2, 256, 50, 68, 32, 0})                                                                                  \
+      ->Args({8, 64, 56, 56, 32, 0})                                                                                   \
+      ->Args({8, 512, 28, 28, 32, 0})                                                                                  \
+      ->Args({8, 2048, 7, 7, 32, 0})
+
+// style transfer and image-to-image generator layers
+#define INSTANCENORM_PROBLEMS()                                                                                        \
+  NORM_ARG_NAMES()                                                                                                     \
+      ->Args({4, 32, 256, 256, 0, 0})                                                                                  \
+      ->Args({4, 64, 128, 128, 0, 0})                                                                                  \
+      ->Args({4, 128, 64, 64, 0, 0})                                                                                   \
+      ->Args({1, 64, 512, 512, 0, 0})                                                                                  \
+      ->Args({16, 256, 64, 64, 0, 0})
@@ -0,0 +1,1567 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <cublas_v2.h>
+#include <cuda_fp16.h>
+#include <cuda_runtime.h>
+#include <cudnn.h>
+
+#include "c_api.h"
+#include "choice_cache.hpp"
+#include "json.hpp"
+
+// Implementation of c_api.h.
+//
+// The layers mirror the LAYER_CUDNN_* and LAYER_CUBLAS_* benchmarks (same
+// layouts, scaling factors, math types and predicted flops), but they do not
+// depend on scope or google benchmark, so the library can be loaded by any
+// process. Everything SetUp creates is registered with a release function
+// that TearDown calls in reverse order.
+
+CUDNN_Scope_Error CUDNN_Scope_GlobalError{nullptr};
+
+namespace c_api {
+
+using json = nlohmann::json;
+
+static void check(cudaError_t status, const char* call) {
+  if (status != cudaSuccess) {
+    throw std::runtime_error(std::string(call) + " failed: " + cudaGetErrorString(status));
+  }
+}
+
+static void check(cudnnStatus_t status, const char* call) {
+  if (status != CUDNN_STATUS_SUCCESS) {
+    throw std::runtime_error(std::string(call) + " failed: " + cudnnGetErrorString(status));
+  }
+}
+
+static void check(cublasStatus_t status, const char* call) {
+  if (status != CUBLAS_STATUS_SUCCESS) {
+    throw std::runtime_error(std::string(call) + " failed with cublas status " + std::to_string(status));
+  }
+}
+
+#define CAPI_CALL(call) c_api::check(call, #call)
+
+static std::mutex& api_mutex() {
+  static std::mutex m;
+  return m;
+}
+
+static void set_error(const std::string& message) {
+  free(CUDNN_Scope_GlobalError.message);
+  CUDNN_Scope_GlobalError.message = strdup(message.c_str());
+}
+
+// The device, handles and stream shared by all layers; used with api_mutex held.
+class context {
+public:
+  static context& instance() {
+    static context ctx;
+    return ctx;
+  }
+
+  void init(int device_id) {
+    if (m_initialized && device_id == m_device_id) {
+      return;
+    }
+    release();
+    CAPI_CALL(cudaSetDevice(device_id));
+    cudaDeviceProp prop;
+    CAPI_CALL(cudaGetDeviceProperties(&prop, device_id));
+    m_tensor_cores = prop.major >= 7;
+    CAPI_CALL(cudaStreamCreateWithFlags(&m_stream, cudaStreamNonBlocking));
+    CAPI_CALL(cudnnCreate(&m_cudnn));
+    CAPI_CALL(cudnnSetStream(m_cudnn, m_stream));
+    CAPI_CALL(cublasCreate(&m_cublas));
+    CAPI_CALL(cublasSetStream(m_cublas, m_stream));
+    m_device_id   = device_id;
+    m_initialized = true;
+    // the library stays loaded across the layers of the caller like the
+    // daemon, so a layer that is set up again does not autotune again
+    warm_cache::enabled() = true;
+  }
+
+  // Initializes device 0 on first use and makes the device current on the calling thread.
+  void activate() {
+    if (!m_initialized) {
+      init(0);
+      return;
+    }
+    CAPI_CALL(cudaSetDevice(m_device_id));
+  }
+
+  int device_id() const {
+    return m_device_id;
+  }
+
+  cudnnHandle_t cudnn() const {
+    return m_cudnn;
+  }
+
+  cublasHandle_t cublas() const {
+    return m_cublas;
+  }
+
+  cudaStream_t stream() const {
+    return m_stream;
+  }
+
+  bool supports_tensor_cores() const {
+    return m_tensor_cores;
+  }
+
+private:
+  void release() {
+    if (m_cublas != nullptr) {
+      cublasDestroy(m_cublas);
+    }
+    if (m_cudnn != nullptr) {
+      cudnnDestroy(m_cudnn);
+    }
+    if (m_stream != nullptr) {
+      cudaStreamDestroy(m_stream);
+    }
+    m_cublas      = nullptr;
+    m_cudnn       = nullptr;
+    m_stream      = nullptr;
+    m_initialized = false;
+  }
+
+  bool m_initialized{false};
+  int m_device_id{0};
+  bool m_tensor_cores{false};
+  cudnnHandle_t m_cudnn{nullptr};
+  cublasHandle_t m_cublas{nullptr};
+  cudaStream_t m_stream{nullptr};
+};
+
+struct data_type_t {
+  CUDNN_Scope_DataType type{CUDNN_Scope_Unknown};
+  const char* name{""};
+  cudnnDataType_t cudnn{CUDNN_DATA_FLOAT};
+  // accumulation type of convolutions and op tensors
+  cudnnDataType_t compute{CUDNN_DATA_FLOAT};
+  size_t size{0};
+  bool is_integral{false};
+};
+
+static data_type_t to_data_type(CUDNN_Scope_DataType type) {
+  switch (type) {
+    case CUDNN_Scope_Byte:
+      return {type, "uint8", CUDNN_DATA_UINT8, CUDNN_DATA_INT32, 1, true};
+    case CUDNN_Scope_Char:
+      return {type, "int8", CUDNN_DATA_INT8, CUDNN_DATA_INT32, 1, true};
+    case CUDNN_Scope_Int:
+      return {type, "int32", CUDNN_DATA_INT32, CUDNN_DATA_INT32, 4, true};
+    case CUDNN_Scope_Half:
+      return {type, "half", CUDNN_DATA_HALF, CUDNN_DATA_FLOAT, 2, false};
+    case CUDNN_Scope_Float:
+      return {type, "float", CUDNN_DATA_FLOAT, CUDNN_DATA_FLOAT, 4, false};
+    case CUDNN_Scope_Double:
+      return {type, "double", CUDNN_DATA_DOUBLE, CUDNN_DATA_DOUBLE, 8, false};
+    default:
+      throw std::invalid_argument("unsupported data type " + std::to_string(type));
+  }
+}
+
+// Same as the benchmarks: -1 stands for 1 in h and w.
+static int to_dim(int64_t dim) {
+  if (dim == -1) {
+    return 1;
+  }
+  if (dim <= 0 || dim > std::numeric_limits<int>::max()) {
+    throw std::invalid_argument("invalid dimension " + std::to_string(dim));
+  }
+  return static_cast<int>(dim);
+}
+
+class layer {
+public:
+  explicit layer(CUDNN_Scope_DataType type) : m_type(to_data_type(type)) {
+  }
+
+  layer(const layer&) = delete;
+  layer& operator=(const layer&) = delete;
+
+  virtual ~layer() {
+    teardown();
+  }
+
+  void setup() {
+    teardown();
+    m_attributes = json::object();
+    try {
+      CAPI_CALL(cudaEventCreate(&m_start));
+      on_teardown([this]() { cudaEventDestroy(m_start); });
+      CAPI_CALL(cudaEventCreate(&m_stop));
+      on_teardown([this]() { cudaEventDestroy(m_stop); });
+      do_setup();
+    } catch (...) {
+      teardown();
+      throw;
+    }
+    m_is_setup = true;
+  }
+
+  int64_t run() {
+    if (!m_is_setup) {
+      throw std::logic_error(std::string(name()) + " is not set up");
+    }
+    auto& ctx = context::instance();
+    CAPI_CALL(cudaEventRecord(m_start, ctx.stream()));
+    do_run();
+    CAPI_CALL(cudaEventRecord(m_stop, ctx.stream()));
+    CAPI_CALL(cudaEventSynchronize(m_stop));
+    float msecs = 0;
+    CAPI_CALL(cudaEventElapsedTime(&msecs, m_start, m_stop));
+    const auto res = static_cast<int64_t>(static_cast<double>(msecs) * 1e6);
+    m_min_ns       = m_num_runs == 0 ? res : std::min(m_min_ns, res);
+    m_max_ns       = m_num_runs == 0 ? res : std::max(m_max_ns, res);
+    m_total_ns += res;
+    m_num_runs++;
+    return res;
+  }
+
+  void teardown() {
+    for (auto it = m_cleanup.rbegin(); it != m_cleanup.rend(); ++it) {
+      (*it)();
+    }
+    m_cleanup.clear();
+    m_is_setup = false;
+  }
+
+  json attributes() const {
+    auto res               = arguments();
+    res["layer"]           = name();
+    res["data_type"]       = m_type.name;
+    res["predicted_flops"] = predicted_flops();
+    res["is_set_up"]       = m_is_setup;
+    res["num_runs"]        = m_num_runs;
+    for (auto it = m_attributes.begin(); it != m_attributes.end(); ++it) {
+      res[it.key()] = it.value();
+    }
+    if (m_num_runs != 0) {
+      res["elapsed_ns_min"]  = m_min_ns;
+      res["elapsed_ns_max"]  = m_max_ns;
+      res["elapsed_ns_mean"] = static_cast<double>(m_total_ns) / m_num_runs;
+    }
+    return res;
+  }
+
+protected:
+  virtual const char* name() const       = 0;
+  virtual json arguments() const         = 0;
+  virtual double predicted_flops() const = 0;
+  virtual void do_setup()                = 0;
+  virtual void do_run()                  = 0;
+
+  cudnnHandle_t cudnn() const {
+    return context::instance().cudnn();
+  }
+
+  cublasHandle_t cublas() const {
+    return context::instance().cublas();
+  }
+
+  // Scaling factors are double for double data and float otherwise.
+  const void* one() const {
+    static const float f  = 1;
+    static const double d = 1;
+    return m_type.type == CUDNN_Scope_Double ? static_cast<const void*>(&d) : static_cast<const void*>(&f);
+  }
+
+  const void* zero() const {
+    static const float f  = 0;
+    static const double d = 0;
+    return m_type.type == CUDNN_Scope_Double ? static_cast<const void*>(&d) : static_cast<const void*>(&f);
+  }
+
+  void on_teardown(std::function<void()> release) {
+    m_cleanup.emplace_back(std::move(release));
+  }
+
+  // NHWC for the integral types, NCHW otherwise, as in the benchmarks.
+  cudnnTensorDescriptor_t tensor(int n, int c, int h, int w, cudnnDataType_t type) {
+    cudnnTensorDescriptor_t res;
+    CAPI_CALL(cudnnCreateTensorDescriptor(&res));
+    on_teardown([res]() { cudnnDestroyTensorDescriptor(res); });
+    const auto format = m_type.is_integral ? CUDNN_TENSOR_NHWC : CUDNN_TENSOR_NCHW;
+    CAPI_CALL(cudnnSetTensor4dDescriptor(res, format, type, n, c, h, w));
+    return res;
+  }
+
+  cudnnTensorDescriptor_t tensor(int n, int c, int h, int w) {
+    return tensor(n, c, h, w, m_type.cudnn);
+  }
+
+  cudnnFilterDescriptor_t filter(int k, int c, int h, int w) {
+    cudnnFilterDescriptor_t res;
+    CAPI_CALL(cudnnCreateFilterDescriptor(&res));
+    on_teardown([res]() { cudnnDestroyFilterDescriptor(res); });
+    const auto format = m_type.is_integral ? CUDNN_TENSOR_NHWC : CUDNN_TENSOR_NCHW;
+    CAPI_CALL(cudnnSetFilter4dDescriptor(res, m_type.cudnn, format, k, c, h, w));
+    return res;
+  }
+
+  cudnnActivationDescriptor_t activation(cudnnActivationMode_t mode) {
+    cudnnActivationDescriptor_t res;
+    CAPI_CALL(cudnnCreateActivationDescriptor(&res));
+    on_teardown([res]() { cudnnDestroyActivationDescriptor(res); });
+    CAPI_CALL(cudnnSetActivationDescriptor(res, mode, CUDNN_NOT_PROPAGATE_NAN, /*coef=*/1.0));
+    return res;
+  }
+
+  // Device memory of the given number of elements of size elem_size, filled with ones.
+  void* buffer(size_t num_elements, size_t elem_size) {
+    if (num_elements == 0) {
+      return nullptr;
+    }
+    void* res = nullptr;
+    CAPI_CALL(cudaMalloc(&res, num_elements * elem_size));
+    on_teardown([res]() { cudaFree(res); });
+    std::vector<char> host(num_elements * elem_size);
+    for (size_t ii = 0; ii < num_elements; ii++) {
+      fill_one(host.data() + ii * elem_size, elem_size);
+    }
+    CAPI_CALL(cudaMemcpy(res, host.data(), host.size(), cudaMemcpyHostToDevice));
+    return res;
+  }
+
+  void* buffer(size_t num_elements) {
+    return buffer(num_elements, m_type.size);
+  }
+
+  // Scratch memory that is not initialized (workspaces, dropout states).
+  void* scratch(size_t bytes) {
+    if (bytes == 0) {
+      return nullptr;
+    }
+    void* res = nullptr;
+    CAPI_CALL(cudaMalloc(&res, bytes));
+    on_teardown([res]() { cudaFree(res); });
+    return res;
+  }
+
+  const data_type_t m_type;
+  json m_attributes{json::object()};
+
+private:
+  void fill_one(char* dst, size_t elem_size) const {
+    if (elem_size == sizeof(float) && !m_type.is_integral) {
+      const float one = 1;
+      std::memcpy(dst, &one, sizeof(one));
+    } else if (elem_size == sizeof(double) && !m_type.is_integral) {
+      const double one = 1;
+      std::memcpy(dst, &one, sizeof(one));
+    } else if (elem_size == sizeof(__half) && m_type.type == CUDNN_Scope_Half) {
+      const __half one = __float2half(1.0f);
+      std::memcpy(dst, &one, sizeof(one));
+    } else if (elem_size == sizeof(int32_t)) {
+      const int32_t one = 1;
+      std::memcpy(dst, &one, sizeof(one));
+    } else {
+      std::memset(dst, 0, elem_size);
+      dst[0] = 1;
+    }
+  }
+
+  std::vector<std::function<void()>> m_cleanup{};
+  bool m_is_setup{false};
+  cudaEvent_t m_start{nullptr};
+  cudaEvent_t m_stop{nullptr};
+  int64_t m_num_runs{0};
+  int64_t m_total_ns{0};
+  int64_t m_min_ns{0};
+  int64_t m_max_ns{0};
+};
+
+struct nchw_t {
+  int n, c, h, w;
+
+  nchw_t(int64_t n, int64_t c, int64_t h, int64_t w) : n(to_dim(n)), c(to_dim(c)), h(to_dim(h)), w(to_dim(w)) {
+  }
+
+  size_t size() const {
+    return static_cast<size_t>(n) * c * h * w;
+  }
+
+  json to_json() const {
+    return {{"n", n}, {"c", c}, {"h", h}, {"w", w}};
+  }
+};
+
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnActivationForward
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnActivationBackward
+template <bool is_forward>
+class activation_layer : public layer {
+public:
+  activation_layer(CUDNN_Scope_DataType type, nchw_t dims, cudnnActivationMode_t mode)
+      : layer(type), m_dims(dims), m_mode(mode) {
+  }
+
+protected:
+  const char* name() const override {
+    return is_forward ? "CUDNN/ACTIVATION_FWD" : "CUDNN/ACTIVATION_BWD";
+  }
+
+  json arguments() const override {
+    auto res               = m_dims.to_json();
+    res["activation_mode"] = static_cast<int>(m_mode);
+    return res;
+  }
+
+  double predicted_flops() const override {
+    return m_mode == CUDNN_ACTIVATION_IDENTITY ? 0 : static_cast<double>(m_dims.size());
+  }
+
+  void do_setup() override {
+    m_desc       = tensor(m_dims.n, m_dims.c, m_dims.h, m_dims.w);
+    m_activation = activation(m_mode);
+    m_x          = buffer(m_dims.size());
+    m_y          = buffer(m_dims.size());
+    if (!is_forward) {
+      m_dy = buffer(m_dims.size());
+      m_dx = buffer(m_dims.size());
+    }
+  }
+
+  void do_run() override {
+    if (is_forward) {
+      CAPI_CALL(cudnnActivationForward(cudnn(), m_activation, one(), m_desc, m_x, zero(), m_desc, m_y));
+    } else {
+      CAPI_CALL(cudnnActivationBackward(cudnn(), m_activation, one(), m_desc, m_y, m_desc, m_dy, m_desc, m_x, zero(),
+                                        m_desc, m_dx));
+    }
+  }
+
+private:
+  const nchw_t m_dims;
+  const cudnnActivationMode_t m_mode;
+  cudnnTensorDescriptor_t m_desc{nullptr};
+  cudnnActivationDescriptor_t m_activation{nullptr};
+  void *m_x{nullptr}, *m_y{nullptr}, *m_dy{nullptr}, *m_dx{nullptr};
+};
+
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnAddTensor
+class add_tensor_layer : public layer {
+public:
+  add_tensor_layer(CUDNN_Scope_DataType type, nchw_t dims, nchw_t bias_dims)
+      : layer(type), m_dims(dims), m_bias_dims(bias_dims) {
+  }
+
+protected:
+  const char* name() const override {
+    return "CUDNN/ADD_TENSOR";
+  }
+
+  json arguments() const override {
+    auto res    = m_dims.to_json();
+    res["bias"] = m_bias_dims.to_json();
+    return res;
+  }
+
+  double predicted_flops() const override {
+    return static_cast<double>(m_dims.size());
+  }
+
+  void do_setup() override {
+    m_desc      = tensor(m_dims.n, m_dims.c, m_dims.h, m_dims.w);
+    m_bias_desc = tensor(m_bias_dims.n, m_bias_dims.c, m_bias_dims.h, m_bias_dims.w);
+    m_output    = buffer(m_dims.size());
+    m_bias      = buffer(m_bias_dims.size());
+  }
+
+  void do_run() override {
+    CAPI_CALL(cudnnAddTensor(cudnn(), one(), m_bias_desc, m_bias, one(), m_desc, m_output));
+  }
+
+private:
+  const nchw_t m_dims;
+  const nchw_t m_bias_dims;
+  cudnnTensorDescriptor_t m_desc{nullptr}, m_bias_desc{nullptr};
+  void *m_output{nullptr}, *m_bias{nullptr};
+};
+
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnOpTensor
+class op_tensor_layer : public layer {
+public:
+  op_tensor_layer(CUDNN_Scope_DataType type, nchw_t dims, cudnnOpTensorOp_t op) : layer(type), m_dims(dims), m_op(op) {
+  }
+
+protected:
+  const char* name() const override {
+    return "CUDNN/OP_TENSOR";
+  }
+
+  json arguments() const override {
+    auto res  = m_dims.to_json();
+    res["op"] = static_cast<int>(m_op);
+    return res;
+  }
+
+  double predicted_flops() const override {
+    return static_cast<double>(m_dims.size());
+  }
+
+  void do_setup() override {
+    CAPI_CALL(cudnnCreateOpTensorDescriptor(&m_op_desc));
+    const auto op_desc = m_op_desc;
+    on_teardown([op_desc]() { cudnnDestroyOpTensorDescriptor(op_desc); });
+    CAPI_CALL(cudnnSetOpTensorDescriptor(m_op_desc, m_op, m_type.compute, CUDNN_NOT_PROPAGATE_NAN));
+    m_desc = tensor(m_dims.n, m_dims.c, m_dims.h, m_dims.w);
+    m_a    = buffer(m_dims.size());
+    m_b    = buffer(m_dims.size());
+    m_c    = buffer(m_dims.size());
+  }
+
+  void do_run() override {
+    CAPI_CALL(cudnnOpTensor(cudnn(), m_op_desc, one(), m_desc, m_a, one(), m_desc, m_b, zero(), m_desc, m_c));
+  }
+
+private:
+  const nchw_t m_dims;
+  const cudnnOpTensorOp_t m_op;
+  cudnnOpTensorDescriptor_t m_op_desc{nullptr};
+  cudnnTensorDescriptor_t m_desc{nullptr};
+  void *m_a{nullptr}, *m_b{nullptr}, *m_c{nullptr};
+};
+
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnScaleTensor
+class scale_tensor_layer : public layer {
+public:
+  scale_tensor_layer(CUDNN_Scope_DataType type, nchw_t dims, double alpha)
+      : layer(type), m_dims(dims), m_alpha(alpha), m_alpha_float(static_cast<float>(alpha)) {
+  }
+
+protected:
+  const char* name() const override {
+    return "CUDNN/SCALE_TENSOR";
+  }
+
+  json arguments() const override {
+    auto res     = m_dims.to_json();
+    res["alpha"] = m_alpha;
+    return res;
+  }
+
+  double predicted_flops() const override {
+    return static_cast<double>(m_dims.size());
+  }
+
+  void do_setup() override {
+    m_desc = tensor(m_dims.n, m_dims.c, m_dims.h, m_dims.w);
+    m_y    = buffer(m_dims.size());
+  }
+
+  void do_run() override {
+    const void* alpha = m_type.type == CUDNN_Scope_Double ? static_cast<const void*>(&m_alpha)
+                                                          : static_cast<const void*>(&m_alpha_float);
+    CAPI_CALL(cudnnScaleTensor(cudnn(), m_desc, m_y, alpha));
+  }
+
+private:
+  const nchw_t m_dims;
+  const double m_alpha;
+  const float m_alpha_float;
+  cudnnTensorDescriptor_t m_desc{nullptr};
+  void* m_y{nullptr};
+};
+
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnBatchNormalizationForwardTraining
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnBatchNormalizationForwardInference
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnBatchNormalizationBackward
+template <bool is_forward>
+class batchnorm_layer : public layer {
+public:
+  batchnorm_layer(CUDNN_Scope_DataType type, nchw_t dims, cudnnBatchNormMode_t mode, bool is_training)
+      : layer(type), m_dims(dims), m_mode(mode), m_is_training(is_training) {
+  }
+
+protected:
+  const char* name() const override {
+    return is_forward ? "CUDNN/BATCHNORM_FWD" : "CUDNN/BATCHNORM_BWD";
+  }
+
+  json arguments() const override {
+    auto res    = m_dims.to_json();
+    res["mode"] = static_cast<int>(m_mode);
+    if (is_forward) {
+      res["is_training"] = m_is_training;
+    }
+    return res;
+  }
+
+  double predicted_flops() const override {
+    return static_cast<double>(m_dims.size());
+  }
+
+  void do_setup() override {
+    m_desc = tensor(m_dims.n, m_dims.c, m_dims.h, m_dims.w);
+    CAPI_CALL(cudnnCreateTensorDescriptor(&m_param_desc));
+    const auto param_desc = m_param_desc;
+    on_teardown([param_desc]() { cudnnDestroyTensorDescriptor(param_desc); });
+    CAPI_CALL(cudnnDeriveBNTensorDescriptor(m_param_desc, m_desc, m_mode));
+
+    // the parameters of half tensors are float
+    const auto param_elem_size = m_type.type == CUDNN_Scope_Half ? sizeof(float) : m_type.size;
+    size_t param_bytes         = 0;
+    CAPI_CALL(cudnnGetTensorSizeInBytes(m_param_desc, &param_bytes));
+    const auto param_size = param_bytes / param_elem_size;
+
+    m_x          = buffer(m_dims.size());
+    m_y          = buffer(m_dims.size());
+    m_scale      = buffer(param_size, param_elem_size);
+    m_bias       = buffer(param_size, param_elem_size);
+    m_mean       = buffer(param_size, param_elem_size);
+    m_variance   = buffer(param_size, param_elem_size);
+    m_saved_mean = buffer(param_size, param_elem_size);
+    m_saved_ivar = buffer(param_size, param_elem_size);
+    if (!is_forward) {
+      m_dx     = buffer(m_dims.size());
+      m_dscale = buffer(param_size, param_elem_size);
+      m_dbias  = buffer(param_size, param_elem_size);
+    }
+  }
+
+  void do_run() override {
+    if (!is_forward) {
+      // y holds dy
+      CAPI_CALL(cudnnBatchNormalizationBackward(cudnn(), m_mode, one(), zero(), one(), zero(), m_desc, m_x, m_desc,
+                                                m_y, m_desc, m_dx, m_param_desc, m_scale, m_dscale, m_dbias,
+                                                epsilon, m_saved_mean, m_saved_ivar));
+    } else if (m_is_training) {
+      CAPI_CALL(cudnnBatchNormalizationForwardTraining(cudnn(), m_mode, one(), zero(), m_desc, m_x, m_desc, m_y,
+                                                       m_param_desc, m_scale, m_bias, exponential_average_factor,
+                                                       m_mean, m_variance, epsilon, m_saved_mean, m_saved_ivar));
+    } else {
+      CAPI_CALL(cudnnBatchNormalizationForwardInference(cudnn(), m_mode, one(), zero(), m_desc, m_x, m_desc, m_y,
+                                                        m_param_desc, m_scale, m_bias, m_mean, m_variance, epsilon));
+    }
+  }
+
+private:
+  static constexpr double exponential_average_factor = 1.0;
+  static constexpr double epsilon                    = 1e-5; // CUDNN_BN_MIN_EPSILON
+
+  const nchw_t m_dims;
+  const cudnnBatchNormMode_t m_mode;
+  const bool m_is_training;
+  cudnnTensorDescriptor_t m_desc{nullptr}, m_param_desc{nullptr};
+  void *m_x{nullptr}, *m_y{nullptr}, *m_dx{nullptr};
+  void *m_scale{nullptr}, *m_bias{nullptr}, *m_mean{nullptr}, *m_variance{nullptr};
+  void *m_saved_mean{nullptr}, *m_saved_ivar{nullptr}, *m_dscale{nullptr}, *m_dbias{nullptr};
+};
+
+struct conv_args_t {
+  nchw_t input;
+  int k, filter_h, filter_w, pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w, group;
+
+  json to_json() const {
+    auto res          = input.to_json();
+    res["k"]          = k;
+    res["filter_h"]   = filter_h;
+    res["filter_w"]   = filter_w;
+    res["pad_h"]      = pad_h;
+    res["pad_w"]      = pad_w;
+    res["stride_h"]   = stride_h;
+    res["stride_w"]   = stride_w;
+    res["dilation_h"] = dilation_h;
+    res["dilation_w"] = dilation_w;
+    res["group"]      = group;
+    return res;
+  }
+
+  int out_h() const {
+    return (input.h + 2 * pad_h - ((filter_h - 1) * dilation_h + 1)) / stride_h + 1;
+  }
+
+  int out_w() const {
+    return (input.w + 2 * pad_w - ((filter_w - 1) * dilation_w + 1)) / stride_w + 1;
+  }
+
+  // same as the convolution benchmarks
+  double predicted_flops() const {
+    return static_cast<double>(k) * input.c * filter_h * filter_w * input.n * out_h() * out_w() / group;
+  }
+};
+
+static conv_args_t to_conv_args(int64_t n, int64_t c, int64_t h, int64_t w, int64_t k, int64_t filter_h,
+                                int64_t filter_w, int64_t pad_h, int64_t pad_w, int64_t stride_h, int64_t stride_w,
+                                int64_t dilation_h, int64_t dilation_w, int64_t group) {
+  const auto to_non_negative = [](int64_t v) {
+    if (v < 0 || v > std::numeric_limits<int>::max()) {
+      throw std::invalid_argument("invalid convolution argument " + std::to_string(v));
+    }
+    return static_cast<int>(v);
+  };
+  conv_args_t res{nchw_t(n, c, h, w),
+                  /*k=*/to_dim(k),
+                  /*filter_h=*/to_dim(filter_h),
+                  /*filter_w=*/to_dim(filter_w),
+                  /*pad_h=*/to_non_negative(pad_h),
+                  /*pad_w=*/to_non_negative(pad_w),
+                  /*stride_h=*/to_dim(stride_h),
+                  /*stride_w=*/to_dim(stride_w),
+                  /*dilation_h=*/to_dim(dilation_h),
+                  /*dilation_w=*/to_dim(dilation_w),
+                  /*group=*/to_dim(group)};
+  if (res.input.c % res.group != 0 || res.k % res.group != 0) {
+    throw std::invalid_argument("the channels and the filters must be divisible by the group count");
+  }
+  return res;
+}
+
+enum class conv_kind { forward, backward_data, backward_filter, backward_bias, bias_activation };
+
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnConvolutionForward
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnConvolutionBackwardData
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnConvolutionBackwardFilter
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnConvolutionBackwardBias
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnConvolutionBiasActivationForward
+template <conv_kind kind>
+class conv_layer : public layer {
+public:
+  conv_layer(CUDNN_Scope_DataType type, conv_args_t args, int algorithm,
+             cudnnActivationMode_t activation_mode = CUDNN_ACTIVATION_IDENTITY)
+      : layer(type), m_args(args), m_algorithm(algorithm), m_activation_mode(activation_mode) {
+  }
+
+protected:
+  const char* name() const override {
+    switch (kind) {
+      case conv_kind::forward:
+        return "CUDNN/CONV_FWD";
+      case conv_kind::backward_data:
+        return "CUDNN/CONV_BWD_DATA";
+      case conv_kind::backward_filter:
+        return "CUDNN/CONV_BWD_FILTER";
+      case conv_kind::backward_bias:
+        return "CUDNN/CONV_BWD_BIAS";
+      default:
+        return "CUDNN/CONV_BIAS_ACTIVATION_FWD";
+    }
+  }
+
+  json arguments() const override {
+    auto res = m_args.to_json();
+    if (kind != conv_kind::backward_bias) {
+      res["algorithm"] = m_algorithm;
+    }
+    if (kind == conv_kind::bias_activation) {
+      res["activation_mode"] = static_cast<int>(m_activation_mode);
+    }
+    return res;
+  }
+
+  double predicted_flops() const override {
+    if (kind == conv_kind::backward_bias) {
+      return static_cast<double>(m_args.input.n) * m_args.k * m_args.out_h() * m_args.out_w();
+    }
+    return m_args.predicted_flops();
+  }
+
+  void do_setup() override {
+    const auto& in = m_args.input;
+    if (m_type.type == CUDNN_Scope_Half && !context::instance().supports_tensor_cores()) {
+      throw std::runtime_error("no Tensorcore support on current device");
+    }
+
+    CAPI_CALL(cudnnCreateConvolutionDescriptor(&m_conv));
+    const auto conv = m_conv;
+    on_teardown([conv]() { cudnnDestroyConvolutionDescriptor(conv); });
+    CAPI_CALL(cudnnSetConvolution2dDescriptor(m_conv, m_args.pad_h, m_args.pad_w, m_args.stride_h, m_args.stride_w,
+                                              m_args.dilation_h, m_args.dilation_w, CUDNN_CROSS_CORRELATION,
+                                              m_type.compute));
+    if (m_type.type == CUDNN_Scope_Half) {
+      CAPI_CALL(cudnnSetConvolutionMathType(m_conv, CUDNN_TENSOR_OP_MATH));
+    }
+    CAPI_CALL(cudnnSetConvolutionGroupCount(m_conv, m_args.group));
+
+    m_x_desc = tensor(in.n, in.c, in.h, in.w);
+    m_w_desc = filter(m_args.k, in.c / m_args.group, m_args.filter_h, m_args.filter_w);
+    int out_n, out_c, out_h, out_w;
+    CAPI_CALL(cudnnGetConvolution2dForwardOutputDim(m_conv, m_x_desc, m_w_desc, &out_n, &out_c, &out_h, &out_w));
+    m_y_desc = tensor(out_n, out_c, out_h, out_w);
+
+    const auto x_size = in.size();
+    const auto w_size = static_cast<size_t>(m_args.k) * (in.c / m_args.group) * m_args.filter_h * m_args.filter_w;
+    const auto y_size = static_cast<size_t>(out_n) * out_c * out_h * out_w;
+
+    m_attributes["output"] = {{"n", out_n}, {"c", out_c}, {"h", out_h}, {"w", out_w}};
+
+    // x/dx, w/dw and y/dy share the buffers, the values do not matter
+    m_y = buffer(y_size);
+    if (kind == conv_kind::backward_bias) {
+      m_b_desc = tensor(1, out_c, 1, 1);
+      m_b      = buffer(out_c);
+      return;
+    }
+    m_x = buffer(x_size);
+    m_w = buffer(w_size);
+    if (kind == conv_kind::bias_activation) {
+      m_b_desc     = tensor(1, out_c, 1, 1);
+      m_b          = buffer(out_c);
+      m_activation = activation(m_activation_mode);
+    }
+
+    const auto algorithm      = m_algorithm >= 0 ? m_algorithm : find_algorithm();
+    size_t workspace_bytes    = 0;
+    m_attributes["algorithm"] = algorithm;
+    m_attributes["autotuned"] = m_algorithm < 0;
+    switch (kind) {
+      case conv_kind::backward_data:
+        m_bwd_data_algo = static_cast<cudnnConvolutionBwdDataAlgo_t>(algorithm);
+        CAPI_CALL(cudnnGetConvolutionBackwardDataWorkspaceSize(cudnn(), m_w_desc, m_y_desc, m_conv, m_x_desc,
+                                                               m_bwd_data_algo, &workspace_bytes));
+        break;
+      case conv_kind::backward_filter:
+        m_bwd_filter_algo = static_cast<cudnnConvolutionBwdFilterAlgo_t>(algorithm);
+        CAPI_CALL(cudnnGetConvolutionBackwardFilterWorkspaceSize(cudnn(), m_x_desc, m_y_desc, m_conv, m_w_desc,
+                                                                 m_bwd_filter_algo, &workspace_bytes));
+        break;
+      default:
+        m_fwd_algo = static_cast<cudnnConvolutionFwdAlgo_t>(algorithm);
+        CAPI_CALL(cudnnGetConvolutionForwardWorkspaceSize(cudnn(), m_x_desc, m_w_desc, m_conv, m_y_desc, m_fwd_algo,
+                                                          &workspace_bytes));
+        break;
+    }
+    m_workspace_bytes               = workspace_bytes;
+    m_workspace                     = scratch(workspace_bytes);
+    m_attributes["workspace_bytes"] = workspace_bytes;
+  }
+
+  void do_run() override {
+    switch (kind) {
+      case conv_kind::forward:
+        CAPI_CALL(cudnnConvolutionForward(cudnn(), one(), m_x_desc, m_x, m_w_desc, m_w, m_conv, m_fwd_algo,
+                                          m_workspace, m_workspace_bytes, zero(), m_y_desc, m_y));
+        break;
+      case conv_kind::backward_data:
+        CAPI_CALL(cudnnConvolutionBackwardData(cudnn(), one(), m_w_desc, m_w, m_y_desc, m_y, m_conv, m_bwd_data_algo,
+                                               m_workspace, m_workspace_bytes, zero(), m_x_desc, m_x));
+        break;
+      case conv_kind::backward_filter:
+        CAPI_CALL(cudnnConvolutionBackwardFilter(cudnn(), one(), m_x_desc, m_x, m_y_desc, m_y, m_conv,
+                                                 m_bwd_filter_algo, m_workspace, m_workspace_bytes, zero(), m_w_desc,
+                                                 m_w));
+        break;
+      case conv_kind::backward_bias:
+        CAPI_CALL(cudnnConvolutionBackwardBias(cudnn(), one(), m_y_desc, m_y, zero(), m_b_desc, m_b));
+        break;
+      case conv_kind::bias_activation:
+        // alpha2 is zero, so z (the output itself) does not contribute
+        CAPI_CALL(cudnnConvolutionBiasActivationForward(cudnn(), one(), m_x_desc, m_x, m_w_desc, m_w, m_conv,
+                                                        m_fwd_algo, m_workspace, m_workspace_bytes, zero(),
+                                                        m_y_desc, m_y, m_b_desc, m_b, m_activation, m_y_desc, m_y));
+        break;
+    }
+  }
+
+private:
+  // The algorithm cudnnFind picked for a layer with the same arguments on the
+  // device, found once per process (see choice_cache.hpp).
+  int find_algorithm() {
+    static warm_cache::choice_cache<int> choices;
+    const auto key = warm_cache::key(name(), context::instance().device_id(), m_type.name, m_args.to_json().dump(),
+                                     static_cast<int>(m_activation_mode));
+    int res = -1;
+    if (choices.find(key, res)) {
+      return res;
+    }
+    res = find_fastest();
+    choices.insert(key, res);
+    return res;
+  }
+
+  // The fastest algorithm that cudnnFind measured for this layer.
+  int find_fastest() {
+    int num_returned = 0;
+    switch (kind) {
+      case conv_kind::backward_data: {
+        cudnnConvolutionBwdDataAlgoPerf_t perfs[CUDNN_CONVOLUTION_BWD_DATA_ALGO_COUNT];
+        CAPI_CALL(cudnnFindConvolutionBackwardDataAlgorithm(cudnn(), m_w_desc, m_y_desc, m_conv, m_x_desc,
+                                                            CUDNN_CONVOLUTION_BWD_DATA_ALGO_COUNT, &num_returned,
+                                                            perfs));
+        return fastest(perfs, num_returned);
+      }
+      case conv_kind::backward_filter: {
+        cudnnConvolutionBwdFilterAlgoPerf_t perfs[CUDNN_CONVOLUTION_BWD_FILTER_ALGO_COUNT];
+        CAPI_CALL(cudnnFindConvolutionBackwardFilterAlgorithm(cudnn(), m_x_desc, m_y_desc, m_conv, m_w_desc,
+                                                              CUDNN_CONVOLUTION_BWD_FILTER_ALGO_COUNT, &num_returned,
+                                                              perfs));
+        return fastest(perfs, num_returned);
+      }
+      default: {
+        cudnnConvolutionFwdAlgoPerf_t perfs[CUDNN_CONVOLUTION_FWD_ALGO_COUNT];
+        CAPI_CALL(cudnnFindConvolutionForwardAlgorithm(cudnn(), m_x_desc, m_w_desc, m_conv, m_y_desc,
+                                                       CUDNN_CONVOLUTION_FWD_ALGO_COUNT, &num_returned, perfs));
+        if (kind == conv_kind::bias_activation && m_activation_mode == CUDNN_ACTIVATION_IDENTITY) {
+          return CUDNN_CONVOLUTION_FWD_ALGO_IMPLICIT_PRECOMP_GEMM;
+        }
+        return fastest(perfs, num_returned);
+      }
+    }
+  }
+
+  // cudnnFind returns the results sorted by time
+  template <typename Perf>
+  static int fastest(const Perf* perfs, int num_returned) {
+    for (int ii = 0; ii < num_returned; ii++) {
+      if (perfs[ii].status == CUDNN_STATUS_SUCCESS) {
+        return static_cast<int>(perfs[ii].algo);
+      }
+    }
+    throw std::runtime_error("no convolution algorithm supports the layer");
+  }
+
+  const conv_args_t m_args;
+  const int m_algorithm;
+  const cudnnActivationMode_t m_activation_mode;
+  cudnnConvolutionDescriptor_t m_conv{nullptr};
+  cudnnTensorDescriptor_t m_x_desc{nullptr}, m_y_desc{nullptr}, m_b_desc{nullptr};
+  cudnnFilterDescriptor_t m_w_desc{nullptr};
+  cudnnActivationDescriptor_t m_activation{nullptr};
+  cudnnConvolutionFwdAlgo_t m_fwd_algo{CUDNN_CONVOLUTION_FWD_ALGO_IMPLICIT_GEMM};
+  cudnnConvolutionBwdDataAlgo_t m_bwd_data_algo{CUDNN_CONVOLUTION_BWD_DATA_ALGO_0};
+  cudnnConvolutionBwdFilterAlgo_t m_bwd_filter_algo{CUDNN_CONVOLUTION_BWD_FILTER_ALGO_0};
+  void *m_x{nullptr}, *m_w{nullptr}, *m_y{nullptr}, *m_b{nullptr}, *m_workspace{nullptr};
+  size_t m_workspace_bytes{0};
+};
+
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnDropoutForward
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnDropoutBackward
+template <bool is_forward>
+class dropout_layer : public layer {
+public:
+  dropout_layer(CUDNN_Scope_DataType type, nchw_t dims, float dropout, uint64_t seed)
+      : layer(type), m_dims(dims), m_dropout(dropout), m_seed(seed) {
+    if (dropout < 0 || dropout > 1) {
+      throw std::invalid_argument("the dropout must be in [0, 1]");
+    }
+  }
+
+protected:
+  const char* name() const override {
+    return is_forward ? "CUDNN/DROPOUT_FWD" : "CUDNN/DROPOUT_BWD";
+  }
+
+  json arguments() const override {
+    auto res       = m_dims.to_json();
+    res["dropout"] = m_dropout;
+    res["seed"]    = m_seed;
+    return res;
+  }
+
+  double predicted_flops() const override {
+    return static_cast<double>(m_dims.size());
+  }
+
+  void do_setup() override {
+    CAPI_CALL(cudnnCreateDropoutDescriptor(&m_dropout_desc));
+    const auto dropout_desc = m_dropout_desc;
+    on_teardown([dropout_desc]() { cudnnDestroyDropoutDescriptor(dropout_desc); });
+    size_t states_bytes = 0;
+    CAPI_CALL(cudnnDropoutGetStatesSize(cudnn(), &states_bytes));
+    const auto states = scratch(states_bytes);
+    // initializes the random states, which takes a while
+    CAPI_CALL(cudnnSetDropoutDescriptor(m_dropout_desc, cudnn(), m_dropout, states, states_bytes, m_seed));
+
+    m_desc = tensor(m_dims.n, m_dims.c, m_dims.h, m_dims.w);
+    CAPI_CALL(cudnnDropoutGetReserveSpaceSize(m_desc, &m_reserve_bytes));
+    m_reserve = scratch(m_reserve_bytes);
+    m_x       = buffer(m_dims.size());
+    m_y       = buffer(m_dims.size());
+    if (!is_forward) {
+      // the backward pass needs the mask of a forward pass in the reserve space
+      CAPI_CALL(cudnnDropoutForward(cudnn(), m_dropout_desc, m_desc, m_x, m_desc, m_y, m_reserve, m_reserve_bytes));
+    }
+    m_attributes["reserve_bytes"] = m_reserve_bytes;
+  }
+
+  void do_run() override {
+    if (is_forward) {
+      CAPI_CALL(cudnnDropoutForward(cudnn(), m_dropout_desc, m_desc, m_x, m_desc, m_y, m_reserve, m_reserve_bytes));
+    } else {
+      CAPI_CALL(cudnnDropoutBackward(cudnn(), m_dropout_desc, m_desc, m_y, m_desc, m_x, m_reserve, m_reserve_bytes));
+    }
+  }
+
+private:
+  const nchw_t m_dims;
+  const float m_dropout;
+  const uint64_t m_seed;
+  cudnnDropoutDescriptor_t m_dropout_desc{nullptr};
+  cudnnTensorDescriptor_t m_desc{nullptr};
+  void *m_x{nullptr}, *m_y{nullptr}, *m_reserve{nullptr};
+  size_t m_reserve_bytes{0};
+};
+
+struct pooling_args_t {
+  int window_h, window_w, pad_h, pad_w, stride_h, stride_w;
+};
+
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnPoolingForward
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnPoolingBackward
+template <bool is_forward>
+class pooling_layer : public layer {
+public:
+  pooling_layer(CUDNN_Scope_DataType type, nchw_t dims, pooling_args_t args, cudnnPoolingMode_t mode)
+      : layer(type), m_dims(dims), m_args(args), m_mode(mode) {
+  }
+
+protected:
+  const char* name() const override {
+    return is_forward ? "CUDNN/POOLING_FWD" : "CUDNN/POOLING_BWD";
+  }
+
+  json arguments() const override {
+    auto res        = m_dims.to_json();
+    res["window_h"] = m_args.window_h;
+    res["window_w"] = m_args.window_w;
+    res["pad_h"]    = m_args.pad_h;
+    res["pad_w"]    = m_args.pad_w;
+    res["stride_h"] = m_args.stride_h;
+    res["stride_w"] = m_args.stride_w;
+    res["mode"]     = static_cast<int>(m_mode);
+    return res;
+  }
+
+  double predicted_flops() const override {
+    return static_cast<double>(m_dims.size());
+  }
+
+  void do_setup() override {
+    CAPI_CALL(cudnnCreatePoolingDescriptor(&m_pooling));
+    const auto pooling = m_pooling;
+    on_teardown([pooling]() { cudnnDestroyPoolingDescriptor(pooling); });
+    CAPI_CALL(cudnnSetPooling2dDescriptor(m_pooling, m_mode, CUDNN_NOT_PROPAGATE_NAN, m_args.window_h,
+                                          m_args.window_w, m_args.pad_h, m_args.pad_w, m_args.stride_h,
+                                          m_args.stride_w));
+    m_x_desc = tensor(m_dims.n, m_dims.c, m_dims.h, m_dims.w);
+    int out_n, out_c, out_h, out_w;
+    CAPI_CALL(cudnnGetPooling2dForwardOutputDim(m_pooling, m_x_desc, &out_n, &out_c, &out_h, &out_w));
+    m_y_desc               = tensor(out_n, out_c, out_h, out_w);
+    m_attributes["output"] = {{"n", out_n}, {"c", out_c}, {"h", out_h}, {"w", out_w}};
+
+    const auto y_size = static_cast<size_t>(out_n) * out_c * out_h * out_w;
+    m_x               = buffer(m_dims.size());
+    m_y               = buffer(y_size);
+    if (!is_forward) {
+      m_dy = buffer(y_size);
+      m_dx = buffer(m_dims.size());
+    }
+  }
+
+  void do_run() override {
+    if (is_forward) {
+      CAPI_CALL(cudnnPoolingForward(cudnn(), m_pooling, one(), m_x_desc, m_x, zero(), m_y_desc, m_y));
+    } else {
+      CAPI_CALL(cudnnPoolingBackward(cudnn(), m_pooling, one(), m_y_desc, m_y, m_y_desc, m_dy, m_x_desc, m_x, zero(),
+                                     m_x_desc, m_dx));
+    }
+  }
+
+private:
+  const nchw_t m_dims;
+  const pooling_args_t m_args;
+  const cudnnPoolingMode_t m_mode;
+  cudnnPoolingDescriptor_t m_pooling{nullptr};
+  cudnnTensorDescriptor_t m_x_desc{nullptr}, m_y_desc{nullptr};
+  void *m_x{nullptr}, *m_y{nullptr}, *m_dy{nullptr}, *m_dx{nullptr};
+};
+
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnSoftmaxForward
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnSoftmaxBackward
+template <bool is_forward>
+class softmax_layer : public layer {
+public:
+  softmax_layer(CUDNN_Scope_DataType type, nchw_t dims, cudnnSoftmaxAlgorithm_t algorithm, cudnnSoftmaxMode_t mode)
+      : layer(type), m_dims(dims), m_algorithm(algorithm), m_mode(mode) {
+  }
+
+protected:
+  const char* name() const override {
+    return is_forward ? "CUDNN/SOFTMAX_FWD" : "CUDNN/SOFTMAX_BWD";
+  }
+
+  json arguments() const override {
+    auto res         = m_dims.to_json();
+    res["algorithm"] = static_cast<int>(m_algorithm);
+    res["mode"]      = static_cast<int>(m_mode);
+    return res;
+  }
+
+  double predicted_flops() const override {
+    return static_cast<double>(m_dims.size());
+  }
+
+  void do_setup() override {
+    m_desc = tensor(m_dims.n, m_dims.c, m_dims.h, m_dims.w);
+    m_x    = buffer(m_dims.size());
+    m_y    = buffer(m_dims.size());
+    if (!is_forward) {
+      m_dy = buffer(m_dims.size());
+      m_dx = buffer(m_dims.size());
+    }
+  }
+
+  void do_run() override {
+    if (is_forward) {
+      CAPI_CALL(cudnnSoftmaxForward(cudnn(), m_algorithm, m_mode, one(), m_desc, m_x, zero(), m_desc, m_y));
+    } else {
+      CAPI_CALL(cudnnSoftmaxBackward(cudnn(), m_algorithm, m_mode, one(), m_desc, m_y, m_desc, m_dy, zero(), m_desc,
+                                     m_dx));
+    }
+  }
+
+private:
+  const nchw_t m_dims;
+  const cudnnSoftmaxAlgorithm_t m_algorithm;
+  const cudnnSoftmaxMode_t m_mode;
+  cudnnTensorDescriptor_t m_desc{nullptr};
+  void *m_x{nullptr}, *m_y{nullptr}, *m_dy{nullptr}, *m_dx{nullptr};
+};
+
+static cublasOperation_t to_operation(int transpose) {
+  return transpose ? CUBLAS_OP_T : CUBLAS_OP_N;
+}
+
+// https://docs.nvidia.com/cuda/cublas/index.html#cublas-lt-t-gt-gemm
+class gemm_layer : public layer {
+public:
+  gemm_layer(CUDNN_Scope_DataType type, int64_t m, int64_t n, int64_t k, int transpose_a, int transpose_b,
+             double alpha, double beta)
+      : layer(type), m_m(to_dim(m)), m_n(to_dim(n)), m_k(to_dim(k)), m_transpose_a(to_operation(transpose_a)),
+        m_transpose_b(to_operation(transpose_b)), m_alpha(alpha), m_beta(beta) {
+    if (m_type.type != CUDNN_Scope_Half && m_type.type != CUDNN_Scope_Float && m_type.type != CUDNN_Scope_Double) {
+      throw std::invalid_argument(std::string("gemm does not support ") + m_type.name);
+    }
+  }
+
+protected:
+  const char* name() const override {
+    return "CUBLAS/GEMM";
+  }
+
+  json arguments() const override {
+    return {{"m", m_m},
+            {"n", m_n},
+            {"k", m_k},
+            {"transpose_a", m_transpose_a == CUBLAS_OP_T},
+            {"transpose_b", m_transpose_b == CUBLAS_OP_T},
+            {"alpha", m_alpha},
+            {"beta", m_beta}};
+  }
+
+  double predicted_flops() const override {
+    return 2.0 * m_m * m_n * m_k;
+  }
+
+  void do_setup() override {
+    m_a = buffer(static_cast<size_t>(m_m) * m_k);
+    m_b = buffer(static_cast<size_t>(m_k) * m_n);
+    m_c = buffer(static_cast<size_t>(m_m) * m_n);
+  }
+
+  void do_run() override {
+    const auto lda = m_transpose_a == CUBLAS_OP_N ? m_m : m_k;
+    const auto ldb = m_transpose_b == CUBLAS_OP_N ? m_k : m_n;
+    switch (m_type.type) {
+      case CUDNN_Scope_Half: {
+        const __half alpha = __float2half(static_cast<float>(m_alpha));
+        const __half beta  = __float2half(static_cast<float>(m_beta));
+        CAPI_CALL(cublasHgemm(cublas(), m_transpose_a, m_transpose_b, m_m, m_n, m_k, &alpha,
+                              static_cast<const __half*>(m_a), lda, static_cast<const __half*>(m_b), ldb, &beta,
+                              static_cast<__half*>(m_c), m_m));
+        break;
+      }
+      case CUDNN_Scope_Float: {
+        const float alpha = static_cast<float>(m_alpha);
+        const float beta  = static_cast<float>(m_beta);
+        CAPI_CALL(cublasSgemm(cublas(), m_transpose_a, m_transpose_b, m_m, m_n, m_k, &alpha,
+                              static_cast<const float*>(m_a), lda, static_cast<const float*>(m_b), ldb, &beta,
+                              static_cast<float*>(m_c), m_m));
+        break;
+      }
+      default:
+        CAPI_CALL(cublasDgemm(cublas(), m_transpose_a, m_transpose_b, m_m, m_n, m_k, &m_alpha,
+                              static_cast<const double*>(m_a), lda, static_cast<const double*>(m_b), ldb, &m_beta,
+                              static_cast<double*>(m_c), m_m));
+        break;
+    }
+  }
+
+private:
+  const int m_m, m_n, m_k;
+  const cublasOperation_t m_transpose_a, m_transpose_b;
+  const double m_alpha, m_beta;
+  void *m_a{nullptr}, *m_b{nullptr}, *m_c{nullptr};
+};
+
+// https://docs.nvidia.com/cuda/cublas/index.html#cublas-lt-t-gt-gemv
+class gemv_layer : public layer {
+public:
+  gemv_layer(CUDNN_Scope_DataType type, int64_t m, int64_t k, int transpose_a, double alpha, double beta)
+      : layer(type), m_m(to_dim(m)), m_k(to_dim(k)), m_transpose_a(to_operation(transpose_a)), m_alpha(alpha),
+        m_beta(beta) {
+    if (m_type.type != CUDNN_Scope_Float && m_type.type != CUDNN_Scope_Double) {
+      throw std::invalid_argument(std::string("gemv does not support ") + m_type.name);
+    }
+  }
+
+protected:
+  const char* name() const override {
+    return "CUBLAS/GEMV";
+  }
+
+  json arguments() const override {
+    return {{"m", m_m},
+            {"k", m_k},
+            {"transpose_a", m_transpose_a == CUBLAS_OP_T},
+            {"alpha", m_alpha},
+            {"beta", m_beta}};
+  }
+
+  // same as the gemv benchmarks
+  double predicted_flops() const override {
+    return static_cast<double>(m_m) * m_k;
+  }
+
+  void do_setup() override {
+    const auto x_size = m_transpose_a == CUBLAS_OP_N ? m_k : m_m;
+    const auto y_size = m_transpose_a == CUBLAS_OP_N ? m_m : m_k;
+    m_a               = buffer(static_cast<size_t>(m_m) * m_k);
+    m_x               = buffer(x_size);
+    m_y               = buffer(y_size);
+  }
+
+  void do_run() override {
+    if (m_type.type == CUDNN_Scope_Float) {
+      const float alpha = static_cast<float>(m_alpha);
+      const float beta  = static_cast<float>(m_beta);
+      CAPI_CALL(cublasSgemv(cublas(), m_transpose_a, m_m, m_k, &alpha, static_cast<const float*>(m_a), m_m,
+                            static_cast<const float*>(m_x), 1, &beta, static_cast<float*>(m_y), 1));
+    } else {
+      CAPI_CALL(cublasDgemv(cublas(), m_transpose_a, m_m, m_k, &m_alpha, static_cast<const double*>(m_a), m_m,
+                            static_cast<const double*>(m_x), 1, &m_beta, static_cast<double*>(m_y), 1));
+    }
+  }
+
+private:
+  const int m_m, m_k;
+  const cublasOperation_t m_transpose_a;
+  const double m_alpha, m_beta;
+  void *m_a{nullptr}, *m_x{nullptr}, *m_y{nullptr};
+};
+
+// Runs f with the api lock held and turns exceptions into CUDNN_Scope_GlobalError.
+template <typename R, typename F>
+static R guarded(R on_error, F f) {
+  std::lock_guard<std::mutex> lock(api_mutex());
+  try {
+    return f();
+  } catch (const std::exception& e) {
+    set_error(e.what());
+  } catch (...) {
+    set_error("unknown error");
+  }
+  return on_error;
+}
+
+static layer* to_layer(void* handle) {
+  if (handle == nullptr) {
+    throw std::invalid_argument("invalid handle");
+  }
+  return static_cast<layer*>(handle);
+}
+
+static int set_up(void* handle) {
+  return guarded(-1, [&]() {
+    context::instance().activate();
+    to_layer(handle)->setup();
+    return 0;
+  });
+}
+
+static void tear_down(void* handle) {
+  guarded(0, [&]() {
+    context::instance().activate();
+    to_layer(handle)->teardown();
+    return 0;
+  });
+}
+
+static char* attributes(void* handle) {
+  return guarded<char*>(nullptr, [&]() { return strdup(to_layer(handle)->attributes().dump().c_str()); });
+}
+
+static int64_t run(void* handle) {
+  return guarded<int64_t>(-1, [&]() {
+    context::instance().activate();
+    return to_layer(handle)->run();
+  });
+}
+
+static void destroy(void* handle) {
+  guarded(0, [&]() {
+    if (handle != nullptr) {
+      context::instance().activate();
+      delete static_cast<layer*>(handle);
+    }
+    return 0;
+  });
+}
+
+} // namespace c_api
+
+EXTERN_C int CUDNN_Scope_Init(int device_id) {
+  return c_api::guarded(-1, [&]() {
+    c_api::context::instance().init(device_id);
+    return 0;
+  });
+}
+
+EXTERN_C void CUDNN_Scope_Free(void* ptr) {
+  free(ptr);
+}
+
+#define CUDNN_SCOPE_DEFINE_LAYER(name)                                                                                 \
+  EXTERN_C int CUDNN_Scope_##name##_SetUp(CUDNN_Scope_##name##Handle handle) {                                         \
+    return c_api::set_up(handle);                                                                                      \
+  }                                                                                                                    \
+  EXTERN_C void CUDNN_Scope_##name##_TearDown(CUDNN_Scope_##name##Handle handle) {                                     \
+    c_api::tear_down(handle);                                                                                          \
+  }                                                                                                                    \
+  EXTERN_C char* CUDNN_Scope_##name##_Attributes(CUDNN_Scope_##name##Handle handle) {                                  \
+    return c_api::attributes(handle);                                                                                  \
+  }                                                                                                                    \
+  EXTERN_C int64_t CUDNN_Scope_##name##_Run(CUDNN_Scope_##name##Handle handle) {                                       \
+    return c_api::run(handle);                                                                                         \
+  }                                                                                                                    \
+  EXTERN_C void CUDNN_Scope_##name##_Delete(CUDNN_Scope_##name##Handle handle) {                                       \
+    c_api::destroy(handle);                                                                                            \
+  }
+
+CUDNN_SCOPE_DEFINE_LAYER(ActivationFWD)
+CUDNN_SCOPE_DEFINE_LAYER(ActivationBWD)
+CUDNN_SCOPE_DEFINE_LAYER(AddTensor)
+CUDNN_SCOPE_DEFINE_LAYER(OpTensor)
+CUDNN_SCOPE_DEFINE_LAYER(ScaleTensor)
+CUDNN_SCOPE_DEFINE_LAYER(BatchNormFWD)
+CUDNN_SCOPE_DEFINE_LAYER(BatchNormBWD)
+CUDNN_SCOPE_DEFINE_LAYER(ConvFWD)
+CUDNN_SCOPE_DEFINE_LAYER(ConvBWDData)
+CUDNN_SCOPE_DEFINE_LAYER(ConvBWDFilter)
+CUDNN_SCOPE_DEFINE_LAYER(ConvBWDBias)
+CUDNN_SCOPE_DEFINE_LAYER(ConvBiasActivationFWD)
+CUDNN_SCOPE_DEFINE_LAYER(DropoutFWD)
+CUDNN_SCOPE_DEFINE_LAYER(DropoutBWD)
+CUDNN_SCOPE_DEFINE_LAYER(PoolingFWD)
+CUDNN_SCOPE_DEFINE_LAYER(PoolingBWD)
+CUDNN_SCOPE_DEFINE_LAYER(SoftmaxFWD)
+CUDNN_SCOPE_DEFINE_LAYER(SoftmaxBWD)
+CUDNN_SCOPE_DEFINE_LAYER(Gemm)
+CUDNN_SCOPE_DEFINE_LAYER(Gemv)
+
+EXTERN_C CUDNN_Scope_ActivationFWDHandle CUDNN_Scope_ActivationFWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                       int64_t c, int64_t h, int64_t w,
+                                                                       cudnnActivationMode_t activation_mode) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::activation_layer<true>(data_type, c_api::nchw_t(n, c, h, w), activation_mode);
+  });
+}
+
+EXTERN_C CUDNN_Scope_ActivationBWDHandle CUDNN_Scope_ActivationBWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                       int64_t c, int64_t h, int64_t w,
+                                                                       cudnnActivationMode_t activation_mode) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::activation_layer<false>(data_type, c_api::nchw_t(n, c, h, w), activation_mode);
+  });
+}
+
+EXTERN_C CUDNN_Scope_AddTensorHandle CUDNN_Scope_AddTensor_New(CUDNN_Scope_DataType data_type, int64_t n, int64_t c,
+                                                               int64_t h, int64_t w, int64_t bias_n, int64_t bias_c,
+                                                               int64_t bias_h, int64_t bias_w) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::add_tensor_layer(data_type, c_api::nchw_t(n, c, h, w),
+                                       c_api::nchw_t(bias_n, bias_c, bias_h, bias_w));
+  });
+}
+
+EXTERN_C CUDNN_Scope_OpTensorHandle CUDNN_Scope_OpTensor_New(CUDNN_Scope_DataType data_type, int64_t n, int64_t c,
+                                                             int64_t h, int64_t w, cudnnOpTensorOp_t op) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::op_tensor_layer(data_type, c_api::nchw_t(n, c, h, w), op);
+  });
+}
+
+EXTERN_C CUDNN_Scope_ScaleTensorHandle CUDNN_Scope_ScaleTensor_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                   int64_t c, int64_t h, int64_t w, double alpha) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::scale_tensor_layer(data_type, c_api::nchw_t(n, c, h, w), alpha);
+  });
+}
+
+EXTERN_C CUDNN_Scope_BatchNormFWDHandle CUDNN_Scope_BatchNormFWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                     int64_t c, int64_t h, int64_t w,
+                                                                     cudnnBatchNormMode_t mode, int is_training) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::batchnorm_layer<true>(data_type, c_api::nchw_t(n, c, h, w), mode, is_training != 0);
+  });
+}
+
+EXTERN_C CUDNN_Scope_BatchNormBWDHandle CUDNN_Scope_BatchNormBWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                     int64_t c, int64_t h, int64_t w,
+                                                                     cudnnBatchNormMode_t mode) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::batchnorm_layer<false>(data_type, c_api::nchw_t(n, c, h, w), mode, true);
+  });
+}
+
+#define CUDNN_SCOPE_CONV_ARGS                                                                                          \
+  c_api::to_conv_args(n, c, h, w, k, filter_height, filter_width, pad_h, pad_w, stride_h, stride_w, dilation_h,        \
+                      dilation_w, group)
+
+EXTERN_C CUDNN_Scope_ConvFWDHandle CUDNN_Scope_ConvFWD_New(CUDNN_Scope_DataType data_type, int64_t n, int64_t c,
+                                                           int64_t h, int64_t w, int64_t k, int64_t filter_height,
+                                                           int64_t filter_width, int64_t pad_h, int64_t pad_w,
+                                                           int64_t stride_h, int64_t stride_w, int64_t dilation_h,
+                                                           int64_t dilation_w, int64_t group, int algorithm) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::conv_layer<c_api::conv_kind::forward>(data_type, CUDNN_SCOPE_CONV_ARGS, algorithm);
+  });
+}
+
+EXTERN_C CUDNN_Scope_ConvBWDDataHandle CUDNN_Scope_ConvBWDData_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                   int64_t c, int64_t h, int64_t w, int64_t k,
+                                                                   int64_t filter_height, int64_t filter_width,
+                                                                   int64_t pad_h, int64_t pad_w, int64_t stride_h,
+                                                                   int64_t stride_w, int64_t dilation_h,
+                                                                   int64_t dilation_w, int64_t group, int algorithm) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::conv_layer<c_api::conv_kind::backward_data>(data_type, CUDNN_SCOPE_CONV_ARGS, algorithm);
+  });
+}
+
+EXTERN_C CUDNN_Scope_ConvBWDFilterHandle CUDNN_Scope_ConvBWDFilter_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                       int64_t c, int64_t h, int64_t w, int64_t k,
+                                                                       int64_t filter_height, int64_t filter_width,
+                                                                       int64_t pad_h, int64_t pad_w, int64_t stride_h,
+                                                                       int64_t stride_w, int64_t dilation_h,
+                                                                       int64_t dilation_w, int64_t group,
+                                                                       int algorithm) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::conv_layer<c_api::conv_kind::backward_filter>(data_type, CUDNN_SCOPE_CONV_ARGS, algorithm);
+  });
+}
+
+EXTERN_C CUDNN_Scope_ConvBWDBiasHandle CUDNN_Scope_ConvBWDBias_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                   int64_t c, int64_t h, int64_t w, int64_t k,
+                                                                   int64_t filter_height, int64_t filter_width,
+                                                                   int64_t pad_h, int64_t pad_w, int64_t stride_h,
+                                                                   int64_t stride_w, int64_t dilation_h,
+                                                                   int64_t dilation_w, int64_t group) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::conv_layer<c_api::conv_kind::backward_bias>(data_type, CUDNN_SCOPE_CONV_ARGS, -1);
+  });
+}
+
+EXTERN_C CUDNN_Scope_ConvBiasActivationFWDHandle
+CUDNN_Scope_ConvBiasActivationFWD_New(CUDNN_Scope_DataType data_type, int64_t n, int64_t c, int64_t h, int64_t w,
+                                      int64_t k, int64_t filter_height, int64_t filter_width, int64_t pad_h,
+                                      int64_t pad_w, int64_t stride_h, int64_t stride_w, int64_t dilation_h,
+                                      int64_t dilation_w, int64_t group, int algorithm,
+                                      cudnnActivationMode_t activation_mode) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::conv_layer<c_api::conv_kind::bias_activation>(data_type, CUDNN_SCOPE_CONV_ARGS, algorithm,
+                                                                    activation_mode);
+  });
+}
+
+#undef CUDNN_SCOPE_CONV_ARGS
+
+EXTERN_C CUDNN_Scope_DropoutFWDHandle CUDNN_Scope_DropoutFWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                 int64_t c, int64_t h, int64_t w, float dropout,
+                                                                 uint64_t seed) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::dropout_layer<true>(data_type, c_api::nchw_t(n, c, h, w), dropout, seed);
+  });
+}
+
+EXTERN_C CUDNN_Scope_DropoutBWDHandle CUDNN_Scope_DropoutBWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                 int64_t c, int64_t h, int64_t w, float dropout,
+                                                                 uint64_t seed) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::dropout_layer<false>(data_type, c_api::nchw_t(n, c, h, w), dropout, seed);
+  });
+}
+
+#define CUDNN_SCOPE_POOLING_ARGS                                                                                       \
+  c_api::pooling_args_t {                                                                                              \
+    c_api::to_dim(window_h), c_api::to_dim(window_w), static_cast<int>(pad_h), static_cast<int>(pad_w),                \
+        c_api::to_dim(stride_h), c_api::to_dim(stride_w)                                                               \
+  }
+
+EXTERN_C CUDNN_Scope_PoolingFWDHandle CUDNN_Scope_PoolingFWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                 int64_t c, int64_t h, int64_t w,
+                                                                 int64_t window_h, int64_t window_w, int64_t pad_h,
+                                                                 int64_t pad_w, int64_t stride_h, int64_t stride_w,
+                                                                 cudnnPoolingMode_t mode) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::pooling_layer<true>(data_type, c_api::nchw_t(n, c, h, w), CUDNN_SCOPE_POOLING_ARGS, mode);
+  });
+}
+
+EXTERN_C CUDNN_Scope_PoolingBWDHandle CUDNN_Scope_PoolingBWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                 int64_t c, int64_t h, int64_t w,
+                                                                 int64_t window_h, int64_t window_w, int64_t pad_h,
+                                                                 int64_t pad_w, int64_t stride_h, int64_t stride_w,
+                                                                 cudnnPoolingMode_t mode) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::pooling_layer<false>(data_type, c_api::nchw_t(n, c, h, w), CUDNN_SCOPE_POOLING_ARGS, mode);
+  });
+}
+
+#undef CUDNN_SCOPE_POOLING_ARGS
+
+EXTERN_C CUDNN_Scope_SoftmaxFWDHandle CUDNN_Scope_SoftmaxFWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                 int64_t c, int64_t h, int64_t w,
+                                                                 cudnnSoftmaxAlgorithm_t algorithm,
+                                                                 cudnnSoftmaxMode_t mode) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::softmax_layer<true>(data_type, c_api::nchw_t(n, c, h, w), algorithm, mode);
+  });
+}
+
+EXTERN_C CUDNN_Scope_SoftmaxBWDHandle CUDNN_Scope_SoftmaxBWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                 int64_t c, int64_t h, int64_t w,
+                                                                 cudnnSoftmaxAlgorithm_t algorithm,
+                                                                 cudnnSoftmaxMode_t mode) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::softmax_layer<false>(data_type, c_api::nchw_t(n, c, h, w), algorithm, mode);
+  });
+}
+
+EXTERN_C CUDNN_Scope_GemmHandle CUDNN_Scope_Gemm_New(CUDNN_Scope_DataType data_type, int64_t m, int64_t n, int64_t k,
+                                                     int transpose_a, int transpose_b, double alpha, double beta) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::gemm_layer(data_type, m, n, k, transpose_a, transpose_b, alpha, beta);
+  });
+}
+
+EXTERN_C CUDNN_Scope_GemvHandle CUDNN_Scope_Gemv_New(CUDNN_Scope_DataType data_type, int64_t m, int64_t k,
+                                                     int transpose_a, double alpha, double beta) {
+  return c_api::guarded<void*>(nullptr, [&]() -> void* {
+    return new c_api::gemv_layer(data_type, m, k, transpose_a, alpha, beta);
+  });
+}
@@ -1,4 +1,3 @@
-
 #pragma once
 
 #include <stddef.h>
@@ -6,6 +5,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <cudnn.h>
+
 #ifndef EXTERN_C
 #ifdef __cplusplus
 #define EXTERN_C extern "C"
@@ -18,6 +19,21 @@
 #endif // __cplusplus
 #endif // EXTERN_C
 
+// Embeddable layer benchmarks (libcudnn_scope_capi.so).
+//
+// Every layer has a handle created by CUDNN_Scope_<Layer>_New, which only
+// records the arguments. SetUp creates the descriptors and device buffers
+// owned by the handle (and picks the fastest algorithm of a convolution whose
+// algorithm is -1), Run executes the layer once and returns the elapsed time
+// in nanoseconds, TearDown releases what SetUp created, and Delete frees the
+// handle. Attributes returns a json object with the arguments, the sizes,
+// the chosen algorithm and the statistics of the runs so far; the string is
+// released with CUDNN_Scope_Free.
+//
+// On failure New and Attributes return NULL, SetUp and Run return -1, and
+// CUDNN_Scope_GlobalError.message describes the last error. Calls of all
+// handles are serialized, since they share one cudnn and one cublas handle.
+
 typedef enum CUDNN_Scope_DataType {
   CUDNN_Scope_Unknown = 0,
   CUDNN_Scope_Byte    = 1,
@@ -40,17 +56,190 @@ typedef struct CUDNN_Scope_Error {
 extern CUDNN_Scope_Error CUDNN_Scope_GlobalError;
 ////////////////////////////////////////////////////////////////////////////////////////
 
+////////////////////////////////////////////////////////////////////////////////////////
+// Library
+////////////////////////////////////////////////////////////////////////////////////////
+// Selects the device and creates the shared handles; optional, device 0 is
+// used otherwise. Must be called before any layer is set up.
+EXTERN_C int CUDNN_Scope_Init(int device_id);
+EXTERN_C void CUDNN_Scope_Free(void* ptr);
+////////////////////////////////////////////////////////////////////////////////////////
+
+#define CUDNN_SCOPE_DECLARE_LAYER(name)                                                                                \
+  typedef void* CUDNN_Scope_##name##Handle;                                                                            \
+  EXTERN_C int CUDNN_Scope_##name##_SetUp(CUDNN_Scope_##name##Handle handle);                                          \
+  EXTERN_C void CUDNN_Scope_##name##_TearDown(CUDNN_Scope_##name##Handle handle);                                      \
+  EXTERN_C char* CUDNN_Scope_##name##_Attributes(CUDNN_Scope_##name##Handle handle);                                   \
+  EXTERN_C int64_t CUDNN_Scope_##name##_Run(CUDNN_Scope_##name##Handle handle);                                        \
+  EXTERN_C void CUDNN_Scope_##name##_Delete(CUDNN_Scope_##name##Handle handle)
+
+////////////////////////////////////////////////////////////////////////////////////////
+// CUDNN_Scope_ActivationFWD
+////////////////////////////////////////////////////////////////////////////////////////
+CUDNN_SCOPE_DECLARE_LAYER(ActivationFWD);
+EXTERN_C CUDNN_Scope_ActivationFWDHandle CUDNN_Scope_ActivationFWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                       int64_t c, int64_t h, int64_t w,
+                                                                       cudnnActivationMode_t activation_mode);
+////////////////////////////////////////////////////////////////////////////////////////
+
 ////////////////////////////////////////////////////////////////////////////////////////
 // CUDNN_Scope_ActivationBWD
 ////////////////////////////////////////////////////////////////////////////////////////
-typedef void* CUDNN_Scope_ActivationBWDHandle;
-EXTERN_C CUDNN_Scope_ActivationBWDHandle CUDNN_Scope_ActivationBWD_New(int64_t w, int64_t h, int64_t c, int64_t n,
-                                                                       int64_t k, int64_t filter_width,
-                                                                       int64_t filter_height, int64_t pad_w,
-                                                                       int64_t pad_h, int64_t wstride, int64_t hstride,
+CUDNN_SCOPE_DECLARE_LAYER(ActivationBWD);
+EXTERN_C CUDNN_Scope_ActivationBWDHandle CUDNN_Scope_ActivationBWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                       int64_t c, int64_t h, int64_t w,
                                                                        cudnnActivationMode_t activation_mode);
-EXTERN_C void CUDNN_Scope_ActivationBWD_SetUp(CUDNN_Scope_ActivationBWDHandle handle);
-EXTERN_C void CUDNN_Scope_ActivationBWD_TearDown(CUDNN_Scope_ActivationBWDHandle handle);
-EXTERN_C char* CUDNN_Scope_ActivationBWD_Attributes(CUDNN_Scope_ActivationBWDHandle handle);
-EXTERN_C int64_t CUDNN_Scope_ActivationBWD_Run(CUDNN_Scope_ActivationBWDHandle handle);
+////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////
+// CUDNN_Scope_AddTensor: output[n, c, h, w] += bias[bias_n, bias_c, bias_h, bias_w]
+////////////////////////////////////////////////////////////////////////////////////////
+CUDNN_SCOPE_DECLARE_LAYER(AddTensor);
+EXTERN_C CUDNN_Scope_AddTensorHandle CUDNN_Scope_AddTensor_New(CUDNN_Scope_DataType data_type, int64_t n, int64_t c,
+                                                               int64_t h, int64_t w, int64_t bias_n, int64_t bias_c,
+                                                               int64_t bias_h, int64_t bias_w);
+////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////
+// CUDNN_Scope_OpTensor
+////////////////////////////////////////////////////////////////////////////////////////
+CUDNN_SCOPE_DECLARE_LAYER(OpTensor);
+EXTERN_C CUDNN_Scope_OpTensorHandle CUDNN_Scope_OpTensor_New(CUDNN_Scope_DataType data_type, int64_t n, int64_t c,
+                                                             int64_t h, int64_t w, cudnnOpTensorOp_t op);
+////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////
+// CUDNN_Scope_ScaleTensor
+////////////////////////////////////////////////////////////////////////////////////////
+CUDNN_SCOPE_DECLARE_LAYER(ScaleTensor);
+EXTERN_C CUDNN_Scope_ScaleTensorHandle CUDNN_Scope_ScaleTensor_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                   int64_t c, int64_t h, int64_t w, double alpha);
+////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////
+// CUDNN_Scope_BatchNormFWD
+////////////////////////////////////////////////////////////////////////////////////////
+CUDNN_SCOPE_DECLARE_LAYER(BatchNormFWD);
+EXTERN_C CUDNN_Scope_BatchNormFWDHandle CUDNN_Scope_BatchNormFWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                     int64_t c, int64_t h, int64_t w,
+                                                                     cudnnBatchNormMode_t mode, int is_training);
+////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////
+// CUDNN_Scope_BatchNormBWD
+////////////////////////////////////////////////////////////////////////////////////////
+CUDNN_SCOPE_DECLARE_LAYER(BatchNormBWD);
+EXTERN_C CUDNN_Scope_BatchNormBWDHandle CUDNN_Scope_BatchNormBWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                     int64_t c, int64_t h, int64_t w,
+                                                                     cudnnBatchNormMode_t mode);
+////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Convolutions. The input is [n, c, h, w], the filters [k, c / group,
+// filter_height, filter_width]; an algorithm of -1 picks the fastest one
+// with cudnnFind during SetUp.
+////////////////////////////////////////////////////////////////////////////////////////
+CUDNN_SCOPE_DECLARE_LAYER(ConvFWD);
+EXTERN_C CUDNN_Scope_ConvFWDHandle CUDNN_Scope_ConvFWD_New(CUDNN_Scope_DataType data_type, int64_t n, int64_t c,
+                                                           int64_t h, int64_t w, int64_t k, int64_t filter_height,
+                                                           int64_t filter_width, int64_t pad_h, int64_t pad_w,
+                                                           int64_t stride_h, int64_t stride_w, int64_t dilation_h,
+                                                           int64_t dilation_w, int64_t group, int algorithm);
+
+CUDNN_SCOPE_DECLARE_LAYER(ConvBWDData);
+EXTERN_C CUDNN_Scope_ConvBWDDataHandle CUDNN_Scope_ConvBWDData_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                   int64_t c, int64_t h, int64_t w, int64_t k,
+                                                                   int64_t filter_height, int64_t filter_width,
+                                                                   int64_t pad_h, int64_t pad_w, int64_t stride_h,
+                                                                   int64_t stride_w, int64_t dilation_h,
+                                                                   int64_t dilation_w, int64_t group, int algorithm);
+
+CUDNN_SCOPE_DECLARE_LAYER(ConvBWDFilter);
+EXTERN_C CUDNN_Scope_ConvBWDFilterHandle CUDNN_Scope_ConvBWDFilter_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                       int64_t c, int64_t h, int64_t w, int64_t k,
+                                                                       int64_t filter_height, int64_t filter_width,
+                                                                       int64_t pad_h, int64_t pad_w, int64_t stride_h,
+                                                                       int64_t stride_w, int64_t dilation_h,
+                                                                       int64_t dilation_w, int64_t group,
+                                                                       int algorithm);
+
+// The bias gradient of the output of the convolution.
+CUDNN_SCOPE_DECLARE_LAYER(ConvBWDBias);
+EXTERN_C CUDNN_Scope_ConvBWDBiasHandle CUDNN_Scope_ConvBWDBias_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                   int64_t c, int64_t h, int64_t w, int64_t k,
+                                                                   int64_t filter_height, int64_t filter_width,
+                                                                   int64_t pad_h, int64_t pad_w, int64_t stride_h,
+                                                                   int64_t stride_w, int64_t dilation_h,
+                                                                   int64_t dilation_w, int64_t group);
+
+// cuDNN only supports CUDNN_ACTIVATION_IDENTITY with the implicit precomp gemm algorithm.
+CUDNN_SCOPE_DECLARE_LAYER(ConvBiasActivationFWD);
+EXTERN_C CUDNN_Scope_ConvBiasActivationFWDHandle
+CUDNN_Scope_ConvBiasActivationFWD_New(CUDNN_Scope_DataType data_type, int64_t n, int64_t c, int64_t h, int64_t w,
+                                      int64_t k, int64_t filter_height, int64_t filter_width, int64_t pad_h,
+                                      int64_t pad_w, int64_t stride_h, int64_t stride_w, int64_t dilation_h,
+                                      int64_t dilation_w, int64_t group, int algorithm,
+                                      cudnnActivationMode_t activation_mode);
+////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////
+// CUDNN_Scope_DropoutFWD / CUDNN_Scope_DropoutBWD
+////////////////////////////////////////////////////////////////////////////////////////
+CUDNN_SCOPE_DECLARE_LAYER(DropoutFWD);
+EXTERN_C CUDNN_Scope_DropoutFWDHandle CUDNN_Scope_DropoutFWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                 int64_t c, int64_t h, int64_t w, float dropout,
+                                                                 uint64_t seed);
+
+CUDNN_SCOPE_DECLARE_LAYER(DropoutBWD);
+EXTERN_C CUDNN_Scope_DropoutBWDHandle CUDNN_Scope_DropoutBWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                 int64_t c, int64_t h, int64_t w, float dropout,
+                                                                 uint64_t seed);
+////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////
+// CUDNN_Scope_PoolingFWD / CUDNN_Scope_PoolingBWD
+////////////////////////////////////////////////////////////////////////////////////////
+CUDNN_SCOPE_DECLARE_LAYER(PoolingFWD);
+EXTERN_C CUDNN_Scope_PoolingFWDHandle CUDNN_Scope_PoolingFWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                 int64_t c, int64_t h, int64_t w,
+                                                                 int64_t window_h, int64_t window_w, int64_t pad_h,
+                                                                 int64_t pad_w, int64_t stride_h, int64_t stride_w,
+                                                                 cudnnPoolingMode_t mode);
+
+CUDNN_SCOPE_DECLARE_LAYER(PoolingBWD);
+EXTERN_C CUDNN_Scope_PoolingBWDHandle CUDNN_Scope_PoolingBWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                 int64_t c, int64_t h, int64_t w,
+                                                                 int64_t window_h, int64_t window_w, int64_t pad_h,
+                                                                 int64_t pad_w, int64_t stride_h, int64_t stride_w,
+                                                                 cudnnPoolingMode_t mode);
+////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////
+// CUDNN_Scope_SoftmaxFWD / CUDNN_Scope_SoftmaxBWD
+////////////////////////////////////////////////////////////////////////////////////////
+CUDNN_SCOPE_DECLARE_LAYER(SoftmaxFWD);
+EXTERN_C CUDNN_Scope_SoftmaxFWDHandle CUDNN_Scope_SoftmaxFWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                 int64_t c, int64_t h, int64_t w,
+                                                                 cudnnSoftmaxAlgorithm_t algorithm,
+                                                                 cudnnSoftmaxMode_t mode);
+
+CUDNN_SCOPE_DECLARE_LAYER(SoftmaxBWD);
+EXTERN_C CUDNN_Scope_SoftmaxBWDHandle CUDNN_Scope_SoftmaxBWD_New(CUDNN_Scope_DataType data_type, int64_t n,
+                                                                 int64_t c, int64_t h, int64_t w,
+                                                                 cudnnSoftmaxAlgorithm_t algorithm,
+                                                                 cudnnSoftmaxMode_t mode);
+////////////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////////////
+// CUDNN_Scope_Gemm: C[m, n] = alpha * op(A) op(B) + beta * C (column major)
+// CUDNN_Scope_Gemv: y = alpha * op(A) x + beta * y
+// The backward passes are gemms and gemvs with transposed operands.
+////////////////////////////////////////////////////////////////////////////////////////
+CUDNN_SCOPE_DECLARE_LAYER(Gemm);
+EXTERN_C CUDNN_Scope_GemmHandle CUDNN_Scope_Gemm_New(CUDNN_Scope_DataType data_type, int64_t m, int64_t n, int64_t k,
+                                                     int transpose_a, int transpose_b, double alpha, double beta);
+
+CUDNN_SCOPE_DECLARE_LAYER(Gemv);
+EXTERN_C CUDNN_Scope_GemvHandle CUDNN_Scope_Gemv_New(CUDNN_Scope_DataType data_type, int64_t m, int64_t k,
+                                                     int transpose_a, double alpha, double beta);
 ////////////////////////////////////////////////////////////////////////////////////////
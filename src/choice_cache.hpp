@@ -0,0 +1,56 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+// The part of warm_cache.hpp that depends on neither CUDA nor google
+// benchmark, so the C API library keeps its autotuning results the same way.
+namespace warm_cache {
+
+inline bool &enabled() {
+  static bool res = false;
+  return res;
+}
+
+// The arguments joined by '/', for the keys of a choice_cache.
+template <typename... Args>
+std::string key(const Args &... args) {
+  std::ostringstream res;
+  int ii = 0;
+  ((res << (ii++ == 0 ? "" : "/") << args), ...);
+  return res.str();
+}
+
+// Results of an autotuning step by key; a miss leaves value untouched.
+template <typename Value>
+class choice_cache {
+public:
+  bool find(const std::string &key, Value &value) {
+    if (!enabled()) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_values.find(key);
+    if (it == m_values.end()) {
+      return false;
+    }
+    value = it->second;
+    return true;
+  }
+
+  void insert(const std::string &key, const Value &value) {
+    if (!enabled()) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_values[key] = value;
+  }
+
+private:
+  std::mutex m_mutex{};
+  std::map<std::string, Value> m_values{};
+};
+
+} // namespace warm_cache
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include <benchmark/benchmark.h>
+
+// Grouped and depthwise convolutions.
+//
+// A convolution with group g is g independent convolutions of C/g channels
+// into K/g filters. With g == C (depthwise, as in MobileNet) every filter
+// reads a single channel, and the layer is bound by memory rather than by its
+// multiply-adds. The conv Impls classify their layer and report the flops and
+// bytes of one group and of the whole layer, so depthwise layers can be told
+// apart and judged by their arithmetic intensity instead of by the flops of
+// a dense convolution.
+namespace conv_group {
+
+enum class kind_t : int { dense = 0, grouped = 1, depthwise = 2 };
+
+static kind_t kind(int64_t channels, int64_t group) {
+  if (group <= 1) {
+    return kind_t::dense;
+  }
+  return group == channels ? kind_t::depthwise : kind_t::grouped;
+}
+
+struct shape_t {
+  int64_t batch_size{1};
+  int64_t channels{1};
+  int64_t num_filters{1};
+  int64_t group{1};
+  // product of the filter, input and output spatial dims (R * S, H * W, P * Q)
+  int64_t filter_elements{1};
+  int64_t input_elements{1};
+  int64_t output_elements{1};
+};
+
+// The bytes count every tensor once: x, w and y (or their gradients).
+template <typename T>
+static void add_counters(benchmark::State &state, const shape_t &shape) {
+  const auto group              = std::max<int64_t>(shape.group, 1);
+  const auto channels_per_group = shape.channels / group;
+  const auto filters_per_group  = shape.num_filters / group;
+  const double per_group_flops  = static_cast<double>(shape.batch_size) * filters_per_group * channels_per_group *
+                                 shape.filter_elements * shape.output_elements;
+  const double per_group_bytes = static_cast<double>(sizeof(T)) *
+                                 (shape.batch_size * channels_per_group * shape.input_elements +
+                                  filters_per_group * channels_per_group * shape.filter_elements +
+                                  shape.batch_size * filters_per_group * shape.output_elements);
+  const auto flops = per_group_flops * group;
+  const auto bytes = per_group_bytes * group;
+  state.counters.insert({{"conv_kind", (int) kind(shape.channels, group)},
+                         {"group", group},
+                         {"channels_per_group", channels_per_group},
+                         {"filters_per_group", filters_per_group},
+                         {"per_group_flops_count", per_group_flops},
+                         {"per_group_bytes", per_group_bytes},
+                         {"effective_flops_count", flops},
+                         {"effective_bytes", bytes},
+                         {"arithmetic_intensity", bytes == 0 ? 0 : flops / bytes},
+                         {"effective_flops", {flops * state.iterations(), benchmark::Counter::kAvgThreadsRate}},
+                         {"effective_bandwidth", {bytes * state.iterations(), benchmark::Counter::kAvgThreadsRate}}});
+}
+
+} // namespace conv_group
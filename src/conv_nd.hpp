@@ -0,0 +1,271 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <cudnn.h>
+
+#include "conv_group.hpp"
+#include "conv_nd_problem.hpp"
+#include "error.hpp"
+#include "helper.hpp"
+
+// 3-D convolutions (video and volumetric models).
+//
+// The problems use the 5-D arg layout of CONV_ND_ARG_NAMES: N, C, D, H, W, K,
+// T, R, S, then the pads, strides and dilations of the depth, height and
+// width, and the group count. The descriptors go through the Nd cudnn APIs,
+// so a 2-D problem is the same problem with D = T = 1. Tensors are NCDHW
+// (NDHWC for integral types) and filters K x C/group x T x R x S.
+namespace conv_nd {
+
+// An arg of 0 picks the default, like the group of the 2-D problems.
+static problem_t problem(const benchmark::State &state) {
+  const auto arg = [&](int ii, int default_value) {
+    const auto value = static_cast<int>(state.range(ii));
+    return value == 0 ? default_value : value;
+  };
+  problem_t res;
+  res.batch_size  = arg(0, 1);
+  res.channels    = arg(1, 1);
+  res.num_filters = arg(5, 1);
+  for (int ii = 0; ii < num_spatial_dims; ii++) {
+    res.input[ii]    = arg(2 + ii, 1);
+    res.filter[ii]   = arg(6 + ii, 1);
+    res.pad[ii]      = static_cast<int>(state.range(9 + ii));
+    res.stride[ii]   = arg(12 + ii, 1);
+    res.dilation[ii] = arg(15 + ii, 1);
+  }
+  res.group = arg(18, 1);
+  return res;
+}
+
+// A problem in the 2-D arg layout of the conv Impls (N, C, H, W, K, R, S, the
+// pads, strides and dilations of the height and width, and the group), D = T = 1.
+static problem_t problem_2d(const benchmark::State &state) {
+  const auto arg = [&](int ii, int default_value) {
+    const auto value = static_cast<int>(state.range(ii));
+    return value == 0 ? default_value : value;
+  };
+  problem_t res;
+  res.batch_size  = arg(0, 1);
+  res.channels    = arg(1, 1);
+  res.num_filters = arg(4, 1);
+  for (int ii = 1; ii < num_spatial_dims; ii++) {
+    res.input[ii]    = arg(1 + ii, 1);
+    res.filter[ii]   = arg(4 + ii, 1);
+    res.pad[ii]      = static_cast<int>(state.range(6 + ii));
+    res.stride[ii]   = arg(8 + ii, 1);
+    res.dilation[ii] = arg(10 + ii, 1);
+  }
+  res.group = arg(13, 1);
+  return res;
+}
+
+template <typename T>
+static void add_counters(benchmark::State &state, const problem_t &problem) {
+  const auto out = problem.output();
+  state.counters.insert({{"input_size", problem.input_size()},
+                         {"input_batch_size", problem.batch_size},
+                         {"input_channels", problem.channels},
+                         {"input_depth", problem.input[0]},
+                         {"input_height", problem.input[1]},
+                         {"input_width", problem.input[2]},
+                         {"num_filters", problem.num_filters},
+                         {"filter_depth", problem.filter[0]},
+                         {"filter_height", problem.filter[1]},
+                         {"filter_width", problem.filter[2]},
+                         {"pad_depth", problem.pad[0]},
+                         {"pad_height", problem.pad[1]},
+                         {"pad_width", problem.pad[2]},
+                         {"stride_depth", problem.stride[0]},
+                         {"stride_height", problem.stride[1]},
+                         {"stride_width", problem.stride[2]},
+                         {"dilation_depth", problem.dilation[0]},
+                         {"dilation_height", problem.dilation[1]},
+                         {"dilation_width", problem.dilation[2]},
+                         {"group", problem.group},
+                         {"output_size", problem.output_size()},
+                         {"output_batch_size", problem.batch_size},
+                         {"output_channels", problem.num_filters},
+                         {"output_depth", out[0]},
+                         {"output_height", out[1]},
+                         {"output_width", out[2]}});
+  const auto predicted_flops = problem.flops();
+  state.counters.insert(
+      {{"predicted_flops_count", predicted_flops},
+       {"predicted_flops", {predicted_flops * state.iterations(), benchmark::Counter::kAvgThreadsRate}}});
+  conv_group::add_counters<T>(state, {problem.batch_size, problem.channels, problem.num_filters, problem.group,
+                                      int64_t(problem.filter[0]) * problem.filter[1] * problem.filter[2],
+                                      int64_t(problem.input[0]) * problem.input[1] * problem.input[2],
+                                      int64_t(out[0]) * out[1] * out[2]});
+}
+
+// The Nd convolution descriptor of a problem.
+template <typename T>
+struct alignas(128) Convolution {
+  bool is_valid{false};
+  MEM_ALIGNED_128 cudnnConvolutionDescriptor_t descriptor{nullptr};
+
+  Convolution(benchmark::State &state, const problem_t &problem, cudnnConvolutionMode_t mode, int math_type) {
+    ANNOTATE_RANGE("descriptor");
+
+    if (PRINT_IF_ERROR(cudnnCreateConvolutionDescriptor(&descriptor))) {
+      state.SkipWithError(BENCHMARK_NAME " failed to cudnnCreateConvolutionDescriptor");
+      return;
+    }
+    auto pad      = problem.pad;
+    auto stride   = problem.stride;
+    auto dilation = problem.dilation;
+    if (PRINT_IF_ERROR(cudnnSetConvolutionNdDescriptor(descriptor, num_spatial_dims, pad.data(), stride.data(),
+                                                       dilation.data(), mode, accumDataType<T>::type))) {
+      state.SkipWithError(BENCHMARK_NAME " failed to cudnnSetConvolutionNdDescriptor");
+      return;
+    }
+    if (PRINT_IF_ERROR(cudnnSetConvolutionGroupCount(descriptor, problem.group))) {
+      state.SkipWithError(BENCHMARK_NAME " failed to cudnnSetConvolutionGroupCount");
+      return;
+    }
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+    if (PRINT_IF_ERROR(cudnnSetConvolutionMathType(descriptor, (cudnnMathType_t) math_type))) {
+      state.SkipWithError(BENCHMARK_NAME " failed to cudnnSetConvolutionMathType");
+      return;
+    }
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+    is_valid = true;
+  }
+
+  ~Convolution() {
+    if (descriptor == nullptr) {
+      return;
+    }
+    PRINT_IF_ERROR(cudnnDestroyConvolutionDescriptor(descriptor));
+  }
+
+  cudnnConvolutionDescriptor_t get() const {
+    if (!is_valid) {
+      return nullptr;
+    }
+    return descriptor;
+  }
+};
+
+// Checks the output dims cudnn computes against those of the problem.
+static bool check_output_dims(benchmark::State &state, const problem_t &problem, cudnnConvolutionDescriptor_t conv,
+                              cudnnTensorDescriptor_t x, cudnnFilterDescriptor_t w) {
+  int dims[num_spatial_dims + 2];
+  const auto err = cudnnGetConvolutionNdForwardOutputDim(conv, x, w, num_spatial_dims + 2, dims);
+  if (PRINT_IF_ERROR(err)) {
+    state.SkipWithError(fmt::format(BENCHMARK_NAME " failed to cudnnGetConvolutionNdForwardOutputDim because of {}",
+                                    utils::detail::error_string(err))
+                            .c_str());
+    return false;
+  }
+  const auto out = problem.output();
+  if (dims[0] != problem.batch_size || dims[1] != problem.num_filters || dims[2] != out[0] || dims[3] != out[1] ||
+      dims[4] != out[2]) {
+    const auto msg = fmt::format(BENCHMARK_NAME " got output dims {}x{}x{}x{}x{} from cudnn, expected {}x{}x{}x{}x{}",
+                                 dims[0], dims[1], dims[2], dims[3], dims[4], problem.batch_size, problem.num_filters,
+                                 out[0], out[1], out[2]);
+    state.SkipWithError(msg.c_str());
+    return false;
+  }
+  return true;
+}
+
+// The setup shared by the forward, backward data and backward filter Impls:
+// the math type (tensor op math for half), the convolution descriptor, the x,
+// w and y descriptors (those of dx, dw and dy in the backward passes) and a
+// device buffer of each, filled with ones. The Impls add the workspace of
+// their algorithm and the call. is_valid is false once the state was skipped.
+template <typename T>
+struct Layer {
+  bool is_valid{false};
+  problem_t problem{};
+  dims_t out{};
+  int math_type{0};
+  std::unique_ptr<Convolution<T>> convolution{};
+  std::unique_ptr<Tensor<T>> x_tensor{};
+  std::unique_ptr<Filter<T>> w_filter{};
+  std::unique_ptr<Tensor<T>> y_tensor{};
+  std::unique_ptr<DeviceMemory<T>> x_memory{};
+  std::unique_ptr<DeviceMemory<T>> w_memory{};
+  std::unique_ptr<DeviceMemory<T>> y_memory{};
+
+  Layer(benchmark::State &state, int math_type0) : problem(conv_nd::problem(state)), out(problem.output()) {
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+    math_type = math_type0;
+    if ((is_half_v<T> || math_type == CUDNN_TENSOR_OP_MATH) && !detail::SupportsTensorCore(cuda_device_id)) {
+      state.SkipWithError(BENCHMARK_NAME "no Tensorcore support on current device");
+      return;
+    }
+    if (is_half_v<T>) {
+      math_type = CUDNN_TENSOR_OP_MATH;
+    }
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+
+    convolution.reset(new Convolution<T>(state, problem, CUDNN_CROSS_CORRELATION, math_type));
+    if (!convolution->is_valid) {
+      return;
+    }
+    x_tensor.reset(new Tensor<T>(state,
+                                 {/*batch_size=*/problem.batch_size,
+                                  /*channels=*/problem.channels,
+                                  /*image_depth=*/problem.input[0],
+                                  /*image_height=*/problem.input[1],
+                                  /*image_width=*/problem.input[2]}));
+    if (!x_tensor->is_valid) {
+      return;
+    }
+    w_filter.reset(new Filter<T>(state,
+                                 {/*out_channels=*/problem.num_filters,
+                                  /*in_channels=*/problem.channels,
+                                  /*kernel_depth=*/problem.filter[0],
+                                  /*kernel_height=*/problem.filter[1],
+                                  /*kernel_width=*/problem.filter[2]},
+                                 problem.group));
+    if (!w_filter->is_valid) {
+      return;
+    }
+    if (!check_output_dims(state, problem, convolution->get(), x_tensor->get(), w_filter->get())) {
+      return;
+    }
+    y_tensor.reset(new Tensor<T>(state,
+                                 {/*batch_size=*/problem.batch_size,
+                                  /*channels=*/problem.num_filters,
+                                  /*image_depth=*/out[0],
+                                  /*image_height=*/out[1],
+                                  /*image_width=*/out[2]}));
+    if (!y_tensor->is_valid) {
+      return;
+    }
+
+    x_memory = ones(state, problem.input_size());
+    if (!x_memory->is_valid) {
+      return;
+    }
+    w_memory = ones(state, problem.filter_size());
+    if (!w_memory->is_valid) {
+      return;
+    }
+    y_memory = ones(state, problem.output_size());
+    if (!y_memory->is_valid) {
+      return;
+    }
+    is_valid = true;
+  }
+
+private:
+  static std::unique_ptr<DeviceMemory<T>> ones(benchmark::State &state, int64_t size) {
+    const auto data = std::vector<T>(size, detail::one<T>());
+    return std::unique_ptr<DeviceMemory<T>>(new DeviceMemory<T>(state, data.data(), data.size() * sizeof(T)));
+  }
+};
+
+} // namespace conv_nd
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+
+// The problem of a 3-D convolution without the cudnn descriptors of
+// conv_nd.hpp, so the CPU references and the host tests can use it.
+namespace conv_nd {
+
+static constexpr int num_spatial_dims = 3;
+
+using dims_t = std::array<int, num_spatial_dims>;
+
+struct problem_t {
+  int batch_size{1};
+  int channels{1};
+  int num_filters{1};
+  int group{1};
+  // depth, height, width
+  dims_t input{{1, 1, 1}};
+  dims_t filter{{1, 1, 1}};
+  dims_t pad{{0, 0, 0}};
+  dims_t stride{{1, 1, 1}};
+  dims_t dilation{{1, 1, 1}};
+
+  // The spatial dims of the output; a dim is <= 0 if the filter does not fit.
+  dims_t output() const {
+    dims_t res;
+    for (int ii = 0; ii < num_spatial_dims; ii++) {
+      const auto extent = (filter[ii] - 1) * dilation[ii] + 1;
+      res[ii]           = (input[ii] + 2 * pad[ii] - extent) / stride[ii] + 1;
+    }
+    return res;
+  }
+
+  // The group divides the channels and the filters, and the filter fits the input.
+  bool is_valid() const {
+    const auto out = output();
+    return group > 0 && channels % group == 0 && num_filters % group == 0 &&
+           *std::min_element(out.begin(), out.end()) > 0;
+  }
+
+  int64_t input_size() const {
+    return int64_t(batch_size) * channels * input[0] * input[1] * input[2];
+  }
+
+  int64_t filter_size() const {
+    return int64_t(num_filters) * (channels / group) * filter[0] * filter[1] * filter[2];
+  }
+
+  int64_t output_size() const {
+    const auto out = output();
+    return int64_t(batch_size) * num_filters * out[0] * out[1] * out[2];
+  }
+
+  // Identifies the problem, e.g. as the key of a cache.
+  std::string key() const {
+    std::string res = std::to_string(batch_size) + "," + std::to_string(channels) + "," +
+                      std::to_string(num_filters) + "," + std::to_string(group);
+    for (const auto &dims : {input, filter, pad, stride, dilation}) {
+      for (const auto dim : dims) {
+        res += "," + std::to_string(dim);
+      }
+    }
+    return res;
+  }
+
+  // Multiply-adds of a direct convolution, whatever the algorithm.
+  double flops() const {
+    const auto out = output();
+    return static_cast<double>(batch_size) * num_filters * (channels / group) * filter[0] * filter[1] * filter[2] *
+           out[0] * out[1] * out[2];
+  }
+};
+
+} // namespace conv_nd
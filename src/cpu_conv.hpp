@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "conv_nd_problem.hpp"
+
+// Multithreaded CPU reference of the 3-D convolutions.
+//
+// Direct cross-correlations over NCDHW tensors and K x C/group x T x R x S
+// filters, the problems of conv_nd.hpp. Each routine splits the independent
+// outputs over num_threads threads (forward: n and k, backward data: n and
+// c, backward filter: k), so no two threads write the same element.
+namespace cpu_conv {
+
+using conv_nd::problem_t;
+
+// Worker threads that stay around between the parallel_for calls, so a timed
+// iteration does not pay for creating and joining its threads. The threads
+// are created on first use, after the CPU Impls pinned the process
+// (--host_pin), and inherit its affinity.
+class thread_pool {
+public:
+  ~thread_pool() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto &thread : m_threads) {
+      thread.join();
+    }
+  }
+
+  // Calls f(begin, end) on num_threads threads, the calling thread being one
+  // of them, that split [0, n); returns once every chunk is done.
+  void run(int64_t n, int num_threads, const std::function<void(int64_t, int64_t)> &f) {
+    std::lock_guard<std::mutex> run_lock(m_run_mutex);
+    while (m_threads.size() + 1 < static_cast<size_t>(num_threads)) {
+      m_threads.emplace_back([this]() { work(); });
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_f          = &f;
+    m_n          = n;
+    m_chunk      = (n + num_threads - 1) / num_threads;
+    m_num_chunks = (n + m_chunk - 1) / m_chunk;
+    m_next       = 0;
+    m_pending    = m_num_chunks;
+    m_wake.notify_all();
+    run_chunks(lock);
+    m_done.wait(lock, [this]() { return m_pending == 0; });
+    m_f = nullptr;
+  }
+
+private:
+  void work() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      m_wake.wait(lock, [this]() { return m_stop || m_next < m_num_chunks; });
+      if (m_stop) {
+        return;
+      }
+      run_chunks(lock);
+    }
+  }
+
+  // Takes chunks until there are none left; lock is held between the chunks.
+  void run_chunks(std::unique_lock<std::mutex> &lock) {
+    while (m_next < m_num_chunks) {
+      const auto begin = m_next++ * m_chunk;
+      const auto &f    = *m_f;
+      lock.unlock();
+      f(begin, std::min(m_n, begin + m_chunk));
+      lock.lock();
+      if (--m_pending == 0) {
+        m_done.notify_all();
+      }
+    }
+  }
+
+  std::mutex m_run_mutex{};
+  std::mutex m_mutex{};
+  std::condition_variable m_wake{};
+  std::condition_variable m_done{};
+  std::vector<std::thread> m_threads{};
+  bool m_stop{false};
+  const std::function<void(int64_t, int64_t)> *m_f{nullptr};
+  int64_t m_n{0};
+  int64_t m_chunk{1};
+  int64_t m_num_chunks{0};
+  int64_t m_next{0};
+  int64_t m_pending{0};
+};
+
+inline thread_pool &pool() {
+  static thread_pool p;
+  return p;
+}
+
+// Calls f(begin, end) on num_threads threads of the pool that split [0, n).
+template <typename F>
+static void parallel_for(int64_t n, int num_threads, F f) {
+  num_threads = static_cast<int>(std::max<int64_t>(1, std::min<int64_t>(num_threads, n)));
+  if (num_threads == 1) {
+    f(int64_t(0), n);
+    return;
+  }
+  pool().run(n, num_threads, std::ref(f));
+}
+
+// Index of (n, c, d, h, w) in a packed NCDHW tensor.
+static inline int64_t offset(int64_t n, int64_t c, int64_t d, int64_t h, int64_t w, int64_t channels,
+                             const conv_nd::dims_t &dims) {
+  return (((n * channels + c) * dims[0] + d) * dims[1] + h) * dims[2] + w;
+}
+
+// The input position of an output position and a filter tap, outside the
+// input if it falls into the padding.
+static inline int input_position(const problem_t &p, int dim, int out, int tap) {
+  return out * p.stride[dim] - p.pad[dim] + tap * p.dilation[dim];
+}
+
+static inline bool is_inside(const problem_t &p, int d, int h, int w) {
+  return d >= 0 && d < p.input[0] && h >= 0 && h < p.input[1] && w >= 0 && w < p.input[2];
+}
+
+template <typename T>
+static void forward(const problem_t &p, const T *x, const T *w, T *y, int num_threads) {
+  const auto out               = p.output();
+  const int channels_per_group = p.channels / p.group;
+  const int filters_per_group  = p.num_filters / p.group;
+  const conv_nd::dims_t filter = p.filter;
+  const int64_t num_outputs    = int64_t(p.batch_size) * p.num_filters;
+  parallel_for(num_outputs, num_threads, [&](int64_t begin, int64_t end) {
+    for (auto nk = begin; nk < end; nk++) {
+      const int n = nk / p.num_filters, k = nk % p.num_filters;
+      const int g = k / filters_per_group;
+      for (int od = 0; od < out[0]; od++) {
+        for (int oh = 0; oh < out[1]; oh++) {
+          for (int ow = 0; ow < out[2]; ow++) {
+            T acc = T(0);
+            for (int c = 0; c < channels_per_group; c++) {
+              for (int t = 0; t < filter[0]; t++) {
+                for (int r = 0; r < filter[1]; r++) {
+                  for (int s = 0; s < filter[2]; s++) {
+                    const auto id = input_position(p, 0, od, t), ih = input_position(p, 1, oh, r),
+                               iw = input_position(p, 2, ow, s);
+                    if (!is_inside(p, id, ih, iw)) {
+                      continue;
+                    }
+                    acc += x[offset(n, g * channels_per_group + c, id, ih, iw, p.channels, p.input)] *
+                           w[offset(k, c, t, r, s, channels_per_group, filter)];
+                  }
+                }
+              }
+            }
+            y[offset(n, k, od, oh, ow, p.num_filters, out)] = acc;
+          }
+        }
+      }
+    }
+  });
+}
+
+template <typename T>
+static void backward_data(const problem_t &p, const T *w, const T *dy, T *dx, int num_threads) {
+  const auto out               = p.output();
+  const int channels_per_group = p.channels / p.group;
+  const int filters_per_group  = p.num_filters / p.group;
+  const conv_nd::dims_t filter = p.filter;
+  const int64_t num_inputs     = int64_t(p.batch_size) * p.channels;
+  // the output position that reads input position in through tap, -1 if none
+  const auto output_position = [&](int dim, int in, int tap) {
+    const auto num = in + p.pad[dim] - tap * p.dilation[dim];
+    if (num < 0 || num % p.stride[dim] != 0 || num / p.stride[dim] >= out[dim]) {
+      return -1;
+    }
+    return num / p.stride[dim];
+  };
+  parallel_for(num_inputs, num_threads, [&](int64_t begin, int64_t end) {
+    for (auto nc = begin; nc < end; nc++) {
+      const int n = nc / p.channels, c = nc % p.channels;
+      const int g = c / channels_per_group;
+      for (int id = 0; id < p.input[0]; id++) {
+        for (int ih = 0; ih < p.input[1]; ih++) {
+          for (int iw = 0; iw < p.input[2]; iw++) {
+            T acc = T(0);
+            for (int kk = 0; kk < filters_per_group; kk++) {
+              const int k = g * filters_per_group + kk;
+              for (int t = 0; t < filter[0]; t++) {
+                const auto od = output_position(0, id, t);
+                for (int r = 0; od >= 0 && r < filter[1]; r++) {
+                  const auto oh = output_position(1, ih, r);
+                  for (int s = 0; oh >= 0 && s < filter[2]; s++) {
+                    const auto ow = output_position(2, iw, s);
+                    if (ow < 0) {
+                      continue;
+                    }
+                    acc += dy[offset(n, k, od, oh, ow, p.num_filters, out)] *
+                           w[offset(k, c % channels_per_group, t, r, s, channels_per_group, filter)];
+                  }
+                }
+              }
+            }
+            dx[offset(n, c, id, ih, iw, p.channels, p.input)] = acc;
+          }
+        }
+      }
+    }
+  });
+}
+
+template <typename T>
+static void backward_filter(const problem_t &p, const T *x, const T *dy, T *dw, int num_threads) {
+  const auto out               = p.output();
+  const int channels_per_group = p.channels / p.group;
+  const int filters_per_group  = p.num_filters / p.group;
+  const conv_nd::dims_t filter = p.filter;
+  parallel_for(p.num_filters, num_threads, [&](int64_t begin, int64_t end) {
+    for (auto k = begin; k < end; k++) {
+      const int g = k / filters_per_group;
+      for (int c = 0; c < channels_per_group; c++) {
+        for (int t = 0; t < filter[0]; t++) {
+          for (int r = 0; r < filter[1]; r++) {
+            for (int s = 0; s < filter[2]; s++) {
+              T acc = T(0);
+              for (int n = 0; n < p.batch_size; n++) {
+                for (int od = 0; od < out[0]; od++) {
+                  for (int oh = 0; oh < out[1]; oh++) {
+                    for (int ow = 0; ow < out[2]; ow++) {
+                      const auto id = input_position(p, 0, od, t), ih = input_position(p, 1, oh, r),
+                                 iw = input_position(p, 2, ow, s);
+                      if (!is_inside(p, id, ih, iw)) {
+                        continue;
+                      }
+                      acc += x[offset(n, g * channels_per_group + c, id, ih, iw, p.channels, p.input)] *
+                             dy[offset(n, k, od, oh, ow, p.num_filters, out)];
+                    }
+                  }
+                }
+              }
+              dw[offset(k, c, t, r, s, channels_per_group, filter)] = acc;
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+} // namespace cpu_conv
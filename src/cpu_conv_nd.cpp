@@ -0,0 +1,72 @@
+#define BENCHMARK_NAME "CPU/CONV_ND"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "args.hpp"
+#include "conv_nd.hpp"
+#include "cpu_conv.hpp"
+#include "init.hpp"
+#include "topology.hpp"
+
+// The CPU reference of the 3-D convolutions on the problems of the
+// CUDNN/CONV_ND families. It runs on every cpu the process may use, so
+// --host_pin restricts it to the cpus near the GPU.
+enum class direction_t : int { forward = 0, backward_data = 1, backward_filter = 2 };
+
+template <typename T, direction_t direction>
+static void LAYER_CPU_CONV_ND_Impl(benchmark::State& state) {
+  const auto problem = conv_nd::problem(state);
+  if (!problem.is_valid()) {
+    state.SkipWithError(BENCHMARK_NAME " got a group that does not divide the channels or a filter larger than the "
+                                       "input");
+    return;
+  }
+  // the kernel threads inherit the cpus of --host_pin
+  if (host_env_lazy_init() != 0) {
+    state.SkipWithError(BENCHMARK_NAME " failed to pin to the cpus near the device");
+    return;
+  }
+  const int num_threads = std::max<int>(1, topology::affinity().size());
+
+  auto x = std::vector<T>(problem.input_size(), T(1));
+  auto w = std::vector<T>(problem.filter_size(), T(1));
+  auto y = std::vector<T>(problem.output_size(), T(1));
+
+  for (auto _ : state) {
+    switch (direction) {
+      case direction_t::forward:
+        cpu_conv::forward(problem, x.data(), w.data(), y.data(), num_threads);
+        break;
+      case direction_t::backward_data:
+        cpu_conv::backward_data(problem, w.data(), y.data(), x.data(), num_threads);
+        break;
+      case direction_t::backward_filter:
+        cpu_conv::backward_filter(problem, x.data(), y.data(), w.data(), num_threads);
+        break;
+    }
+    benchmark::ClobberMemory();
+  }
+
+  conv_nd::add_counters<T>(state, problem);
+  state.counters.insert({{"num_cpu_threads", num_threads}});
+  state.SetItemsProcessed(int64_t(state.iterations()) * problem.output_size());
+}
+
+static void LAYER_CPU_CONV_ND_FWD_FLOAT(benchmark::State& state) {
+  LAYER_CPU_CONV_ND_Impl<float, direction_t::forward>(state);
+}
+
+static void LAYER_CPU_CONV_ND_BWD_DATA_FLOAT(benchmark::State& state) {
+  LAYER_CPU_CONV_ND_Impl<float, direction_t::backward_data>(state);
+}
+
+static void LAYER_CPU_CONV_ND_BWD_FILTER_FLOAT(benchmark::State& state) {
+  LAYER_CPU_CONV_ND_Impl<float, direction_t::backward_filter>(state);
+}
+
+BENCHMARK(LAYER_CPU_CONV_ND_FWD_FLOAT)->CONV_3D_PROBLEMS()->UseRealTime();
+BENCHMARK(LAYER_CPU_CONV_ND_BWD_DATA_FLOAT)->CONV_3D_PROBLEMS()->UseRealTime();
+BENCHMARK(LAYER_CPU_CONV_ND_BWD_FILTER_FLOAT)->CONV_3D_PROBLEMS()->UseRealTime();
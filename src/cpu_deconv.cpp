@@ -0,0 +1,52 @@
+#define BENCHMARK_NAME "CPU/DECONV"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "args.hpp"
+#include "cpu_conv.hpp"
+#include "deconv.hpp"
+#include "init.hpp"
+#include "topology.hpp"
+
+// The CPU reference of the CUDNN/DECONV_FWD families. Each output element
+// gathers the input elements that reach it (the backward data loop of
+// cpu_conv.hpp on the transposed convolution), so no two threads write the
+// same element and no col2im buffer is needed.
+template <typename T>
+static void LAYER_CPU_DECONV_FWD_Impl(benchmark::State& state) {
+  const auto problem = deconv::problem(state);
+  if (!problem.is_valid()) {
+    state.SkipWithError(BENCHMARK_NAME " got an empty output, an output pad not smaller than the stride or a group "
+                                       "that does not divide the channels");
+    return;
+  }
+  const auto conv       = problem.as_conv();
+  // the kernel threads inherit the cpus of --host_pin
+  if (host_env_lazy_init() != 0) {
+    state.SkipWithError(BENCHMARK_NAME " failed to pin to the cpus near the device");
+    return;
+  }
+  const int num_threads = std::max<int>(1, topology::affinity().size());
+
+  auto x = std::vector<T>(problem.input_size(), T(1));
+  auto w = std::vector<T>(problem.filter_size(), T(1));
+  auto y = std::vector<T>(problem.output_size(), T(1));
+
+  for (auto _ : state) {
+    cpu_conv::backward_data(conv, w.data(), x.data(), y.data(), num_threads);
+    benchmark::ClobberMemory();
+  }
+
+  deconv::add_counters<T>(state, problem);
+  state.counters.insert({{"num_cpu_threads", num_threads}});
+  state.SetItemsProcessed(int64_t(state.iterations()) * problem.output_size());
+}
+
+static void LAYER_CPU_DECONV_FWD_FLOAT(benchmark::State& state) {
+  LAYER_CPU_DECONV_FWD_Impl<float>(state);
+}
+
+BENCHMARK(LAYER_CPU_DECONV_FWD_FLOAT)->DECONV_PROBLEMS()->UseRealTime();
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include "conv_nd_problem.hpp"
+#include "cpu_conv.hpp"
+
+// Depthwise convolutions on the CPU (group == channels, MobileNet style).
+//
+// Every output plane reads a single input plane, so instead of the generic
+// loop nest of cpu_conv.hpp the kernel accumulates whole output rows: for a
+// filter tap, an output row gets tap * (a shifted input row), a contiguous
+// axpy when the stride is 1 that the compiler vectorizes. The output planes
+// are split over the threads. Tensors are NCHW, filters K x 1 x R x S with K
+// a multiple of C (the channel multiplier), and the problems are 2-D
+// conv_nd problems (D = T = 1).
+namespace cpu_depthwise {
+
+using conv_nd::problem_t;
+
+// group == channels and every channel has the same number of filters
+static bool is_depthwise(const problem_t &p) {
+  return p.group == p.channels && p.num_filters % p.channels == 0 && p.input[0] == 1 && p.filter[0] == 1;
+}
+
+// out[ow] += tap * in[ow * stride + offset] for the ow that read inside [0, width).
+template <typename T>
+static inline void accumulate_row(T *__restrict__ out, const T *__restrict__ in, T tap, int width, int out_width,
+                                  int stride, int offset) {
+  const int begin = offset >= 0 ? 0 : (-offset + stride - 1) / stride;
+  const int end   = width - 1 - offset < 0 ? 0 : std::min(out_width, (width - 1 - offset) / stride + 1);
+  if (stride == 1) {
+    const T *__restrict__ shifted = in + offset;
+    for (int ow = begin; ow < end; ow++) {
+      out[ow] += tap * shifted[ow];
+    }
+    return;
+  }
+  for (int ow = begin; ow < end; ow++) {
+    out[ow] += tap * in[ow * stride + offset];
+  }
+}
+
+template <typename T>
+static void forward(const problem_t &p, const T *x, const T *w, T *y, int num_threads) {
+  const auto out       = p.output();
+  const int multiplier = p.num_filters / p.channels;
+  const int64_t planes = int64_t(p.batch_size) * p.num_filters;
+
+  const int H = p.input[1], W = p.input[2], P = out[1], Q = out[2], R = p.filter[1], S = p.filter[2];
+  cpu_conv::parallel_for(planes, num_threads, [&](int64_t begin, int64_t end) {
+    for (auto nk = begin; nk < end; nk++) {
+      const int n      = nk / p.num_filters;
+      const int k      = nk % p.num_filters;
+      const T *x_plane = x + (int64_t(n) * p.channels + k / multiplier) * H * W;
+      const T *w_k     = w + int64_t(k) * R * S;
+      T *y_plane       = y + nk * P * Q;
+      std::fill(y_plane, y_plane + int64_t(P) * Q, T(0));
+      for (int oh = 0; oh < P; oh++) {
+        for (int r = 0; r < R; r++) {
+          const int ih = oh * p.stride[1] - p.pad[1] + r * p.dilation[1];
+          if (ih < 0 || ih >= H) {
+            continue;
+          }
+          for (int s = 0; s < S; s++) {
+            accumulate_row(y_plane + int64_t(oh) * Q, x_plane + int64_t(ih) * W, w_k[r * S + s], W, Q, p.stride[2],
+                           s * p.dilation[2] - p.pad[2]);
+          }
+        }
+      }
+    }
+  });
+}
+
+} // namespace cpu_depthwise
@@ -0,0 +1,64 @@
+#define BENCHMARK_NAME "CPU/DEPTHWISE_CONV"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "args.hpp"
+#include "conv_nd.hpp"
+#include "cpu_conv.hpp"
+#include "cpu_depthwise.hpp"
+#include "init.hpp"
+#include "topology.hpp"
+
+// The depthwise layers on the CPU, with the row kernel of cpu_depthwise.hpp
+// and, to compare against, the generic loop nest of cpu_conv.hpp. Like the
+// CPU/CONV_ND families they run on every cpu the process may use.
+enum class kernel_t : int { generic = 0, depthwise = 1 };
+
+template <typename T, kernel_t kernel>
+static void LAYER_CPU_DEPTHWISE_CONV_Impl(benchmark::State& state) {
+  const auto problem = conv_nd::problem_2d(state);
+  if (!problem.is_valid() || !cpu_depthwise::is_depthwise(problem)) {
+    state.SkipWithError(BENCHMARK_NAME " got a problem that is not a depthwise convolution");
+    return;
+  }
+  // the kernel threads inherit the cpus of --host_pin
+  if (host_env_lazy_init() != 0) {
+    state.SkipWithError(BENCHMARK_NAME " failed to pin to the cpus near the device");
+    return;
+  }
+  const int num_threads = std::max<int>(1, topology::affinity().size());
+
+  auto x = std::vector<T>(problem.input_size(), T(1));
+  auto w = std::vector<T>(problem.filter_size(), T(1));
+  auto y = std::vector<T>(problem.output_size(), T(1));
+
+  for (auto _ : state) {
+    switch (kernel) {
+      case kernel_t::generic:
+        cpu_conv::forward(problem, x.data(), w.data(), y.data(), num_threads);
+        break;
+      case kernel_t::depthwise:
+        cpu_depthwise::forward(problem, x.data(), w.data(), y.data(), num_threads);
+        break;
+    }
+    benchmark::ClobberMemory();
+  }
+
+  conv_nd::add_counters<T>(state, problem);
+  state.counters.insert({{"num_cpu_threads", num_threads}, {"cpu_kernel", (int) kernel}});
+  state.SetItemsProcessed(int64_t(state.iterations()) * problem.output_size());
+}
+
+static void LAYER_CPU_DEPTHWISE_CONV_FWD_FLOAT(benchmark::State& state) {
+  LAYER_CPU_DEPTHWISE_CONV_Impl<float, kernel_t::depthwise>(state);
+}
+
+static void LAYER_CPU_DEPTHWISE_CONV_FWD_GENERIC_FLOAT(benchmark::State& state) {
+  LAYER_CPU_DEPTHWISE_CONV_Impl<float, kernel_t::generic>(state);
+}
+
+BENCHMARK(LAYER_CPU_DEPTHWISE_CONV_FWD_FLOAT)->DEPTHWISE_CONV_PROBLEMS()->UseRealTime();
+BENCHMARK(LAYER_CPU_DEPTHWISE_CONV_FWD_GENERIC_FLOAT)->DEPTHWISE_CONV_PROBLEMS()->UseRealTime();
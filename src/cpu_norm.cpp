@@ -0,0 +1,92 @@
+#define BENCHMARK_NAME "CPU/NORM"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "args.hpp"
+#include "cpu_norm.hpp"
+#include "init.hpp"
+#include "norm.hpp"
+#include "topology.hpp"
+
+// The CPU counterparts of the CUDNN/NORM_FWD and CUDNN/NORM_BWD families: two
+// sweeps over every row instead of the batchnorm, op tensor and reduction calls
+// cudnn 7 needs (see cpu_norm.hpp).
+template <typename T, norm::kind_t kind, bool is_backward>
+static void LAYER_CPU_NORM_Impl(benchmark::State& state) {
+  const auto problem = norm::problem(state, kind);
+  if (!problem.is_valid()) {
+    state.SkipWithError(BENCHMARK_NAME " got an empty tensor, a begin axis outside of 1..3 or a group count that does "
+                                       "not divide the channels");
+    return;
+  }
+  // the kernel threads inherit the cpus of --host_pin
+  if (host_env_lazy_init() != 0) {
+    state.SkipWithError(BENCHMARK_NAME " failed to pin to the cpus near the device");
+    return;
+  }
+  const int num_threads = std::max<int>(1, topology::affinity().size());
+
+  auto x       = std::vector<T>(problem.size(), T(1));
+  auto y       = std::vector<T>(problem.size(), T(1));
+  auto dy      = std::vector<T>(problem.size(), T(1));
+  auto dx      = std::vector<T>(problem.size());
+  auto gamma   = std::vector<T>(problem.param_size(), T(1));
+  auto beta    = std::vector<T>(problem.param_size(), T(1));
+  auto dgamma  = std::vector<T>(problem.param_size());
+  auto dbeta   = std::vector<T>(problem.param_size());
+  auto mean    = std::vector<T>(problem.num_rows());
+  auto inv_std = std::vector<T>(problem.num_rows());
+
+  // the backward pass starts from the statistics the forward pass saved
+  cpu_norm::forward(problem, x.data(), gamma.data(), beta.data(), y.data(), mean.data(), inv_std.data(),
+                    num_threads);
+
+  for (auto _ : state) {
+    if (is_backward) {
+      cpu_norm::backward(problem, x.data(), dy.data(), gamma.data(), mean.data(), inv_std.data(), dx.data(),
+                         dgamma.data(), dbeta.data(), num_threads);
+    } else {
+      cpu_norm::forward(problem, x.data(), gamma.data(), beta.data(), y.data(), mean.data(), inv_std.data(),
+                        num_threads);
+    }
+    benchmark::ClobberMemory();
+  }
+
+  norm::add_counters<T>(state, problem, is_backward);
+  state.counters.insert({{"num_cpu_threads", num_threads}});
+  state.SetItemsProcessed(int64_t(state.iterations()) * problem.size());
+}
+
+static void LAYER_CPU_LAYERNORM_FWD_FLOAT(benchmark::State& state) {
+  LAYER_CPU_NORM_Impl<float, norm::kind_t::layer, false>(state);
+}
+
+static void LAYER_CPU_LAYERNORM_BWD_FLOAT(benchmark::State& state) {
+  LAYER_CPU_NORM_Impl<float, norm::kind_t::layer, true>(state);
+}
+
+static void LAYER_CPU_GROUPNORM_FWD_FLOAT(benchmark::State& state) {
+  LAYER_CPU_NORM_Impl<float, norm::kind_t::group, false>(state);
+}
+
+static void LAYER_CPU_GROUPNORM_BWD_FLOAT(benchmark::State& state) {
+  LAYER_CPU_NORM_Impl<float, norm::kind_t::group, true>(state);
+}
+
+static void LAYER_CPU_INSTANCENORM_FWD_FLOAT(benchmark::State& state) {
+  LAYER_CPU_NORM_Impl<float, norm::kind_t::instance, false>(state);
+}
+
+static void LAYER_CPU_INSTANCENORM_BWD_FLOAT(benchmark::State& state) {
+  LAYER_CPU_NORM_Impl<float, norm::kind_t::instance, true>(state);
+}
+
+BENCHMARK(LAYER_CPU_LAYERNORM_FWD_FLOAT)->LAYERNORM_PROBLEMS()->UseRealTime();
+BENCHMARK(LAYER_CPU_LAYERNORM_BWD_FLOAT)->LAYERNORM_PROBLEMS()->UseRealTime();
+BENCHMARK(LAYER_CPU_GROUPNORM_FWD_FLOAT)->GROUPNORM_PROBLEMS()->UseRealTime();
+BENCHMARK(LAYER_CPU_GROUPNORM_BWD_FLOAT)->GROUPNORM_PROBLEMS()->UseRealTime();
+BENCHMARK(LAYER_CPU_INSTANCENORM_FWD_FLOAT)->INSTANCENORM_PROBLEMS()->UseRealTime();
+BENCHMARK(LAYER_CPU_INSTANCENORM_BWD_FLOAT)->INSTANCENORM_PROBLEMS()->UseRealTime();
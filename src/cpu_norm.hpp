@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "cpu_conv.hpp"
+#include "norm.hpp"
+
+// Layer, group and instance normalization on the CPU.
+//
+// The rows of norm.hpp are split over the threads, and every row is swept
+// twice. The forward pass sums x and x^2 over a row for its mean and variance
+// (in double, so summing the squares does not lose the variance to
+// cancellation), then sweeps it again to write the normalized, scaled and
+// shifted output. The backward pass sweeps x and dy for the two row sums of
+// the input gradient and the scale and shift gradients, then sweeps them again
+// to write dx. mean and inv_std hold a value per row.
+namespace cpu_norm {
+
+using norm::kind_t;
+using norm::problem_t;
+
+template <typename T>
+static void forward(const problem_t &p, const T *x, const T *gamma, const T *beta, T *y, T *mean, T *inv_std,
+                    int num_threads) {
+  const auto row_size = p.row_size();
+  const auto run      = int64_t(p.height) * p.width;
+  cpu_conv::parallel_for(p.num_rows(), num_threads, [&](int64_t begin, int64_t end) {
+    for (auto row = begin; row < end; row++) {
+      const T *x_row = x + row * row_size;
+      T *y_row       = y + row * row_size;
+      double sum     = 0, sum_sq = 0;
+      for (int64_t ii = 0; ii < row_size; ii++) {
+        sum += x_row[ii];
+        sum_sq += double(x_row[ii]) * x_row[ii];
+      }
+      const auto m = sum / row_size;
+      const auto r = 1 / std::sqrt(std::max(sum_sq / row_size - m * m, 0.0) + p.epsilon);
+      mean[row]    = static_cast<T>(m);
+      inv_std[row] = static_cast<T>(r);
+      if (p.kind == kind_t::layer) {
+        for (int64_t ii = 0; ii < row_size; ii++) {
+          y_row[ii] = static_cast<T>((x_row[ii] - m) * r) * gamma[ii] + beta[ii];
+        }
+        continue;
+      }
+      // a scale and a shift per channel
+      const auto channel = p.first_channel(row);
+      for (int64_t cc = 0; cc < row_size / run; cc++) {
+        const auto scale = static_cast<T>(r * gamma[channel + cc]);
+        const auto shift = static_cast<T>(beta[channel + cc] - m * scale);
+        for (int64_t ii = cc * run; ii < (cc + 1) * run; ii++) {
+          y_row[ii] = x_row[ii] * scale + shift;
+        }
+      }
+    }
+  });
+}
+
+template <typename T>
+static void backward(const problem_t &p, const T *x, const T *dy, const T *gamma, const T *mean, const T *inv_std,
+                     T *dx, T *dgamma, T *dbeta, int num_threads) {
+  const auto row_size = p.row_size();
+  const auto run      = p.kind == kind_t::layer ? int64_t(1) : int64_t(p.height) * p.width;
+  std::fill(dgamma, dgamma + p.param_size(), T(0));
+  std::fill(dbeta, dbeta + p.param_size(), T(0));
+  std::mutex params_mutex;
+  cpu_conv::parallel_for(p.num_rows(), num_threads, [&](int64_t begin, int64_t end) {
+    // the scale and shift gradients of this thread's rows
+    std::vector<double> local_dgamma(p.param_size()), local_dbeta(p.param_size());
+    for (auto row = begin; row < end; row++) {
+      const T *x_row  = x + row * row_size;
+      const T *dy_row = dy + row * row_size;
+      T *dx_row       = dx + row * row_size;
+
+      const double m   = mean[row], r = inv_std[row];
+      const auto first = p.kind == kind_t::layer ? 0 : p.first_channel(row);
+      // g = dy * gamma, the gradient of the normalized input; a scale per
+      // run of elements (one for layer norm, H * W for the others)
+      double sum_g = 0, sum_g_x_hat = 0;
+      for (int64_t cc = 0; cc < row_size / run; cc++) {
+        const double scale  = gamma[first + cc];
+        double sum_dy_x_hat = 0, sum_dy = 0;
+        for (int64_t ii = cc * run; ii < (cc + 1) * run; ii++) {
+          const auto x_hat = (x_row[ii] - m) * r;
+          sum_dy_x_hat += dy_row[ii] * x_hat;
+          sum_dy += dy_row[ii];
+        }
+        sum_g += scale * sum_dy;
+        sum_g_x_hat += scale * sum_dy_x_hat;
+        local_dgamma[first + cc] += sum_dy_x_hat;
+        local_dbeta[first + cc] += sum_dy;
+      }
+      const auto mean_g = sum_g / row_size, mean_g_x_hat = sum_g_x_hat / row_size;
+      for (int64_t cc = 0; cc < row_size / run; cc++) {
+        const double scale = gamma[first + cc];
+        for (int64_t ii = cc * run; ii < (cc + 1) * run; ii++) {
+          const auto x_hat = (x_row[ii] - m) * r;
+          dx_row[ii]       = static_cast<T>(r * (dy_row[ii] * scale - mean_g - x_hat * mean_g_x_hat));
+        }
+      }
+    }
+    std::lock_guard<std::mutex> lock(params_mutex);
+    for (int64_t ii = 0; ii < p.param_size(); ii++) {
+      dgamma[ii] += static_cast<T>(local_dgamma[ii]);
+      dbeta[ii] += static_cast<T>(local_dbeta[ii]);
+    }
+  });
+}
+
+} // namespace cpu_norm
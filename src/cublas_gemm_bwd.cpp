@@ -38,6 +38,11 @@ static void iLAYER_CUBLAS_GEMM_BWD_Impl(benchmark::State& state) {
     return;
   }
 
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
   // n, c, h, w
   const auto M                   = state.range(0);
   const auto N                   = state.range(1);
@@ -126,7 +131,7 @@ static void iLAYER_CUBLAS_GEMM_BWD_Impl(benchmark::State& state) {
 
   cublasStatus_t cublas_err;
   BENCHMARK_BLOCK(cublas_err, {
-    cublas_err = cublasSgemm(cublas_handle, transA, transB, M, N, K, reinterpret_cast<T*>(&alpha), d_a, lda, d_b, ldb,
+    cublas_err = cublasSgemm(handles.cublas, transA, transB, M, N, K, reinterpret_cast<T*>(&alpha), d_a, lda, d_b, ldb,
                              reinterpret_cast<T*>(&beta), d_c, M);
   });
 
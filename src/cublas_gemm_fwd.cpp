@@ -36,6 +36,11 @@ static void iLAYER_CUBLAS_GEMM_FWD_Impl(benchmark::State& state) {
     return;
   }
 
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
   // n, c, h, w
   const auto M                   = state.range(0);
   const auto N                   = state.range(1);
@@ -72,13 +77,13 @@ static void iLAYER_CUBLAS_GEMM_FWD_Impl(benchmark::State& state) {
   std::fill(c.begin(), c.end(), zero);
 
   if constexpr (is_half_v<T>) {
-    if (PRINT_IF_ERROR(cublasSetMathMode(cublas_handle, CUBLAS_TENSOR_OP_MATH))) {
+    if (PRINT_IF_ERROR(cublasSetMathMode(handles.cublas, CUBLAS_TENSOR_OP_MATH))) {
       LOG(critical, "CUBLAS/{} failed to sett math mode to default", IMPLEMENTATION_NAME);
       state.SkipWithError(fmt::format("CUBLAS/{} failed to set math mode to defaultt", IMPLEMENTATION_NAME).c_str());
       return;
     }
   } else {
-    if (PRINT_IF_ERROR(cublasSetMathMode(cublas_handle, CUBLAS_DEFAULT_MATH))) {
+    if (PRINT_IF_ERROR(cublasSetMathMode(handles.cublas, CUBLAS_DEFAULT_MATH))) {
       LOG(critical, "CUBLAS/{} failed to sett math mode to default", IMPLEMENTATION_NAME);
       state.SkipWithError(fmt::format("CUBLAS/{} failed to set math mode to defaultt", IMPLEMENTATION_NAME).c_str());
       return;
@@ -132,13 +137,13 @@ static void iLAYER_CUBLAS_GEMM_FWD_Impl(benchmark::State& state) {
   cublasStatus_t cublas_err;
   if constexpr (is_half_v<T>) {
     BENCHMARK_BLOCK(cublas_err, {
-      cublas_err = cublasGemmEx(cublas_handle, CUBLAS_OP_N, CUBLAS_OP_N, M, N, K, &alpha, d_a, CUDA_R_16F, M, d_b,
+      cublas_err = cublasGemmEx(handles.cublas, CUBLAS_OP_N, CUBLAS_OP_N, M, N, K, &alpha, d_a, CUDA_R_16F, M, d_b,
                                 CUDA_R_16F, K, &beta, d_c, CUDA_R_16F, M, CUDA_R_16F, CUBLAS_GEMM_DEFAULT_TENSOR_OP);
     });
   } else {
     BENCHMARK_BLOCK(cublas_err, {
-      cublas_err = cublasSgemm(cublas_handle, transA, transB, M, N, K, reinterpret_cast<T*>(&alpha), d_a, lda, d_b, ldb,
-                               reinterpret_cast<T*>(&beta), d_c, M);
+      cublas_err = cublasSgemm(handles.cublas, transA, transB, M, N, K, reinterpret_cast<T*>(&alpha), d_a, lda, d_b,
+                               ldb, reinterpret_cast<T*>(&beta), d_c, M);
     });
   }
 
@@ -36,6 +36,11 @@ static void iLAYER_CUBLAS_GEMV_FWD_Impl(benchmark::State& state) {
     return;
   }
 
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
   const auto M             = state.range(0);
   const auto K             = state.range(1);
   cublasOperation_t transA = state.range(2) == 0 ? CUBLAS_OP_N : CUBLAS_OP_T;
@@ -115,7 +120,7 @@ static void iLAYER_CUBLAS_GEMV_FWD_Impl(benchmark::State& state) {
 
   cublasStatus_t cublas_err;
   BENCHMARK_BLOCK(cublas_err, {
-    cublas_err = cublasSgemv(cublas_handle, transA, M, K, reinterpret_cast<T*>(&alpha), d_a, lda, d_b, incx,
+    cublas_err = cublasSgemv(handles.cublas, transA, M, K, reinterpret_cast<T*>(&alpha), d_a, lda, d_b, incx,
                              reinterpret_cast<T*>(&beta), d_c, incy);
   });
 
@@ -143,13 +148,21 @@ static void LAYER_CUBLAS_GEMV_FWD_Impl(benchmark::State& state) {
 
 template <>
 void iLAYER_CUBLAS_GEMV_FWD_Impl<__half>(benchmark::State& state) {
-  cublasSetMathMode(cublas_handle, CUBLAS_TENSOR_OP_MATH);
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+  cublasSetMathMode(handles.cublas, CUBLAS_TENSOR_OP_MATH);
   return iLAYER_CUBLAS_GEMV_FWD_Impl<float>(state); // there is no half precision
 }
 
 template <>
 void iLAYER_CUBLAS_GEMV_FWD_Impl<int8_t>(benchmark::State& state) {
-  cublasSetMathMode(cublas_handle, CUBLAS_TENSOR_OP_MATH);
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+  cublasSetMathMode(handles.cublas, CUBLAS_TENSOR_OP_MATH);
   return iLAYER_CUBLAS_GEMV_FWD_Impl<float>(state); // there is no half precision
 }
 
@@ -27,6 +27,11 @@ static void LAYER_CUDNN_ACTIVATION_BWD_Impl(benchmark::State& state) {
     return;
   }
 
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
   // n, c, h, w
   const auto in_n = state.range(0);
   const auto in_c = state.range(1);
@@ -92,7 +97,7 @@ static void LAYER_CUDNN_ACTIVATION_BWD_Impl(benchmark::State& state) {
 
   cudnnStatus_t cudnn_err;
   BENCHMARK_BLOCK(cudnn_err, {
-    cudnn_err = cudnnActivationBackward(cudnn_handle,
+    cudnn_err = cudnnActivationBackward(handles.cudnn,
                                         activation_descriptor,
                                         &alpha,
                                         x_descriptor,
@@ -27,6 +27,11 @@ static void iLAYER_CUDNN_ACTIVATION_FWD_Impl(benchmark::State& state) {
     return;
   }
 
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
   // n, c, h, w
   const auto in_n = state.range(0);
   const auto in_c = state.range(1);
@@ -81,7 +86,7 @@ static void iLAYER_CUDNN_ACTIVATION_FWD_Impl(benchmark::State& state) {
   cudnnStatus_t cudnn_err;
   BENCHMARK_BLOCK(cudnn_err, {
     cudnn_err = cudnnActivationForward(
-        cudnn_handle, activation_descriptor, &alpha, x_descriptor, d_x, &beta, x_descriptor, d_y);
+        handles.cudnn, activation_descriptor, &alpha, x_descriptor, d_x, &beta, x_descriptor, d_y);
   });
 
   state.counters.insert({{"input_size", in_n * in_c * in_h * in_w},
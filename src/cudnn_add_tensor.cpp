@@ -26,6 +26,11 @@ static void iLAYER_CUDNN_ADD_TENSOR_Impl(benchmark::State& state) {
     return;
   }
 
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
   const auto out_0      = state.range(0);
   const auto out_1      = state.range(1);
   const auto out_2      = state.range(2);
@@ -80,7 +85,7 @@ static void iLAYER_CUDNN_ADD_TENSOR_Impl(benchmark::State& state) {
 
   cudnnStatus_t cudnn_err;
   BENCHMARK_BLOCK(cudnn_err, {
-    cudnn_err = cudnnAddTensor(cudnn_handle, &alpha, input_descriptor, d_input, &beta, output_descriptor, d_output);
+    cudnn_err = cudnnAddTensor(handles.cudnn, &alpha, input_descriptor, d_input, &beta, output_descriptor, d_output);
   });
 
   state.counters.insert({{"a_desc_0", bias_0},
@@ -27,6 +27,11 @@ static void iLAYER_CUDNN_BATCHNORM_BWD_Impl(benchmark::State& state) {
     return;
   }
 
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
   // n, c, h, w
   const auto in_n = state.range(0);
   const auto in_c = state.range(1);
@@ -124,8 +129,8 @@ static void iLAYER_CUDNN_BATCHNORM_BWD_Impl(benchmark::State& state) {
   cudnnStatus_t cudnn_err;
   BENCHMARK_BLOCK(cudnn_err, {
     cudnn_err = cudnnBatchNormalizationBackward(
-        cudnn_handle, batchnorm_mode, &alpha, &beta, &alpha, &beta, x_descriptor, d_x, x_descriptor, d_dy, x_descriptor,
-        d_dx, scale_bias_descriptor, d_scale, d_dscale, d_dbias, epsilon, d_saved_mean, d_saved_in_var);
+        handles.cudnn, batchnorm_mode, &alpha, &beta, &alpha, &beta, x_descriptor, d_x, x_descriptor, d_dy,
+        x_descriptor, d_dx, scale_bias_descriptor, d_scale, d_dscale, d_dbias, epsilon, d_saved_mean, d_saved_in_var);
   });
 
   state.counters.insert({{"input_size", in_n * in_c * in_h * in_w},
@@ -28,6 +28,11 @@ static void iLAYER_CUDNN_BATCHNORM_FWD_Impl(benchmark::State& state) {
     return;
   }
 
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
   // n, c, h, w
   const auto in_n = state.range(0);
   const auto in_c = state.range(1);
@@ -139,7 +144,7 @@ static void iLAYER_CUDNN_BATCHNORM_FWD_Impl(benchmark::State& state) {
 
   BENCHMARK_BLOCK(cudnn_err, {
     if (is_training) {
-      cudnn_err = cudnnBatchNormalizationForwardTraining(cudnn_handle,
+      cudnn_err = cudnnBatchNormalizationForwardTraining(handles.cudnn,
                                                          batchnorm_mode,
                                                          &alpha,
                                                          &beta,
@@ -157,7 +162,7 @@ static void iLAYER_CUDNN_BATCHNORM_FWD_Impl(benchmark::State& state) {
                                                          d_saved_mean,
                                                          d_saved_in_var);
     } else {
-      cudnn_err = cudnnBatchNormalizationForwardInference(cudnn_handle,
+      cudnn_err = cudnnBatchNormalizationForwardInference(handles.cudnn,
                                                           batchnorm_mode,
                                                           &alpha,
                                                           &beta,
@@ -25,6 +25,11 @@ static void LAYER_CUDNN_CONV_BWD_BIAS_Impl(benchmark::State& state) {
     state.SkipWithError(BENCHMARK_NAME " no CUDA device found");
     return;
   }
+
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
   MEM_ALIGNED_128 const T alpha = detail::one<T>();
   MEM_ALIGNED_128 const T beta  = detail::zero<T>();
 
@@ -86,7 +91,7 @@ static void LAYER_CUDNN_CONV_BWD_BIAS_Impl(benchmark::State& state) {
 
   cudnnStatus_t cudnn_err;
   BENCHMARK_BLOCK(cudnn_err, {
-    cudnn_err = cudnnConvolutionBackwardBias(cudnn_handle, &alpha, dy_descriptor, d_dy, &beta, db_descriptor, d_db);
+    cudnn_err = cudnnConvolutionBackwardBias(handles.cudnn, &alpha, dy_descriptor, d_dy, &beta, db_descriptor, d_db);
   });
 
   state.counters.insert({{"input_size", batch_size * channels * height * width},
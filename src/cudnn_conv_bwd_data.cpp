@@ -13,10 +13,12 @@
 #include <cudnn.h>
 
 #include "args.hpp"
+#include "conv_group.hpp"
 #include "error.hpp"
 #include "helper.hpp"
 #include "init.hpp"
 #include "utils.hpp"
+#include "warm_cache.hpp"
 
 // http://www.goldsborough.me/cuda/ml/cudnn/c++/2017/10/01/14-37-23-convolutions_with_cudnn/
 // https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnConvolutionBwdDataAlgo_t
@@ -32,6 +34,11 @@ static void iLAYER_CUDNN_CONV_BWD_DATA_Impl(benchmark::State& state) {
     state.SkipWithError(BENCHMARK_NAME " no CUDA device found");
     return;
   }
+
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
 #ifdef CUDNN_SUPPORTS_TENSOR_OPS
   if (math_type == CUDNN_TENSOR_OP_MATH && !detail::SupportsTensorCore(cuda_device_id)) {
     state.SkipWithError(BENCHMARK_NAME "no Tensorcore support on current device");
@@ -106,7 +113,8 @@ static void iLAYER_CUDNN_CONV_BWD_DATA_Impl(benchmark::State& state) {
                                                   {/*out_channels=*/num_filters,
                                                    /*in_channels=*/channels,
                                                    /*kernel_height=*/filter_height,
-                                                   /*kernel_width=*/filter_width});
+                                                   /*kernel_width=*/filter_width},
+                                                  group);
   if (!w_filter.is_valid) {
     return;
   }
@@ -134,7 +142,7 @@ static void iLAYER_CUDNN_CONV_BWD_DATA_Impl(benchmark::State& state) {
 
   MEM_ALIGNED_128 cudnnConvolutionBwdDataAlgo_t advised_convolution_algorithm = (cudnnConvolutionBwdDataAlgo_t) -1;
   if (IS_ERROR(cudnnGetConvolutionBackwardDataAlgorithm(
-          cudnn_handle, w_descriptor, dy_descriptor, convolution_descriptor, dx_descriptor,
+          handles.cudnn, w_descriptor, dy_descriptor, convolution_descriptor, dx_descriptor,
           CUDNN_CONVOLUTION_BWD_DATA_PREFER_FASTEST, 0, &advised_convolution_algorithm))) {
     advised_convolution_algorithm = (cudnnConvolutionBwdDataAlgo_t) -1;
   }
@@ -145,7 +153,7 @@ static void iLAYER_CUDNN_CONV_BWD_DATA_Impl(benchmark::State& state) {
     // Note: cudnn workspace size function doesn't work for INT8_CONFIG
     workspace_bytes = 1073741824;
   } else {
-    if (PRINT_IF_ERROR(cudnnGetConvolutionBackwardDataWorkspaceSize(cudnn_handle,
+    if (PRINT_IF_ERROR(cudnnGetConvolutionBackwardDataWorkspaceSize(handles.cudnn,
                                                                     w_descriptor,
                                                                     dy_descriptor,
                                                                     convolution_descriptor,
@@ -170,7 +178,7 @@ static void iLAYER_CUDNN_CONV_BWD_DATA_Impl(benchmark::State& state) {
   auto output             = std::vector<T>(output_bytes / sizeof(T));
   std::fill(output.begin(), output.end(), detail::one<T>());
 
-  MEM_ALIGNED_128 DeviceMemory<T> workspace_memory(state, workspace_bytes);
+  MEM_ALIGNED_128 warm_cache::Workspace<T> workspace_memory(state, workspace_bytes);
   if (!workspace_memory.is_valid) {
     return;
   }
@@ -196,7 +204,7 @@ static void iLAYER_CUDNN_CONV_BWD_DATA_Impl(benchmark::State& state) {
 
   cudnnStatus_t cudnn_err;
   BENCHMARK_BLOCK(cudnn_err, {
-    cudnn_err = cudnnConvolutionBackwardData(cudnn_handle, &alpha, w_descriptor, d_w, dy_descriptor, d_dy,
+    cudnn_err = cudnnConvolutionBackwardData(handles.cudnn, &alpha, w_descriptor, d_w, dy_descriptor, d_dy,
                                              convolution_descriptor, convolution_algorithm, d_workspace,
                                              workspace_bytes, &beta, dx_descriptor, d_dx);
   });
@@ -232,6 +240,8 @@ static void iLAYER_CUDNN_CONV_BWD_DATA_Impl(benchmark::State& state) {
   const auto N = batch_size, K = num_filters, C = channels, H = height, W = width, R = filter_height, S = filter_width;
   const auto P = out_h, Q = out_w;
 
+  conv_group::add_counters<T>(state, {N, C, K, group, R * S, H * W, int64_t(P) * Q});
+
   const auto compute_flops = [&](cudnnConvolutionBwdDataAlgo_t alg) {
     switch (alg) {
       case CUDNN_CONVOLUTION_BWD_DATA_ALGO_0:
@@ -271,22 +281,38 @@ static void iLAYER_CUDNN_CONV_BWD_DATA_Impl(benchmark::State& state) {
   }
 
   static const int max_count = 10;
-  /* cudnn_err = cudnnGetConvolutionBackwardDataAlgorithmMaxCount(cudnn_handle, &max_count); */
+  /* cudnn_err = cudnnGetConvolutionBackwardDataAlgorithmMaxCount(handles.cudnn, &max_count); */
   /* if (PRINT_IF_ERROR(cudnn_err)) { */
   /*   state.SkipWithError(BENCHMARK_NAME " failed to perform cudnnGetConvolutionBackwardDataAlgorithmMaxCount"); */
   /* } */
 
-  cudnnConvolutionBwdDataAlgoPerf_t perfResults[max_count];
-  int returned_count;
-  cudnn_err =
-      cudnnFindConvolutionBackwardDataAlgorithm(cudnn_handle, w_descriptor, dy_descriptor, convolution_descriptor,
-                                                dx_descriptor, max_count, &returned_count, perfResults);
-  if (PRINT_IF_ERROR(cudnn_err)) {
-    state.SkipWithError(BENCHMARK_NAME " failed to perform cudnnFindConvolutionBackwardDataAlgorithm");
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+  const int find_math_type = math_type;
+#else  // CUDNN_SUPPORTS_TENSOR_OPS
+  const int find_math_type = 0;
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+  // the daemon keeps the results of a layer (see warm_cache.hpp)
+  auto& find_results  = warm_cache::find_results<cudnnConvolutionBwdDataAlgoPerf_t>();
+  const auto find_key = warm_cache::layer_key(BENCHMARK_NAME, state, 14, (int) valueDataType<T>::type, find_math_type);
+  std::vector<cudnnConvolutionBwdDataAlgoPerf_t> perfResults;
+  if (!find_results.find(find_key, perfResults)) {
+    int returned_count = 0;
+    perfResults.resize(max_count);
+    annotate::range find_range("find");
+    cudnn_err =
+        cudnnFindConvolutionBackwardDataAlgorithm(handles.cudnn, w_descriptor, dy_descriptor, convolution_descriptor,
+                                                  dx_descriptor, max_count, &returned_count, perfResults.data());
+    find_range.end();
+    if (PRINT_IF_ERROR(cudnn_err)) {
+      state.SkipWithError(BENCHMARK_NAME " failed to perform cudnnFindConvolutionBackwardDataAlgorithm");
+      perfResults.clear();
+    } else {
+      perfResults.resize(returned_count);
+      find_results.insert(find_key, perfResults);
+    }
   }
 
-  for (auto ii = 0; ii < returned_count; ii++) {
-    cudnnConvolutionBwdDataAlgoPerf_t perfResult = perfResults[ii];
+  for (const auto& perfResult : perfResults) {
     if (perfResult.algo == convolution_algorithm) {
       state.counters.insert({{"advised_time", perfResult.time},
                              {"advised_memory", perfResult.memory},
@@ -390,4 +416,15 @@ BENCHMARK_LAYER(LAYER_CUDNN_CONV_BWD_DATA_HALF_TENSOROP);
 BENCHMARK_LAYER(LAYER_CUDNN_CONV_BWD_DATA_FLOAT);
 // BENCHMARK_LAYER(LAYER_CUDNN_CONV_BWD_DATA_DOUBLE);
 
+// the depthwise layers of mobilenet-v2 (group == C), with the algorithms that support grouped convolutions
+#define BENCHMARK_DEPTHWISE_LAYER(b)                                                                                   \
+  BENCHMARK_CUDNN_TEMPLATE(b, CUDNN_CONVOLUTION_BWD_DATA_ALGO_0)->DEPTHWISE_CONV_PROBLEMS()->UseManualTime();          \
+  BENCHMARK_CUDNN_TEMPLATE(b, CUDNN_CONVOLUTION_BWD_DATA_ALGO_1)->DEPTHWISE_CONV_PROBLEMS()->UseManualTime()
+
+BENCHMARK_DEPTHWISE_LAYER(LAYER_CUDNN_CONV_BWD_DATA_HALF);
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+BENCHMARK_DEPTHWISE_LAYER(LAYER_CUDNN_CONV_BWD_DATA_HALF_TENSOROP);
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+BENCHMARK_DEPTHWISE_LAYER(LAYER_CUDNN_CONV_BWD_DATA_FLOAT);
+
 #endif // GENERATED_BENCHMARK_LAYER
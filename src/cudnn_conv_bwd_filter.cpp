@@ -13,10 +13,12 @@
 #include <cudnn.h>
 
 #include "args.hpp"
+#include "conv_group.hpp"
 #include "error.hpp"
 #include "helper.hpp"
 #include "init.hpp"
 #include "utils.hpp"
+#include "warm_cache.hpp"
 
 // http://www.goldsborough.me/cuda/ml/cudnn/c++/2017/10/01/14-37-23-convolutions_with_cudnn/
 // https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnConvolutionBwdFilterAlgo_t
@@ -32,6 +34,11 @@ static void iLAYER_CUDNN_CONV_BWD_FILTER_Impl(benchmark::State& state) {
     state.SkipWithError(BENCHMARK_NAME " no CUDA device found");
     return;
   }
+
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
 #ifdef CUDNN_SUPPORTS_TENSOR_OPS
   int math_type = math_type0;
   if ((is_half_v<T> || math_type == CUDNN_TENSOR_OP_MATH) && !detail::SupportsTensorCore(cuda_device_id)) {
@@ -111,7 +118,8 @@ static void iLAYER_CUDNN_CONV_BWD_FILTER_Impl(benchmark::State& state) {
                                                    {/*out_channels=*/num_filters,
                                                     /*in_channels=*/channels,
                                                     /*kernel_height=*/filter_height,
-                                                    /*kernel_width=*/filter_width});
+                                                    /*kernel_width=*/filter_width},
+                                                   group);
   if (!dw_filter.is_valid) {
     return;
   }
@@ -138,7 +146,7 @@ static void iLAYER_CUDNN_CONV_BWD_FILTER_Impl(benchmark::State& state) {
 
   MEM_ALIGNED_128 cudnnConvolutionBwdFilterAlgo_t advised_convolution_algorithm = (cudnnConvolutionBwdFilterAlgo_t) -1;
   if (IS_ERROR(cudnnGetConvolutionBackwardFilterAlgorithm(
-          cudnn_handle, x_descriptor, dy_descriptor, convolution_descriptor, dw_descriptor,
+          handles.cudnn, x_descriptor, dy_descriptor, convolution_descriptor, dw_descriptor,
           CUDNN_CONVOLUTION_BWD_FILTER_PREFER_FASTEST, 0, &advised_convolution_algorithm))) {
     advised_convolution_algorithm = (cudnnConvolutionBwdFilterAlgo_t) -1;
   }
@@ -149,7 +157,7 @@ static void iLAYER_CUDNN_CONV_BWD_FILTER_Impl(benchmark::State& state) {
     // Note: cudnn workspace size function doesn't work for INT8_CONFIG
     workspace_bytes = 1073741824;
   } else {
-    if (PRINT_IF_ERROR(cudnnGetConvolutionBackwardFilterWorkspaceSize(cudnn_handle,
+    if (PRINT_IF_ERROR(cudnnGetConvolutionBackwardFilterWorkspaceSize(handles.cudnn,
                                                                       x_descriptor,
                                                                       dy_descriptor,
                                                                       convolution_descriptor,
@@ -174,7 +182,7 @@ static void iLAYER_CUDNN_CONV_BWD_FILTER_Impl(benchmark::State& state) {
   auto output             = std::vector<T>(output_bytes / sizeof(T));
   std::fill(output.begin(), output.end(), detail::one<T>());
 
-  MEM_ALIGNED_128 DeviceMemory<T> workspace_memory(state, workspace_bytes);
+  MEM_ALIGNED_128 warm_cache::Workspace<T> workspace_memory(state, workspace_bytes);
   if (!workspace_memory.is_valid) {
     return;
   }
@@ -200,7 +208,7 @@ static void iLAYER_CUDNN_CONV_BWD_FILTER_Impl(benchmark::State& state) {
 
   cudnnStatus_t cudnn_err;
   BENCHMARK_BLOCK(cudnn_err, {
-    cudnn_err = cudnnConvolutionBackwardFilter(cudnn_handle, &alpha, x_descriptor, d_x, dy_descriptor, d_dy,
+    cudnn_err = cudnnConvolutionBackwardFilter(handles.cudnn, &alpha, x_descriptor, d_x, dy_descriptor, d_dy,
                                                convolution_descriptor, convolution_algorithm, d_workspace,
                                                workspace_bytes, &beta, dw_descriptor, d_dw);
   });
@@ -236,6 +244,8 @@ static void iLAYER_CUDNN_CONV_BWD_FILTER_Impl(benchmark::State& state) {
   const auto N = batch_size, K = num_filters, C = channels, H = height, W = width, R = filter_height, S = filter_width;
   const auto P = out_h, Q = out_w;
 
+  conv_group::add_counters<T>(state, {N, C, K, group, R * S, H * W, int64_t(P) * Q});
+
   const auto compute_flops = [&](cudnnConvolutionBwdFilterAlgo_t alg) {
     switch (alg) {
       case CUDNN_CONVOLUTION_BWD_FILTER_ALGO_0:
@@ -276,22 +286,33 @@ static void iLAYER_CUDNN_CONV_BWD_FILTER_Impl(benchmark::State& state) {
   }
 
   static const int max_count = 10;
-  /* cudnn_err = cudnnGetConvolutionBackwardFilterAlgorithmMaxCount(cudnn_handle, &max_count); */
+  /* cudnn_err = cudnnGetConvolutionBackwardFilterAlgorithmMaxCount(handles.cudnn, &max_count); */
   /* if (PRINT_IF_ERROR(cudnn_err)) { */
   /*   state.SkipWithError(BENCHMARK_NAME " failed to perform cudnnGetConvolutionBackwardFilterAlgorithmMaxCount"); */
   /* } */
 
-  cudnnConvolutionBwdFilterAlgoPerf_t perfResults[max_count];
-  int returned_count;
-  cudnn_err =
-      cudnnFindConvolutionBackwardFilterAlgorithm(cudnn_handle, x_descriptor, dy_descriptor, convolution_descriptor,
-                                                  dw_descriptor, max_count, &returned_count, perfResults);
-  if (PRINT_IF_ERROR(cudnn_err)) {
-    state.SkipWithError(BENCHMARK_NAME " failed to perform cudnnFindConvolutionBackwardFilterAlgorithm");
+  // the daemon keeps the results of a layer (see warm_cache.hpp)
+  auto& find_results  = warm_cache::find_results<cudnnConvolutionBwdFilterAlgoPerf_t>();
+  const auto find_key = warm_cache::layer_key(BENCHMARK_NAME, state, 14, (int) valueDataType<T>::type, (int) math_type);
+  std::vector<cudnnConvolutionBwdFilterAlgoPerf_t> perfResults;
+  if (!find_results.find(find_key, perfResults)) {
+    int returned_count = 0;
+    perfResults.resize(max_count);
+    annotate::range find_range("find");
+    cudnn_err =
+        cudnnFindConvolutionBackwardFilterAlgorithm(handles.cudnn, x_descriptor, dy_descriptor, convolution_descriptor,
+                                                    dw_descriptor, max_count, &returned_count, perfResults.data());
+    find_range.end();
+    if (PRINT_IF_ERROR(cudnn_err)) {
+      state.SkipWithError(BENCHMARK_NAME " failed to perform cudnnFindConvolutionBackwardFilterAlgorithm");
+      perfResults.clear();
+    } else {
+      perfResults.resize(returned_count);
+      find_results.insert(find_key, perfResults);
+    }
   }
 
-  for (auto ii = 0; ii < returned_count; ii++) {
-    cudnnConvolutionBwdFilterAlgoPerf_t perfResult = perfResults[ii];
+  for (const auto& perfResult : perfResults) {
     if (perfResult.algo == convolution_algorithm) {
       state.counters.insert({{"advised_time", perfResult.time},
                              {"advised_memory", perfResult.memory},
@@ -395,4 +416,16 @@ BENCHMARK_LAYER(LAYER_CUDNN_CONV_BWD_FILTER_HALF_TENSOROP);
 BENCHMARK_LAYER(LAYER_CUDNN_CONV_BWD_FILTER_FLOAT);
 // BENCHMARK_LAYER(LAYER_CUDNN_CONV_BWD_FILTER_DOUBLE);
 
+// the depthwise layers of mobilenet-v2 (group == C), with the algorithms that support grouped convolutions
+#define BENCHMARK_DEPTHWISE_LAYER(b)                                                                                   \
+  BENCHMARK_CUDNN_TEMPLATE(b, CUDNN_CONVOLUTION_BWD_FILTER_ALGO_0)->DEPTHWISE_CONV_PROBLEMS()->UseManualTime();        \
+  BENCHMARK_CUDNN_TEMPLATE(b, CUDNN_CONVOLUTION_BWD_FILTER_ALGO_1)->DEPTHWISE_CONV_PROBLEMS()->UseManualTime();        \
+  BENCHMARK_CUDNN_TEMPLATE(b, CUDNN_CONVOLUTION_BWD_FILTER_ALGO_3)->DEPTHWISE_CONV_PROBLEMS()->UseManualTime()
+
+BENCHMARK_DEPTHWISE_LAYER(LAYER_CUDNN_CONV_BWD_FILTER_HALF);
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+BENCHMARK_DEPTHWISE_LAYER(LAYER_CUDNN_CONV_BWD_FILTER_HALF_TENSOROP);
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+BENCHMARK_DEPTHWISE_LAYER(LAYER_CUDNN_CONV_BWD_FILTER_FLOAT);
+
 #endif // GENERATED_BENCHMARK_LAYER
@@ -0,0 +1,145 @@
+#define BENCHMARK_NAME "CUDNN/CONV_ND_FWD"
+
+#include <benchmark/benchmark.h>
+
+#include <iostream>
+#include <numeric>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <cudnn.h>
+
+#include "args.hpp"
+#include "conv_nd.hpp"
+#include "error.hpp"
+#include "helper.hpp"
+#include "init.hpp"
+#include "utils.hpp"
+#include "warm_cache.hpp"
+
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnSetConvolutionNdDescriptor
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnConvolutionForward
+template <typename T, cudnnConvolutionFwdAlgo_t convolution_algorithm
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+          ,
+          cudnnMathType_t math_type0 = CUDNN_DEFAULT_MATH
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+          >
+static void iLAYER_CUDNN_CONV_ND_FWD_Impl(benchmark::State& state) {
+  if (!has_cuda) {
+    state.SkipWithError(BENCHMARK_NAME " no CUDA device found");
+    return;
+  }
+
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const T alpha = detail::one<T>();
+  MEM_ALIGNED_128 const T beta  = detail::zero<T>();
+
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+  conv_nd::Layer<T> layer(state, math_type0);
+#else
+  conv_nd::Layer<T> layer(state, 0);
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+  if (!layer.is_valid) {
+    return;
+  }
+  const auto& problem = layer.problem;
+
+  MEM_ALIGNED_128 cudnnConvolutionDescriptor_t convolution_descriptor = layer.convolution->get();
+  MEM_ALIGNED_128 cudnnTensorDescriptor_t x_descriptor                = layer.x_tensor->get();
+  MEM_ALIGNED_128 cudnnFilterDescriptor_t w_descriptor                = layer.w_filter->get();
+  MEM_ALIGNED_128 cudnnTensorDescriptor_t y_descriptor                = layer.y_tensor->get();
+  MEM_ALIGNED_128 const auto d_x                                      = layer.x_memory->get();
+  MEM_ALIGNED_128 const auto d_w                                      = layer.w_memory->get();
+  MEM_ALIGNED_128 const auto d_y                                      = layer.y_memory->get();
+
+  MEM_ALIGNED_128 size_t workspace_bytes = 0;
+  if (PRINT_IF_ERROR(cudnnGetConvolutionForwardWorkspaceSize(handles.cudnn, x_descriptor, w_descriptor,
+                                                             convolution_descriptor, y_descriptor,
+                                                             convolution_algorithm, &workspace_bytes))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnGetConvolutionForwardWorkspaceSize");
+    return;
+  }
+
+  MEM_ALIGNED_128 warm_cache::Workspace<T> workspace_memory(state, workspace_bytes);
+  if (!workspace_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_workspace = workspace_memory.get();
+
+  cudnnStatus_t cudnn_err;
+  BENCHMARK_BLOCK(cudnn_err, {
+    cudnn_err = cudnnConvolutionForward(handles.cudnn, &alpha, x_descriptor, d_x, w_descriptor, d_w,
+                                        convolution_descriptor, convolution_algorithm, d_workspace, workspace_bytes,
+                                        &beta, y_descriptor, d_y);
+  });
+
+  conv_nd::add_counters<T>(state, problem);
+  state.counters.insert({{"workspace_bytes", workspace_bytes},
+                         {"workspace_megabytes", workspace_bytes / 1048576.0},
+                         {"convolution_algorithm", (int) convolution_algorithm},
+                         {"x_tensor_layout", (int) layer.x_tensor->layout},
+                         {"y_tensor_layout", (int) layer.y_tensor->layout},
+                         {"w_filter_layout", (int) layer.w_filter->layout},
+                         {"math_type", (int) layer.math_type}});
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * problem.output_size());
+}
+
+template <typename T, cudnnConvolutionFwdAlgo_t convolution_algorithm
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+          ,
+          cudnnMathType_t math_type = CUDNN_DEFAULT_MATH
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+          >
+static void LAYER_CUDNN_CONV_ND_FWD_Impl(benchmark::State& state) {
+  try {
+    iLAYER_CUDNN_CONV_ND_FWD_Impl<T, convolution_algorithm
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+                                  ,
+                                  math_type
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+                                  >(state);
+  } catch (const std::exception& e) {
+    const auto err = std::string("Exception in " BENCHMARK_NAME) + e.what();
+    state.SkipWithError(err.c_str());
+  } catch (const std::string& e) {
+    const auto err = std::string("Exception in " BENCHMARK_NAME) + e;
+    state.SkipWithError(err.c_str());
+  } catch (...) {
+    state.SkipWithError("unknown exception in " BENCHMARK_NAME);
+  }
+}
+
+template <cudnnConvolutionFwdAlgo_t convolution_algorithm>
+static void LAYER_CUDNN_CONV_ND_FWD_HALF(benchmark::State& state) {
+  LAYER_CUDNN_CONV_ND_FWD_Impl<__half, convolution_algorithm>(state);
+}
+
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+template <cudnnConvolutionFwdAlgo_t convolution_algorithm>
+static void LAYER_CUDNN_CONV_ND_FWD_HALF_TENSOROP(benchmark::State& state) {
+  LAYER_CUDNN_CONV_ND_FWD_Impl<__half, convolution_algorithm, CUDNN_TENSOR_OP_MATH>(state);
+}
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+
+template <cudnnConvolutionFwdAlgo_t convolution_algorithm>
+static void LAYER_CUDNN_CONV_ND_FWD_FLOAT(benchmark::State& state) {
+  LAYER_CUDNN_CONV_ND_FWD_Impl<float, convolution_algorithm>(state);
+}
+
+// the algorithms cudnn implements for 3-D convolutions
+#define BENCHMARK_LAYER(b)                                                                                             \
+  BENCHMARK_CUDNN_TEMPLATE(b, CUDNN_CONVOLUTION_FWD_ALGO_IMPLICIT_GEMM)->CONV_3D_PROBLEMS()->UseManualTime();          \
+  BENCHMARK_CUDNN_TEMPLATE(b, CUDNN_CONVOLUTION_FWD_ALGO_IMPLICIT_PRECOMP_GEMM)->CONV_3D_PROBLEMS()->UseManualTime();  \
+  BENCHMARK_CUDNN_TEMPLATE(b, CUDNN_CONVOLUTION_FWD_ALGO_FFT_TILING)->CONV_3D_PROBLEMS()->UseManualTime()
+
+BENCHMARK_LAYER(LAYER_CUDNN_CONV_ND_FWD_HALF);
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+BENCHMARK_LAYER(LAYER_CUDNN_CONV_ND_FWD_HALF_TENSOROP);
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+BENCHMARK_LAYER(LAYER_CUDNN_CONV_ND_FWD_FLOAT);
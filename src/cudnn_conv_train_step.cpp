@@ -0,0 +1,351 @@
+#define BENCHMARK_NAME "CUDNN/CONV_TRAIN_STEP"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <numeric>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <cudnn.h>
+
+#include "args.hpp"
+#include "conv_nd.hpp"
+#include "error.hpp"
+#include "helper.hpp"
+#include "init.hpp"
+#include "train_step.hpp"
+#include "utils.hpp"
+#include "warm_cache.hpp"
+
+// One training step of a convolution layer: forward, backward data, backward
+// filter and, with_bias, backward bias, back to back on shared x, w and dy
+// (see train_step.hpp). The iteration time is the whole step.
+template <typename T, bool with_bias
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+          ,
+          cudnnMathType_t math_type0 = CUDNN_DEFAULT_MATH
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+          >
+static void iLAYER_CUDNN_CONV_TRAIN_STEP_Impl(benchmark::State& state) {
+  if (!has_cuda) {
+    state.SkipWithError(BENCHMARK_NAME " no CUDA device found");
+    return;
+  }
+
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+  int math_type = math_type0;
+  if ((is_half_v<T> || math_type == CUDNN_TENSOR_OP_MATH) && !detail::SupportsTensorCore(cuda_device_id)) {
+    state.SkipWithError(BENCHMARK_NAME "no Tensorcore support on current device");
+    return;
+  }
+  if (is_half_v<T>) {
+    math_type = CUDNN_TENSOR_OP_MATH;
+  }
+#else
+  int math_type = 0;
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+
+  MEM_ALIGNED_128 const T alpha = detail::one<T>();
+  MEM_ALIGNED_128 const T beta  = detail::zero<T>();
+
+  const auto problem = conv_nd::problem_2d(state);
+  if (!problem.is_valid()) {
+    state.SkipWithError(BENCHMARK_NAME " got a group that does not divide the channels or a filter larger than the "
+                                       "input");
+    return;
+  }
+  const auto out = problem.output();
+
+  MEM_ALIGNED_128 cudnnConvolutionDescriptor_t convolution_descriptor;
+  if (PRINT_IF_ERROR(cudnnCreateConvolutionDescriptor(&convolution_descriptor))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnCreateConvolutionDescriptor");
+    return;
+  }
+  defer(cudnnDestroyConvolutionDescriptor(convolution_descriptor));
+  if (PRINT_IF_ERROR(cudnnSetConvolution2dDescriptor(convolution_descriptor,
+                                                     /*pad_height=*/problem.pad[1],
+                                                     /*pad_width=*/problem.pad[2],
+                                                     /*vertical_stride=*/problem.stride[1],
+                                                     /*horizontal_stride=*/problem.stride[2],
+                                                     /*dilation_height=*/problem.dilation[1],
+                                                     /*dilation_width=*/problem.dilation[2],
+                                                     /*mode=*/CUDNN_CROSS_CORRELATION,
+                                                     /*computeType=*/accumDataType<T>::type))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnSetConvolution2dDescriptor");
+    return;
+  }
+  if (PRINT_IF_ERROR(cudnnSetConvolutionGroupCount(convolution_descriptor, problem.group))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnSetConvolutionGroupCount");
+    return;
+  }
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+  if (PRINT_IF_ERROR(cudnnSetConvolutionMathType(convolution_descriptor, (cudnnMathType_t) math_type))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnSetConvolutionMathType");
+    return;
+  }
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+
+  // x and dx share a descriptor, as do y and dy, and w and dw
+  MEM_ALIGNED_128 auto x_tensor = Tensor<T>(state,
+                                            {/*batch_size=*/problem.batch_size,
+                                             /*channels=*/problem.channels,
+                                             /*image_height=*/problem.input[1],
+                                             /*image_width=*/problem.input[2]});
+  if (!x_tensor.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 cudnnTensorDescriptor_t x_descriptor = x_tensor.get();
+
+  const auto w_filter = Filter<T>(state,
+                                  {/*out_channels=*/problem.num_filters,
+                                   /*in_channels=*/problem.channels,
+                                   /*kernel_height=*/problem.filter[1],
+                                   /*kernel_width=*/problem.filter[2]},
+                                  problem.group);
+  if (!w_filter.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 cudnnFilterDescriptor_t w_descriptor = w_filter.get();
+
+  MEM_ALIGNED_128 auto y_tensor = Tensor<T>(state,
+                                            {/*batch_size=*/problem.batch_size,
+                                             /*channels=*/problem.num_filters,
+                                             /*image_height=*/out[1],
+                                             /*image_width=*/out[2]});
+  if (!y_tensor.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 cudnnTensorDescriptor_t y_descriptor = y_tensor.get();
+
+  MEM_ALIGNED_128 auto db_tensor = Tensor<T>(state, {problem.num_filters});
+  if (!db_tensor.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 cudnnTensorDescriptor_t db_descriptor = db_tensor.get();
+
+  // pick the algorithm of every call under the shared workspace budget; the
+  // daemon keeps the choices of a layer (see warm_cache.hpp)
+  static const int max_count = 10;
+  int returned_count         = 0;
+  using choices_t            = std::array<train_step::choice_t, train_step::num_phases>;
+  static warm_cache::choice_cache<choices_t> choice_cache;
+  const auto choice_key = fmt::format("{}/{}/{}/{}", problem.key(), (int) valueDataType<T>::type, math_type,
+                                      train_step_workspace_bytes);
+  choices_t choices;
+  const auto is_cached = choice_cache.find(choice_key, choices);
+
+  if (!is_cached) {
+    annotate::range find_range("find");
+    cudnnConvolutionFwdAlgoPerf_t fwd_results[max_count];
+    if (PRINT_IF_ERROR(cudnnFindConvolutionForwardAlgorithm(handles.cudnn, x_descriptor, w_descriptor,
+                                                            convolution_descriptor, y_descriptor, max_count,
+                                                            &returned_count, fwd_results))) {
+      state.SkipWithError(BENCHMARK_NAME " failed to perform cudnnFindConvolutionForwardAlgorithm");
+      return;
+    }
+    choices[train_step::forward] = train_step::choose(fwd_results, returned_count, train_step_workspace_bytes);
+
+    cudnnConvolutionBwdDataAlgoPerf_t bwd_data_results[max_count];
+    if (PRINT_IF_ERROR(cudnnFindConvolutionBackwardDataAlgorithm(handles.cudnn, w_descriptor, y_descriptor,
+                                                                 convolution_descriptor, x_descriptor, max_count,
+                                                                 &returned_count, bwd_data_results))) {
+      state.SkipWithError(BENCHMARK_NAME " failed to perform cudnnFindConvolutionBackwardDataAlgorithm");
+      return;
+    }
+    choices[train_step::backward_data] =
+        train_step::choose(bwd_data_results, returned_count, train_step_workspace_bytes);
+
+    cudnnConvolutionBwdFilterAlgoPerf_t bwd_filter_results[max_count];
+    if (PRINT_IF_ERROR(cudnnFindConvolutionBackwardFilterAlgorithm(handles.cudnn, x_descriptor, y_descriptor,
+                                                                   convolution_descriptor, w_descriptor, max_count,
+                                                                   &returned_count, bwd_filter_results))) {
+      state.SkipWithError(BENCHMARK_NAME " failed to perform cudnnFindConvolutionBackwardFilterAlgorithm");
+      return;
+    }
+    choices[train_step::backward_filter] =
+        train_step::choose(bwd_filter_results, returned_count, train_step_workspace_bytes);
+    find_range.end();
+    choice_cache.insert(choice_key, choices);
+  }
+
+  for (int ii = 0; ii < train_step::backward_bias; ii++) {
+    if (choices[ii].algorithm == -1) {
+      state.SkipWithError(fmt::format(BENCHMARK_NAME " found no {} algorithm within the workspace budget",
+                                      train_step::phase_name(ii))
+                              .c_str());
+      return;
+    }
+  }
+  const auto fwd_algorithm        = (cudnnConvolutionFwdAlgo_t) choices[train_step::forward].algorithm;
+  const auto bwd_data_algorithm   = (cudnnConvolutionBwdDataAlgo_t) choices[train_step::backward_data].algorithm;
+  const auto bwd_filter_algorithm = (cudnnConvolutionBwdFilterAlgo_t) choices[train_step::backward_filter].algorithm;
+
+  MEM_ALIGNED_128 size_t workspace_bytes = 0;
+  for (const auto& choice : choices) {
+    workspace_bytes = std::max(workspace_bytes, choice.workspace_bytes);
+  }
+
+  auto input  = std::vector<T>(problem.input_size());
+  auto kernel = std::vector<T>(problem.filter_size());
+  auto output = std::vector<T>(problem.output_size());
+  std::fill(input.begin(), input.end(), detail::one<T>());
+  std::fill(kernel.begin(), kernel.end(), detail::one<T>());
+  std::fill(output.begin(), output.end(), detail::one<T>());
+
+  MEM_ALIGNED_128 warm_cache::Workspace<T> workspace_memory(state, workspace_bytes);
+  if (!workspace_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_workspace = workspace_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> x_memory(state, input.data(), input.size() * sizeof(T));
+  if (!x_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_x = x_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> w_memory(state, kernel.data(), kernel.size() * sizeof(T));
+  if (!w_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_w = w_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> y_memory(state, output.size() * sizeof(T));
+  if (!y_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_y = y_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> dy_memory(state, output.data(), output.size() * sizeof(T));
+  if (!dy_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_dy = dy_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> dx_memory(state, input.size() * sizeof(T));
+  if (!dx_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_dx = dx_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> dw_memory(state, kernel.size() * sizeof(T));
+  if (!dw_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_dw = dw_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> db_memory(state, problem.num_filters * sizeof(T));
+  if (!db_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_db = db_memory.get();
+
+  train_step::phase_timer timer(handle_pool::stream(state), num_warmup);
+
+  // a failed call ends the step, the error is reported by BENCHMARK_BLOCK
+  cudnnStatus_t cudnn_err;
+  BENCHMARK_BLOCK(cudnn_err, {
+    timer.mark(train_step::forward);
+    cudnn_err = cudnnConvolutionForward(handles.cudnn, &alpha, x_descriptor, d_x, w_descriptor, d_w,
+                                        convolution_descriptor, fwd_algorithm, d_workspace, workspace_bytes, &beta,
+                                        y_descriptor, d_y);
+    timer.mark(train_step::backward_data);
+    if (cudnn_err == CUDNN_STATUS_SUCCESS) {
+      cudnn_err = cudnnConvolutionBackwardData(handles.cudnn, &alpha, w_descriptor, d_w, y_descriptor, d_dy,
+                                               convolution_descriptor, bwd_data_algorithm, d_workspace,
+                                               workspace_bytes, &beta, x_descriptor, d_dx);
+    }
+    timer.mark(train_step::backward_filter);
+    if (cudnn_err == CUDNN_STATUS_SUCCESS) {
+      cudnn_err = cudnnConvolutionBackwardFilter(handles.cudnn, &alpha, x_descriptor, d_x, y_descriptor, d_dy,
+                                                 convolution_descriptor, bwd_filter_algorithm, d_workspace,
+                                                 workspace_bytes, &beta, w_descriptor, d_dw);
+    }
+    timer.mark(train_step::backward_bias);
+    if (with_bias && cudnn_err == CUDNN_STATUS_SUCCESS) {
+      cudnn_err = cudnnConvolutionBackwardBias(handles.cudnn, &alpha, y_descriptor, d_dy, &beta, db_descriptor, d_db);
+    }
+    timer.mark(train_step::num_phases);
+  });
+  timer.collect();
+
+  conv_nd::add_counters<T>(state, problem);
+  train_step::add_counters(state, timer, choices);
+  state.counters.insert({{"with_bias", with_bias},
+                         {"workspace_bytes", workspace_bytes},
+                         {"workspace_megabytes", workspace_bytes / 1048576.0},
+                         {"workspace_budget_bytes", train_step_workspace_bytes},
+                         {"cached_choices", is_cached},
+                         {"x_tensor_layout", (int) x_tensor.layout},
+                         {"y_tensor_layout", (int) y_tensor.layout},
+                         {"w_filter_layout", (int) w_filter.layout},
+                         {"math_type", (int) math_type}});
+
+  // the forward and both backward convolutions do the multiply-adds of the layer
+  const double predicted_flops = 3 * problem.flops();
+  state.counters.insert(
+      {{"predicted_train_step_flops_count", predicted_flops},
+       {"predicted_train_step_flops", {predicted_flops * state.iterations(), benchmark::Counter::kAvgThreadsRate}}});
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * problem.batch_size);
+}
+
+template <typename T, bool with_bias
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+          ,
+          cudnnMathType_t math_type = CUDNN_DEFAULT_MATH
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+          >
+static void LAYER_CUDNN_CONV_TRAIN_STEP_Impl(benchmark::State& state) {
+  try {
+    iLAYER_CUDNN_CONV_TRAIN_STEP_Impl<T, with_bias
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+                                      ,
+                                      math_type
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+                                      >(state);
+  } catch (const std::exception& e) {
+    const auto err = std::string("Exception in " BENCHMARK_NAME) + e.what();
+    state.SkipWithError(err.c_str());
+  } catch (const std::string& e) {
+    const auto err = std::string("Exception in " BENCHMARK_NAME) + e;
+    state.SkipWithError(err.c_str());
+  } catch (...) {
+    state.SkipWithError("unknown exception in " BENCHMARK_NAME);
+  }
+}
+
+template <bool with_bias>
+static void LAYER_CUDNN_CONV_TRAIN_STEP_HALF(benchmark::State& state) {
+  LAYER_CUDNN_CONV_TRAIN_STEP_Impl<__half, with_bias>(state);
+}
+
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+template <bool with_bias>
+static void LAYER_CUDNN_CONV_TRAIN_STEP_HALF_TENSOROP(benchmark::State& state) {
+  LAYER_CUDNN_CONV_TRAIN_STEP_Impl<__half, with_bias, CUDNN_TENSOR_OP_MATH>(state);
+}
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+
+template <bool with_bias>
+static void LAYER_CUDNN_CONV_TRAIN_STEP_FLOAT(benchmark::State& state) {
+  LAYER_CUDNN_CONV_TRAIN_STEP_Impl<float, with_bias>(state);
+}
+
+#define BENCHMARK_LAYER(b)                                                                                             \
+  BENCHMARK_CUDNN_TEMPLATE(b, false)->CONV_TRAIN_STEP_PROBLEMS()->UseManualTime();                                     \
+  BENCHMARK_CUDNN_TEMPLATE(b, true)->CONV_TRAIN_STEP_PROBLEMS()->UseManualTime()
+
+BENCHMARK_LAYER(LAYER_CUDNN_CONV_TRAIN_STEP_HALF);
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+BENCHMARK_LAYER(LAYER_CUDNN_CONV_TRAIN_STEP_HALF_TENSOROP);
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+BENCHMARK_LAYER(LAYER_CUDNN_CONV_TRAIN_STEP_FLOAT);
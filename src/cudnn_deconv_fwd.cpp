@@ -0,0 +1,251 @@
+#define BENCHMARK_NAME "CUDNN/DECONV_FWD"
+
+#include <benchmark/benchmark.h>
+
+#include <iostream>
+#include <numeric>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <cudnn.h>
+
+#include "args.hpp"
+#include "deconv.hpp"
+#include "error.hpp"
+#include "helper.hpp"
+#include "init.hpp"
+#include "utils.hpp"
+#include "warm_cache.hpp"
+
+// A transposed convolution runs as the backward data pass of the convolution
+// it transposes (see deconv.hpp): x plays dy, y plays dx.
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnConvolutionBackwardData
+template <typename T, cudnnConvolutionBwdDataAlgo_t convolution_algorithm
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+          ,
+          cudnnMathType_t math_type0 = CUDNN_DEFAULT_MATH
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+          >
+static void iLAYER_CUDNN_DECONV_FWD_Impl(benchmark::State& state) {
+  if (!has_cuda) {
+    state.SkipWithError(BENCHMARK_NAME " no CUDA device found");
+    return;
+  }
+
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+  int math_type = math_type0;
+  if ((is_half_v<T> || math_type == CUDNN_TENSOR_OP_MATH) && !detail::SupportsTensorCore(cuda_device_id)) {
+    state.SkipWithError(BENCHMARK_NAME "no Tensorcore support on current device");
+    return;
+  }
+  if (is_half_v<T>) {
+    math_type = CUDNN_TENSOR_OP_MATH;
+  }
+#else
+  int math_type = 0;
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+
+  MEM_ALIGNED_128 const T alpha = detail::one<T>();
+  MEM_ALIGNED_128 const T beta  = detail::zero<T>();
+
+  const auto problem = deconv::problem(state);
+  if (!problem.is_valid()) {
+    state.SkipWithError(BENCHMARK_NAME " got an empty output, an output pad not smaller than the stride or a group "
+                                       "that does not divide the channels");
+    return;
+  }
+  const auto out = problem.output();
+
+  MEM_ALIGNED_128 cudnnConvolutionDescriptor_t convolution_descriptor;
+  if (PRINT_IF_ERROR(cudnnCreateConvolutionDescriptor(&convolution_descriptor))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnCreateConvolutionDescriptor");
+    return;
+  }
+  defer(cudnnDestroyConvolutionDescriptor(convolution_descriptor));
+  if (PRINT_IF_ERROR(cudnnSetConvolution2dDescriptor(convolution_descriptor,
+                                                     /*pad_height=*/problem.pad[0],
+                                                     /*pad_width=*/problem.pad[1],
+                                                     /*vertical_stride=*/problem.stride[0],
+                                                     /*horizontal_stride=*/problem.stride[1],
+                                                     /*dilation_height=*/problem.dilation[0],
+                                                     /*dilation_width=*/problem.dilation[1],
+                                                     /*mode=*/CUDNN_CROSS_CORRELATION,
+                                                     /*computeType=*/accumDataType<T>::type))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnSetConvolution2dDescriptor");
+    return;
+  }
+  if (PRINT_IF_ERROR(cudnnSetConvolutionGroupCount(convolution_descriptor, problem.group))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnSetConvolutionGroupCount");
+    return;
+  }
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+  if (PRINT_IF_ERROR(cudnnSetConvolutionMathType(convolution_descriptor, (cudnnMathType_t) math_type))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnSetConvolutionMathType");
+    return;
+  }
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+
+  MEM_ALIGNED_128 auto x_tensor = Tensor<T>(state,
+                                            {/*batch_size=*/problem.batch_size,
+                                             /*channels=*/problem.in_channels,
+                                             /*image_height=*/problem.input[0],
+                                             /*image_width=*/problem.input[1]});
+  if (!x_tensor.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 cudnnTensorDescriptor_t x_descriptor = x_tensor.get();
+
+  // the filters of the transposed convolution map the K output channels onto the C input channels
+  const auto w_filter = Filter<T>(state,
+                                  {/*out_channels=*/problem.in_channels,
+                                   /*in_channels=*/problem.out_channels,
+                                   /*kernel_height=*/problem.filter[0],
+                                   /*kernel_width=*/problem.filter[1]},
+                                  problem.group);
+  if (!w_filter.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 cudnnFilterDescriptor_t w_descriptor = w_filter.get();
+
+  MEM_ALIGNED_128 auto y_tensor = Tensor<T>(state,
+                                            {/*batch_size=*/problem.batch_size,
+                                             /*channels=*/problem.out_channels,
+                                             /*image_height=*/out[0],
+                                             /*image_width=*/out[1]});
+  if (!y_tensor.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 cudnnTensorDescriptor_t y_descriptor = y_tensor.get();
+
+  int conv_n, conv_c, conv_h, conv_w;
+  const auto cudnn_get_conv_output_err = cudnnGetConvolution2dForwardOutputDim(
+      convolution_descriptor, y_descriptor, w_descriptor, &conv_n, &conv_c, &conv_h, &conv_w);
+  if (PRINT_IF_ERROR(cudnn_get_conv_output_err)) {
+    state.SkipWithError(fmt::format(BENCHMARK_NAME " failed to cudnnGetConvolution2dForwardOutputDim because of {}",
+                                    utils::detail::error_string(cudnn_get_conv_output_err))
+                            .c_str());
+    return;
+  }
+  if (conv_c != problem.in_channels || conv_h != problem.input[0] || conv_w != problem.input[1]) {
+    const auto msg = fmt::format(BENCHMARK_NAME " transposes a convolution with a {}x{}x{} output, expected {}x{}x{}",
+                                 conv_c, conv_h, conv_w, problem.in_channels, problem.input[0], problem.input[1]);
+    state.SkipWithError(msg.c_str());
+    return;
+  }
+
+  MEM_ALIGNED_128 size_t workspace_bytes = 0;
+  if (PRINT_IF_ERROR(cudnnGetConvolutionBackwardDataWorkspaceSize(handles.cudnn, w_descriptor, x_descriptor,
+                                                                  convolution_descriptor, y_descriptor,
+                                                                  convolution_algorithm, &workspace_bytes))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnGetConvolutionBackwardDataWorkspaceSize");
+    return;
+  }
+
+  auto input  = std::vector<T>(problem.input_size());
+  auto kernel = std::vector<T>(problem.filter_size());
+  std::fill(input.begin(), input.end(), detail::one<T>());
+  std::fill(kernel.begin(), kernel.end(), detail::one<T>());
+
+  MEM_ALIGNED_128 warm_cache::Workspace<T> workspace_memory(state, workspace_bytes);
+  if (!workspace_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_workspace = workspace_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> x_memory(state, input.data(), input.size() * sizeof(T));
+  if (!x_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_x = x_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> w_memory(state, kernel.data(), kernel.size() * sizeof(T));
+  if (!w_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_w = w_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> y_memory(state, problem.output_size() * sizeof(T));
+  if (!y_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_y = y_memory.get();
+
+  cudnnStatus_t cudnn_err;
+  BENCHMARK_BLOCK(cudnn_err, {
+    cudnn_err = cudnnConvolutionBackwardData(handles.cudnn, &alpha, w_descriptor, d_w, x_descriptor, d_x,
+                                             convolution_descriptor, convolution_algorithm, d_workspace,
+                                             workspace_bytes, &beta, y_descriptor, d_y);
+  });
+
+  deconv::add_counters<T>(state, problem);
+  state.counters.insert({{"workspace_bytes", workspace_bytes},
+                         {"workspace_megabytes", workspace_bytes / 1048576.0},
+                         {"convolution_algorithm", (int) convolution_algorithm},
+                         {"x_tensor_layout", (int) x_tensor.layout},
+                         {"y_tensor_layout", (int) y_tensor.layout},
+                         {"w_filter_layout", (int) w_filter.layout},
+                         {"math_type", (int) math_type}});
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * problem.output_size());
+}
+
+template <typename T, cudnnConvolutionBwdDataAlgo_t convolution_algorithm
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+          ,
+          cudnnMathType_t math_type = CUDNN_DEFAULT_MATH
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+          >
+static void LAYER_CUDNN_DECONV_FWD_Impl(benchmark::State& state) {
+  try {
+    iLAYER_CUDNN_DECONV_FWD_Impl<T, convolution_algorithm
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+                                 ,
+                                 math_type
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+                                 >(state);
+  } catch (const std::exception& e) {
+    const auto err = std::string("Exception in " BENCHMARK_NAME) + e.what();
+    state.SkipWithError(err.c_str());
+  } catch (const std::string& e) {
+    const auto err = std::string("Exception in " BENCHMARK_NAME) + e;
+    state.SkipWithError(err.c_str());
+  } catch (...) {
+    state.SkipWithError("unknown exception in " BENCHMARK_NAME);
+  }
+}
+
+template <cudnnConvolutionBwdDataAlgo_t convolution_algorithm>
+static void LAYER_CUDNN_DECONV_FWD_HALF(benchmark::State& state) {
+  LAYER_CUDNN_DECONV_FWD_Impl<__half, convolution_algorithm>(state);
+}
+
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+template <cudnnConvolutionBwdDataAlgo_t convolution_algorithm>
+static void LAYER_CUDNN_DECONV_FWD_HALF_TENSOROP(benchmark::State& state) {
+  LAYER_CUDNN_DECONV_FWD_Impl<__half, convolution_algorithm, CUDNN_TENSOR_OP_MATH>(state);
+}
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+
+template <cudnnConvolutionBwdDataAlgo_t convolution_algorithm>
+static void LAYER_CUDNN_DECONV_FWD_FLOAT(benchmark::State& state) {
+  LAYER_CUDNN_DECONV_FWD_Impl<float, convolution_algorithm>(state);
+}
+
+#define BENCHMARK_LAYER(b)                                                                                             \
+  BENCHMARK_CUDNN_TEMPLATE(b, CUDNN_CONVOLUTION_BWD_DATA_ALGO_0)->DECONV_PROBLEMS()->UseManualTime();                  \
+  BENCHMARK_CUDNN_TEMPLATE(b, CUDNN_CONVOLUTION_BWD_DATA_ALGO_1)->DECONV_PROBLEMS()->UseManualTime();                  \
+  BENCHMARK_CUDNN_TEMPLATE(b, CUDNN_CONVOLUTION_BWD_DATA_ALGO_FFT)->DECONV_PROBLEMS()->UseManualTime();                \
+  BENCHMARK_CUDNN_TEMPLATE(b, CUDNN_CONVOLUTION_BWD_DATA_ALGO_FFT_TILING)->DECONV_PROBLEMS()->UseManualTime();         \
+  BENCHMARK_CUDNN_TEMPLATE(b, CUDNN_CONVOLUTION_BWD_DATA_ALGO_WINOGRAD)->DECONV_PROBLEMS()->UseManualTime();           \
+  BENCHMARK_CUDNN_TEMPLATE(b, CUDNN_CONVOLUTION_BWD_DATA_ALGO_WINOGRAD_NONFUSED)->DECONV_PROBLEMS()->UseManualTime()
+
+BENCHMARK_LAYER(LAYER_CUDNN_DECONV_FWD_HALF);
+#ifdef CUDNN_SUPPORTS_TENSOR_OPS
+BENCHMARK_LAYER(LAYER_CUDNN_DECONV_FWD_HALF_TENSOROP);
+#endif // CUDNN_SUPPORTS_TENSOR_OPS
+BENCHMARK_LAYER(LAYER_CUDNN_DECONV_FWD_FLOAT);
@@ -27,6 +27,11 @@ static void iLAYER_CUDNN_DROPOUT_BWD_Impl(benchmark::State& state) {
     return;
   }
 
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
   // n, c, h, w
   const auto in_n = state.range(0);
   const auto in_c = state.range(1);
@@ -55,7 +60,7 @@ static void iLAYER_CUDNN_DROPOUT_BWD_Impl(benchmark::State& state) {
   }
 
   size_t states_bytes = 0;
-  if (PRINT_IF_ERROR(cudnnDropoutGetStatesSize(cudnn_handle, &states_bytes))) {
+  if (PRINT_IF_ERROR(cudnnDropoutGetStatesSize(handles.cudnn, &states_bytes))) {
     state.SkipWithError(BENCHMARK_NAME " failed to cudnnDropoutGetStatesSize");
     return;
   }
@@ -67,7 +72,7 @@ static void iLAYER_CUDNN_DROPOUT_BWD_Impl(benchmark::State& state) {
   MEM_ALIGNED_128 const auto d_states = states_memory.get();
 
   if (PRINT_IF_ERROR(
-          cudnnSetDropoutDescriptor(dropout_descriptor, cudnn_handle, dropout, d_states, states_bytes, seed))) {
+          cudnnSetDropoutDescriptor(dropout_descriptor, handles.cudnn, dropout, d_states, states_bytes, seed))) {
     state.SkipWithError(BENCHMARK_NAME " failed to cudnnSetDropoutDescriptor");
     return;
   }
@@ -103,8 +108,8 @@ static void iLAYER_CUDNN_DROPOUT_BWD_Impl(benchmark::State& state) {
 
   cudnnStatus_t cudnn_err;
   BENCHMARK_BLOCK(cudnn_err, {
-    cudnn_err = cudnnDropoutBackward(
-        cudnn_handle, dropout_descriptor, x_descriptor, d_dy, x_descriptor, d_dx, d_reserve_space, reserve_space_bytes);
+    cudnn_err = cudnnDropoutBackward(handles.cudnn, dropout_descriptor, x_descriptor, d_dy, x_descriptor, d_dx,
+                                     d_reserve_space, reserve_space_bytes);
   });
 
   state.counters.insert({{"input_size", in_n * in_c * in_h * in_w},
@@ -0,0 +1,321 @@
+#define BENCHMARK_NAME "CUDNN/NORM_BWD"
+
+#include <benchmark/benchmark.h>
+
+#include <iostream>
+#include <numeric>
+#include <stdio.h>
+#include <stdlib.h>
+#include <type_traits>
+#include <vector>
+
+#include <cudnn.h>
+
+#include "args.hpp"
+#include "error.hpp"
+#include "helper.hpp"
+#include "init.hpp"
+#include "norm.hpp"
+#include "utils.hpp"
+
+// The backward pass of cudnn_norm_fwd.cpp, from the x_hat, mean and inverse
+// variance the forward pass saved:
+//   1. tmp = dy * x_hat, then dgamma = tmp and dbeta = dy, both reduced onto
+//      the scale and shift of the affine view;
+//   2. tmp = dy * gamma, the gradient of x_hat;
+//   3. the spatial batch normalization backward pass of the stats view turns
+//      it into dx (its unit scale has gradients nobody reads).
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnBatchNormalizationBackward
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnOpTensor
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnReduceTensor
+template <typename T, norm::kind_t kind>
+static void iLAYER_CUDNN_NORM_BWD_Impl(benchmark::State& state) {
+  if (!has_cuda) {
+    state.SkipWithError(BENCHMARK_NAME " no CUDA device found");
+    return;
+  }
+
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
+  const auto problem = norm::problem(state, kind);
+  if (!problem.is_valid()) {
+    state.SkipWithError(BENCHMARK_NAME " got an empty tensor, a begin axis outside of 1..3 or a group count that does "
+                                       "not divide the channels");
+    return;
+  }
+
+  MEM_ALIGNED_128 const T alpha           = detail::one<T>();
+  MEM_ALIGNED_128 const T beta            = detail::zero<T>();
+  const double exponential_average_factor = 1.0;             // exponentialAverageFactor
+  const double epsilon                    = problem.epsilon; // at least CUDNN_BN_MIN_EPSILON
+
+  const auto stats  = problem.stats_view();
+  const auto affine = problem.affine_view();
+  const auto params = problem.param_view();
+
+  MEM_ALIGNED_128 auto stats_tensor = Tensor<T>(state, {stats[0], stats[1], stats[2], stats[3]});
+  if (!stats_tensor.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 cudnnTensorDescriptor_t stats_descriptor = stats_tensor.get();
+
+  MEM_ALIGNED_128 auto affine_tensor = Tensor<T>(state, {affine[0], affine[1], affine[2], affine[3]});
+  if (!affine_tensor.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 cudnnTensorDescriptor_t affine_descriptor = affine_tensor.get();
+
+  MEM_ALIGNED_128 auto param_tensor = Tensor<T>(state, {params[0], params[1], params[2], params[3]});
+  if (!param_tensor.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 cudnnTensorDescriptor_t param_descriptor = param_tensor.get();
+
+  MEM_ALIGNED_128 cudnnTensorDescriptor_t scale_bias_descriptor{nullptr};
+  if (PRINT_IF_ERROR(cudnnCreateTensorDescriptor(&scale_bias_descriptor))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnCreateTensorDescriptor");
+    return;
+  }
+  defer(cudnnDestroyTensorDescriptor(scale_bias_descriptor));
+
+  if (PRINT_IF_ERROR(cudnnDeriveBNTensorDescriptor(scale_bias_descriptor, stats_descriptor, CUDNN_BATCHNORM_SPATIAL))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnDeriveBNTensorDescriptor");
+    return;
+  }
+
+  size_t scale_bias_bytes;
+  if (PRINT_IF_ERROR(cudnnGetTensorSizeInBytes(scale_bias_descriptor, &scale_bias_bytes))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnGetTensorSizeInBytes");
+    return;
+  }
+
+  MEM_ALIGNED_128 cudnnOpTensorDescriptor_t mul_descriptor{nullptr};
+  if (PRINT_IF_ERROR(cudnnCreateOpTensorDescriptor(&mul_descriptor))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnCreateOpTensorDescriptor");
+    return;
+  }
+  defer(cudnnDestroyOpTensorDescriptor(mul_descriptor));
+  if (PRINT_IF_ERROR(cudnnSetOpTensorDescriptor(mul_descriptor, CUDNN_OP_TENSOR_MUL, accumDataType<T>::type,
+                                                CUDNN_NOT_PROPAGATE_NAN))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnSetOpTensorDescriptor");
+    return;
+  }
+
+  MEM_ALIGNED_128 cudnnReduceTensorDescriptor_t sum_descriptor{nullptr};
+  if (PRINT_IF_ERROR(cudnnCreateReduceTensorDescriptor(&sum_descriptor))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnCreateReduceTensorDescriptor");
+    return;
+  }
+  defer(cudnnDestroyReduceTensorDescriptor(sum_descriptor));
+  if (PRINT_IF_ERROR(cudnnSetReduceTensorDescriptor(sum_descriptor, CUDNN_REDUCE_TENSOR_ADD, accumDataType<T>::type,
+                                                    CUDNN_NOT_PROPAGATE_NAN, CUDNN_REDUCE_TENSOR_NO_INDICES,
+                                                    CUDNN_32BIT_INDICES))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnSetReduceTensorDescriptor");
+    return;
+  }
+
+  MEM_ALIGNED_128 size_t workspace_bytes = 0;
+  if (PRINT_IF_ERROR(cudnnGetReductionWorkspaceSize(handles.cudnn, sum_descriptor, affine_descriptor, param_descriptor,
+                                                    &workspace_bytes))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnGetReductionWorkspaceSize");
+    return;
+  }
+
+  // the batch normalization scales by one and shifts by zero; its parameters
+  // are float for half data (cudnnDeriveBNTensorDescriptor)
+  using bn_param_t = typename std::conditional<is_half_v<T>, float, T>::type;
+  auto unit_scale  = std::vector<bn_param_t>(scale_bias_bytes / sizeof(bn_param_t));
+  auto zero_bias   = std::vector<bn_param_t>(scale_bias_bytes / sizeof(bn_param_t));
+  std::fill(unit_scale.begin(), unit_scale.end(), detail::one<bn_param_t>());
+  std::fill(zero_bias.begin(), zero_bias.end(), detail::zero<bn_param_t>());
+
+  auto input = std::vector<T>(problem.size());
+  auto param = std::vector<T>(problem.param_size());
+  std::fill(input.begin(), input.end(), detail::one<T>());
+  std::fill(param.begin(), param.end(), detail::one<T>());
+
+  const auto input_bytes = problem.size() * sizeof(T);
+  const auto param_bytes = problem.param_size() * sizeof(T);
+
+  MEM_ALIGNED_128 DeviceMemory<T> workspace_memory(state, workspace_bytes);
+  if (!workspace_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_workspace = workspace_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> x_memory(state, input.data(), input_bytes);
+  if (!x_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_x = x_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> x_hat_memory(state, input_bytes);
+  if (!x_hat_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_x_hat = x_hat_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> dy_memory(state, input.data(), input_bytes);
+  if (!dy_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_dy = dy_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> tmp_memory(state, input_bytes);
+  if (!tmp_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_tmp = tmp_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> dx_memory(state, input_bytes);
+  if (!dx_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_dx = dx_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> gamma_memory(state, param.data(), param_bytes);
+  if (!gamma_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_gamma = gamma_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> dgamma_memory(state, param_bytes);
+  if (!dgamma_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_dgamma = dgamma_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> dbeta_memory(state, param_bytes);
+  if (!dbeta_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_dbeta = dbeta_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<bn_param_t> scale_memory(state, unit_scale.data(), scale_bias_bytes);
+  if (!scale_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_scale = scale_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<bn_param_t> bias_memory(state, zero_bias.data(), scale_bias_bytes);
+  if (!bias_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_bias = bias_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<bn_param_t> dscale_memory(state, scale_bias_bytes);
+  if (!dscale_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_dscale = dscale_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<bn_param_t> dbias_memory(state, scale_bias_bytes);
+  if (!dbias_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_dbias = dbias_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<bn_param_t> saved_mean_memory(state, scale_bias_bytes);
+  if (!saved_mean_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_saved_mean = saved_mean_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<bn_param_t> saved_in_var_memory(state, scale_bias_bytes);
+  if (!saved_in_var_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_saved_in_var = saved_in_var_memory.get();
+
+  // the forward pass saves x_hat and the statistics of every row
+  const auto cudnn_fwd_err = cudnnBatchNormalizationForwardTraining(
+      handles.cudnn, CUDNN_BATCHNORM_SPATIAL, &alpha, &beta, stats_descriptor, d_x, stats_descriptor, d_x_hat,
+      scale_bias_descriptor, d_scale, d_bias, exponential_average_factor, nullptr, nullptr, epsilon, d_saved_mean,
+      d_saved_in_var);
+  if (PRINT_IF_ERROR(cudnn_fwd_err)) {
+    state.SkipWithError(fmt::format(BENCHMARK_NAME " failed to cudnnBatchNormalizationForwardTraining because of {}",
+                                    utils::detail::error_string(cudnn_fwd_err))
+                            .c_str());
+    return;
+  }
+
+  cudnnStatus_t cudnn_err;
+  BENCHMARK_BLOCK(cudnn_err, {
+    cudnn_err = cudnnOpTensor(handles.cudnn, mul_descriptor, &alpha, affine_descriptor, d_dy, &alpha,
+                              affine_descriptor, d_x_hat, &beta, affine_descriptor, d_tmp);
+    if (cudnn_err == CUDNN_STATUS_SUCCESS) {
+      cudnn_err = cudnnReduceTensor(handles.cudnn, sum_descriptor, nullptr, 0, d_workspace, workspace_bytes, &alpha,
+                                    affine_descriptor, d_tmp, &beta, param_descriptor, d_dgamma);
+    }
+    if (cudnn_err == CUDNN_STATUS_SUCCESS) {
+      cudnn_err = cudnnReduceTensor(handles.cudnn, sum_descriptor, nullptr, 0, d_workspace, workspace_bytes, &alpha,
+                                    affine_descriptor, d_dy, &beta, param_descriptor, d_dbeta);
+    }
+    if (cudnn_err == CUDNN_STATUS_SUCCESS) {
+      cudnn_err = cudnnOpTensor(handles.cudnn, mul_descriptor, &alpha, affine_descriptor, d_dy, &alpha,
+                                param_descriptor, d_gamma, &beta, affine_descriptor, d_tmp);
+    }
+    if (cudnn_err == CUDNN_STATUS_SUCCESS) {
+      cudnn_err = cudnnBatchNormalizationBackward(handles.cudnn, CUDNN_BATCHNORM_SPATIAL, &alpha, &beta, &alpha, &beta,
+                                                  stats_descriptor, d_x, stats_descriptor, d_tmp, stats_descriptor,
+                                                  d_dx, scale_bias_descriptor, d_scale, d_dscale, d_dbias, epsilon,
+                                                  d_saved_mean, d_saved_in_var);
+    }
+  });
+
+  norm::add_counters<T>(state, problem, true);
+  state.counters.insert({{"workspace_bytes", workspace_bytes},
+                         {"workspace_megabytes", workspace_bytes / 1048576.0},
+                         {"stats_tensor_layout", (int) stats_tensor.layout}});
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * problem.size());
+}
+
+template <typename T, norm::kind_t kind>
+static void LAYER_CUDNN_NORM_BWD_Impl(benchmark::State& state) {
+  try {
+    iLAYER_CUDNN_NORM_BWD_Impl<T, kind>(state);
+  } catch (const std::exception& e) {
+    const auto err = std::string("Exception in " BENCHMARK_NAME) + e.what();
+    state.SkipWithError(err.c_str());
+  } catch (const std::string& e) {
+    const auto err = std::string("Exception in " BENCHMARK_NAME) + e;
+    state.SkipWithError(err.c_str());
+  } catch (...) {
+    state.SkipWithError("unknown exception in " BENCHMARK_NAME);
+  }
+}
+
+static void LAYER_CUDNN_LAYERNORM_BWD_HALF(benchmark::State& state) {
+  LAYER_CUDNN_NORM_BWD_Impl<__half, norm::kind_t::layer>(state);
+}
+
+static void LAYER_CUDNN_LAYERNORM_BWD_FLOAT(benchmark::State& state) {
+  LAYER_CUDNN_NORM_BWD_Impl<float, norm::kind_t::layer>(state);
+}
+
+static void LAYER_CUDNN_GROUPNORM_BWD_HALF(benchmark::State& state) {
+  LAYER_CUDNN_NORM_BWD_Impl<__half, norm::kind_t::group>(state);
+}
+
+static void LAYER_CUDNN_GROUPNORM_BWD_FLOAT(benchmark::State& state) {
+  LAYER_CUDNN_NORM_BWD_Impl<float, norm::kind_t::group>(state);
+}
+
+static void LAYER_CUDNN_INSTANCENORM_BWD_HALF(benchmark::State& state) {
+  LAYER_CUDNN_NORM_BWD_Impl<__half, norm::kind_t::instance>(state);
+}
+
+static void LAYER_CUDNN_INSTANCENORM_BWD_FLOAT(benchmark::State& state) {
+  LAYER_CUDNN_NORM_BWD_Impl<float, norm::kind_t::instance>(state);
+}
+
+BENCHMARK_CUDNN(LAYER_CUDNN_LAYERNORM_BWD_HALF)->LAYERNORM_PROBLEMS()->UseManualTime();
+BENCHMARK_CUDNN(LAYER_CUDNN_LAYERNORM_BWD_FLOAT)->LAYERNORM_PROBLEMS()->UseManualTime();
+BENCHMARK_CUDNN(LAYER_CUDNN_GROUPNORM_BWD_HALF)->GROUPNORM_PROBLEMS()->UseManualTime();
+BENCHMARK_CUDNN(LAYER_CUDNN_GROUPNORM_BWD_FLOAT)->GROUPNORM_PROBLEMS()->UseManualTime();
+BENCHMARK_CUDNN(LAYER_CUDNN_INSTANCENORM_BWD_HALF)->INSTANCENORM_PROBLEMS()->UseManualTime();
+BENCHMARK_CUDNN(LAYER_CUDNN_INSTANCENORM_BWD_FLOAT)->INSTANCENORM_PROBLEMS()->UseManualTime();
@@ -0,0 +1,250 @@
+#define BENCHMARK_NAME "CUDNN/NORM_FWD"
+
+#include <benchmark/benchmark.h>
+
+#include <iostream>
+#include <numeric>
+#include <stdio.h>
+#include <stdlib.h>
+#include <type_traits>
+#include <vector>
+
+#include <cudnn.h>
+
+#include "args.hpp"
+#include "error.hpp"
+#include "helper.hpp"
+#include "init.hpp"
+#include "norm.hpp"
+#include "utils.hpp"
+
+// cudnn 7 has no layer, group or instance normalization call, so the forward
+// pass is built from the calls it has (see norm.hpp):
+//   1. a spatial batch normalization of the stats view, where every row is a
+//      channel, with a unit scale and a zero bias: y = x_hat, and the saved
+//      mean and inverse variance of every row;
+//   2. y *= gamma, broadcast over the affine view;
+//   3. y += beta, broadcast over the affine view.
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnBatchNormalizationForwardTraining
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnOpTensor
+// https://docs.nvidia.com/deeplearning/sdk/cudnn-developer-guide/index.html#cudnnAddTensor
+template <typename T, norm::kind_t kind>
+static void iLAYER_CUDNN_NORM_FWD_Impl(benchmark::State& state) {
+  if (!has_cuda) {
+    state.SkipWithError(BENCHMARK_NAME " no CUDA device found");
+    return;
+  }
+
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
+  const auto problem = norm::problem(state, kind);
+  if (!problem.is_valid()) {
+    state.SkipWithError(BENCHMARK_NAME " got an empty tensor, a begin axis outside of 1..3 or a group count that does "
+                                       "not divide the channels");
+    return;
+  }
+
+  MEM_ALIGNED_128 const T alpha           = detail::one<T>();
+  MEM_ALIGNED_128 const T beta            = detail::zero<T>();
+  const double exponential_average_factor = 1.0;             // exponentialAverageFactor
+  const double epsilon                    = problem.epsilon; // at least CUDNN_BN_MIN_EPSILON
+
+  const auto stats  = problem.stats_view();
+  const auto affine = problem.affine_view();
+  const auto params = problem.param_view();
+
+  MEM_ALIGNED_128 auto stats_tensor = Tensor<T>(state, {stats[0], stats[1], stats[2], stats[3]});
+  if (!stats_tensor.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 cudnnTensorDescriptor_t stats_descriptor = stats_tensor.get();
+
+  MEM_ALIGNED_128 auto affine_tensor = Tensor<T>(state, {affine[0], affine[1], affine[2], affine[3]});
+  if (!affine_tensor.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 cudnnTensorDescriptor_t affine_descriptor = affine_tensor.get();
+
+  MEM_ALIGNED_128 auto param_tensor = Tensor<T>(state, {params[0], params[1], params[2], params[3]});
+  if (!param_tensor.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 cudnnTensorDescriptor_t param_descriptor = param_tensor.get();
+
+  MEM_ALIGNED_128 cudnnTensorDescriptor_t scale_bias_descriptor{nullptr};
+  if (PRINT_IF_ERROR(cudnnCreateTensorDescriptor(&scale_bias_descriptor))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnCreateTensorDescriptor");
+    return;
+  }
+  defer(cudnnDestroyTensorDescriptor(scale_bias_descriptor));
+
+  if (PRINT_IF_ERROR(cudnnDeriveBNTensorDescriptor(scale_bias_descriptor, stats_descriptor, CUDNN_BATCHNORM_SPATIAL))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnDeriveBNTensorDescriptor");
+    return;
+  }
+
+  size_t scale_bias_bytes;
+  if (PRINT_IF_ERROR(cudnnGetTensorSizeInBytes(scale_bias_descriptor, &scale_bias_bytes))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnGetTensorSizeInBytes");
+    return;
+  }
+
+  MEM_ALIGNED_128 cudnnOpTensorDescriptor_t mul_descriptor{nullptr};
+  if (PRINT_IF_ERROR(cudnnCreateOpTensorDescriptor(&mul_descriptor))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnCreateOpTensorDescriptor");
+    return;
+  }
+  defer(cudnnDestroyOpTensorDescriptor(mul_descriptor));
+  if (PRINT_IF_ERROR(cudnnSetOpTensorDescriptor(mul_descriptor, CUDNN_OP_TENSOR_MUL, accumDataType<T>::type,
+                                                CUDNN_NOT_PROPAGATE_NAN))) {
+    state.SkipWithError(BENCHMARK_NAME " failed to cudnnSetOpTensorDescriptor");
+    return;
+  }
+
+  // the batch normalization scales by one and shifts by zero; its parameters
+  // are float for half data (cudnnDeriveBNTensorDescriptor)
+  using bn_param_t = typename std::conditional<is_half_v<T>, float, T>::type;
+  auto unit_scale  = std::vector<bn_param_t>(scale_bias_bytes / sizeof(bn_param_t));
+  auto zero_bias   = std::vector<bn_param_t>(scale_bias_bytes / sizeof(bn_param_t));
+  std::fill(unit_scale.begin(), unit_scale.end(), detail::one<bn_param_t>());
+  std::fill(zero_bias.begin(), zero_bias.end(), detail::zero<bn_param_t>());
+
+  auto input = std::vector<T>(problem.size());
+  auto param = std::vector<T>(problem.param_size());
+  std::fill(input.begin(), input.end(), detail::one<T>());
+  std::fill(param.begin(), param.end(), detail::one<T>());
+
+  const auto input_bytes = problem.size() * sizeof(T);
+  const auto param_bytes = problem.param_size() * sizeof(T);
+
+  MEM_ALIGNED_128 DeviceMemory<T> x_memory(state, input.data(), input_bytes);
+  if (!x_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_x = x_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> y_memory(state, input_bytes);
+  if (!y_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_y = y_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> gamma_memory(state, param.data(), param_bytes);
+  if (!gamma_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_gamma = gamma_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<T> beta_memory(state, param.data(), param_bytes);
+  if (!beta_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_beta = beta_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<bn_param_t> scale_memory(state, unit_scale.data(), scale_bias_bytes);
+  if (!scale_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_scale = scale_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<bn_param_t> bias_memory(state, zero_bias.data(), scale_bias_bytes);
+  if (!bias_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_bias = bias_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<bn_param_t> saved_mean_memory(state, scale_bias_bytes);
+  if (!saved_mean_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_saved_mean = saved_mean_memory.get();
+
+  MEM_ALIGNED_128 DeviceMemory<bn_param_t> saved_in_var_memory(state, scale_bias_bytes);
+  if (!saved_in_var_memory.is_valid) {
+    return;
+  }
+  MEM_ALIGNED_128 const auto d_saved_in_var = saved_in_var_memory.get();
+
+  cudnnStatus_t cudnn_err;
+  BENCHMARK_BLOCK(cudnn_err, {
+    // no running averages: the statistics of a row are not reused across inputs
+    cudnn_err = cudnnBatchNormalizationForwardTraining(handles.cudnn,
+                                                       CUDNN_BATCHNORM_SPATIAL,
+                                                       &alpha,
+                                                       &beta,
+                                                       stats_descriptor,
+                                                       d_x,
+                                                       stats_descriptor,
+                                                       d_y,
+                                                       scale_bias_descriptor,
+                                                       d_scale,
+                                                       d_bias,
+                                                       exponential_average_factor,
+                                                       nullptr,
+                                                       nullptr,
+                                                       epsilon,
+                                                       d_saved_mean,
+                                                       d_saved_in_var);
+    if (cudnn_err == CUDNN_STATUS_SUCCESS) {
+      cudnn_err = cudnnOpTensor(handles.cudnn, mul_descriptor, &alpha, affine_descriptor, d_y, &alpha,
+                                param_descriptor, d_gamma, &beta, affine_descriptor, d_y);
+    }
+    if (cudnn_err == CUDNN_STATUS_SUCCESS) {
+      cudnn_err = cudnnAddTensor(handles.cudnn, &alpha, param_descriptor, d_beta, &alpha, affine_descriptor, d_y);
+    }
+  });
+
+  norm::add_counters<T>(state, problem, false);
+  state.counters.insert({{"stats_tensor_layout", (int) stats_tensor.layout}});
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * problem.size());
+}
+
+template <typename T, norm::kind_t kind>
+static void LAYER_CUDNN_NORM_FWD_Impl(benchmark::State& state) {
+  try {
+    iLAYER_CUDNN_NORM_FWD_Impl<T, kind>(state);
+  } catch (const std::exception& e) {
+    const auto err = std::string("Exception in " BENCHMARK_NAME) + e.what();
+    state.SkipWithError(err.c_str());
+  } catch (const std::string& e) {
+    const auto err = std::string("Exception in " BENCHMARK_NAME) + e;
+    state.SkipWithError(err.c_str());
+  } catch (...) {
+    state.SkipWithError("unknown exception in " BENCHMARK_NAME);
+  }
+}
+
+static void LAYER_CUDNN_LAYERNORM_FWD_HALF(benchmark::State& state) {
+  LAYER_CUDNN_NORM_FWD_Impl<__half, norm::kind_t::layer>(state);
+}
+
+static void LAYER_CUDNN_LAYERNORM_FWD_FLOAT(benchmark::State& state) {
+  LAYER_CUDNN_NORM_FWD_Impl<float, norm::kind_t::layer>(state);
+}
+
+static void LAYER_CUDNN_GROUPNORM_FWD_HALF(benchmark::State& state) {
+  LAYER_CUDNN_NORM_FWD_Impl<__half, norm::kind_t::group>(state);
+}
+
+static void LAYER_CUDNN_GROUPNORM_FWD_FLOAT(benchmark::State& state) {
+  LAYER_CUDNN_NORM_FWD_Impl<float, norm::kind_t::group>(state);
+}
+
+static void LAYER_CUDNN_INSTANCENORM_FWD_HALF(benchmark::State& state) {
+  LAYER_CUDNN_NORM_FWD_Impl<__half, norm::kind_t::instance>(state);
+}
+
+static void LAYER_CUDNN_INSTANCENORM_FWD_FLOAT(benchmark::State& state) {
+  LAYER_CUDNN_NORM_FWD_Impl<float, norm::kind_t::instance>(state);
+}
+
+BENCHMARK_CUDNN(LAYER_CUDNN_LAYERNORM_FWD_HALF)->LAYERNORM_PROBLEMS()->UseManualTime();
+BENCHMARK_CUDNN(LAYER_CUDNN_LAYERNORM_FWD_FLOAT)->LAYERNORM_PROBLEMS()->UseManualTime();
+BENCHMARK_CUDNN(LAYER_CUDNN_GROUPNORM_FWD_HALF)->GROUPNORM_PROBLEMS()->UseManualTime();
+BENCHMARK_CUDNN(LAYER_CUDNN_GROUPNORM_FWD_FLOAT)->GROUPNORM_PROBLEMS()->UseManualTime();
+BENCHMARK_CUDNN(LAYER_CUDNN_INSTANCENORM_FWD_HALF)->INSTANCENORM_PROBLEMS()->UseManualTime();
+BENCHMARK_CUDNN(LAYER_CUDNN_INSTANCENORM_FWD_FLOAT)->INSTANCENORM_PROBLEMS()->UseManualTime();
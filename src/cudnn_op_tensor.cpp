@@ -27,6 +27,11 @@ static void iLAYER_CUDNN_OP_TENSOR_Impl(benchmark::State& state) {
     return;
   }
 
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
   // C = OP(alpha * A, alpha * B) + beta * C
   const auto in_n = state.range(0);
   const auto in_c = state.range(1);
@@ -99,7 +104,7 @@ static void iLAYER_CUDNN_OP_TENSOR_Impl(benchmark::State& state) {
 
   cudnnStatus_t cudnn_err;
   BENCHMARK_BLOCK(cudnn_err, {
-    cudnn_err = cudnnOpTensor(cudnn_handle, op_descriptor, &alpha, input_a_descriptor, d_a_input, &alpha,
+    cudnn_err = cudnnOpTensor(handles.cudnn, op_descriptor, &alpha, input_a_descriptor, d_a_input, &alpha,
                               input_b_descriptor, d_b_input, &beta, output_descriptor, d_output);
   });
 
@@ -28,6 +28,11 @@ static void iLAYER_CUDNN_POOLING_BWD_Impl(benchmark::State& state) {
     return;
   }
 
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
   const auto in_n         = state.range(0);
   const auto in_c         = state.range(1);
   const auto in_h         = state.range(2);
@@ -123,7 +128,7 @@ static void iLAYER_CUDNN_POOLING_BWD_Impl(benchmark::State& state) {
 
   cudnnStatus_t cudnn_err;
   BENCHMARK_BLOCK(cudnn_err, {
-    cudnn_err = cudnnPoolingBackward(cudnn_handle,
+    cudnn_err = cudnnPoolingBackward(handles.cudnn,
                                      pooling_descriptor,
                                      &alpha,
                                      y_descriptor,
@@ -28,6 +28,11 @@ static void iLAYER_CUDNN_POOLING_FWD_Impl(benchmark::State& state) {
     return;
   }
 
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
   const auto in_n         = state.range(0);
   const auto in_c         = state.range(1);
   const auto in_h         = state.range(2);
@@ -110,7 +115,7 @@ static void iLAYER_CUDNN_POOLING_FWD_Impl(benchmark::State& state) {
   cudnnStatus_t cudnn_err;
   BENCHMARK_BLOCK(cudnn_err, {
     cudnn_err =
-        cudnnPoolingForward(cudnn_handle, pooling_descriptor, &alpha, x_descriptor, d_x, &beta, y_descriptor, d_y);
+        cudnnPoolingForward(handles.cudnn, pooling_descriptor, &alpha, x_descriptor, d_x, &beta, y_descriptor, d_y);
   });
 
   state.counters.insert({{"input_size", in_n * in_c * in_h * in_w},
@@ -26,6 +26,11 @@ static void iLAYER_CUDNN_SCALE_TENSOR_Impl(benchmark::State& state) {
     return;
   }
 
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
   const auto in_n = state.range(0);
   const auto in_c = state.range(1);
   const auto in_h = state.range(2);
@@ -60,11 +65,11 @@ static void iLAYER_CUDNN_SCALE_TENSOR_Impl(benchmark::State& state) {
   PRINT_IF_ERROR(cudaEventCreate(&stop));
 
   for (auto _ : state) {
-    cudaEventRecord(start, NULL);
+    cudaEventRecord(start, handles.stream);
 
-    const cudnnStatus_t cudnn_err = cudnnScaleTensor(cudnn_handle, input_descriptor, d_input, &alpha);
+    const cudnnStatus_t cudnn_err = cudnnScaleTensor(handles.cudnn, input_descriptor, d_input, &alpha);
 
-    cudaEventRecord(stop, NULL);
+    cudaEventRecord(stop, handles.stream);
     const auto cuda_err = cudaEventSynchronize(stop);
 
     state.PauseTiming();
@@ -27,6 +27,11 @@ static void iLAYER_CUDNN_SOFTMAX_BWD_Impl(benchmark::State& state) {
     return;
   }
 
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
   const auto in_n = state.range(0);
   const auto in_c = state.range(1);
   const auto in_h = state.range(2) == -1 ? 1 : state.range(2);
@@ -71,7 +76,7 @@ static void iLAYER_CUDNN_SOFTMAX_BWD_Impl(benchmark::State& state) {
 
   cudnnStatus_t cudnn_err;
   BENCHMARK_BLOCK(cudnn_err, {
-    cudnn_err = cudnnSoftmaxBackward(cudnn_handle,
+    cudnn_err = cudnnSoftmaxBackward(handles.cudnn,
                                      softmax_algorithm,
                                      softmax_mode,
                                      &alpha,
@@ -27,6 +27,11 @@ static void iLAYER_CUDNN_SOFTMAX_FWD_Impl(benchmark::State& state) {
     return;
   }
 
+  const handle_pool::lease handles(state);
+  if (!handles.is_valid) {
+    return;
+  }
+
   const auto in_n = state.range(0);
   const auto in_c = state.range(1);
   const auto in_h = state.range(2) == -1 ? 1 : state.range(2);
@@ -65,7 +70,7 @@ static void iLAYER_CUDNN_SOFTMAX_FWD_Impl(benchmark::State& state) {
 
   cudnnStatus_t cudnn_err;
   BENCHMARK_BLOCK(cudnn_err, {
-    cudnn_err = cudnnSoftmaxForward(cudnn_handle, softmax_algorithm, softmax_mode, &alpha, x_descriptor, d_x, &beta,
+    cudnn_err = cudnnSoftmaxForward(handles.cudnn, softmax_algorithm, softmax_mode, &alpha, x_descriptor, d_x, &beta,
                                     x_descriptor, d_y);
   });
 
@@ -4,6 +4,9 @@
 #include <cassert>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <set>
+#include <unordered_map>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -12,6 +15,7 @@
 
 #include "fmt/printf.h"
 #include "init.hpp"
+#include "metric_planner.hpp"
 #include "prettyprint.hpp"
 
 #define DRIVER_API_CALL(apiFuncCall)                                                                                   \
@@ -49,6 +53,10 @@
     }                                                                                                                  \
   } while (0)
 
+#ifndef CUDNN_CUPTI_NUM_ITERS
+#define CUDNN_CUPTI_NUM_ITERS 4
+#endif // CUDNN_CUPTI_NUM_ITERS
+
 #define _LOG(...) LOG(debug, fmt::sprintf("[Log]: " __VA_ARGS__))
 #define _DBG(...) LOG(debug, fmt::sprintf("[Log]: " __VA_ARGS__))
 
@@ -89,6 +97,16 @@ namespace detail {
     metric_val_t m_metric_values;
   };
 
+  using kernel_data_map_t = std::unordered_map<std::string, kernel_data_t>;
+
+  // CUPTI allows a single subscriber, so every profiler shares one and
+  // points it to its kernel data while it is started.
+  struct subscription_t {
+    CUpti_SubscriberHandle handle;
+    bool subscribed{false};
+    kernel_data_map_t *active{nullptr};
+  };
+
   static void CUPTIAPI get_value_callback(void *userdata,
                                           CUpti_CallbackDomain UNUSED domain,
                                           CUpti_CallbackId cbid,
@@ -112,8 +130,10 @@ namespace detail {
       return;
     }
 
-    std::map<std::string, detail::kernel_data_t> *kernel_data =
-        (std::map<std::string, detail::kernel_data_t> *) userdata;
+    auto kernel_data = ((subscription_t *) userdata)->active;
+    if (kernel_data == nullptr) {
+      return;
+    }
 
     if (cbInfo->callbackSite == CUPTI_API_ENTER) {
       // If this is kernel name hasn't been seen before
@@ -241,6 +261,23 @@ namespace detail {
     }
   }
 
+  inline subscription_t &subscription() {
+    static subscription_t instance;
+    if (!instance.subscribed) {
+      CUPTI_CALL(cuptiSubscribe(&instance.handle, (CUpti_CallbackFunc) get_value_callback, &instance));
+      instance.subscribed = true;
+    }
+    return instance;
+  }
+
+  static void enable_launch_callbacks(uint32_t enable) {
+    const auto handle = subscription().handle;
+    CUPTI_CALL(
+        cuptiEnableCallback(enable, handle, CUPTI_CB_DOMAIN_RUNTIME_API, CUPTI_RUNTIME_TRACE_CBID_cudaLaunch_v3020));
+    CUPTI_CALL(cuptiEnableCallback(enable, handle, CUPTI_CB_DOMAIN_RUNTIME_API,
+                                   CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000));
+  }
+
   static double metric_value_to_double(CUpti_MetricID &id, CUpti_MetricValue &value) {
     CUpti_MetricValueKind value_kind;
     size_t value_kind_sz = sizeof(value_kind);
@@ -269,6 +306,10 @@ namespace detail {
 
 } // namespace detail
 
+// A profiling session. Metric and event ids, the event group sets and the
+// callback subscription are resolved once when the session is created;
+// start() and stop() only arm the callbacks and collect the values of the
+// kernels launched in between, so a session can be reused across iterations.
 struct profiler {
   typedef std::vector<std::string> strvec_t;
   using event_val_t  = detail::kernel_data_t::event_val_t;
@@ -280,7 +321,6 @@ struct profiler {
 
     int device_count = 0;
 
-    CUPTI_CALL(cuptiActivityEnable(CUPTI_ACTIVITY_KIND_KERNEL));
     DRIVER_API_CALL(cuDeviceGetCount(&device_count));
     if (device_count == 0) {
       const auto err = fmt::format("There is no device supporting CUDA.\n");
@@ -291,13 +331,6 @@ struct profiler {
     m_metric_ids.resize(m_num_metrics);
     m_event_ids.resize(m_num_events);
 
-    // Init device, context and setup callback
-    CUPTI_CALL(cuptiSubscribe(&m_subscriber, (CUpti_CallbackFunc) detail::get_value_callback, &m_kernel_data));
-    CUPTI_CALL(
-        cuptiEnableCallback(1, m_subscriber, CUPTI_CB_DOMAIN_RUNTIME_API, CUPTI_RUNTIME_TRACE_CBID_cudaLaunch_v3020));
-    CUPTI_CALL(cuptiEnableCallback(1, m_subscriber, CUPTI_CB_DOMAIN_RUNTIME_API,
-                                   CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000));
-
     CUpti_MetricID *metric_ids = (CUpti_MetricID *) calloc(sizeof(CUpti_MetricID), m_num_metrics);
     defer(free(metric_ids));
     for (int i = 0; i < m_num_metrics; ++i) {
@@ -320,11 +353,6 @@ struct profiler {
       std::copy(metric_ids, metric_ids + m_num_metrics, m_metric_ids.begin());
 
       _LOG("# metric_passes = %d", m_metric_passes);
-
-      if (m_metric_passes > 1) {
-        CUPTI_CALL(cuptiEnableKernelReplayMode(m_context));
-        _LOG("replaying kernel...");
-      }
     }
     if (m_num_events > 0) {
       CUPTI_CALL(
@@ -382,19 +410,51 @@ struct profiler {
   }
 
   ~profiler() {
+    // the session may outlive the context at exit, so errors are ignored here
+    if (m_metric_pass_data != nullptr) {
+      cuptiEventGroupSetsDestroy(m_metric_pass_data);
+    }
+    if (m_event_pass_data != nullptr) {
+      cuptiEventGroupSetsDestroy(m_event_pass_data);
+    }
   }
 
   int get_passes() {
     return m_metric_passes + m_event_passes;
   }
 
+  // Every pass but the first is a replay of the kernel, whether the passes
+  // come from the metrics, the events or both (the replayed slot of the
+  // planner merges them).
+  bool needs_replay() const {
+    return m_metric_passes + m_event_passes > 1;
+  }
+
   void start() {
+    // drop the kernels collected by the previous iteration
+    for (auto it = m_kernel_data.begin(); it != m_kernel_data.end();) {
+      if (it->first == dummy_kernel_name) {
+        ++it;
+      } else {
+        it = m_kernel_data.erase(it);
+      }
+    }
+    m_kernel_names.clear();
+
+    if (needs_replay()) {
+      CUPTI_CALL(cuptiEnableKernelReplayMode(m_context));
+      _LOG("replaying kernel...");
+    }
+    detail::subscription().active = &m_kernel_data;
+    detail::enable_launch_callbacks(1);
   }
 
   void stop() {
+    detail::enable_launch_callbacks(0);
+    detail::subscription().active = nullptr;
 
     _LOG("# metric_passes = %d", m_metric_passes);
-    if (m_metric_passes > 1) {
+    if (needs_replay()) {
       CUPTI_CALL(cuptiDisableKernelReplayMode(m_context));
       _LOG("disable replay kernel...");
     }
@@ -431,11 +491,13 @@ struct profiler {
             cuptiMetricGetValue(m_device, m_metric_ids[i], total_events * sizeof(CUpti_EventID), event_ids,
                                 total_events * sizeof(uint64_t), event_values, 0, &metric_value);
         if (_status != CUPTI_SUCCESS) {
-          // const char *errstr;
-          // cuptiGetResultString(_status, &errstr);
-          // const auto err =
-          //     fmt::format("Metric value retrieval failed for metric {} because of {}.\n", m_metric_names[i], errstr);
-          // std::cerr << err;
+          // reported once per metric, the value is left out of the counters
+          if (m_failed_metrics.insert(m_metric_names[i]).second) {
+            const char *errstr;
+            cuptiGetResultString(_status, &errstr);
+            LOG(error, fmt::format("metric value retrieval failed for metric {} because of {}", m_metric_names[i],
+                                   errstr));
+          }
           continue;
         }
         k.second.m_metric_values.insert(
@@ -453,13 +515,14 @@ struct profiler {
         k.second.m_event_values.insert({"xxx", event_map[m_event_ids[i]]});
       }
     }
+  }
 
-    // Disable callback and unsubscribe
-    CUPTI_CALL(
-        cuptiEnableCallback(0, m_subscriber, CUPTI_CB_DOMAIN_RUNTIME_API, CUPTI_RUNTIME_TRACE_CBID_cudaLaunch_v3020));
-    CUPTI_CALL(cuptiEnableCallback(0, m_subscriber, CUPTI_CB_DOMAIN_RUNTIME_API,
-                                   CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000));
-    CUPTI_CALL(cuptiUnsubscribe(m_subscriber));
+  const strvec_t &metric_names() const {
+    return m_metric_names;
+  }
+
+  const strvec_t &event_names() const {
+    return m_event_names;
   }
 
   std::vector<std::string> get_kernel_names() {
@@ -488,25 +551,96 @@ struct profiler {
   }
 
 private:
-  const strvec_t &m_event_names{};
-  const strvec_t &m_metric_names{};
+  const strvec_t m_event_names{};
+  const strvec_t m_metric_names{};
   uint32_t m_device_num;
   int m_num_metrics, m_num_events;
   std::vector<CUpti_MetricID> m_metric_ids;
   std::vector<CUpti_EventID> m_event_ids;
 
-  CUpti_SubscriberHandle m_subscriber;
-
-  CUpti_EventGroupSets *m_metric_pass_data;
-  CUpti_EventGroupSets *m_event_pass_data;
+  CUpti_EventGroupSets *m_metric_pass_data{nullptr};
+  CUpti_EventGroupSets *m_event_pass_data{nullptr};
 
   int m_metric_passes, m_event_passes;
   // Kernel-specific (indexed by name) trace data
-  std::map<std::string, detail::kernel_data_t> m_kernel_data;
+  detail::kernel_data_map_t m_kernel_data;
   std::vector<std::string> m_kernel_names;
+  std::set<std::string> m_failed_metrics;
   int m_num_kernels;
 };
 
+static bool metrics_fit_one_pass(const std::vector<std::string> &names) {
+  std::vector<CUpti_MetricID> ids(names.size());
+  for (size_t ii = 0; ii < names.size(); ii++) {
+    if (cuptiMetricGetIdFromName(m_device, names[ii].c_str(), &ids[ii]) != CUPTI_SUCCESS) {
+      return false;
+    }
+  }
+  CUpti_EventGroupSets *sets = nullptr;
+  if (cuptiMetricCreateEventGroupSets(m_context, sizeof(CUpti_MetricID) * ids.size(), ids.data(), &sets) !=
+      CUPTI_SUCCESS) {
+    return false;
+  }
+  const auto res = sets->numSets == 1;
+  cuptiEventGroupSetsDestroy(sets);
+  return res;
+}
+
+static bool events_fit_one_pass(const std::vector<std::string> &names) {
+  std::vector<CUpti_EventID> ids(names.size());
+  for (size_t ii = 0; ii < names.size(); ii++) {
+    if (cuptiEventGetIdFromName(m_device, names[ii].c_str(), &ids[ii]) != CUPTI_SUCCESS) {
+      return false;
+    }
+  }
+  CUpti_EventGroupSets *sets = nullptr;
+  if (cuptiEventGroupSetsCreate(m_context, sizeof(CUpti_EventID) * ids.size(), ids.data(), &sets) != CUPTI_SUCCESS) {
+    return false;
+  }
+  const auto res = sets->numSets == 1;
+  cuptiEventGroupSetsDestroy(sets);
+  return res;
+}
+
+// One profiler per planned pass (see metric_planner.hpp). Iteration i is
+// profiled by the profiler of slot i % slots, so the passes are spread over
+// the benchmark iterations instead of being replayed within each of them.
+class planned_session {
+public:
+  planned_session(const profiler::strvec_t &events, const profiler::strvec_t &metrics, size_t num_iterations) {
+    const auto metric_plan = metric_planner::plan(metrics, metrics_fit_one_pass);
+    const auto event_plan  = metric_planner::plan(events, events_fit_one_pass);
+    m_slots                = metric_planner::schedule(metric_plan, event_plan, num_iterations);
+    for (const auto &slot : m_slots) {
+      _LOG("slot %d: %d metrics, %d events, replay=%d", m_profilers.size(), slot.metrics.size(), slot.events.size(),
+           slot.replay);
+      m_profilers.emplace_back(new profiler(slot.events, slot.metrics));
+    }
+  }
+
+  // nullptr if there is nothing to profile
+  profiler *for_iteration(int iteration) {
+    if (m_profilers.empty()) {
+      return nullptr;
+    }
+    return m_profilers[iteration % m_profilers.size()].get();
+  }
+
+  const std::vector<metric_planner::slot_t> &slots() const {
+    return m_slots;
+  }
+
+private:
+  std::vector<metric_planner::slot_t> m_slots{};
+  std::vector<std::unique_ptr<profiler>> m_profilers{};
+};
+
+// The process wide session, created on first use with the --metrics and --events flags.
+inline planned_session &session() {
+  static planned_session instance(::events, ::metrics, CUDNN_CUPTI_NUM_ITERS);
+  return instance;
+}
+
 #ifndef __CUPTI_PROFILER_NAME_SHORT
 #define __CUPTI_PROFILER_NAME_SHORT 128
 #endif
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <benchmark/benchmark.h>
+
+#include "conv_group.hpp"
+#include "conv_nd.hpp"
+
+// Transposed convolutions (deconvolutions) of decoder and segmentation networks.
+//
+// A deconvolution upsamples an N x C x H x W input into an N x K x P x Q
+// output, P = (H - 1) * stride - 2 * pad + dilation * (R - 1) + output_pad + 1,
+// with C x K/group x R x S filters. It is the backward data pass of the
+// convolution that maps the output back onto the input (as_conv), which is
+// how cudnn and the CPU reference run it. A strided convolution maps several
+// output sizes onto the same input size; the output padding, smaller than
+// the stride, picks one of them.
+//
+// The problems use the arg layout of DECONV_ARG_NAMES: N, C, H, W, K, R, S,
+// then the pads, strides, output pads and dilations of the height and width,
+// and the group count.
+namespace deconv {
+
+// height, width
+using dims_t = std::array<int, 2>;
+
+struct problem_t {
+  int batch_size{1};
+  int in_channels{1};
+  int out_channels{1};
+  int group{1};
+  dims_t input{{1, 1}};
+  dims_t filter{{1, 1}};
+  dims_t pad{{0, 0}};
+  dims_t stride{{1, 1}};
+  dims_t output_pad{{0, 0}};
+  dims_t dilation{{1, 1}};
+
+  dims_t output() const {
+    dims_t res;
+    for (int ii = 0; ii < 2; ii++) {
+      res[ii] = (input[ii] - 1) * stride[ii] - 2 * pad[ii] + dilation[ii] * (filter[ii] - 1) + output_pad[ii] + 1;
+    }
+    return res;
+  }
+
+  // The convolution whose backward data pass this is: its input is the
+  // output of the deconvolution and its filters map K channels onto C.
+  conv_nd::problem_t as_conv() const {
+    const auto out = output();
+    conv_nd::problem_t res;
+    res.batch_size  = batch_size;
+    res.channels    = out_channels;
+    res.num_filters = in_channels;
+    res.group       = group;
+    res.input       = {{1, out[0], out[1]}};
+    res.filter      = {{1, filter[0], filter[1]}};
+    res.pad         = {{0, pad[0], pad[1]}};
+    res.stride      = {{1, stride[0], stride[1]}};
+    res.dilation    = {{1, dilation[0], dilation[1]}};
+    return res;
+  }
+
+  // The output is not empty, the group divides both channel counts, the output
+  // pads are smaller than the strides, and the convolution maps the output back
+  // onto the input.
+  bool is_valid() const {
+    const auto out = output();
+    for (int ii = 0; ii < 2; ii++) {
+      if (out[ii] <= 0 || output_pad[ii] < 0 || output_pad[ii] >= stride[ii]) {
+        return false;
+      }
+    }
+    const auto conv = as_conv();
+    if (!conv.is_valid()) {
+      return false;
+    }
+    const auto conv_out = conv.output();
+    return conv_out[1] == input[0] && conv_out[2] == input[1];
+  }
+
+  int64_t input_size() const {
+    return int64_t(batch_size) * in_channels * input[0] * input[1];
+  }
+
+  int64_t filter_size() const {
+    return int64_t(in_channels) * (out_channels / group) * filter[0] * filter[1];
+  }
+
+  int64_t output_size() const {
+    const auto out = output();
+    return int64_t(batch_size) * out_channels * out[0] * out[1];
+  }
+
+  // Every input element is scattered through K/group x R x S taps, whatever the algorithm.
+  double flops() const {
+    return static_cast<double>(batch_size) * in_channels * (out_channels / group) * filter[0] * filter[1] *
+           input[0] * input[1];
+  }
+};
+
+// An arg of 0 picks the default, except for the pads and output pads.
+static problem_t problem(const benchmark::State &state) {
+  const auto arg = [&](int ii, int default_value) {
+    const auto value = static_cast<int>(state.range(ii));
+    return value == 0 ? default_value : value;
+  };
+  problem_t res;
+  res.batch_size   = arg(0, 1);
+  res.in_channels  = arg(1, 1);
+  res.out_channels = arg(4, 1);
+  for (int ii = 0; ii < 2; ii++) {
+    res.input[ii]      = arg(2 + ii, 1);
+    res.filter[ii]     = arg(5 + ii, 1);
+    res.pad[ii]        = static_cast<int>(state.range(7 + ii));
+    res.stride[ii]     = arg(9 + ii, 1);
+    res.output_pad[ii] = static_cast<int>(state.range(11 + ii));
+    res.dilation[ii]   = arg(13 + ii, 1);
+  }
+  res.group = arg(15, 1);
+  return res;
+}
+
+template <typename T>
+static void add_counters(benchmark::State &state, const problem_t &problem) {
+  const auto out = problem.output();
+  state.counters.insert({{"input_size", problem.input_size()},
+                         {"input_batch_size", problem.batch_size},
+                         {"input_channels", problem.in_channels},
+                         {"input_height", problem.input[0]},
+                         {"input_width", problem.input[1]},
+                         {"num_filters", problem.out_channels},
+                         {"filter_height", problem.filter[0]},
+                         {"filter_width", problem.filter[1]},
+                         {"pad_height", problem.pad[0]},
+                         {"pad_width", problem.pad[1]},
+                         {"stride_height", problem.stride[0]},
+                         {"stride_width", problem.stride[1]},
+                         {"output_pad_height", problem.output_pad[0]},
+                         {"output_pad_width", problem.output_pad[1]},
+                         {"dilation_height", problem.dilation[0]},
+                         {"dilation_width", problem.dilation[1]},
+                         {"output_size", problem.output_size()},
+                         {"output_batch_size", problem.batch_size},
+                         {"output_channels", problem.out_channels},
+                         {"output_height", out[0]},
+                         {"output_width", out[1]}});
+  const auto predicted_flops = problem.flops();
+  state.counters.insert(
+      {{"predicted_flops_count", predicted_flops},
+       {"predicted_flops", {predicted_flops * state.iterations(), benchmark::Counter::kAvgThreadsRate}}});
+  // the groups in terms of the transposed convolution, whose input is our output
+  const auto conv = problem.as_conv();
+  conv_group::add_counters<T>(state, {conv.batch_size, conv.channels, conv.num_filters, conv.group,
+                                      int64_t(problem.filter[0]) * problem.filter[1], int64_t(out[0]) * out[1],
+                                      int64_t(problem.input[0]) * problem.input[1]});
+}
+
+} // namespace deconv
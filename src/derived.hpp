@@ -0,0 +1,469 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+#include "range_profiler.hpp"
+#include "results.hpp"
+
+// Derived hardware efficiency metrics.
+//
+// The raw profiler values of a result file (kernel_stat, range_metric and the
+// older kernel_metric counters) are combined with the benchmark time and the
+// analytic predicted_flops_count into metrics such as the achieved DRAM
+// bandwidth, the achieved FLOP/s, the arithmetic intensity and the ratio of
+// measured to predicted flops, once per benchmark and once per kernel.
+//
+// The formulas are read from a small expression file, one `name = expression`
+// per line, evaluated in order so later formulas can use earlier ones:
+//
+//   # bytes moved to and from device memory
+//   dram_bytes = dram_read_bytes + dram_write_bytes
+//   achieved_dram_bandwidth = dram_bytes / time
+//
+// Expressions support + - * / ( ), numbers and the functions min(a, b),
+// max(a, b), sum(a, ...) and default(a, b). Unknown names are undefined
+// (NaN); sum skips undefined arguments, default(a, b) is b when a is
+// undefined, and formulas that end up undefined are not reported.
+namespace derived {
+
+using json = nlohmann::json;
+
+using scope_t = std::map<std::string, double>;
+
+static const double undefined = std::numeric_limits<double>::quiet_NaN();
+
+static const char *default_formulas = R"(# bytes moved to and from device memory
+dram_bytes = dram_read_bytes + dram_write_bytes
+achieved_dram_bandwidth = dram_bytes / time
+# single precision flops, from their components on the range profiler
+sp_flops = default(flop_count_sp, flop_count_sp_add + flop_count_sp_mul + 2 * flop_count_sp_fma)
+hp_flops = default(flop_count_hp, flop_count_hp_add + flop_count_hp_mul + 2 * flop_count_hp_fma)
+dp_flops = default(flop_count_dp, flop_count_dp_add + flop_count_dp_mul + 2 * flop_count_dp_fma)
+flops = sum(sp_flops, hp_flops, dp_flops)
+achieved_flops = flops / time
+arithmetic_intensity = flops / dram_bytes
+measured_to_predicted_flops = flops / predicted_flops
+predicted_flops_per_second = predicted_flops / time
+# with --power_sampling
+achieved_flops_per_watt = achieved_flops / power_w_mean
+predicted_flops_per_joule = predicted_flops / energy_per_iteration_j
+)";
+
+class expression {
+public:
+  explicit expression(const std::string &text) : m_text(text) {
+    m_root = parse_sum();
+    skip_space();
+    if (m_pos != m_text.size()) {
+      fail("unexpected " + m_text.substr(m_pos, 1));
+    }
+  }
+
+  double evaluate(const scope_t &scope) const {
+    return evaluate(*m_root, scope);
+  }
+
+private:
+  struct node_t {
+    // '+', '-', '*', '/', 'n' number, 'v' variable, 'f' function, 'u' unary minus
+    char kind{'n'};
+    double number{0};
+    std::string name{""};
+    std::vector<std::unique_ptr<node_t>> args{};
+  };
+  using node_ptr = std::unique_ptr<node_t>;
+
+  [[noreturn]] void fail(const std::string &msg) const {
+    throw std::runtime_error("invalid expression \"" + m_text + "\": " + msg);
+  }
+
+  void skip_space() {
+    while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+      m_pos++;
+    }
+  }
+
+  bool accept(char c) {
+    skip_space();
+    if (m_pos < m_text.size() && m_text[m_pos] == c) {
+      m_pos++;
+      return true;
+    }
+    return false;
+  }
+
+  static node_ptr binary(char kind, node_ptr lhs, node_ptr rhs) {
+    node_ptr res(new node_t);
+    res->kind = kind;
+    res->args.emplace_back(std::move(lhs));
+    res->args.emplace_back(std::move(rhs));
+    return res;
+  }
+
+  node_ptr parse_sum() {
+    auto res = parse_product();
+    while (true) {
+      if (accept('+')) {
+        res = binary('+', std::move(res), parse_product());
+      } else if (accept('-')) {
+        res = binary('-', std::move(res), parse_product());
+      } else {
+        return res;
+      }
+    }
+  }
+
+  node_ptr parse_product() {
+    auto res = parse_unary();
+    while (true) {
+      if (accept('*')) {
+        res = binary('*', std::move(res), parse_unary());
+      } else if (accept('/')) {
+        res = binary('/', std::move(res), parse_unary());
+      } else {
+        return res;
+      }
+    }
+  }
+
+  node_ptr parse_unary() {
+    if (accept('-')) {
+      node_ptr res(new node_t);
+      res->kind = 'u';
+      res->args.emplace_back(parse_unary());
+      return res;
+    }
+    return parse_primary();
+  }
+
+  node_ptr parse_primary() {
+    if (accept('(')) {
+      auto res = parse_sum();
+      if (!accept(')')) {
+        fail("missing )");
+      }
+      return res;
+    }
+    skip_space();
+    if (m_pos == m_text.size()) {
+      fail("unexpected end");
+    }
+    node_ptr res(new node_t);
+    const auto c = m_text[m_pos];
+    if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+      size_t len  = 0;
+      res->kind   = 'n';
+      res->number = std::stod(m_text.substr(m_pos), &len);
+      m_pos += len;
+      return res;
+    }
+    if (!std::isalpha(static_cast<unsigned char>(c)) && c != '_') {
+      fail("unexpected " + std::string(1, c));
+    }
+    const auto begin = m_pos;
+    while (m_pos < m_text.size() &&
+           (std::isalnum(static_cast<unsigned char>(m_text[m_pos])) || m_text[m_pos] == '_' || m_text[m_pos] == '.')) {
+      m_pos++;
+    }
+    res->name = m_text.substr(begin, m_pos - begin);
+    if (!accept('(')) {
+      res->kind = 'v';
+      return res;
+    }
+    res->kind = 'f';
+    if (!accept(')')) {
+      do {
+        res->args.emplace_back(parse_sum());
+      } while (accept(','));
+      if (!accept(')')) {
+        fail("missing ) after the arguments of " + res->name);
+      }
+    }
+    const auto num_args = res->args.size();
+    if (((res->name == "min" || res->name == "max" || res->name == "default") && num_args != 2) ||
+        (res->name == "sum" && num_args == 0)) {
+      fail("wrong number of arguments for " + res->name);
+    }
+    if (res->name != "min" && res->name != "max" && res->name != "default" && res->name != "sum") {
+      fail("unknown function " + res->name);
+    }
+    return res;
+  }
+
+  static double evaluate(const node_t &node, const scope_t &scope) {
+    switch (node.kind) {
+    case 'n':
+      return node.number;
+    case 'v': {
+      const auto it = scope.find(node.name);
+      return it == scope.end() ? undefined : it->second;
+    }
+    case 'u':
+      return -evaluate(*node.args[0], scope);
+    case '+':
+      return evaluate(*node.args[0], scope) + evaluate(*node.args[1], scope);
+    case '-':
+      return evaluate(*node.args[0], scope) - evaluate(*node.args[1], scope);
+    case '*':
+      return evaluate(*node.args[0], scope) * evaluate(*node.args[1], scope);
+    case '/': {
+      const auto denominator = evaluate(*node.args[1], scope);
+      return denominator == 0 ? undefined : evaluate(*node.args[0], scope) / denominator;
+    }
+    default:
+      break;
+    }
+    std::vector<double> args;
+    for (const auto &arg : node.args) {
+      args.emplace_back(evaluate(*arg, scope));
+    }
+    if (node.name == "default") {
+      return std::isnan(args[0]) ? args[1] : args[0];
+    }
+    if (node.name == "min") {
+      return std::min(args[0], args[1]);
+    }
+    if (node.name == "max") {
+      return std::max(args[0], args[1]);
+    }
+    double res   = 0;
+    bool defined = false;
+    for (const auto arg : args) {
+      if (!std::isnan(arg)) {
+        res += arg;
+        defined = true;
+      }
+    }
+    return defined ? res : undefined;
+  }
+
+  std::string m_text{""};
+  size_t m_pos{0};
+  node_ptr m_root{nullptr};
+};
+
+struct formula_t {
+  std::string name{""};
+  std::shared_ptr<expression> expr{nullptr};
+};
+
+static std::vector<formula_t> parse_formulas(std::istream &stream) {
+  std::vector<formula_t> res;
+  std::string line;
+  while (std::getline(stream, line)) {
+    const auto comment = line.find('#');
+    if (comment != std::string::npos) {
+      line = line.substr(0, comment);
+    }
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+    const auto eq = line.find('=');
+    if (eq == std::string::npos) {
+      throw std::runtime_error("expected name = expression in \"" + line + "\"");
+    }
+    formula_t formula;
+    const auto name_begin = line.find_first_not_of(" \t");
+    const auto name_end   = line.find_last_not_of(" \t", eq - 1);
+    if (name_begin >= eq) {
+      throw std::runtime_error("missing name in \"" + line + "\"");
+    }
+    formula.name = line.substr(name_begin, name_end - name_begin + 1);
+    formula.expr = std::make_shared<expression>(line.substr(eq + 1));
+    res.emplace_back(formula);
+  }
+  return res;
+}
+
+static std::vector<formula_t> load_formulas(const std::string &path) {
+  if (path.empty()) {
+    std::istringstream stream(default_formulas);
+    return parse_formulas(stream);
+  }
+  std::ifstream stream(path);
+  if (!stream.is_open()) {
+    throw std::runtime_error("unable to open " + path);
+  }
+  return parse_formulas(stream);
+}
+
+// Evaluates the formulas on top of scope. Returns only the defined values.
+static std::map<std::string, double> evaluate(const std::vector<formula_t> &formulas, scope_t scope) {
+  std::map<std::string, double> res;
+  for (const auto &formula : formulas) {
+    const auto value    = formula.expr->evaluate(scope);
+    scope[formula.name] = value;
+    if (std::isfinite(value)) {
+      res[formula.name] = value;
+    }
+  }
+  return res;
+}
+
+// Raw values of one kernel, averaged over the profiled iterations.
+struct kernel_values_t {
+  scope_t values{};
+  // sum of the launch durations per iteration, from --trace_kernels
+  std::map<int, double> duration_ns{};
+};
+
+namespace detail {
+  // Makes a metric reachable under its legacy and its Perfworks name.
+  static void add_metric(scope_t &scope, const std::string &name, double value) {
+    scope[name] = value;
+    for (const auto &alias : range_profiler::metric_aliases()) {
+      if (alias.second == name && !scope.count(alias.first)) {
+        scope[alias.first] = value;
+      } else if (alias.first == name && !scope.count(alias.second)) {
+        scope[alias.second] = value;
+      }
+    }
+  }
+
+  struct mean_t {
+    double sum{0};
+    size_t count{0};
+
+    void add(double value) {
+      sum += value;
+      count++;
+    }
+
+    double get() const {
+      return count == 0 ? undefined : sum / count;
+    }
+  };
+} // namespace detail
+
+// Splits the profiler counters of a result entry into per kernel values and
+// the benchmark level values (the per kernel values summed over the kernels,
+// or the range profiler values of the whole block).
+static std::map<std::string, kernel_values_t> kernel_values(const results::entry_t &entry, scope_t &benchmark) {
+  static const std::regex kernel_stat_re(R"(^kernel_stat:(\d+)/((?:metric|event):.+)/mean$)");
+  static const std::regex kernel_metric_re(
+      R"(^kernel_(?:metric|event):(.+)/current_iter:(\d+)/(?:metric|event):(.+)$)");
+  static const std::regex kernel_trace_re(R"(^kernel_trace:(.+)/current_iter:(\d+)/launch:\d+/duration_ns$)");
+  static const std::regex range_metric_re(R"(^range_metric:[^/]+/current_iter:\d+/metric:(.+)$)");
+
+  std::map<double, std::string> kernel_names;
+  const std::string kernel_id_prefix = "kernel_id:";
+  for (auto it = entry.counters.lower_bound(kernel_id_prefix);
+       it != entry.counters.end() && it->first.compare(0, kernel_id_prefix.size(), kernel_id_prefix) == 0; ++it) {
+    kernel_names[it->second] = it->first.substr(kernel_id_prefix.size());
+  }
+
+  std::map<std::string, std::map<std::string, detail::mean_t>> kernel_means;
+  std::map<std::string, detail::mean_t> range_means;
+  std::map<std::string, kernel_values_t> res;
+  std::smatch match;
+  for (const auto &counter : entry.counters) {
+    if (std::regex_match(counter.first, match, kernel_stat_re)) {
+      const auto name_it = kernel_names.find(std::stod(match[1]));
+      const auto kernel  = name_it == kernel_names.end() ? match[1].str() : name_it->second;
+      const auto value   = match[2].str();
+      kernel_means[kernel][value.substr(value.find(':') + 1)].add(counter.second);
+    } else if (std::regex_match(counter.first, match, kernel_metric_re)) {
+      kernel_means[match[1]][match[3]].add(counter.second);
+    } else if (std::regex_match(counter.first, match, kernel_trace_re)) {
+      res[match[1]].duration_ns[std::stoi(match[2])] += counter.second;
+    } else if (std::regex_match(counter.first, match, range_metric_re)) {
+      range_means[match[1]].add(counter.second);
+    }
+  }
+
+  scope_t totals;
+  for (const auto &kernel : kernel_means) {
+    auto &values = res[kernel.first].values;
+    for (const auto &mean : kernel.second) {
+      detail::add_metric(values, mean.first, mean.second.get());
+      totals[mean.first] += mean.second.get();
+    }
+  }
+  for (auto &kernel : res) {
+    if (kernel.second.duration_ns.empty()) {
+      continue;
+    }
+    detail::mean_t duration;
+    for (const auto &iteration : kernel.second.duration_ns) {
+      duration.add(iteration.second);
+    }
+    kernel.second.values["time"] = duration.get() * 1e-9;
+  }
+  for (const auto &total : totals) {
+    detail::add_metric(benchmark, total.first, total.second);
+  }
+  for (const auto &mean : range_means) {
+    detail::add_metric(benchmark, mean.first, mean.second.get());
+  }
+  return res;
+}
+
+// Every counter of the entry, plus time (seconds per iteration) and
+// predicted_flops (the analytic flop count of one iteration).
+static scope_t benchmark_scope(const results::entry_t &entry) {
+  scope_t scope;
+  for (const auto &counter : entry.counters) {
+    if (counter.first.find(':') == std::string::npos) {
+      scope[counter.first] = counter.second;
+    }
+  }
+  scope["time"]            = entry.time_s;
+  scope["predicted_flops"] = entry.counter("predicted_flops_count", undefined);
+  return scope;
+}
+
+static json run(const std::vector<std::string> &paths, const std::vector<formula_t> &formulas) {
+  json res = json::array();
+  for (const auto &path : paths) {
+    const auto file = results::load(path);
+    for (const auto &entry : results::merge_repetitions(file.entries)) {
+      if (entry.error_occurred) {
+        continue;
+      }
+      const auto base    = benchmark_scope(entry);
+      auto scope         = base;
+      const auto kernels = kernel_values(entry, scope);
+
+      json kernels_json = json::array();
+      for (const auto &kernel : kernels) {
+        // the kernel time is only known when traced
+        auto kernel_scope = base;
+        kernel_scope.erase("time");
+        for (const auto &value : kernel.second.values) {
+          kernel_scope[value.first] = value.second;
+        }
+        const auto values = evaluate(formulas, kernel_scope);
+        if (!values.empty()) {
+          kernels_json.push_back({{"kernel", kernel.first}, {"derived", values}});
+        }
+      }
+
+      res.push_back({
+          {"file", path},
+          {"name", entry.name},
+          {"layer", entry.layer},
+          {"family", entry.family},
+          {"algorithm", entry.algorithm},
+          {"time_s", entry.time_s},
+          {"derived", evaluate(formulas, scope)},
+          {"kernels", kernels_json},
+      });
+    }
+  }
+  return res;
+}
+
+} // namespace derived
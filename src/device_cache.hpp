@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "json.hpp"
+
+// On-disk cache of the device properties.
+//
+// Querying the name, compute capability and pci bus id of a device
+// initializes the CUDA runtime, which is a good part of the startup time of a
+// single layer run. The properties are kept in one small json file per device
+// and reused as long as the key matches: the host, the device index, the
+// visible devices, the device order, the driver and the GPUs of the host
+// (their pci bus ids and UUIDs, as the driver lists them in /proc), so a
+// swapped or reordered card is a cache miss. Nothing in here touches the GPU.
+namespace device_cache {
+
+using json = nlohmann::json;
+
+struct info_t {
+  std::string gpu_name{""};
+  std::string pci_bus_id{""};
+  int compute_capability_major{0};
+  int compute_capability_minor{0};
+};
+
+static std::string read_file(const std::string &path) {
+  std::ifstream stream(path);
+  return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+// The UUID of every GPU the driver knows by its pci bus id.
+static json host_gpus(const std::string &dir = "/proc/driver/nvidia/gpus") {
+  std::map<std::string, std::string> res;
+  if (auto gpus = opendir(dir.c_str())) {
+    while (const auto entry = readdir(gpus)) {
+      const std::string bus_id = entry->d_name;
+      if (bus_id == "." || bus_id == "..") {
+        continue;
+      }
+      std::ifstream stream(dir + "/" + bus_id + "/information");
+      std::string line;
+      while (std::getline(stream, line)) {
+        const auto value = line.find_first_not_of(" \t", 9);
+        if (line.compare(0, 9, "GPU UUID:") == 0 && value != std::string::npos) {
+          res[bus_id] = line.substr(value);
+        }
+      }
+      res.emplace(bus_id, "");
+    }
+    closedir(gpus);
+  }
+  return res;
+}
+
+static std::string getenv_or_empty(const char *name) {
+  const auto value = std::getenv(name);
+  return value == nullptr ? "" : value;
+}
+
+// Identifies the device and the driver without initializing CUDA. The device
+// index maps to a GPU through CUDA_VISIBLE_DEVICES and CUDA_DEVICE_ORDER
+// among the GPUs of the host.
+static json key(const std::string &host_name, int device_id) {
+  return {
+      {"host_name", host_name},
+      {"device_id", device_id},
+      {"visible_devices", getenv_or_empty("CUDA_VISIBLE_DEVICES")},
+      {"device_order", getenv_or_empty("CUDA_DEVICE_ORDER")},
+      {"driver", read_file("/proc/driver/nvidia/version")},
+      {"gpus", host_gpus()},
+  };
+}
+
+// $XDG_CACHE_HOME/cudnn_scope or ~/.cache/cudnn_scope, empty if neither is set.
+static std::string default_dir() {
+  const auto xdg_cache_home = std::getenv("XDG_CACHE_HOME");
+  if (xdg_cache_home != nullptr && xdg_cache_home[0] != '\0') {
+    return std::string(xdg_cache_home) + "/cudnn_scope";
+  }
+  const auto home = std::getenv("HOME");
+  if (home != nullptr && home[0] != '\0') {
+    return std::string(home) + "/.cache/cudnn_scope";
+  }
+  return "";
+}
+
+static std::string path(const std::string &dir, int device_id) {
+  return dir + "/device_" + std::to_string(device_id) + ".json";
+}
+
+// The cached info of the device; false if there is none or the key changed.
+static bool load(const std::string &path, const json &key, info_t &info) {
+  std::ifstream stream(path);
+  if (!stream.is_open()) {
+    return false;
+  }
+  try {
+    json js;
+    stream >> js;
+    if (js.value("key", json()) != key) {
+      return false;
+    }
+    info.gpu_name                 = js.at("gpu_name").get<std::string>();
+    info.pci_bus_id               = js.at("pci_bus_id").get<std::string>();
+    info.compute_capability_major = js.at("compute_capability_major").get<int>();
+    info.compute_capability_minor = js.at("compute_capability_minor").get<int>();
+  } catch (const std::exception &) {
+    // a corrupt or older file is a cache miss
+    return false;
+  }
+  return true;
+}
+
+// Writes through a temporary file, so concurrent runs never read a partial file.
+static void save(const std::string &path, const json &key, const info_t &info) {
+  const auto dir = path.substr(0, path.rfind('/'));
+  for (auto pos = dir.find('/', 1);; pos = dir.find('/', pos + 1)) {
+    const auto parent = dir.substr(0, pos);
+    if (mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST) {
+      throw std::runtime_error("unable to create " + parent);
+    }
+    if (pos == std::string::npos) {
+      break;
+    }
+  }
+  const json js = {
+      {"key", key},
+      {"gpu_name", info.gpu_name},
+      {"pci_bus_id", info.pci_bus_id},
+      {"compute_capability_major", info.compute_capability_major},
+      {"compute_capability_minor", info.compute_capability_minor},
+  };
+  const auto tmp_path = path + "." + std::to_string(getpid());
+  {
+    std::ofstream stream(tmp_path);
+    if (!(stream << js.dump(2) << "\n")) {
+      throw std::runtime_error("unable to write " + tmp_path);
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    throw std::runtime_error("unable to write " + path);
+  }
+}
+
+} // namespace device_cache
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <cublas_v2.h>
+#include <cuda.h>
+#include <cuda_runtime.h>
+#include <cudnn.h>
+
+#include "error.hpp"
+#include "host_env.hpp"
+#include "init.hpp"
+#include "topology.hpp"
+
+// cudnn and cublas handles for benchmarks that run with Threads(N).
+//
+// A handle must not be used by several host threads at the same time, so
+// every benchmark thread takes its handles from the pool by
+// state.thread_index. Thread 0 gets the process handles on the default
+// stream, so single threaded runs behave as before. The other threads get a
+// cudnn and a cublas handle of their own, both bound to a non-blocking
+// stream; they are created on first use and kept for the following
+// benchmarks, since the thread indices repeat. The first call initializes the
+// device and creates the process handles (cudnn_lazy_init). Before the
+// handles are handed out, the context of the process is made current on every
+// benchmark thread, the thread is pinned like the thread that initialized the
+// device (--host_pin) and, with --numa_placement, bound to the NUMA node of
+// the device. Failures do not throw: the lease skips the benchmark with the
+// reason, like the other error paths of the Impls.
+namespace handle_pool {
+
+struct handles_t {
+  cudnnHandle_t cudnn{nullptr};
+  cublasHandle_t cublas{nullptr};
+  // nullptr is the default stream
+  cudaStream_t stream{nullptr};
+};
+
+class pool {
+public:
+  // The handles of thread_index, nullptr with the reason in error if they can not be created.
+  handles_t *get(int thread_index, std::string &error) {
+    if (cudnn_lazy_init() != 0) {
+      error = "unable to initialize the CUDA device";
+      return nullptr;
+    }
+    if (!make_context_current()) {
+      error = "unable to make the CUDA context current on the benchmark thread";
+      return nullptr;
+    }
+    if (!bind_to_pinned_cpus()) {
+      error = "unable to pin the benchmark thread to the cpus of --host_pin";
+      return nullptr;
+    }
+    if (!bind_to_numa_node()) {
+      error = "unable to bind the benchmark thread to the numa node of the device";
+      return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (thread_index <= 0) {
+      m_first.cudnn  = cudnn_handle;
+      m_first.cublas = cublas_handle;
+      return &m_first;
+    }
+    if (m_handles.size() < static_cast<size_t>(thread_index)) {
+      m_handles.resize(thread_index);
+    }
+    auto &handles = m_handles[thread_index - 1];
+    if (handles == nullptr) {
+      handles = create(error);
+    }
+    return handles.get();
+  }
+
+  // Number of threads with handles of their own.
+  size_t size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_handles.size();
+  }
+
+private:
+  static bool make_context_current() {
+    thread_local CUcontext current = nullptr;
+    if (current == m_context) {
+      return true;
+    }
+    if (PRINT_IF_ERROR(cuCtxSetCurrent(m_context))) {
+      return false;
+    }
+    current = m_context;
+    return true;
+  }
+
+  // Threads that existed before the first benchmark pinned the process do not
+  // inherit the pinning.
+  static bool bind_to_pinned_cpus() {
+    thread_local bool is_bound = false;
+    const auto &cpus           = host_env::pinned_cpus();
+    if (cpus.empty() || is_bound) {
+      return true;
+    }
+    is_bound = topology::bind_cpus(cpus);
+    return is_bound;
+  }
+
+  static bool bind_to_numa_node() {
+    thread_local int bound = -1;
+    if (numa_node < 0 || bound == numa_node) {
+      return true;
+    }
+    if (!topology::bind_node(numa_node)) {
+      return false;
+    }
+    bound = numa_node;
+    return true;
+  }
+
+  // The handles live until the end of the process, like the process handles;
+  // nullptr if one of them can not be created, the next call tries again.
+  static std::unique_ptr<handles_t> create(std::string &error) {
+    std::unique_ptr<handles_t> res(new handles_t);
+    if (PRINT_IF_ERROR(cudaStreamCreateWithFlags(&res->stream, cudaStreamNonBlocking))) {
+      error = "unable to create the stream of a benchmark thread";
+      return nullptr;
+    }
+    if (PRINT_IF_ERROR(cudnnCreate(&res->cudnn)) || PRINT_IF_ERROR(cudnnSetStream(res->cudnn, res->stream))) {
+      error = "unable to create the cudnn handle of a benchmark thread";
+      destroy(*res);
+      return nullptr;
+    }
+    if (PRINT_IF_ERROR(cublasCreate(&res->cublas)) || PRINT_IF_ERROR(cublasSetStream(res->cublas, res->stream))) {
+      error = "unable to create the cublas handle of a benchmark thread";
+      destroy(*res);
+      return nullptr;
+    }
+    return res;
+  }
+
+  static void destroy(const handles_t &handles) {
+    if (handles.cublas != nullptr) {
+      cublasDestroy(handles.cublas);
+    }
+    if (handles.cudnn != nullptr) {
+      cudnnDestroy(handles.cudnn);
+    }
+    if (handles.stream != nullptr) {
+      cudaStreamDestroy(handles.stream);
+    }
+  }
+
+  std::mutex m_mutex{};
+  handles_t m_first{};
+  std::vector<std::unique_ptr<handles_t>> m_handles{};
+};
+
+inline pool &instance() {
+  static pool p;
+  return p;
+}
+
+// The stream the kernels of the benchmark thread are launched on, the
+// default stream if its handles can not be created (the lease of the Impl
+// has skipped the benchmark then).
+inline cudaStream_t stream(const benchmark::State &state) {
+  std::string error;
+  const auto handles = instance().get(state.thread_index, error);
+  return handles == nullptr ? nullptr : handles->stream;
+}
+
+// The handles of one benchmark thread for the duration of an Impl.
+//
+// Google benchmark sums the counters of all threads, which breaks the sizes
+// and hashes the Impls report. The lease keeps those of thread 0 only; the
+// per thread averaged counters (kAvgThreads, kAvgThreadsRate) of every thread
+// are kept so that rates add up over the threads. If the handles can not be
+// created, the benchmark is skipped with the reason and is_valid is false.
+class lease {
+public:
+  explicit lease(benchmark::State &state) : m_state(state) {
+    std::string error;
+    const auto handles = instance().get(state.thread_index, error);
+    if (handles == nullptr) {
+      state.SkipWithError(error.c_str());
+      return;
+    }
+    cudnn    = handles->cudnn;
+    cublas   = handles->cublas;
+    stream   = handles->stream;
+    is_valid = true;
+  }
+
+  lease(const lease &) = delete;
+  lease &operator=(const lease &) = delete;
+
+  ~lease() {
+    if (m_state.thread_index == 0) {
+      return;
+    }
+    auto &counters = m_state.counters;
+    for (auto it = counters.begin(); it != counters.end();) {
+      if ((it->second.flags & benchmark::Counter::kAvgThreads) == 0) {
+        it = counters.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  cudnnHandle_t cudnn{nullptr};
+  cublasHandle_t cublas{nullptr};
+  cudaStream_t stream{nullptr};
+  bool is_valid{false};
+
+private:
+  benchmark::State &m_state;
+};
+
+} // namespace handle_pool
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// The hash of the string valued counters ("<name>:<value>", fnv1a_64(value))
+// and of the layer signatures; it has no CUDA dependency so the offline
+// tools can use it.
+static uint64_t fnv1a_64(const char* data, int len) {
+  static const uint64_t kOffset = UINT64_C(14695981039346656037);
+  static const uint64_t kPrime  = UINT64_C(1099511628211);
+
+  const uint8_t* octets = reinterpret_cast<const uint8_t*>(data);
+
+  uint64_t hash = kOffset;
+
+  for (int i = 0; i < len; ++i) {
+    hash = hash ^ octets[i];
+    hash = hash * kPrime;
+  }
+
+  return hash;
+}
+
+static uint64_t fnv1a_64(const std::string& str) {
+  return fnv1a_64(str.data(), str.length());
+}
@@ -2,6 +2,7 @@
 
 #include <benchmark/benchmark.h>
 
+#include <cstring>
 #include <initializer_list>
 #include <iostream>
 #include <mutex>
@@ -13,8 +14,12 @@
 
 #include <cudnn.h>
 
+#include "annotate.hpp"
+#include "handle_pool.hpp"
 #include "init.hpp"
+#include "topology.hpp"
 #include "utils.hpp"
+#include "warm_cache.hpp"
 
 #ifndef BENCHMARK_NAME
 #define BENCHMARK_NAME "CUDNN"
@@ -29,7 +34,8 @@ struct alignas(128) DeviceMemory {
   bool is_valid{false};
   size_t size;
   DeviceMemory(benchmark::State &state, const size_t &size0) : size(size0) {
-    if (PRINT_IF_ERROR(cudaMalloc(&ptr, size))) {
+    ANNOTATE_RANGE("allocation");
+    if (!allocate(state)) {
       state.SkipWithError(BENCHMARK_NAME " device memory allocation failed");
       return;
     }
@@ -40,25 +46,70 @@ struct alignas(128) DeviceMemory {
     is_valid = true;
   }
   DeviceMemory(benchmark::State &state, const T *data, const size_t &size0) : size(size0) {
-    if (PRINT_IF_ERROR(cudaMalloc(&ptr, size))) {
+    ANNOTATE_RANGE("allocation");
+    if (!allocate(state)) {
       state.SkipWithError(BENCHMARK_NAME " device memory allocation failed");
       return;
     }
-    if (PRINT_IF_ERROR(cudaMemcpy(ptr, data, size, cudaMemcpyHostToDevice))) {
+    if (!upload(state, data)) {
       state.SkipWithError(BENCHMARK_NAME " device memory copy failed");
       return;
     }
     is_valid = true;
   }
+  // With --numa_placement the data is copied through a pinned buffer on the
+  // NUMA node of the device instead of wherever the OS placed it.
+  bool upload(benchmark::State &state, const T *data) {
+    if (numa_node < 0) {
+      return !PRINT_IF_ERROR(cudaMemcpy(ptr, data, size, cudaMemcpyHostToDevice));
+    }
+    topology::host_buffer staging(size, numa_node);
+    if (staging.get() == nullptr ||
+        PRINT_IF_ERROR(cudaHostRegister(staging.get(), staging.size(), cudaHostRegisterDefault))) {
+      return false;
+    }
+    std::memcpy(staging.get(), data, size);
+    const auto is_copied = !PRINT_IF_ERROR(cudaMemcpy(ptr, staging.get(), size, cudaMemcpyHostToDevice));
+    cudaHostUnregister(staging.get());
+    if (state.thread_index == 0) {
+      state.counters.insert({"numa_staging_node", staging.node()});
+    }
+    return is_copied;
+  }
   ~DeviceMemory() {
     if (ptr == nullptr) {
       return;
     }
+    if (thread_index >= 0) {
+      warm_cache::buffers().release(thread_index, ptr);
+      return;
+    }
     cudaFree(ptr);
   }
   T *get() {
     return ptr;
   }
+
+private:
+  // Borrows the buffer from the pool of the benchmark thread while the daemon
+  // keeps the caches warm (see warm_cache.hpp).
+  bool allocate(benchmark::State &state) {
+    if (warm_cache::enabled() && size != 0) {
+      ptr = static_cast<T *>(warm_cache::buffers().acquire(state.thread_index, size));
+      if (ptr != nullptr) {
+        thread_index = state.thread_index;
+      }
+      return ptr != nullptr;
+    }
+    if (PRINT_IF_ERROR(cudaMalloc(&ptr, size))) {
+      ptr = nullptr;
+      return false;
+    }
+    return true;
+  }
+
+  // of the pool the buffer was borrowed from, -1 if it was allocated
+  int thread_index{-1};
 };
 
 template <typename T, Layout LayoutV = Layout::Automatic>
@@ -82,10 +133,11 @@ struct alignas(128) Filter {
 
   Filter(benchmark::State &state, const std::initializer_list<int> &shape0, int group0 = 1)
       : shape(shape0), group(group0) {
+    ANNOTATE_RANGE("descriptor");
 
-    assert(shape.size() <= 4);
+    assert(shape.size() <= CUDNN_DIM_MAX);
     alignas(128) int dims[4] = {1, 1, 1, 1};
-    for (size_t ii = 0; ii < shape.size(); ++ii) {
+    for (size_t ii = 0; ii < shape.size() && ii < 4; ++ii) {
       dims[ii] = shape[ii];
     }
     if (PRINT_IF_ERROR(cudnnCreateFilterDescriptor(&descriptor))) {
@@ -93,6 +145,18 @@ struct alignas(128) Filter {
       return;
     }
 
+    if (shape.size() > 4) {
+      // K x C x T x R x S ...
+      std::vector<int> nd_dims(shape.begin(), shape.end());
+      nd_dims[1] /= group;
+      if (PRINT_IF_ERROR(cudnnSetFilterNdDescriptor(descriptor, value_type, layout, nd_dims.size(), nd_dims.data()))) {
+        state.SkipWithError(BENCHMARK_NAME " failed to cudnnSetFilterNdDescriptor");
+        return;
+      }
+      is_valid = true;
+      return;
+    }
+
     if (PRINT_IF_ERROR(
             cudnnSetFilter4dDescriptor(descriptor, value_type, layout, dims[0], dims[1] / group, dims[2], dims[3]))) {
       state.SkipWithError(BENCHMARK_NAME " failed to cudnnSetFilter4dDescriptor");
@@ -137,10 +201,11 @@ struct alignas(128) Tensor {
 
   Tensor(benchmark::State &state, const std::initializer_list<int> &shape0, int group0 = 1)
       : shape(shape0), group(group0) {
+    ANNOTATE_RANGE("descriptor");
 
-    assert(shape.size() <= 4);
+    assert(shape.size() <= CUDNN_DIM_MAX);
     alignas(128) int dims[4] = {1, 1, 1, 1};
-    for (size_t ii = 0; ii < shape.size(); ++ii) {
+    for (size_t ii = 0; ii < shape.size() && ii < 4; ++ii) {
       dims[ii] = shape[ii];
     }
     if (PRINT_IF_ERROR(cudnnCreateTensorDescriptor(&descriptor))) {
@@ -148,6 +213,11 @@ struct alignas(128) Tensor {
       return;
     }
 
+    if (shape.size() > 4) {
+      is_valid = set_nd_descriptor(state);
+      return;
+    }
+
     const int N  = dims[0];
     const int C  = dims[1];
     const int H  = dims[2];
@@ -181,6 +251,39 @@ struct alignas(128) Tensor {
     is_valid = true;
   }
 
+  // N x C x D x H x W ..., fully packed with the channels innermost for NHWC.
+  bool set_nd_descriptor(benchmark::State &state) {
+    const int num_dims = shape.size();
+    std::vector<int> nd_dims(shape.begin(), shape.end());
+    std::vector<int> strides(num_dims, 1);
+    nd_dims[1] = shape[1] / group;
+    if (layout == CUDNN_TENSOR_NHWC) {
+      strides[num_dims - 1] = shape[1];
+      for (int ii = num_dims - 2; ii >= 2; --ii) {
+        strides[ii] = strides[ii + 1] * shape[ii + 1];
+      }
+      strides[0] = strides[2] * shape[2];
+    } else {
+      for (int ii = num_dims - 2; ii >= 0; --ii) {
+        strides[ii] = strides[ii + 1] * shape[ii + 1];
+      }
+    }
+    if (PRINT_IF_ERROR(cudnnSetTensorNdDescriptor(descriptor, value_type, num_dims, nd_dims.data(), strides.data()))) {
+      const auto join = [](const std::vector<int> &xs) {
+        std::string res;
+        for (const auto x : xs) {
+          res += (res.empty() ? "" : "x") + std::to_string(x);
+        }
+        return res;
+      };
+      const auto err = fmt::format(BENCHMARK_NAME " failed to cudnnSetTensorNdDescriptor using dims {} and stride {}",
+                                   join(nd_dims), join(strides));
+      state.SkipWithError(err.c_str());
+      return false;
+    }
+    return true;
+  }
+
   ~Tensor() {
     if (!is_valid) {
       return;
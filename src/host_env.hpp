@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "json.hpp"
+#include "topology.hpp"
+
+// Host environment.
+//
+// Frequency scaling, turbo, SMT and ASLR are the largest host side noise
+// sources of small layers. The setup/ scripts change them by hand, but their
+// state was never recorded. This module reads the state so that it is
+// reported with every benchmark, applies the settings of the setup/ scripts
+// with --host_env_apply (needs root), and pins the process to the cpus of the
+// NUMA node of the GPU with --host_pin.
+namespace host_env {
+
+struct state_t {
+  // governor of the online cpus, "mixed" if they differ
+  std::string governor{"unknown"};
+  // on, off or unknown
+  std::string turbo{"unknown"};
+  // smt/control: on, off, forceoff, notsupported or unknown
+  std::string smt{"unknown"};
+  // randomize_va_space, -1 if unknown
+  int aslr{-1};
+  int num_numa_nodes{0};
+  int num_online_cpus{0};
+  // cpus the process may run on
+  std::string affinity{""};
+  // NUMA node of the GPU, -1 if unknown
+  int gpu_numa_node{-1};
+};
+
+static bool write_file(const std::string &path, const std::string &value) {
+  std::ofstream stream(path);
+  return static_cast<bool>(stream << value << "\n" << std::flush);
+}
+
+static std::string cpu_path(int cpu) {
+  return "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+}
+
+static std::vector<int> online_cpus() {
+  return topology::parse_cpu_list(topology::read_line("/sys/devices/system/cpu/online"));
+}
+
+static std::string governor() {
+  std::set<std::string> governors;
+  for (const auto cpu : online_cpus()) {
+    const auto governor = topology::read_line(cpu_path(cpu) + "/cpufreq/scaling_governor");
+    if (!governor.empty()) {
+      governors.insert(governor);
+    }
+  }
+  if (governors.empty()) {
+    return "unknown";
+  }
+  return governors.size() == 1 ? *governors.begin() : "mixed";
+}
+
+static std::string turbo() {
+  const auto no_turbo = topology::read_line("/sys/devices/system/cpu/intel_pstate/no_turbo");
+  if (!no_turbo.empty()) {
+    return no_turbo == "1" ? "off" : "on";
+  }
+  const auto boost = topology::read_line("/sys/devices/system/cpu/cpufreq/boost");
+  if (!boost.empty()) {
+    return boost == "1" ? "on" : "off";
+  }
+  return "unknown";
+}
+
+static std::string smt() {
+  const auto control = topology::read_line("/sys/devices/system/cpu/smt/control");
+  if (!control.empty()) {
+    return control;
+  }
+  // older kernels: a sibling list with more than one cpu means smt is on
+  const auto cpus = online_cpus();
+  if (cpus.empty()) {
+    return "unknown";
+  }
+  for (const auto cpu : cpus) {
+    if (topology::parse_cpu_list(topology::read_line(cpu_path(cpu) + "/topology/thread_siblings_list")).size() > 1) {
+      return "on";
+    }
+  }
+  return "off";
+}
+
+static int aslr() {
+  const auto value = topology::read_line("/proc/sys/kernel/randomize_va_space");
+  return value.empty() ? -1 : std::atoi(value.c_str());
+}
+
+// pci_bus_id may be empty if the GPU is not known yet.
+static state_t probe(const std::string &pci_bus_id) {
+  state_t res;
+  res.governor        = governor();
+  res.turbo           = turbo();
+  res.smt             = smt();
+  res.aslr            = aslr();
+  res.num_numa_nodes  = static_cast<int>(topology::online_nodes().size());
+  res.num_online_cpus = static_cast<int>(online_cpus().size());
+  res.affinity        = topology::format_cpu_list(topology::affinity());
+  res.gpu_numa_node   = topology::device_node(pci_bus_id);
+  return res;
+}
+
+// Applies the settings of the setup/ scripts: performance governor, no turbo,
+// no SMT, no ASLR, and drops the page cache. Returns the settings that could
+// not be changed.
+static std::vector<std::string> apply_recommended() {
+  std::vector<std::string> failed;
+  const auto cpus = online_cpus();
+  for (const auto cpu : cpus) {
+    const auto path = cpu_path(cpu) + "/cpufreq/scaling_governor";
+    if (!topology::read_line(path).empty() && !write_file(path, "performance")) {
+      failed.emplace_back("scaling_governor");
+      break;
+    }
+  }
+  if (!topology::read_line("/sys/devices/system/cpu/intel_pstate/no_turbo").empty()) {
+    if (!write_file("/sys/devices/system/cpu/intel_pstate/no_turbo", "1")) {
+      failed.emplace_back("turbo");
+    }
+  } else if (!topology::read_line("/sys/devices/system/cpu/cpufreq/boost").empty()) {
+    if (!write_file("/sys/devices/system/cpu/cpufreq/boost", "0")) {
+      failed.emplace_back("turbo");
+    }
+  }
+  const auto smt_control = topology::read_line("/sys/devices/system/cpu/smt/control");
+  if (smt_control == "on" && !write_file("/sys/devices/system/cpu/smt/control", "off")) {
+    failed.emplace_back("smt");
+  }
+  if (!write_file("/proc/sys/kernel/randomize_va_space", "0")) {
+    failed.emplace_back("randomize_va_space");
+  }
+  sync();
+  if (!write_file("/proc/sys/vm/drop_caches", "3")) {
+    failed.emplace_back("drop_caches");
+  }
+  return failed;
+}
+
+static nlohmann::json to_json(const state_t &state) {
+  return {
+      {"governor", state.governor},
+      {"turbo", state.turbo},
+      {"smt", state.smt},
+      {"aslr", state.aslr},
+      {"num_numa_nodes", state.num_numa_nodes},
+      {"num_online_cpus", state.num_online_cpus},
+      {"affinity", state.affinity},
+      {"gpu_numa_node", state.gpu_numa_node},
+  };
+}
+
+// The state recorded before the first benchmark, reported with every benchmark.
+inline state_t &recorded() {
+  static state_t state;
+  return state;
+}
+
+// The cpus of --host_pin, empty if the process is not pinned.
+inline std::vector<int> &pinned_cpus() {
+  static std::vector<int> cpus;
+  return cpus;
+}
+
+} // namespace host_env
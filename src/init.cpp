@@ -6,19 +6,46 @@
 #include "spdlog/sinks/ansicolor_sink.h"
 #include "spdlog/spdlog.h"
 
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+#include <benchmark/benchmark.h>
+
 #include <cudnn.h>
 
 #include "config.hpp"
 #include "error.hpp"
+#include "init.hpp"
 #include "init/init.hpp"
 
+#include "activity_trace.hpp"
+#include "annotate.hpp"
 #include "cupti_profiler.hpp"
+#include "derived.hpp"
+#include "device_cache.hpp"
+#include "host_env.hpp"
+#include "kernel_metrics.hpp"
+#include "range_profiler.hpp"
+#include "power_sampler.hpp"
+#include "predictor.hpp"
+#include "rollup.hpp"
+#include "sample_sink.hpp"
+#include "server.hpp"
+#include "store.hpp"
+#include "sweep.hpp"
+#include "topology.hpp"
+#include "warm_cache.hpp"
 
 CUcontext m_context;
 CUdevice m_device;
 cudnnHandle_t cudnn_handle;
 cublasHandle_t cublas_handle;
 int32_t num_warmup;
+int64_t train_step_workspace_bytes{-1};
 std::vector<std::string> metrics;
 std::vector<std::string> events;
 
@@ -28,6 +55,7 @@ std::string cuda_driver_version{""};
 std::string cuda_runtime_version{""};
 #ifdef ENABLE_CUDNN_CUPTI
 std::string cupti_version{""};
+bool cupti_range_profiler{false};
 #endif // ENABLE_CUDNN_CUPTI
 std::string cublas_version{""};
 std::string cudnn_version{""};
@@ -36,6 +64,39 @@ std::string compute_capability{""};
 DEFINE_FLAG_int32(num_warmup, 10, "number of times to run warmup code");
 DEFINE_FLAG_bool(list_metrics, false, "list cupti metrics");
 DEFINE_FLAG_bool(list_events, false, "list cupti events");
+DEFINE_FLAG_string(cupti_backend, "auto", "metric backend: legacy, range or auto (by compute capability)");
+DEFINE_FLAG_bool(trace_kernels, false, "trace every kernel launch through the cupti activity api instead of metrics");
+DEFINE_FLAG_int32(trace_buffer_kb, 4096, "size of each cupti activity buffer used by --trace_kernels");
+DEFINE_FLAG_int32(trace_num_buffers, 8, "number of cupti activity buffers used by --trace_kernels");
+DEFINE_FLAG_string(kernel_metrics_output, "", "write the per kernel metric tables to this json lines file");
+DEFINE_FLAG_string(power_sampling, "none", "sample clock, power and temperature: none, nvml or file");
+DEFINE_FLAG_string(power_sampling_file, "", "readings replayed by --power_sampling=file");
+DEFINE_FLAG_int32(power_sampling_period_ms, 20, "period of --power_sampling");
+DEFINE_FLAG_string(sample_output, "", "write every timed iteration to this binary file");
+DEFINE_FLAG_int32(sample_buffer_kb, 1024, "size of the in-memory buffer used for --sample_output");
+DEFINE_FLAG_string(rollup_output, "", "write the model rollup to this file instead of stdout");
+DEFINE_FLAG_int32(rollup_workspace_mb, -1, "workspace budget for algorithms picked by the model rollup");
+DEFINE_FLAG_int32(rollup_top, 10, "number of critical layers listed by the model rollup");
+DEFINE_FLAG_string(predictor_model, "predictor.json", "path of the performance prediction model");
+DEFINE_FLAG_string(store, "results.store", "path of the local result store");
+DEFINE_FLAG_string(store_query, "", "query the result store (best or trend) and exit");
+DEFINE_FLAG_string(store_device, "", "restrict --store_query=best to this gpu");
+DEFINE_FLAG_string(store_layer, "", "layer name or signature used by --store_query=trend");
+DEFINE_FLAG_string(annotate, "none", "sink of the benchmark phase annotations: none, nvtx or chrome");
+DEFINE_FLAG_string(annotate_output, "trace.json", "chrome trace event file written by --annotate=chrome");
+DEFINE_FLAG_bool(sweep, false, "shard the benchmarks over all --cuda_device_ids, one child process per batch");
+DEFINE_FLAG_string(sweep_output, "sweep.json", "merged json output of --sweep");
+DEFINE_FLAG_int32(sweep_batch_size, 32, "number of benchmarks run by one child process of --sweep");
+DEFINE_FLAG_int32(sweep_batch_s, 60, "estimated seconds after which a --sweep batch stops growing");
+DEFINE_FLAG_int32(sweep_processes_per_device, 1, "number of concurrent --sweep workers per device");
+DEFINE_FLAG_string(derive_formulas, "", "expression file of the derived metrics");
+DEFINE_FLAG_string(derive_output, "", "write the derived metrics to this file instead of stdout");
+DEFINE_FLAG_string(daemon_socket, "", "serve benchmark requests on this unix socket instead of running the benchmarks");
+DEFINE_FLAG_string(device_cache, "", "directory of the cached device properties, none to disable");
+DEFINE_FLAG_bool(host_env_apply, false, "apply the settings of the setup/ scripts before running (needs root)");
+DEFINE_FLAG_string(host_pin, "none", "pin the benchmarks to the cpus near the gpu: none, node or core");
+DEFINE_FLAG_bool(numa_placement, false, "bind the benchmark threads and staging buffers to the numa node of the gpu");
+DEFINE_FLAG_int32(train_step_workspace_mb, -1, "workspace budget shared by the calls of a conv training step");
 
 FLAGS_NS(std::vector<std::string> flop_metrics({"half_precision_fu_utilization", "tensor_precision_fu_utilization"}));
 FLAGS_NS(std::vector<std::string> occupancy_metrics({"achieved_occupancy"}));
@@ -43,8 +104,15 @@ FLAGS_NS(std::vector<std::string> memory_metrics({"dram_read_bytes", "dram_write
 
 FLAGS_NS(std::vector<std::string> metrics = flop_metrics;);
 FLAGS_NS(std::vector<std::string> events({}));
+FLAGS_NS(std::vector<std::string> rollup({}));
+FLAGS_NS(std::vector<std::string> rollup_layer_counts({}));
+FLAGS_NS(std::vector<std::string> predictor_train({}));
+FLAGS_NS(std::vector<std::string> store_import({}));
+FLAGS_NS(std::vector<std::string> derive({}));
+FLAGS_NS(std::vector<std::string> sweep_prior({}));
 
 int cuda_device_id = 0;
+int numa_node      = -1;
 
 #ifdef ENABLE_CUDNN_CUPTI
 static void register_cupti_flags() {
@@ -53,9 +121,255 @@ static void register_cupti_flags() {
   RegisterOpt(clara::Opt(FLAG(metrics), "events")["--events"]("events to capture"));
   RegisterOpt(clara::Opt(FLAG(list_metrics), "list_metrics")["-m"]["--list_metrics"]("list cupti metrics"));
   RegisterOpt(clara::Opt(FLAG(list_events), "list_events")["-e"]["--list_events"]("list cupti events"));
+  RegisterOpt(clara::Opt(FLAG(cupti_backend), "auto|legacy|range")["--cupti_backend"](
+      "collect metrics with the legacy event/metric api or the range profiler api, auto picks the range profiler "
+      "from compute capability 7.5 on"));
+  RegisterOpt(clara::Opt(FLAG(trace_kernels), "trace_kernels")["--trace_kernels"](
+      "record start/end, launch configuration, registers and shared memory of every kernel instead of metrics"));
+  RegisterOpt(clara::Opt(FLAG(trace_buffer_kb), "kb")["--trace_buffer_kb"](
+      "size of each cupti activity buffer used by --trace_kernels"));
+  RegisterOpt(clara::Opt(FLAG(trace_num_buffers), "count")["--trace_num_buffers"](
+      "number of cupti activity buffers used by --trace_kernels"));
+  RegisterOpt(clara::Opt(FLAG(kernel_metrics_output), "path")["--kernel_metrics_output"](
+      "write the per kernel, per iteration metric and event values to this file, one json line per benchmark"));
 }
 #endif // ENABLE_CUDNN_CUPTI
 
+static void register_cudnn_flags() {
+  RegisterOpt(clara::Opt(FLAG(power_sampling), "none|nvml|file")["--power_sampling"](
+      "sample sm clock, power, temperature and throttle reasons during the timed iterations and add min/mean/max and "
+      "energy per iteration counters"));
+  RegisterOpt(clara::Opt(FLAG(power_sampling_file), "path")["--power_sampling_file"](
+      "readings replayed by --power_sampling=file, one \"sm_clock_mhz temperature_c power_w\" line per sample"));
+  RegisterOpt(clara::Opt(FLAG(power_sampling_period_ms), "ms")["--power_sampling_period_ms"](
+      "period of --power_sampling"));
+  RegisterOpt(clara::Opt(FLAG(sample_output), "path")["--sample_output"](
+      "write every timed iteration (elapsed time, timestamp, clock, temperature) to this binary file"));
+  RegisterOpt(clara::Opt(FLAG(sample_buffer_kb), "kb")["--sample_buffer_kb"](
+      "size of the in-memory buffer used for --sample_output"));
+  RegisterOpt(clara::Opt(FLAG(rollup), "model=results.json")["--rollup"](
+      "sum the fastest algorithm of each layer into model latency and throughput, then exit"));
+  RegisterOpt(clara::Opt(FLAG(rollup_layer_counts), "model=counts.json")["--rollup_layer_counts"](
+      "how often every layer of a model occurs in it, by layer name or signature"));
+  RegisterOpt(clara::Opt(FLAG(rollup_output), "path")["--rollup_output"](
+      "write the model rollup to this file instead of stdout"));
+  RegisterOpt(clara::Opt(FLAG(rollup_workspace_mb), "mb")["--rollup_workspace_mb"](
+      "workspace budget for algorithms picked by the model rollup"));
+  RegisterOpt(clara::Opt(FLAG(rollup_top), "count")["--rollup_top"](
+      "number of critical layers listed by the model rollup"));
+  RegisterOpt(clara::Opt(FLAG(predictor_train), "results.json")["--predictor_train"](
+      "fit the performance prediction model on these result files, write it to --predictor_model, then exit"));
+  RegisterOpt(clara::Opt(FLAG(predictor_model), "path")["--predictor_model"](
+      "path of the performance prediction model"));
+  RegisterOpt(clara::Opt(FLAG(store), "path")["--store"]("path of the local result store"));
+  RegisterOpt(clara::Opt(FLAG(store_import), "results.json")["--store_import"](
+      "import these result files into the local result store, then exit"));
+  RegisterOpt(clara::Opt(FLAG(store_query), "best|trend")["--store_query"](
+      "print the fastest algorithm of every layer (best) or a layer across cudnn versions (trend), then exit"));
+  RegisterOpt(clara::Opt(FLAG(store_device), "gpu_name")["--store_device"]("restrict --store_query=best to this gpu"));
+  RegisterOpt(clara::Opt(FLAG(store_layer), "layer")["--store_layer"](
+      "layer name (or part of it) or signature used by --store_query=trend"));
+  RegisterOpt(clara::Opt(FLAG(annotate), "none|nvtx|chrome")["--annotate"](
+      "record descriptor setup, allocation, find, warmup and timed iterations as nvtx ranges or chrome trace events"));
+  RegisterOpt(clara::Opt(FLAG(annotate_output), "path")["--annotate_output"](
+      "chrome trace event file written by --annotate=chrome"));
+  RegisterOpt(clara::Opt(FLAG(sweep), "sweep")["--sweep"](
+      "run the benchmarks on all --cuda_device_ids, one worker per device, and merge the results into --sweep_output"));
+  RegisterOpt(clara::Opt(FLAG(sweep_output), "path")["--sweep_output"]("merged json output of --sweep"));
+  RegisterOpt(clara::Opt(FLAG(sweep_batch_size), "count")["--sweep_batch_size"](
+      "number of benchmarks run by one child process of --sweep"));
+  RegisterOpt(clara::Opt(FLAG(sweep_batch_s), "seconds")["--sweep_batch_s"](
+      "estimated seconds after which a --sweep batch stops growing"));
+  RegisterOpt(clara::Opt(FLAG(sweep_processes_per_device), "count")["--sweep_processes_per_device"](
+      "number of concurrent --sweep workers per device, e.g. for cpu bound benchmarks"));
+  RegisterOpt(clara::Opt(FLAG(sweep_prior), "results.json")["--sweep_prior"](
+      "earlier results used to estimate the cost of each benchmark of --sweep"));
+  RegisterOpt(clara::Opt(FLAG(derive), "results.json")["--derive"](
+      "compute bandwidth, flop/s, arithmetic intensity and measured/predicted flops of these result files, then exit"));
+  RegisterOpt(clara::Opt(FLAG(derive_formulas), "path")["--derive_formulas"](
+      "expression file of the derived metrics, the built-in formulas are used if empty"));
+  RegisterOpt(clara::Opt(FLAG(derive_output), "path")["--derive_output"](
+      "write the derived metrics to this file instead of stdout"));
+  RegisterOpt(clara::Opt(FLAG(daemon_socket), "path")["--daemon_socket"](
+      "initialize once, then serve benchmark requests (one json object per line) on this unix socket until a "
+      "shutdown request"));
+  RegisterOpt(clara::Opt(FLAG(device_cache), "dir|none")["--device_cache"](
+      "directory of the cached device properties (default ~/.cache/cudnn_scope), none to always query the device"));
+  RegisterOpt(clara::Opt(FLAG(host_env_apply), "host_env_apply")["--host_env_apply"](
+      "set the performance governor, disable turbo, smt and aslr, and drop the page cache before running (needs "
+      "root)"));
+  RegisterOpt(clara::Opt(FLAG(host_pin), "none|node|core")["--host_pin"](
+      "pin the benchmarks to the cpus of the numa node of the gpu (node) or to the first of them (core)"));
+  RegisterOpt(clara::Opt(FLAG(numa_placement), "numa_placement")["--numa_placement"](
+      "bind every benchmark thread to the numa node of the gpu and copy the host data through pinned buffers "
+      "allocated on that node"));
+  RegisterOpt(clara::Opt(FLAG(train_step_workspace_mb), "mb")["--train_step_workspace_mb"](
+      "workspace budget shared by the forward and backward calls of a CONV_TRAIN_STEP, -1 for no budget"));
+}
+
+static int rollup_init() {
+  if (FLAG(rollup).empty()) {
+    return 0;
+  }
+  rollup::options_t opts;
+  if (FLAG(rollup_workspace_mb) >= 0) {
+    opts.workspace_budget_bytes = FLAG(rollup_workspace_mb) * 1048576.0;
+  }
+  opts.top = std::max(FLAG(rollup_top), 0);
+  try {
+    const auto res = rollup::run(FLAG(rollup), opts, FLAG(rollup_layer_counts));
+    if (FLAG(rollup_output).empty()) {
+      std::cout << res.dump(2) << "\n";
+    } else {
+      std::ofstream(FLAG(rollup_output)) << res.dump(2) << "\n";
+    }
+  } catch (const std::exception& e) {
+    LOG(error, fmt::format("rollup failed because of {}", e.what()));
+    return -1;
+  }
+  exit(0);
+}
+
+static int derive_init() {
+  if (FLAG(derive).empty()) {
+    return 0;
+  }
+  try {
+    const auto formulas = derived::load_formulas(FLAG(derive_formulas));
+    const auto res      = derived::run(FLAG(derive), formulas);
+    if (FLAG(derive_output).empty()) {
+      std::cout << res.dump(2) << "\n";
+    } else {
+      std::ofstream(FLAG(derive_output)) << res.dump(2) << "\n";
+    }
+  } catch (const std::exception& e) {
+    LOG(error, fmt::format("derive failed because of {}", e.what()));
+    return -1;
+  }
+  exit(0);
+}
+
+// Runs the sweep in a work directory that is removed afterwards, unless a
+// run failed: the errors point to the logs of the failed runs.
+static bool sweep_run(const std::vector<std::string>& args, const std::vector<std::string>& base_args) {
+  sweep::process::work_dir_t work_dir_guard;
+  const auto& work_dir = work_dir_guard.path();
+  const auto names =
+      sweep::process::list_benchmarks(base_args, sweep::process::flag_value(args, "--benchmark_filter"), work_dir);
+  std::vector<int> workers;
+  for (int ii = 0; ii < std::max(FLAG(sweep_processes_per_device), 1); ii++) {
+    workers.insert(workers.end(), FLAG(cuda_device_ids).begin(), FLAG(cuda_device_ids).end());
+  }
+
+  sweep::cost_model::options_t cost_opts;
+  cost_opts.num_warmup = FLAG(num_warmup);
+  sweep::cost_model costs(cost_opts);
+  for (const auto& path : FLAG(sweep_prior)) {
+    costs.add_prior(results::load(path).entries);
+  }
+  if (std::ifstream(FLAG(predictor_model)).good()) {
+    costs.set_model(predictor::model::load(FLAG(predictor_model)));
+  }
+  std::vector<double> estimates;
+  for (const auto& name : names) {
+    estimates.emplace_back(costs.estimate(name));
+  }
+  for (const auto& source : costs.num_estimates()) {
+    LOG(info, fmt::format("sweep estimated the cost of {} benchmarks from {}", source.second, source.first));
+  }
+  LOG(info, fmt::format("sweep of {} benchmarks over {} workers in {}", names.size(), workers.size(), work_dir));
+
+  sweep::options_t opts;
+  opts.batch_size   = std::max(FLAG(sweep_batch_size), 1);
+  opts.max_batch_s  = std::max(FLAG(sweep_batch_s), 1);
+  const auto report = sweep::run(workers, names, estimates, opts, sweep::process::runner(base_args, work_dir));
+  std::ofstream(FLAG(sweep_output)) << report.merged.dump(2) << "\n";
+  std::ofstream(FLAG(sweep_output) + ".report.json") << sweep::to_json(report).dump(2) << "\n";
+  for (const auto& error : report.errors) {
+    LOG(error, error);
+  }
+  LOG(info, fmt::format("sweep wrote {} results to {} in {:.1f}s, {} benchmarks failed",
+                        report.merged["benchmarks"].size(), FLAG(sweep_output), report.wall_s, report.failed.size()));
+  LOG(info, fmt::format("sweep makespan {:.1f}s, estimated {:.1f}s with a lower bound of {:.1f}s", report.wall_s,
+                        report.estimate.lpt_makespan, report.estimate.lower_bound));
+  if (report.num_rerun != 0) {
+    LOG(info, fmt::format("sweep ran {} benchmarks of failed batches again one by one", report.num_rerun));
+  }
+  if (!report.errors.empty()) {
+    LOG(info, fmt::format("sweep kept the logs of the failed runs in {}", work_dir));
+    work_dir_guard.keep();
+  }
+  return report.failed.empty();
+}
+
+static int sweep_init() {
+  if (!FLAG(sweep)) {
+    return 0;
+  }
+  try {
+    const auto args = sweep::process::self_args();
+    auto controlled = sweep::process::controlled_flags();
+    controlled.insert(controlled.end(), {"--sweep", "--sweep_output", "--sweep_batch_size", "--sweep_batch_s",
+                                         "--sweep_processes_per_device", "--sweep_prior"});
+    const auto base_args = sweep::process::strip(args, controlled);
+
+    // exit() skips the destructors, so the work directory is removed by sweep_run
+    exit(sweep_run(args, base_args) ? 0 : 1);
+  } catch (const std::exception& e) {
+    LOG(error, fmt::format("sweep failed because of {}", e.what()));
+    return -1;
+  }
+}
+
+static int predictor_init() {
+  if (FLAG(predictor_train).empty()) {
+    return 0;
+  }
+  try {
+    std::vector<results::entry_t> entries;
+    for (const auto& path : FLAG(predictor_train)) {
+      const auto file = results::load(path);
+      entries.insert(entries.end(), file.entries.begin(), file.entries.end());
+    }
+    const auto model = predictor::model::train(entries);
+    model.save(FLAG(predictor_model));
+    for (const auto& group : model.rooflines()) {
+      std::cout << fmt::format("{}: samples={} rms_log_error={:.3f}\n", group.first, group.second.num_samples,
+                               group.second.rms_log_error);
+    }
+  } catch (const std::exception& e) {
+    LOG(error, fmt::format("predictor training failed because of {}", e.what()));
+    return -1;
+  }
+  exit(0);
+}
+
+static int store_init() {
+  if (FLAG(store_import).empty() && FLAG(store_query).empty()) {
+    return 0;
+  }
+  try {
+    store::database db(FLAG(store));
+    for (const auto& path : FLAG(store_import)) {
+      if (!db.import(path)) {
+        LOG(info, fmt::format("{} is already in {}", path, FLAG(store)));
+      }
+    }
+    if (FLAG(store_query) == "best") {
+      std::cout << db.best_per_layer(FLAG(store_device)).dump(2) << "\n";
+    } else if (FLAG(store_query) == "trend") {
+      std::cout << db.trend(FLAG(store_layer)).dump(2) << "\n";
+    } else if (!FLAG(store_query).empty()) {
+      LOG(error, fmt::format("unknown store query {}", FLAG(store_query)));
+      return -1;
+    }
+  } catch (const std::exception& e) {
+    LOG(error, fmt::format("store failed because of {}", e.what()));
+    return -1;
+  }
+  exit(0);
+}
+
 static int cuda_init() {
   if (PRINT_IF_ERROR(cuDeviceGet(&m_device, cuda_device_id))) {
     LOG(error, "cudnn_init failed to get CUDA device");
@@ -73,6 +387,10 @@ static int cuda_init() {
 static void cupti_options() {
   using namespace cupti_profiler;
 
+  if ((FLAG(list_metrics) || FLAG(list_events)) && cudnn_lazy_init() != 0) {
+    exit(1);
+  }
+
   if (FLAG(list_metrics)) {
     for (const auto& metric : available_metrics(cuda_device_id)) {
       std::cout << metric << "\n";
@@ -89,6 +407,33 @@ static void cupti_options() {
 }
 #endif // ENABLE_CUDNN_CUPTI
 
+#ifdef ENABLE_CUDNN_CUPTI
+static int activity_trace_init() {
+  if (!FLAG(trace_kernels)) {
+    return 0;
+  }
+  try {
+    activity_trace::tracer::instance().enable(std::max(FLAG(trace_num_buffers), 2),
+                                              static_cast<size_t>(std::max(FLAG(trace_buffer_kb), 1)) * 1024);
+  } catch (const std::exception& e) {
+    LOG(error, fmt::format("activity_trace_init failed because of {}", e.what()));
+    return -1;
+  }
+  return 0;
+}
+
+static int kernel_metrics_init() {
+  if (FLAG(kernel_metrics_output) == "") {
+    return 0;
+  }
+  if (!kernel_metrics::output().open(FLAG(kernel_metrics_output))) {
+    LOG(error, fmt::format("unable to open {} for the kernel metric tables", FLAG(kernel_metrics_output)));
+    return -1;
+  }
+  return 0;
+}
+#endif // ENABLE_CUDNN_CUPTI
+
 static void cudnn_before_init() {
   // Create a version string and tell scope about it
   // These values are defined in cudnn_scope/config.hpp.in
@@ -96,42 +441,56 @@ static void cudnn_before_init() {
       version(SCOPE_PROJECT_NAME, SCOPE_VERSION, SCOPE_GIT_REFSPEC, SCOPE_GIT_HASH, SCOPE_GIT_LOCAL_CHANGES));
 }
 
-static int cudnn_init() {
-
-  cuda_device_id = FLAG(cuda_device_ids)[0];
-
-  if (PRINT_IF_ERROR(utils::cuda_reset_device(cuda_device_id))) {
-    LOG(error, "cudnn_init failed to reset CUDA device");
-    return -1;
+static int annotate_init() {
+  if (FLAG(annotate) == "none") {
+    return 0;
   }
-  if (PRINT_IF_ERROR(cudaSetDevice(cuda_device_id))) {
-    LOG(error, "cudnn_init failed to set CUDA device");
+  try {
+    if (FLAG(annotate) == "chrome") {
+      annotate::set_sink(std::unique_ptr<annotate::sink>(new annotate::chrome_trace_sink(FLAG(annotate_output))));
+      return 0;
+    }
+#ifdef ENABLE_CUDNN_NVTX
+    if (FLAG(annotate) == "nvtx") {
+      annotate::set_sink(std::unique_ptr<annotate::sink>(new annotate::nvtx_sink()));
+      return 0;
+    }
+#endif // ENABLE_CUDNN_NVTX
+  } catch (const std::exception& e) {
+    LOG(error, fmt::format("annotate_init failed because of {}", e.what()));
     return -1;
   }
+  LOG(error, fmt::format("annotate_init: the {} sink is not available in this build", FLAG(annotate)));
+  return -1;
+}
 
-  const auto err = cuda_init();
-  if (err) {
-    return err;
-  }
-
-  if (PRINT_IF_ERROR(cudnnCreate(&cudnn_handle))) {
-    LOG(error, "cudnn_init failed create CUDNN handle");
-    return -1;
-  }
+// The device, the context and the handles are set up by cudnn_lazy_init when
+// the first benchmark runs, so listing or filtering benchmarks and the
+// offline tools never touch the GPU.
+static int cudnn_init() {
+  cuda_device_id = FLAG(cuda_device_ids)[0];
 
   num_warmup = FLAG(num_warmup);
 
+  if (FLAG(train_step_workspace_mb) >= 0) {
+    train_step_workspace_bytes = int64_t(FLAG(train_step_workspace_mb)) * 1048576;
+  }
+
   metrics = FLAG(metrics);
   events  = FLAG(events);
 
   return 0;
 }
 
-static int cublas_init() {
-  if (PRINT_IF_ERROR(cublasCreate(&cublas_handle))) {
-    LOG(error, "cublas_init failed create CUBLAS handle");
+static int sample_sink_init() {
+  if (FLAG(sample_output).empty()) {
+    return 0;
+  }
+  const auto buffer_bytes = static_cast<size_t>(std::max(FLAG(sample_buffer_kb), 1)) * 1024;
+  if (!sample_sink::instance().open(FLAG(sample_output), buffer_bytes)) {
+    LOG(error, fmt::format("sample_sink_init failed to open {}", FLAG(sample_output)));
     return -1;
-  };
+  }
   return 0;
 }
 
@@ -205,31 +564,378 @@ static inline int compute_capability_major(int device_id) {
   return major;
 }
 
-static std::string get_compute_capability() {
-  return fmt::format("{}.{}", compute_capability_major(cuda_device_id), compute_capability_minor(cuda_device_id));
+static device_cache::info_t query_device_info() {
+  device_cache::info_t res;
+  res.gpu_name                 = get_gpu_name();
+  res.compute_capability_major = compute_capability_major(cuda_device_id);
+  res.compute_capability_minor = compute_capability_minor(cuda_device_id);
+  char pci_bus_id[64];
+  if (!PRINT_IF_ERROR(cudaDeviceGetPCIBusId(pci_bus_id, sizeof(pci_bus_id), cuda_device_id))) {
+    res.pci_bus_id = pci_bus_id;
+  }
+  return res;
+}
+
+struct device_info_t {
+  std::mutex mutex{};
+  // the cache was read
+  bool is_checked{false};
+  bool is_loaded{false};
+  std::string path{""};
+  nlohmann::json key{};
+  device_cache::info_t info{};
+};
+
+static device_info_t& device_info() {
+  static device_info_t res;
+  return res;
+}
+
+// The properties of the device from the cache of --device_cache, if its key
+// still matches. Reading the cache does not touch the GPU, so cudnn_lazy_init
+// checks it before it resets the device and creates the context.
+static bool load_device_info() {
+  auto& state = device_info();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.is_checked) {
+    return state.is_loaded;
+  }
+  const auto dir   = FLAG(device_cache).empty() ? device_cache::default_dir() : FLAG(device_cache);
+  state.path       = dir.empty() || dir == "none" ? std::string("") : device_cache::path(dir, cuda_device_id);
+  state.key        = device_cache::key(get_hostname(), cuda_device_id);
+  state.is_loaded  = !state.path.empty() && device_cache::load(state.path, state.key, state.info);
+  state.is_checked = true;
+  return state.is_loaded;
+}
+
+// The properties of the device, from the cache if it has them; queried
+// properties are written back to the cache.
+static const device_cache::info_t& get_device_info() {
+  auto& state = device_info();
+  if (load_device_info()) {
+    return state.info;
+  }
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.is_loaded) {
+    return state.info;
+  }
+  state.info      = query_device_info();
+  state.is_loaded = true;
+  if (!state.path.empty() && !state.info.gpu_name.empty()) {
+    try {
+      device_cache::save(state.path, state.key, state.info);
+    } catch (const std::exception& e) {
+      LOG(info, fmt::format("unable to cache the device properties because of {}", e.what()));
+    }
+  }
+  return state.info;
+}
+
+// Only checks --power_sampling; the sampler is started by cudnn_lazy_init, so
+// listing benchmarks and the offline tools do not open NVML.
+static int power_sampler_init() {
+  const auto backend = FLAG(power_sampling);
+  if (backend == "none" || backend == "file") {
+    return 0;
+  }
+#ifdef ENABLE_CUDNN_NVML
+  if (backend == "nvml") {
+    return 0;
+  }
+#endif // ENABLE_CUDNN_NVML
+  LOG(error, fmt::format("power_sampler_init: --power_sampling={} is not available in this build", backend));
+  return -1;
+}
+
+static int power_sampler_lazy_init(const std::string& pci_bus_id) {
+  if (FLAG(power_sampling) == "none") {
+    return 0;
+  }
+  std::unique_ptr<power_sampler::backend> backend;
+  try {
+    if (FLAG(power_sampling) == "file") {
+      backend.reset(new power_sampler::file_backend(FLAG(power_sampling_file)));
+    }
+#ifdef ENABLE_CUDNN_NVML
+    if (FLAG(power_sampling) == "nvml") {
+      if (pci_bus_id.empty()) {
+        LOG(error, "power_sampler_lazy_init failed to get the pci bus id of the device");
+        return -1;
+      }
+      backend.reset(new power_sampler::nvml_backend(pci_bus_id));
+    }
+#endif // ENABLE_CUDNN_NVML
+  } catch (const std::exception& e) {
+    LOG(error, fmt::format("power_sampler_lazy_init failed because of {}", e.what()));
+    return -1;
+  }
+  const auto period = std::chrono::milliseconds(std::max(FLAG(power_sampling_period_ms), 1));
+  power_sampler::instance().reset(new power_sampler::sampler(std::move(backend), period));
+  power_sampler::attach_to_sample_sink();
+  return 0;
 }
 
+// Checks --host_pin and applies --host_env_apply, which only touch the host.
+// Pinning needs the pci bus id of the device and happens in host_env_lazy_init.
+static int host_env_init() {
+  const auto pin = FLAG(host_pin);
+  if (pin != "none" && pin != "node" && pin != "core") {
+    LOG(error, fmt::format("host_env_init got unknown --host_pin={}", pin));
+    return -1;
+  }
+  if (FLAG(host_env_apply)) {
+    const auto failed = host_env::apply_recommended();
+    for (const auto& setting : failed) {
+      LOG(error, fmt::format("host_env_init failed to change {}", setting));
+    }
+  }
+  return 0;
+}
+
+// Pins the calling thread, and through handle_pool every other benchmark
+// thread, and records the host state reported with every benchmark.
+static int pin_and_probe_host_env() {
+  const auto pin = FLAG(host_pin);
+  std::string pci_bus_id{""};
+  if (pin != "none") {
+    pci_bus_id = get_device_info().pci_bus_id;
+    auto cpus  = topology::device_cpus(pci_bus_id);
+    if (cpus.empty()) {
+      LOG(error, fmt::format("host_env_lazy_init failed to find the cpus near the device {}", pci_bus_id));
+      return -1;
+    }
+    if (pin == "core") {
+      cpus.resize(1);
+    }
+    if (!topology::bind_cpus(cpus)) {
+      LOG(error, fmt::format("host_env_lazy_init failed to pin to the cpus {}", topology::format_cpu_list(cpus)));
+      return -1;
+    }
+    host_env::pinned_cpus() = cpus;
+  }
+  host_env::recorded() = host_env::probe(pci_bus_id);
+  LOG(info, fmt::format("host environment: {}", host_env::to_json(host_env::recorded()).dump()));
+  return 0;
+}
+
+int host_env_lazy_init() {
+  static std::once_flag once;
+  static int res = 0;
+  std::call_once(once, []() { res = pin_and_probe_host_env(); });
+  return res;
+}
+
+#ifdef ENABLE_CUDNN_CUPTI
+static int check_cupti_backend() {
+#ifndef ENABLE_CUDNN_CUPTI_RANGE_PROFILER
+  if (cupti_range_profiler) {
+    LOG(error, "cupti_backend_init requires the range profiler, which was not found at build time");
+    return -1;
+  }
+#endif // ENABLE_CUDNN_CUPTI_RANGE_PROFILER
+  return 0;
+}
+
+// auto is resolved from the compute capability by cudnn_lazy_init
+static int cupti_backend_init() {
+  const auto backend = FLAG(cupti_backend);
+  if (backend != "legacy" && backend != "range" && backend != "auto") {
+    LOG(error, fmt::format("cupti_backend_init got unknown backend {}", backend));
+    return -1;
+  }
+  cupti_range_profiler = backend == "range";
+  return check_cupti_backend();
+}
+#endif // ENABLE_CUDNN_CUPTI
+
+// The versions that are known without a device; gpu_name, compute_capability
+// and cublas_version are filled in by cudnn_lazy_init.
 static void system_info() {
-  gpu_name             = get_gpu_name();
   host_name            = get_hostname();
   cuda_runtime_version = get_cuda_runtime_version();
   cuda_driver_version  = get_cuda_driver_version();
-  cublas_version       = get_cublas_version();
 #ifdef ENABLE_CUDNN_CUPTI
   cupti_version = get_cupti_version();
 #endif // ENABLE_CUDNN_CUPTI
-  cudnn_version      = get_cudnn_version();
-  compute_capability = get_compute_capability();
+  cudnn_version = get_cudnn_version();
+}
+
+// Runs f on a thread of its own with the context of the process current.
+template <typename F>
+static auto on_context_thread(F f) -> std::future<decltype(f())> {
+  return std::async(std::launch::async, [f]() {
+    if (PRINT_IF_ERROR(cuCtxSetCurrent(m_context))) {
+      throw std::runtime_error("unable to make the CUDA context current");
+    }
+    return f();
+  });
+}
+
+static int lazy_init() {
+  ANNOTATE_RANGE("init");
+  const auto start = std::chrono::steady_clock::now();
+  // read before the device is touched; cached properties are not queried
+  const auto is_cached = load_device_info();
+
+  if (PRINT_IF_ERROR(utils::cuda_reset_device(cuda_device_id))) {
+    LOG(error, "cudnn_init failed to reset CUDA device");
+    return -1;
+  }
+  if (PRINT_IF_ERROR(cudaSetDevice(cuda_device_id))) {
+    LOG(error, "cudnn_init failed to set CUDA device");
+    return -1;
+  }
+  const auto err = cuda_init();
+  if (err) {
+    return err;
+  }
+
+  // the handles and the device properties do not depend on each other
+  auto cudnn  = on_context_thread([]() { return !PRINT_IF_ERROR(cudnnCreate(&cudnn_handle)); });
+  auto cublas = on_context_thread([]() { return !PRINT_IF_ERROR(cublasCreate(&cublas_handle)); });
+  std::future<device_cache::info_t> device;
+  if (!is_cached) {
+    device = on_context_thread([]() { return get_device_info(); });
+  }
+  try {
+    if (!cudnn.get()) {
+      LOG(error, "cudnn_init failed create CUDNN handle");
+      return -1;
+    }
+    if (!cublas.get()) {
+      LOG(error, "cublas_init failed create CUBLAS handle");
+      return -1;
+    }
+    const auto info    = is_cached ? get_device_info() : device.get();
+    gpu_name           = info.gpu_name;
+    compute_capability = fmt::format("{}.{}", info.compute_capability_major, info.compute_capability_minor);
+    if (host_env_lazy_init() != 0 || power_sampler_lazy_init(info.pci_bus_id) != 0) {
+      return -1;
+    }
+    host_env::recorded().gpu_numa_node = topology::device_node(info.pci_bus_id);
+    if (FLAG(numa_placement)) {
+      numa_node = host_env::recorded().gpu_numa_node;
+      if (numa_node < 0) {
+        LOG(info, "--numa_placement is ignored because the numa node of the device is unknown");
+      }
+    }
+#ifdef ENABLE_CUDNN_CUPTI
+    if (FLAG(cupti_backend) == "auto") {
+      cupti_range_profiler = range_profiler::is_required(info.compute_capability_major, info.compute_capability_minor);
+      if (check_cupti_backend() != 0) {
+        return -1;
+      }
+    }
+#endif // ENABLE_CUDNN_CUPTI
+  } catch (const std::exception& e) {
+    LOG(error, fmt::format("cudnn_init failed because of {}", e.what()));
+    return -1;
+  }
+  cublas_version = get_cublas_version();
+
+  const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  LOG(info, fmt::format("initialized device {} ({}) in {:.0f}ms", cuda_device_id, gpu_name, elapsed));
+  return 0;
+}
+
+int cudnn_lazy_init() {
+  static std::once_flag once;
+  static int res = 0;
+  std::call_once(once, []() { res = lazy_init(); });
+  return res;
+}
+
+// Runs the benchmarks of a daemon request in this process. google benchmark
+// keeps its flags in globals and only sets them by parsing a command line, so
+// a request with another filter, min time or repetitions than the previous
+// one parses them again, defaulting to the command line of the daemon.
+static nlohmann::json daemon_run(const server::request_t& request) {
+  static const auto daemon_args = sweep::process::self_args();
+  const auto default_flag       = [](const std::string& name, const std::string& value) {
+    const auto res = sweep::process::flag_value(daemon_args, name);
+    return res.empty() ? value : res;
+  };
+  const auto filter = request.filter.empty() ? sweep::filter_regex(request.benchmarks) : request.filter;
+  std::vector<std::string> args{
+      daemon_args[0],
+      "--benchmark_filter=" + filter,
+      "--benchmark_out=",
+      "--benchmark_list_tests=false",
+      "--benchmark_min_time=" + (request.options.min_time > 0 ? std::to_string(request.options.min_time)
+                                                              : default_flag("--benchmark_min_time", "0.5")),
+      "--benchmark_repetitions=" + (request.options.repetitions > 0 ? std::to_string(request.options.repetitions)
+                                                                    : default_flag("--benchmark_repetitions", "1")),
+  };
+  static std::vector<std::string> last_args{};
+  if (args != last_args) {
+    last_args = args;
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+      argv.emplace_back(&arg[0]);
+    }
+    argv.emplace_back(nullptr);
+    int argc = static_cast<int>(args.size());
+    benchmark::Initialize(&argc, argv.data());
+  }
+
+  std::ostringstream output, errors;
+  benchmark::JSONReporter reporter;
+  reporter.SetOutputStream(&output);
+  reporter.SetErrorStream(&errors);
+  num_warmup           = request.options.num_warmup >= 0 ? request.options.num_warmup : FLAG(num_warmup);
+  const auto num_found = benchmark::RunSpecifiedBenchmarks(&reporter);
+  num_warmup           = FLAG(num_warmup);
+  if (num_found == 0) {
+    throw std::runtime_error("no benchmark matches " + filter);
+  }
+  return nlohmann::json::parse(output.str());
+}
+
+static void daemon_serve() {
+  if (FLAG(daemon_socket).empty()) {
+    return;
+  }
+  // initialize before the first request, so it does not pay for it, and keep
+  // the workspaces and algorithm choices between the requests
+  if (cudnn_lazy_init() != 0) {
+    exit(1);
+  }
+  warm_cache::enabled() = true;
+  try {
+    server::server daemon(FLAG(daemon_socket), daemon_run);
+    LOG(info, fmt::format("daemon serving benchmark requests on {}", FLAG(daemon_socket)));
+    daemon.serve();
+    LOG(info, fmt::format("daemon served {} requests", daemon.status()["num_served"].get<size_t>()));
+  } catch (const std::exception& e) {
+    LOG(error, fmt::format("daemon failed because of {}", e.what()));
+    exit(1);
+  }
+  exit(0);
 }
 
 SCOPE_REGISTER_BEFORE_INIT(cudnn_before_init);
+SCOPE_REGISTER_BEFORE_INIT(register_cudnn_flags);
 #ifdef ENABLE_CUDNN_CUPTI
 SCOPE_REGISTER_BEFORE_INIT(register_cupti_flags);
 #endif // ENABLE_CUDNN_CUPTI
+SCOPE_REGISTER_INIT(rollup_init);
+SCOPE_REGISTER_INIT(derive_init);
+SCOPE_REGISTER_INIT(sweep_init);
+SCOPE_REGISTER_INIT(predictor_init);
+SCOPE_REGISTER_INIT(store_init);
+SCOPE_REGISTER_INIT(annotate_init);
 SCOPE_REGISTER_INIT(cudnn_init);
-SCOPE_REGISTER_INIT(cublas_init);
+SCOPE_REGISTER_INIT(sample_sink_init);
+SCOPE_REGISTER_INIT(power_sampler_init);
+SCOPE_REGISTER_INIT(host_env_init);
+#ifdef ENABLE_CUDNN_CUPTI
+SCOPE_REGISTER_INIT(cupti_backend_init);
+SCOPE_REGISTER_INIT(activity_trace_init);
+SCOPE_REGISTER_INIT(kernel_metrics_init);
+#endif // ENABLE_CUDNN_CUPTI
 #ifdef ENABLE_CUDNN_CUPTI
 SCOPE_REGISTER_AFTER_INIT(cupti_options, "cupti");
 #endif // ENABLE_CUDNN_CUPTI
 SCOPE_REGISTER_AFTER_INIT(color_logger, "logger");
 SCOPE_REGISTER_AFTER_INIT(system_info, "system_info");
+SCOPE_REGISTER_AFTER_INIT(daemon_serve, "daemon");
@@ -7,8 +7,20 @@ extern CUdevice m_device;
 extern cudnnHandle_t cudnn_handle;
 extern cublasHandle_t cublas_handle;
 extern int cuda_device_id;
+// NUMA node of the device with --numa_placement, -1 to leave placement to the OS
+extern int numa_node;
+
+// Resets the device and creates the context and the cudnn/cublas handles on
+// the first call; returns -1 if that failed.
+int cudnn_lazy_init();
+// Pins the process to the cpus near the device (--host_pin) and records the
+// host state on the first call; returns -1 if pinning failed. cudnn_lazy_init
+// calls it, the CPU benchmarks call it on their own.
+int host_env_lazy_init();
 
 extern int32_t num_warmup;
+// workspace budget shared by the calls of a CONV_TRAIN_STEP, -1 for no budget
+extern int64_t train_step_workspace_bytes;
 extern std::vector<std::string> metrics;
 extern std::vector<std::string> events;
 
@@ -22,4 +34,6 @@ extern std::string compute_capability;
 
 #ifdef ENABLE_CUDNN_CUPTI
 extern std::string cupti_version;
+// metrics are collected by range_profiler instead of cupti_profiler
+extern bool cupti_range_profiler;
 #endif // ENABLE_CUDNN_CUPTI
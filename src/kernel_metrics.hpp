@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <cxxabi.h>
+
+#include "json.hpp"
+
+// Compact storage of per kernel profiler values.
+//
+// Instead of one "kernel_metric:<demangled name>/current_iter:<i>/metric:<m>"
+// counter per kernel, iteration and metric, a benchmark collects rows of
+// (kernel id, iteration, value id, value) in a table. Kernel symbols are
+// interned process wide and demangled once. Only the mean/min/max per kernel
+// and value become benchmark counters; the full table can be written as one
+// json line per benchmark with --kernel_metrics_output.
+namespace kernel_metrics {
+
+using json = nlohmann::json;
+
+static std::string demangle_symbol(const std::string &symbol) {
+  int status     = 0;
+  char *realname = abi::__cxa_demangle(symbol.c_str(), nullptr, nullptr, &status);
+  if (status != 0 || realname == nullptr) {
+    return symbol;
+  }
+  std::string res(realname);
+  free(realname);
+  return res;
+}
+
+class symbol_table {
+public:
+  uint32_t intern(const std::string &symbol) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_ids.find(symbol);
+    if (it != m_ids.end()) {
+      return it->second;
+    }
+    const auto id = static_cast<uint32_t>(m_symbols.size());
+    m_ids.emplace(symbol, id);
+    m_symbols.emplace_back(symbol);
+    m_demangled.emplace_back(demangle_symbol(symbol));
+    return id;
+  }
+
+  std::string symbol(uint32_t id) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_symbols.at(id);
+  }
+
+  std::string demangled(uint32_t id) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_demangled.at(id);
+  }
+
+private:
+  mutable std::mutex m_mutex{};
+  std::unordered_map<std::string, uint32_t> m_ids{};
+  std::vector<std::string> m_symbols{};
+  std::vector<std::string> m_demangled{};
+};
+
+inline symbol_table &symbols() {
+  static symbol_table instance;
+  return instance;
+}
+
+struct row_t {
+  uint32_t kernel_id;
+  uint32_t iteration;
+  uint32_t value_id;
+  double value;
+};
+
+struct summary_t {
+  uint32_t kernel_id{0};
+  // e.g. metric:dram_read_bytes or event:inst_executed
+  std::string value_name{""};
+  size_t count{0};
+  double mean{0};
+  double min{0};
+  double max{0};
+};
+
+class table {
+public:
+  void add(uint32_t kernel_id, uint32_t iteration, const std::string &value_name, double value) {
+    auto it = m_value_ids.find(value_name);
+    if (it == m_value_ids.end()) {
+      it = m_value_ids.emplace(value_name, static_cast<uint32_t>(m_value_names.size())).first;
+      m_value_names.emplace_back(value_name);
+    }
+    m_rows.push_back(row_t{kernel_id, iteration, it->second, value});
+  }
+
+  bool empty() const {
+    return m_rows.empty();
+  }
+
+  const std::vector<row_t> &rows() const {
+    return m_rows;
+  }
+
+  // One summary per (kernel, value), ordered by kernel id then value name.
+  std::vector<summary_t> aggregate() const {
+    std::map<std::pair<uint32_t, uint32_t>, summary_t> acc;
+    for (const auto &row : m_rows) {
+      auto &s = acc[{row.kernel_id, row.value_id}];
+      if (s.count == 0) {
+        s.kernel_id  = row.kernel_id;
+        s.value_name = m_value_names[row.value_id];
+        s.min        = std::numeric_limits<double>::max();
+        s.max        = std::numeric_limits<double>::lowest();
+      }
+      s.count++;
+      s.mean += row.value;
+      s.min = std::min(s.min, row.value);
+      s.max = std::max(s.max, row.value);
+    }
+    std::vector<summary_t> res;
+    for (auto &s : acc) {
+      s.second.mean /= s.second.count;
+      res.emplace_back(std::move(s.second));
+    }
+    std::sort(res.begin(), res.end(), [](const summary_t &a, const summary_t &b) {
+      return a.kernel_id != b.kernel_id ? a.kernel_id < b.kernel_id : a.value_name < b.value_name;
+    });
+    return res;
+  }
+
+  json to_json() const {
+    json kernels = json::object();
+    json rows    = json::array();
+    for (const auto &row : m_rows) {
+      const auto key = std::to_string(row.kernel_id);
+      if (!kernels.count(key)) {
+        kernels[key] = symbols().demangled(row.kernel_id);
+      }
+      rows.push_back({row.kernel_id, row.iteration, row.value_id, row.value});
+    }
+    return {{"kernels", kernels}, {"values", m_value_names}, {"rows", rows}};
+  }
+
+private:
+  std::vector<row_t> m_rows{};
+  std::vector<std::string> m_value_names{};
+  std::unordered_map<std::string, uint32_t> m_value_ids{};
+};
+
+// Appends one json document per benchmark and line.
+class writer {
+public:
+  bool open(const std::string &path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stream.open(path, std::ios::out | std::ios::trunc);
+    return m_stream.is_open();
+  }
+
+  bool is_open() const {
+    return m_stream.is_open();
+  }
+
+  // Returns the id of the table in the output, 0 if there is no output.
+  uint64_t write(const std::string &benchmark, const table &t) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_stream.is_open()) {
+      return 0;
+    }
+    const auto id = ++m_num_tables;
+    json doc         = t.to_json();
+    doc["table_id"]  = id;
+    doc["benchmark"] = benchmark;
+    m_stream << doc.dump() << "\n";
+    return id;
+  }
+
+private:
+  std::mutex m_mutex{};
+  std::ofstream m_stream{};
+  uint64_t m_num_tables{0};
+};
+
+inline writer &output() {
+  static writer instance;
+  return instance;
+}
+
+} // namespace kernel_metrics
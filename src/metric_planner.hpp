@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Planning of profiler passes.
+//
+// Collecting a metric set that does not fit into one pass used to turn on
+// kernel replay for every kernel of every iteration. Instead the metrics (and
+// events) are split into groups that each fit into a single pass and the
+// groups are spread over the profiled iterations, pass i on iteration i.
+// Replay is only used for metrics that need several passes on their own, or
+// for the groups that do not fit into the available iterations.
+//
+// The planner only sees names and a compatibility predicate, "can these be
+// collected in one pass", so it does not depend on CUPTI.
+namespace metric_planner {
+
+using compatible_t = std::function<bool(const std::vector<std::string> &)>;
+
+// groups up to this size are partitioned exactly, larger ones greedily
+static const size_t exact_limit = 12;
+
+struct plan_t {
+  // every group can be collected in a single pass
+  std::vector<std::vector<std::string>> passes{};
+  // need more than one pass even when collected alone
+  std::vector<std::string> multi_pass{};
+};
+
+struct slot_t {
+  std::vector<std::string> metrics{};
+  std::vector<std::string> events{};
+  // the slot needs kernel replay
+  bool replay{false};
+};
+
+namespace detail {
+  class memo_compatible {
+  public:
+    explicit memo_compatible(const compatible_t &compatible) : m_compatible(compatible) {
+    }
+
+    bool operator()(std::vector<std::string> group) {
+      std::sort(group.begin(), group.end());
+      std::string key;
+      for (const auto &item : group) {
+        key += item + '\n';
+      }
+      const auto it = m_cache.find(key);
+      if (it != m_cache.end()) {
+        return it->second;
+      }
+      return m_cache[key] = m_compatible(group);
+    }
+
+  private:
+    const compatible_t &m_compatible;
+    std::map<std::string, bool> m_cache{};
+  };
+
+  static bool fits(memo_compatible &compatible, std::vector<std::string> group, const std::string &item) {
+    group.emplace_back(item);
+    return compatible(group);
+  }
+
+  static std::vector<std::vector<std::string>> first_fit(const std::vector<std::string> &items,
+                                                         memo_compatible &compatible) {
+    std::vector<std::vector<std::string>> groups;
+    for (const auto &item : items) {
+      auto it = std::find_if(groups.begin(), groups.end(), [&](const std::vector<std::string> &group) {
+        return fits(compatible, group, item);
+      });
+      if (it == groups.end()) {
+        groups.push_back({item});
+      } else {
+        it->emplace_back(item);
+      }
+    }
+    return groups;
+  }
+
+  static void search(const std::vector<std::string> &items, size_t idx, memo_compatible &compatible,
+                     std::vector<std::vector<std::string>> &groups, std::vector<std::vector<std::string>> &best) {
+    if (groups.size() >= best.size()) {
+      return;
+    }
+    if (idx == items.size()) {
+      best = groups;
+      return;
+    }
+    const auto &item = items[idx];
+    for (auto &group : groups) {
+      if (fits(compatible, group, item)) {
+        group.emplace_back(item);
+        search(items, idx + 1, compatible, groups, best);
+        group.pop_back();
+      }
+    }
+    groups.push_back({item});
+    search(items, idx + 1, compatible, groups, best);
+    groups.pop_back();
+  }
+} // namespace detail
+
+// Partitions items into the fewest groups that are each compatible.
+static plan_t plan(const std::vector<std::string> &items, const compatible_t &compatible) {
+  detail::memo_compatible memo(compatible);
+  plan_t res;
+
+  std::vector<std::string> single_pass;
+  for (const auto &item : items) {
+    if (std::find(single_pass.begin(), single_pass.end(), item) != single_pass.end() ||
+        std::find(res.multi_pass.begin(), res.multi_pass.end(), item) != res.multi_pass.end()) {
+      continue;
+    }
+    if (memo({item})) {
+      single_pass.emplace_back(item);
+    } else {
+      res.multi_pass.emplace_back(item);
+    }
+  }
+
+  // the most constrained items first
+  std::map<std::string, size_t> conflicts;
+  for (size_t ii = 0; ii < single_pass.size(); ii++) {
+    for (size_t jj = ii + 1; jj < single_pass.size(); jj++) {
+      if (!memo({single_pass[ii], single_pass[jj]})) {
+        conflicts[single_pass[ii]]++;
+        conflicts[single_pass[jj]]++;
+      }
+    }
+  }
+  std::stable_sort(single_pass.begin(), single_pass.end(),
+                   [&](const std::string &a, const std::string &b) { return conflicts[a] > conflicts[b]; });
+
+  res.passes = detail::first_fit(single_pass, memo);
+  if (single_pass.size() <= exact_limit && res.passes.size() > 1) {
+    std::vector<std::vector<std::string>> groups;
+    detail::search(single_pass, 0, memo, groups, res.passes);
+  }
+  return res;
+}
+
+// Assigns the planned passes to num_iterations iterations. Iteration i
+// collects slot i % slots.size(). Multi pass items and the passes that do not
+// fit into the iterations are collected together in a last, replayed slot.
+static std::vector<slot_t> schedule(const plan_t &metrics, const plan_t &events, size_t num_iterations) {
+  std::vector<slot_t> slots;
+  for (const auto &pass : metrics.passes) {
+    slot_t slot;
+    slot.metrics = pass;
+    slots.emplace_back(slot);
+  }
+  for (const auto &pass : events.passes) {
+    slot_t slot;
+    slot.events = pass;
+    slots.emplace_back(slot);
+  }
+
+  const auto has_multi_pass = !metrics.multi_pass.empty() || !events.multi_pass.empty();
+  const auto num_slots      = std::max<size_t>(num_iterations, 1);
+  if (!has_multi_pass && slots.size() <= num_slots) {
+    return slots;
+  }
+
+  const auto keep = std::min(slots.size(), num_slots - 1);
+  slot_t replay;
+  replay.replay = true;
+  for (size_t ii = keep; ii < slots.size(); ii++) {
+    replay.metrics.insert(replay.metrics.end(), slots[ii].metrics.begin(), slots[ii].metrics.end());
+    replay.events.insert(replay.events.end(), slots[ii].events.begin(), slots[ii].events.end());
+  }
+  replay.metrics.insert(replay.metrics.end(), metrics.multi_pass.begin(), metrics.multi_pass.end());
+  replay.events.insert(replay.events.end(), events.multi_pass.begin(), events.multi_pass.end());
+  slots.resize(keep);
+  slots.emplace_back(replay);
+  return slots;
+}
+
+} // namespace metric_planner
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <benchmark/benchmark.h>
+
+// Layer, group and instance normalization.
+//
+// All three normalize the rows of an NCHW tensor seen as a rows x row_size
+// matrix and then apply a learned scale and shift:
+//   layer:    a row per index of the axes before begin_axis, over the axes
+//             from begin_axis on (N x CHW for begin_axis = 1), scale and
+//             shift per normalized element;
+//   group:    a row per sample and group of C/group channels, scale and
+//             shift per channel;
+//   instance: group with one channel per group.
+// The problems use the arg layout of NORM_ARG_NAMES: N, C, H, W, the group
+// count (group norm) and the first normalized axis (layer norm).
+namespace norm {
+
+enum class kind_t : int { layer = 0, group = 1, instance = 2 };
+
+// N, C, H, W or a view of them
+using dims_t = std::array<int, 4>;
+
+struct problem_t {
+  kind_t kind{kind_t::layer};
+  int batch_size{1};
+  int channels{1};
+  int height{1};
+  int width{1};
+  int group{1};
+  int begin_axis{1};
+  double epsilon{1e-5};
+
+  dims_t dims() const {
+    return {{batch_size, channels, height, width}};
+  }
+
+  int num_groups() const {
+    switch (kind) {
+      case kind_t::group:
+        return group;
+      case kind_t::instance:
+        return channels;
+      default:
+        return 1;
+    }
+  }
+
+  bool is_valid() const {
+    for (const auto dim : dims()) {
+      if (dim <= 0) {
+        return false;
+      }
+    }
+    if (kind == kind_t::layer) {
+      return begin_axis >= 1 && begin_axis <= 3;
+    }
+    return num_groups() > 0 && channels % num_groups() == 0;
+  }
+
+  int64_t size() const {
+    return int64_t(batch_size) * channels * height * width;
+  }
+
+  // The number of (mean, variance) pairs.
+  int64_t num_rows() const {
+    if (kind != kind_t::layer) {
+      return int64_t(batch_size) * num_groups();
+    }
+    const auto d = dims();
+    int64_t res  = 1;
+    for (int ii = 0; ii < begin_axis; ii++) {
+      res *= d[ii];
+    }
+    return res;
+  }
+
+  int64_t row_size() const {
+    return size() / num_rows();
+  }
+
+  int64_t param_size() const {
+    return kind == kind_t::layer ? row_size() : channels;
+  }
+
+  // The channel of the first element of a row; the channels of a row are
+  // contiguous runs of H * W elements.
+  int first_channel(int64_t row) const {
+    return static_cast<int>(row % num_groups()) * (channels / num_groups());
+  }
+
+  // The tensor as seen by the batch normalization that computes the row
+  // statistics: every row is a channel.
+  dims_t stats_view() const {
+    return {{1, static_cast<int>(num_rows()), static_cast<int>(row_size()), 1}};
+  }
+
+  // The tensor and the scale and shift as seen by the affine transform.
+  dims_t affine_view() const {
+    if (kind == kind_t::layer) {
+      return {{static_cast<int>(num_rows()), static_cast<int>(row_size()), 1, 1}};
+    }
+    return {{batch_size, channels, height * width, 1}};
+  }
+
+  dims_t param_view() const {
+    return {{1, static_cast<int>(param_size()), 1, 1}};
+  }
+};
+
+// An arg of 0 picks 1.
+static problem_t problem(const benchmark::State &state, kind_t kind) {
+  const auto arg = [&](int ii) {
+    const auto value = static_cast<int>(state.range(ii));
+    return value == 0 ? 1 : value;
+  };
+  problem_t res;
+  res.kind       = kind;
+  res.batch_size = arg(0);
+  res.channels   = arg(1);
+  res.height     = arg(2);
+  res.width      = arg(3);
+  res.group      = arg(4);
+  res.begin_axis = arg(5);
+  return res;
+}
+
+// Like batchnorm, predicted_flops counts an op per element. The bytes count
+// every tensor once: x and y (and dy for the backward pass) and the scale and
+// shift (and their gradients), the least any implementation moves. The CPU
+// kernels read x (and dy) twice.
+template <typename T>
+static void add_counters(benchmark::State &state, const problem_t &problem, bool is_backward) {
+  state.counters.insert({{"input_size", problem.size()},
+                         {"input_batch_size", problem.batch_size},
+                         {"input_channels", problem.channels},
+                         {"input_height", problem.height},
+                         {"input_width", problem.width},
+                         {"output_size", problem.size()},
+                         {"norm_kind", (int) problem.kind},
+                         {"group", problem.num_groups()},
+                         {"begin_axis", problem.kind == kind_t::layer ? problem.begin_axis : 2},
+                         {"num_rows", problem.num_rows()},
+                         {"row_size", problem.row_size()},
+                         {"param_size", problem.param_size()},
+                         {"epsilon", problem.epsilon},
+                         {"is_backward", is_backward}});
+  const auto num_passes      = is_backward ? 3 : 2;
+  const auto predicted_flops = static_cast<double>(problem.size());
+  const auto predicted_bytes =
+      static_cast<double>(num_passes * (problem.size() + problem.param_size()) * sizeof(T));
+  state.counters.insert(
+      {{"predicted_flops_count", predicted_flops},
+       {"predicted_flops", {predicted_flops * state.iterations(), benchmark::Counter::kAvgThreadsRate}},
+       {"predicted_bytes", predicted_bytes},
+       {"predicted_bandwidth", {predicted_bytes * state.iterations(), benchmark::Counter::kAvgThreadsRate}}});
+}
+
+} // namespace norm
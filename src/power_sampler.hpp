@@ -0,0 +1,409 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef ENABLE_CUDNN_NVML
+#include <nvml.h>
+#endif // ENABLE_CUDNN_NVML
+
+#include "sample_sink.hpp"
+
+// Power, clock and thermal sampling during the timed iterations.
+//
+// The setup scripts pin the clocks, but what the GPU actually ran at is not
+// recorded. With --power_sampling a background thread reads the SM clock,
+// power draw, temperature and clock throttle reasons at a fixed period while a
+// BENCHMARK_BLOCK runs its timed iterations. The min/mean/max of each reading
+// and the energy per iteration are added as counters, so throttled runs and
+// perf-per-watt show up in the results. The energy is the power integrated
+// over the timed intervals of the window only: the error checks, the sample
+// recording and the profiler replays between iterations do not count.
+// Readings come from NVML or, for tests and machines without NVML, from a text
+// file with one "sm_clock_mhz temperature_c power_w" line per sample.
+namespace power_sampler {
+
+static const float not_available = std::numeric_limits<float>::quiet_NaN();
+
+struct reading_t {
+  float sm_clock_mhz{not_available};
+  float temperature_c{not_available};
+  float power_w{not_available};
+  // bit mask of nvmlClocksThrottleReasons, 0 if not throttled or unknown
+  uint64_t throttle_reasons{0};
+};
+
+class backend {
+public:
+  virtual ~backend() {
+  }
+  virtual reading_t read() = 0;
+};
+
+#ifdef ENABLE_CUDNN_NVML
+#define NVML_API_CALL(apiFuncCall)                                                                                     \
+  do {                                                                                                                 \
+    nvmlReturn_t _status = apiFuncCall;                                                                                \
+    if (_status != NVML_SUCCESS) {                                                                                     \
+      throw std::runtime_error(std::string(#apiFuncCall) + " failed with error " + nvmlErrorString(_status));          \
+    }                                                                                                                  \
+  } while (0)
+
+class nvml_backend : public backend {
+public:
+  // The device is identified by its pci bus id since nvml and cuda may number devices differently.
+  explicit nvml_backend(const std::string &pci_bus_id) {
+    NVML_API_CALL(nvmlInit());
+    if (nvmlDeviceGetHandleByPciBusId(pci_bus_id.c_str(), &m_device) != NVML_SUCCESS) {
+      nvmlShutdown();
+      throw std::runtime_error("unable to get the nvml handle of device " + pci_bus_id);
+    }
+  }
+
+  ~nvml_backend() {
+    nvmlShutdown();
+  }
+
+  // Readings the device does not support are left as not available.
+  reading_t read() override {
+    reading_t res;
+    unsigned int value = 0;
+    if (nvmlDeviceGetClockInfo(m_device, NVML_CLOCK_SM, &value) == NVML_SUCCESS) {
+      res.sm_clock_mhz = value;
+    }
+    if (nvmlDeviceGetTemperature(m_device, NVML_TEMPERATURE_GPU, &value) == NVML_SUCCESS) {
+      res.temperature_c = value;
+    }
+    if (nvmlDeviceGetPowerUsage(m_device, &value) == NVML_SUCCESS) {
+      res.power_w = value / 1000.0f;
+    }
+    unsigned long long reasons = 0;
+    if (nvmlDeviceGetCurrentClocksThrottleReasons(m_device, &reasons) == NVML_SUCCESS) {
+      // idle and application clock settings are not throttling
+      res.throttle_reasons =
+          reasons & ~static_cast<unsigned long long>(nvmlClocksThrottleReasonGpuIdle |
+                                                     nvmlClocksThrottleReasonApplicationsClocksSetting);
+    }
+    return res;
+  }
+
+private:
+  nvmlDevice_t m_device{nullptr};
+};
+#endif // ENABLE_CUDNN_NVML
+
+// Replays the readings of a text file, one per read, and then repeats the last
+// one. Lines are "sm_clock_mhz temperature_c power_w [throttle_reasons]";
+// empty lines and lines starting with # are skipped.
+class file_backend : public backend {
+public:
+  explicit file_backend(const std::string &path) {
+    std::ifstream stream(path);
+    if (!stream.is_open()) {
+      throw std::runtime_error("unable to open " + path);
+    }
+    std::string line;
+    while (std::getline(stream, line)) {
+      if (line.find_first_not_of(" \t\r") == std::string::npos || line[line.find_first_not_of(" \t")] == '#') {
+        continue;
+      }
+      std::istringstream fields(line);
+      reading_t reading;
+      if (!(fields >> reading.sm_clock_mhz >> reading.temperature_c >> reading.power_w)) {
+        throw std::runtime_error("invalid power sample \"" + line + "\" in " + path);
+      }
+      fields >> reading.throttle_reasons;
+      m_readings.emplace_back(reading);
+    }
+    if (m_readings.empty()) {
+      throw std::runtime_error("no power samples in " + path);
+    }
+  }
+
+  reading_t read() override {
+    const auto &res = m_readings[std::min(m_next, m_readings.size() - 1)];
+    m_next++;
+    return res;
+  }
+
+private:
+  std::vector<reading_t> m_readings{};
+  size_t m_next{0};
+};
+
+struct stat_t {
+  double min{std::numeric_limits<double>::quiet_NaN()};
+  double mean{std::numeric_limits<double>::quiet_NaN()};
+  double max{std::numeric_limits<double>::quiet_NaN()};
+  size_t count{0};
+
+  void add(double value) {
+    if (std::isnan(value)) {
+      return;
+    }
+    if (count == 0) {
+      min = mean = max = value;
+    } else {
+      min = std::min(min, value);
+      max = std::max(max, value);
+      mean += (value - mean) / (count + 1);
+    }
+    count++;
+  }
+};
+
+struct summary_t {
+  size_t num_samples{0};
+  stat_t sm_clock_mhz{};
+  stat_t temperature_c{};
+  stat_t power_w{};
+  // union of the throttle reasons seen in the window
+  uint64_t throttle_reasons{0};
+  double duration_s{0};
+  // the part of the window inside the timed intervals
+  double timed_s{0};
+  // integral of the power, linearly interpolated between the samples, over the
+  // timed intervals; NaN without power readings
+  double energy_j{std::numeric_limits<double>::quiet_NaN()};
+};
+
+// Samples the backend on a background thread between start() and stop().
+class sampler {
+public:
+  using clock      = std::chrono::steady_clock;
+  using sample_t   = std::pair<clock::time_point, reading_t>;
+  using interval_t = std::pair<clock::time_point, clock::time_point>;
+
+  sampler(std::unique_ptr<backend> b, std::chrono::microseconds period)
+      : m_backend(std::move(b)), m_period(std::max(period, std::chrono::microseconds(100))) {
+    m_latest = m_backend->read();
+    m_thread = std::thread([this]() { run(); });
+  }
+
+  sampler(const sampler &) = delete;
+  sampler &operator=(const sampler &) = delete;
+
+  ~sampler() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_exit = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+  }
+
+  // Starts a window; the first sample is taken right away.
+  void start() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_samples.clear();
+    m_intervals.clear();
+    m_timed  = false;
+    m_start  = clock::now();
+    m_active = true;
+    sample_locked();
+    m_cv.notify_all();
+  }
+
+  // Opens and closes a timed interval of the window. Only the time is taken, a
+  // reading could block the iteration.
+  void begin_timed() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_active && !m_timed) {
+      m_intervals.emplace_back(clock::now(), clock::time_point{});
+      m_timed = true;
+    }
+  }
+
+  void end_timed() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_active && m_timed) {
+      m_intervals.back().second = clock::now();
+      m_timed                   = false;
+    }
+  }
+
+  // Ends the window with a last sample and summarizes it.
+  summary_t stop() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_active) {
+      return summary_t{};
+    }
+    const auto end = clock::now();
+    if (m_timed) {
+      m_intervals.back().second = end;
+      m_timed                   = false;
+    }
+    sample_locked();
+    m_active = false;
+    return summarize(m_samples, m_intervals, std::chrono::duration<double>(end - m_start).count());
+  }
+
+  // The most recent reading, also outside of a window.
+  reading_t latest() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_latest;
+  }
+
+  // Without intervals the whole window counts as timed.
+  static summary_t summarize(const std::vector<sample_t> &samples, std::vector<interval_t> intervals,
+                             double duration_s) {
+    summary_t res;
+    res.num_samples = samples.size();
+    res.duration_s  = duration_s;
+    for (const auto &sample : samples) {
+      res.sm_clock_mhz.add(sample.second.sm_clock_mhz);
+      res.temperature_c.add(sample.second.temperature_c);
+      res.power_w.add(sample.second.power_w);
+      res.throttle_reasons |= sample.second.throttle_reasons;
+    }
+    if (intervals.empty()) {
+      if (samples.empty()) {
+        res.timed_s = duration_s;
+        return res;
+      }
+      intervals.emplace_back(samples.front().first, samples.back().first);
+    }
+    for (const auto &interval : intervals) {
+      res.timed_s += std::chrono::duration<double>(interval.second - interval.first).count();
+    }
+
+    std::vector<sample_t> powered;
+    std::copy_if(samples.begin(), samples.end(), std::back_inserter(powered),
+                 [](const sample_t &sample) { return !std::isnan(sample.second.power_w); });
+    if (powered.empty()) {
+      return res;
+    }
+    if (powered.size() == 1) {
+      res.energy_j = powered.front().second.power_w * res.timed_s;
+      return res;
+    }
+    // the power at t: linear between the samples, constant before the first and after the last
+    const auto power_at = [&](clock::time_point t) -> double {
+      if (t <= powered.front().first) {
+        return powered.front().second.power_w;
+      }
+      if (t >= powered.back().first) {
+        return powered.back().second.power_w;
+      }
+      const auto next = std::upper_bound(powered.begin(), powered.end(), t,
+                                         [](clock::time_point t, const sample_t &sample) { return t < sample.first; });
+      const auto prev = std::prev(next);
+      const auto span = std::chrono::duration<double>(next->first - prev->first).count();
+      if (span <= 0) {
+        return next->second.power_w;
+      }
+      const auto frac = std::chrono::duration<double>(t - prev->first).count() / span;
+      return prev->second.power_w + frac * (next->second.power_w - prev->second.power_w);
+    };
+    // the trapezoids between the interval ends and the samples inside the interval
+    res.energy_j = 0;
+    for (const auto &interval : intervals) {
+      std::vector<clock::time_point> points{interval.first};
+      for (const auto &sample : powered) {
+        if (sample.first > interval.first && sample.first < interval.second) {
+          points.emplace_back(sample.first);
+        }
+      }
+      points.emplace_back(interval.second);
+      for (size_t ii = 1; ii < points.size(); ii++) {
+        const auto dt = std::chrono::duration<double>(points[ii] - points[ii - 1]).count();
+        res.energy_j += dt * (power_at(points[ii - 1]) + power_at(points[ii])) / 2;
+      }
+    }
+    return res;
+  }
+
+private:
+  void sample_locked() {
+    m_latest = m_backend->read();
+    m_samples.emplace_back(clock::now(), m_latest);
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_exit) {
+      if (!m_active) {
+        m_cv.wait(lock, [this]() { return m_exit || m_active; });
+        continue;
+      }
+      if (m_cv.wait_for(lock, m_period, [this]() { return m_exit || !m_active; })) {
+        continue;
+      }
+      sample_locked();
+    }
+  }
+
+  std::unique_ptr<backend> m_backend;
+  const std::chrono::microseconds m_period;
+  std::mutex m_mutex{};
+  std::condition_variable m_cv{};
+  bool m_active{false};
+  bool m_exit{false};
+  bool m_timed{false};
+  clock::time_point m_start{};
+  reading_t m_latest{};
+  std::vector<sample_t> m_samples{};
+  std::vector<interval_t> m_intervals{};
+  std::thread m_thread{};
+};
+
+// The process wide sampler, nullptr unless --power_sampling is set.
+inline std::unique_ptr<sampler> &instance() {
+  static std::unique_ptr<sampler> s{nullptr};
+  return s;
+}
+
+// Starts a sampling window if --power_sampling is set.
+inline void begin_window() {
+  if (instance() != nullptr) {
+    instance()->start();
+  }
+}
+
+// Brackets a timed iteration of the window.
+inline void begin_timed() {
+  if (instance() != nullptr) {
+    instance()->begin_timed();
+  }
+}
+
+inline void end_timed() {
+  if (instance() != nullptr) {
+    instance()->end_timed();
+  }
+}
+
+// Ends the window; num_samples is 0 if there was none.
+inline summary_t end_window() {
+  return instance() == nullptr ? summary_t{} : instance()->stop();
+}
+
+// Feeds the latest reading into the raw iteration samples of --sample_output.
+inline void attach_to_sample_sink() {
+  sample_sink::instance().set_environment_reader([]() {
+    sample_sink::environment_reading_t res;
+    if (instance() == nullptr) {
+      return res;
+    }
+    const auto reading = instance()->latest();
+    res.sm_clock_mhz   = reading.sm_clock_mhz;
+    res.temperature_c  = reading.temperature_c;
+    res.power_w        = reading.power_w;
+    return res;
+  });
+}
+
+} // namespace power_sampler
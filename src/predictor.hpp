@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "results.hpp"
+
+// Performance prediction for layer shapes that were not swept.
+//
+// A piecewise roofline is fitted per (layer kind, data type, algorithm):
+//
+//   time = scale * max(overhead, flops / peak_flops, bytes / peak_bytes)
+//
+// overhead is the launch floor, peak_flops and peak_bytes are the throughput
+// ceilings observed in the sweep (a high percentile, to be robust against
+// outliers) and scale is a least squares correction in log space. Every
+// sample goes into four groups, and a group with too few samples is not
+// fitted (except the global one). predict() uses the first fitted key of
+//
+//   kind/dtype/algorithm, kind/dtype, kind, * (global)
+namespace predictor {
+
+static const int model_format_version = 1;
+
+struct features_t {
+  // layer kind without the instance index and data type, e.g. LAYER_CUDNN_CONV_FWD
+  std::string kind{""};
+  std::string dtype{""};
+  std::string algorithm{""};
+  double flops{0};
+  double bytes{0};
+};
+
+struct roofline_t {
+  double overhead_s{0};
+  double peak_flops{0};
+  double peak_bytes_per_s{0};
+  double scale{1};
+  size_t num_samples{0};
+  // root mean square of log(observed / predicted)
+  double rms_log_error{0};
+
+  double predict(const features_t &f) const {
+    double t = overhead_s;
+    if (peak_flops > 0 && f.flops > 0) {
+      t = std::max(t, f.flops / peak_flops);
+    }
+    if (peak_bytes_per_s > 0 && f.bytes > 0) {
+      t = std::max(t, f.bytes / peak_bytes_per_s);
+    }
+    return scale * t;
+  }
+};
+
+static size_t dtype_bytes(const std::string &dtype) {
+  if (dtype == "INT8") {
+    return 1;
+  }
+  if (dtype == "HALF" || dtype == "FLOAT16") {
+    return 2;
+  }
+  if (dtype == "DOUBLE" || dtype == "FLOAT64") {
+    return 8;
+  }
+  return 4;
+}
+
+// LAYER_CUDNN_CONV_FWD_1_FLOAT32 -> (LAYER_CUDNN_CONV_FWD, FLOAT32)
+static std::pair<std::string, std::string> split_family(const std::string &family) {
+  static const std::vector<std::string> dtypes{"_HALF_TENSOROP", "_FLOAT16", "_FLOAT32", "_FLOAT64", "_HALF",
+                                               "_FLOAT",         "_DOUBLE",  "_INT8",    "_INT32"};
+  std::string kind = family, dtype = "FLOAT32";
+  for (const auto &suffix : dtypes) {
+    const auto pos = family.rfind(suffix);
+    if (pos != std::string::npos && pos + suffix.size() == family.size()) {
+      kind  = family.substr(0, pos);
+      dtype = suffix.substr(1);
+      if (dtype == "HALF_TENSOROP") {
+        dtype = "HALF";
+      }
+      break;
+    }
+  }
+  // the generated families are split into numbered translation units
+  const auto pos = kind.find_last_of('_');
+  if (pos != std::string::npos && pos + 1 < kind.size() &&
+      std::all_of(kind.begin() + pos + 1, kind.end(), [](char c) { return std::isdigit(c); })) {
+    kind = kind.substr(0, pos);
+  }
+  return {kind, dtype};
+}
+
+static double product_of_inputs(const results::entry_t &entry) {
+  double res = 1;
+  for (int ii = 0; ii < 8; ii++) {
+    const auto val = entry.counter("input[" + std::to_string(ii) + "]", -1);
+    if (val > 0) {
+      res *= val;
+    }
+  }
+  return res;
+}
+
+static features_t features_from(const results::entry_t &entry) {
+  features_t f;
+  const auto kind_dtype = split_family(entry.family);
+  f.kind                = kind_dtype.first;
+  f.dtype               = kind_dtype.second;
+  f.algorithm           = entry.algorithm;
+
+  const auto elem_bytes  = static_cast<double>(dtype_bytes(f.dtype));
+  const auto input_size  = entry.counter("input_size", product_of_inputs(entry));
+  const auto output_size = entry.counter("output_size", input_size);
+  double weight_size     = 0;
+  if (entry.counter("num_filters", -1) > 0) {
+    weight_size = entry.counter("num_filters") * std::max(entry.counter("input_channels", 1), 1.0) *
+                  std::max(entry.counter("filter_height", 1), 1.0) * std::max(entry.counter("filter_width", 1), 1.0) /
+                  std::max(entry.counter("group", 1), 1.0);
+  }
+  f.bytes = (input_size + output_size + weight_size) * elem_bytes;
+  f.flops = entry.counter("predicted_flops_count", -1);
+  if (f.flops <= 0) {
+    // element-wise layers do a constant amount of work per output element
+    f.flops = output_size;
+  }
+  return f;
+}
+
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty()) {
+    return 0;
+  }
+  const auto idx = static_cast<size_t>(std::min(v.size() - 1.0, std::floor(p * (v.size() - 1) + 0.5)));
+  std::nth_element(v.begin(), v.begin() + idx, v.end());
+  return v[idx];
+}
+
+static roofline_t fit(const std::vector<std::pair<features_t, double>> &samples) {
+  roofline_t r;
+  r.num_samples = samples.size();
+  if (samples.empty()) {
+    return r;
+  }
+  std::vector<double> times, flop_rates, byte_rates;
+  for (const auto &s : samples) {
+    times.emplace_back(s.second);
+    if (s.first.flops > 0) {
+      flop_rates.emplace_back(s.first.flops / s.second);
+    }
+    if (s.first.bytes > 0) {
+      byte_rates.emplace_back(s.first.bytes / s.second);
+    }
+  }
+  r.overhead_s       = percentile(times, 0.05);
+  r.peak_flops       = percentile(flop_rates, 0.95);
+  r.peak_bytes_per_s = percentile(byte_rates, 0.95);
+
+  std::vector<double> log_ratios;
+  for (const auto &s : samples) {
+    const auto predicted = r.predict(s.first);
+    if (predicted > 0) {
+      log_ratios.emplace_back(std::log(s.second / predicted));
+    }
+  }
+  if (log_ratios.empty()) {
+    return r;
+  }
+  const auto mean_log_ratio = std::accumulate(log_ratios.begin(), log_ratios.end(), 0.0) / log_ratios.size();
+  r.scale                   = std::exp(mean_log_ratio);
+
+  double sq_sum = 0;
+  for (const auto &ratio : log_ratios) {
+    sq_sum += (ratio - mean_log_ratio) * (ratio - mean_log_ratio);
+  }
+  r.rms_log_error = std::sqrt(sq_sum / log_ratios.size());
+  return r;
+}
+
+class model {
+public:
+  // groups with fewer samples use a coarser fit
+  static const size_t min_group_samples = 4;
+
+  static model train(const std::vector<results::entry_t> &entries) {
+    std::map<std::string, std::vector<std::pair<features_t, double>>> groups;
+    for (const auto &entry : results::merge_repetitions(entries)) {
+      if (entry.error_occurred || entry.time_s <= 0) {
+        continue;
+      }
+      const auto f = features_from(entry);
+      for (const auto &key : keys(f)) {
+        groups[key].emplace_back(f, entry.time_s);
+      }
+    }
+    model m;
+    for (const auto &group : groups) {
+      if (group.second.size() >= min_group_samples || group.first == global_key()) {
+        m.m_rooflines[group.first] = fit(group.second);
+      }
+    }
+    return m;
+  }
+
+  // Returns a negative value if there is nothing to predict from.
+  double predict(const features_t &f) const {
+    for (const auto &key : keys(f)) {
+      const auto it = m_rooflines.find(key);
+      if (it != m_rooflines.end()) {
+        return it->second.predict(f);
+      }
+    }
+    return -1;
+  }
+
+  double predict(const results::entry_t &entry) const {
+    return predict(features_from(entry));
+  }
+
+  const std::map<std::string, roofline_t> &rooflines() const {
+    return m_rooflines;
+  }
+
+  results::json to_json() const {
+    results::json groups = results::json::object();
+    for (const auto &r : m_rooflines) {
+      groups[r.first] = {{"overhead_s", r.second.overhead_s},
+                         {"peak_flops", r.second.peak_flops},
+                         {"peak_bytes_per_s", r.second.peak_bytes_per_s},
+                         {"scale", r.second.scale},
+                         {"num_samples", r.second.num_samples},
+                         {"rms_log_error", r.second.rms_log_error}};
+    }
+    return {{"version", model_format_version}, {"kind", "piecewise_roofline"}, {"groups", groups}};
+  }
+
+  static model from_json(const results::json &doc) {
+    if (doc.value("version", 0) != model_format_version) {
+      throw std::runtime_error("unsupported predictor model version");
+    }
+    model m;
+    for (const auto &item : doc.at("groups").items()) {
+      const auto &g = item.value();
+      roofline_t r;
+      r.overhead_s                = g.value("overhead_s", 0.0);
+      r.peak_flops                = g.value("peak_flops", 0.0);
+      r.peak_bytes_per_s          = g.value("peak_bytes_per_s", 0.0);
+      r.scale                     = g.value("scale", 1.0);
+      r.num_samples               = g.value("num_samples", 0);
+      r.rms_log_error             = g.value("rms_log_error", 0.0);
+      m.m_rooflines[item.key()] = r;
+    }
+    return m;
+  }
+
+  void save(const std::string &path) const {
+    std::ofstream stream(path);
+    if (!stream.is_open()) {
+      throw std::runtime_error("unable to write " + path);
+    }
+    stream << to_json().dump(2) << "\n";
+  }
+
+  static model load(const std::string &path) {
+    std::ifstream stream(path);
+    if (!stream.is_open()) {
+      throw std::runtime_error("unable to open " + path);
+    }
+    results::json doc;
+    stream >> doc;
+    return from_json(doc);
+  }
+
+private:
+  static std::string global_key() {
+    return "*";
+  }
+
+  // most specific first
+  static std::vector<std::string> keys(const features_t &f) {
+    return {f.kind + "/" + f.dtype + "/" + f.algorithm, f.kind + "/" + f.dtype, f.kind, global_key()};
+  }
+
+  std::map<std::string, roofline_t> m_rooflines{};
+};
+
+} // namespace predictor
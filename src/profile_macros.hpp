@@ -2,10 +2,20 @@
 
 #include <algorithm>
 #include <cmath>
+#include <map>
 #include <numeric>
 #include <vector>
 
+#include "activity_trace.hpp"
+#include "annotate.hpp"
 #include "cupti_profiler.hpp"
+#include "handle_pool.hpp"
+#include "host_env.hpp"
+#include "kernel_metrics.hpp"
+#include "power_sampler.hpp"
+#include "range_profiler.hpp"
+#include "sample_sink.hpp"
+#include "topology.hpp"
 
 #ifndef IMPLEMENTATION_NAME
 #define IMPLEMENTATION_NAME BENCHMARK_NAME
@@ -86,53 +96,240 @@ static double StatisticsStdDev(const std::vector<double>& v) {
 #define CUPTI_STATE_COUNTER_INFO                                                                                       \
   {"cupti_enabled", ENABLE_CUDNN_CUPTI}, {"cupti_num_iters", CUDNN_CUPTI_NUM_ITERS},                                   \
       {std::string("cupti_version:") + cupti_version, fnv1a_64(cupti_version)},
-#define CUPTI_PROFILE_START cupti_profiler::profiler profiler(events, metrics)
+#ifdef ENABLE_CUDNN_CUPTI_RANGE_PROFILER
+// The block is replayed once per profiler pass after the timed run of the iteration.
+#define CUPTI_RANGE_PROFILE(current_iter)                                                                              \
+  do {                                                                                                                 \
+    auto* range_session = profiled ? range_profiler::session() : nullptr;                                              \
+    if (range_session != nullptr) {                                                                                    \
+      AddRangeMetricCounters(state, current_iter,                                                                      \
+                             range_session->profile("benchmark_block", BENCHMARK_BLOCK_1(benchmark_block)));           \
+    }                                                                                                                  \
+  } while (0)
+#else // ENABLE_CUDNN_CUPTI_RANGE_PROFILER
+#define CUPTI_RANGE_PROFILE(current_iter)
+#endif // ENABLE_CUDNN_CUPTI_RANGE_PROFILER
+// The kernels of concurrent benchmark threads can not be told apart, so only
+// single threaded runs are profiled. A CUPTI or nvperf failure is kept in
+// profile_err, and BENCHMARK_BLOCK skips the benchmark with its error string.
+#define CUPTI_PROFILE_SESSION                                                                                          \
+  auto& tracer  = activity_trace::tracer::instance();                                                                  \
+  auto profiled = state.threads == 1;                                                                                  \
+  cupti_profiler::planned_session* planned = nullptr;                                                                  \
+  try {                                                                                                                \
+    planned = (!profiled || tracer.is_enabled() || cupti_range_profiler) ? nullptr : &cupti_profiler::session();       \
+  } catch (const std::exception& e) {                                                                                  \
+    profile_err = e.what();                                                                                            \
+  }                                                                                                                    \
+  cupti_profiler::profiler* profiler = nullptr;                                                                        \
+  kernel_metrics::table kernel_metric_table
+#define CUPTI_PROFILE_START(current_iter)                                                                              \
+  do {                                                                                                                 \
+    try {                                                                                                              \
+      profiler = planned == nullptr ? nullptr : planned->for_iteration(current_iter);                                  \
+      if (profiler != nullptr) {                                                                                       \
+        profiler->start();                                                                                             \
+      } else if (profiled && tracer.is_enabled()) {                                                                    \
+        tracer.begin_iteration();                                                                                      \
+      }                                                                                                                \
+    } catch (const std::exception& e) {                                                                                \
+      profiler    = nullptr;                                                                                           \
+      profile_err = e.what();                                                                                          \
+    }                                                                                                                  \
+  } while (0)
 #define CUPTI_PROFILE_STOP(current_iter)                                                                               \
   do {                                                                                                                 \
-    profiler.stop();                                                                                                   \
-    const auto current_iter_s = std::string("/current_iter:") + std::to_string(current_iter);                          \
-    for (const auto kernel_name : profiler.get_kernel_names()) {                                                       \
-      const auto demangled_name = demangle(kernel_name);                                                               \
-      state.counters.insert({std::string("kernel:") + kernel_name, fnv1a_64(kernel_name)});                            \
-      state.counters.insert({std::string("demangled_kernel:") + demangled_name, fnv1a_64(kernel_name)});               \
-      for (const auto metric_value : profiler.get_metric_values(kernel_name)) {                                        \
-        state.counters.insert(                                                                                         \
-            {std::string("kernel_metric:") + demangled_name + current_iter_s + "/metric:" + metric_value.first,        \
-             metric_value.second});                                                                                    \
+    try {                                                                                                              \
+      if (!profiled || !profile_err.empty()) {                                                                         \
+        break;                                                                                                         \
       }                                                                                                                \
-      for (const auto event_value : profiler.get_event_values(kernel_name)) {                                          \
-        state.counters.insert(                                                                                         \
-            {std::string("kernel_event:") + demangled_name + current_iter_s + "/event:" + event_value.first,           \
-             event_value.second});                                                                                     \
+      if (tracer.is_enabled()) {                                                                                       \
+        AddKernelTraceCounters(state, kernel_metric_table, current_iter, tracer.end_iteration(),                       \
+                               tracer.num_dropped_buffers());                                                          \
+        break;                                                                                                         \
       }                                                                                                                \
+      if (planned == nullptr) {                                                                                        \
+        CUPTI_RANGE_PROFILE(current_iter);                                                                             \
+        break;                                                                                                         \
+      }                                                                                                                \
+      if (profiler == nullptr) {                                                                                       \
+        break;                                                                                                         \
+      }                                                                                                                \
+      profiler->stop();                                                                                                \
+      for (const auto& metric_name : profiler->metric_names()) {                                                       \
+        state.counters.insert({std::string("metric_iteration:") + metric_name, current_iter});                         \
+      }                                                                                                                \
+      for (const auto& event_name : profiler->event_names()) {                                                         \
+        state.counters.insert({std::string("event_iteration:") + event_name, current_iter});                           \
+      }                                                                                                                \
+      for (const auto& kernel_name : profiler->get_kernel_names()) {                                                   \
+        const auto kernel_id = kernel_metrics::symbols().intern(kernel_name);                                          \
+        for (const auto& metric_value : profiler->get_metric_values(kernel_name)) {                                    \
+          kernel_metric_table.add(kernel_id, current_iter, "metric:" + metric_value.first, metric_value.second);       \
+        }                                                                                                              \
+        for (const auto& event_value : profiler->get_event_values(kernel_name)) {                                      \
+          kernel_metric_table.add(kernel_id, current_iter, "event:" + event_value.first, event_value.second);          \
+        }                                                                                                              \
+      }                                                                                                                \
+    } catch (const std::exception& e) {                                                                                \
+      profile_err = e.what();                                                                                          \
     }                                                                                                                  \
   } while (0)
+#define CUPTI_PROFILE_FINISH AddKernelMetricCounters(state, kernel_metric_table, __PRETTY_FUNCTION__)
+
+// The per kernel values of the legacy profiler and the kernel trace are
+// aggregated over the iterations; the kernels are listed once as
+// kernel_id:<demangled name>.
+template <typename State>
+static void AddKernelMetricCounters(State& state, const kernel_metrics::table& table, const char* benchmark) {
+  if (table.empty()) {
+    return;
+  }
+  for (const auto& summary : table.aggregate()) {
+    const auto prefix = std::string("kernel_stat:") + std::to_string(summary.kernel_id) + "/" + summary.value_name;
+    state.counters.insert({std::string("kernel_id:") + kernel_metrics::symbols().demangled(summary.kernel_id),
+                           summary.kernel_id});
+    state.counters.insert({
+        {prefix + "/mean", summary.mean},
+        {prefix + "/min", summary.min},
+        {prefix + "/max", summary.max},
+    });
+  }
+  const auto table_id = kernel_metrics::output().write(benchmark, table);
+  if (table_id != 0) {
+    state.counters.insert({"kernel_metrics_table_id", table_id});
+  }
+}
+
+// Counters of the range profiler, one value per metric over the whole benchmark block.
+template <typename State>
+static void AddRangeMetricCounters(State& state, int current_iter, const std::map<std::string, double>& values) {
+  const auto current_iter_s = std::string("/current_iter:") + std::to_string(current_iter);
+  for (const auto& metric_value : values) {
+    state.counters.insert(
+        {std::string("range_metric:benchmark_block") + current_iter_s + "/metric:" + metric_value.first,
+         metric_value.second});
+  }
+}
+
+// The launches of --trace_kernels go into the kernel table of the benchmark
+// as trace:<field> values, so they are reported per kernel like the profiler
+// values (see AddKernelMetricCounters) instead of as a counter per launch.
+// trace:launches is the number of launches of a kernel in an iteration.
+template <typename State>
+static void AddKernelTraceCounters(State& state, kernel_metrics::table& table, int current_iter,
+                                   const std::vector<activity_trace::kernel_record_t>& records,
+                                   size_t num_dropped_buffers) {
+  const auto first_start = records.empty() ? 0 : records.front().start_ns;
+  std::map<uint32_t, int> launches;
+  for (const auto& record : records) {
+    const auto kernel_id = kernel_metrics::symbols().intern(record.name);
+    launches[kernel_id]++;
+    table.add(kernel_id, current_iter, "trace:start_ns", record.start_ns - first_start);
+    table.add(kernel_id, current_iter, "trace:duration_ns", record.duration_ns());
+    table.add(kernel_id, current_iter, "trace:grid_x", record.grid[0]);
+    table.add(kernel_id, current_iter, "trace:grid_y", record.grid[1]);
+    table.add(kernel_id, current_iter, "trace:grid_z", record.grid[2]);
+    table.add(kernel_id, current_iter, "trace:block_x", record.block[0]);
+    table.add(kernel_id, current_iter, "trace:block_y", record.block[1]);
+    table.add(kernel_id, current_iter, "trace:block_z", record.block[2]);
+    table.add(kernel_id, current_iter, "trace:registers_per_thread", record.registers_per_thread);
+    table.add(kernel_id, current_iter, "trace:static_shared_bytes", record.static_shared_bytes);
+    table.add(kernel_id, current_iter, "trace:dynamic_shared_bytes", record.dynamic_shared_bytes);
+  }
+  for (const auto& kernel_launches : launches) {
+    table.add(kernel_launches.first, current_iter, "trace:launches", kernel_launches.second);
+  }
+  state.counters["kernel_trace_num_launches"] += records.size();
+  state.counters["kernel_trace_dropped_buffers"] = num_dropped_buffers;
+}
 #else // ENABLE_CUDNN_CUPTI
 #define BENCHMARK_CUDNN(...) BENCHMARK(__VA_ARGS__)->CUSTOM_STATS()
 #define BENCHMARK_CUDNN_TEMPLATE(...) BENCHMARK_TEMPLATE(__VA_ARGS__)->CUSTOM_STATS()
 #define CUPTI_STATE_COUNTER_INFO {"cupti_enabled", 0},
-#define CUPTI_PROFILE_START
+#define CUPTI_PROFILE_SESSION
+#define CUPTI_PROFILE_START(current_iter)
 #define CUPTI_PROFILE_STOP(current_iter)
+#define CUPTI_PROFILE_FINISH
 #endif // ENABLE_CUDNN_CUPTI
 
+// Clock, temperature and power seen during the timed iterations (--power_sampling).
+template <typename State>
+static void AddPowerCounters(State& state, const power_sampler::summary_t& summary, int num_iterations) {
+  if (summary.num_samples == 0) {
+    return;
+  }
+  const auto add_stat = [&](const std::string& name, const power_sampler::stat_t& stat) {
+    if (stat.count == 0) {
+      return;
+    }
+    state.counters.insert({{name + "_min", stat.min}, {name + "_mean", stat.mean}, {name + "_max", stat.max}});
+  };
+  add_stat("sm_clock_mhz", summary.sm_clock_mhz);
+  add_stat("temperature_c", summary.temperature_c);
+  add_stat("power_w", summary.power_w);
+  state.counters.insert({{"power_num_samples", summary.num_samples},
+                         {"power_timed_s", summary.timed_s},
+                         {"clocks_throttle_reasons", summary.throttle_reasons}});
+  if (!std::isnan(summary.energy_j) && num_iterations > 0) {
+    state.counters.insert({"energy_per_iteration_j", summary.energy_j / num_iterations});
+  }
+}
+
+// Host state recorded before the first benchmark (--host_env_apply, --host_pin) and the NUMA
+// placement of the benchmark thread (--numa_placement).
+template <typename State>
+static void AddHostEnvCounters(State& state) {
+  const auto& env = host_env::recorded();
+  state.counters.insert({{std::string("host_governor:") + env.governor, fnv1a_64(env.governor)},
+                         {std::string("host_turbo:") + env.turbo, fnv1a_64(env.turbo)},
+                         {std::string("host_smt:") + env.smt, fnv1a_64(env.smt)},
+                         {std::string("host_affinity:") + env.affinity, fnv1a_64(env.affinity)},
+                         {"host_aslr", env.aslr},
+                         {"host_num_numa_nodes", env.num_numa_nodes},
+                         {"host_num_online_cpus", env.num_online_cpus},
+                         {"host_gpu_numa_node", env.gpu_numa_node},
+                         {"numa_placement_node", numa_node},
+                         {"numa_thread_node", topology::current_node()}});
+}
+
 #define BENCHMARK_BLOCK_1(x) x
 
 #define BENCHMARK_BLOCK(block_err, ...)                                                                                \
   do {                                                                                                                 \
     const auto BENCHMARK_BLOCK_1(benchmark_block) = [&]() { __VA_ARGS__ };                                             \
+    const annotate::range benchmark_range(__PRETTY_FUNCTION__);                                                        \
+    annotate::range warmup_range("warmup");                                                                            \
     for (int ii = 0; ii < num_warmup; ii++) {                                                                          \
       BENCHMARK_BLOCK_1(benchmark_block)();                                                                            \
     }                                                                                                                  \
+    warmup_range.end();                                                                                                \
     cudaEvent_t start, stop;                                                                                           \
     PRINT_IF_ERROR(cudaEventCreate(&start));                                                                           \
     PRINT_IF_ERROR(cudaEventCreate(&stop));                                                                            \
-    int num_iterations = 0;                                                                                            \
+    const auto block_stream    = handle_pool::stream(state);                                                           \
+    int num_iterations         = 0;                                                                                    \
+    std::string profile_err{""};                                                                                       \
+    CUPTI_PROFILE_SESSION;                                                                                             \
+    const auto sample_block_id = sample_sink::instance().begin_block(__PRETTY_FUNCTION__,                              \
+                                                                     fnv1a_64(__PRETTY_FUNCTION__));                   \
+    annotate::range timed_range("timed_iterations");                                                                   \
+    if (state.thread_index == 0) {                                                                                     \
+      power_sampler::begin_window();                                                                                   \
+    }                                                                                                                  \
     for (auto _ : state) {                                                                                             \
-      CUPTI_PROFILE_START;                                                                                             \
-      cudaEventRecord(start, NULL);                                                                                    \
+      const annotate::range iteration_range("iteration");                                                              \
+      CUPTI_PROFILE_START(num_iterations);                                                                             \
+      if (state.thread_index == 0) {                                                                                   \
+        power_sampler::begin_timed();                                                                                  \
+      }                                                                                                                \
+      cudaEventRecord(start, block_stream);                                                                            \
       BENCHMARK_BLOCK_1(benchmark_block)();                                                                            \
-      cudaEventRecord(stop, NULL);                                                                                     \
+      cudaEventRecord(stop, block_stream);                                                                             \
       const auto cuda_err = cudaEventSynchronize(stop);                                                                \
+      if (state.thread_index == 0) {                                                                                   \
+        power_sampler::end_timed();                                                                                    \
+      }                                                                                                                \
       CUPTI_PROFILE_STOP(num_iterations);                                                                              \
       state.PauseTiming();                                                                                             \
       if (PRINT_IF_ERROR(block_err)) {                                                                                 \
@@ -147,15 +344,27 @@ static double StatisticsStdDev(const std::vector<double>& v) {
                                 .c_str());                                                                             \
         break;                                                                                                         \
       }                                                                                                                \
+      if (!profile_err.empty()) {                                                                                      \
+        state.SkipWithError(fmt::format("{} failed to collect metrics because of {}", IMPLEMENTATION_NAME,             \
+                                        profile_err.substr(0, profile_err.find_last_not_of('\n') + 1))                 \
+                                .c_str());                                                                             \
+        break;                                                                                                         \
+      }                                                                                                                \
       float msecTotal = 0.0f;                                                                                          \
       if (PRINT_IF_ERROR(cudaEventElapsedTime(&msecTotal, start, stop))) {                                             \
         state.SkipWithError(fmt::format("{} failed to get elapsed time", IMPLEMENTATION_NAME).c_str());                \
         break;                                                                                                         \
       }                                                                                                                \
       state.SetIterationTime(msecTotal / 1000);                                                                        \
+      sample_sink::instance().record(sample_block_id, num_iterations, msecTotal);                                      \
       num_iterations++;                                                                                                \
       state.ResumeTiming();                                                                                            \
     }                                                                                                                  \
+    if (state.thread_index == 0) {                                                                                     \
+      AddPowerCounters(state, power_sampler::end_window(), num_iterations);                                            \
+    }                                                                                                                  \
+    timed_range.end();                                                                                                 \
+    CUPTI_PROFILE_FINISH;                                                                                              \
     state.counters.insert(                                                                                             \
         {{std::string("benchmark_func:") + std::string(__PRETTY_FUNCTION__), fnv1a_64(__PRETTY_FUNCTION__)},           \
          {std::string("benchmark_file:") + std::string(__FILE__), fnv1a_64(__FILE__)},                                 \
@@ -168,5 +377,8 @@ static double StatisticsStdDev(const std::vector<double>& v) {
          {std::string("gpu_name:") + gpu_name, fnv1a_64(gpu_name)},                                                    \
          {std::string("host_name:") + host_name, fnv1a_64(host_name)},                                                 \
          {"num_iterations", state.iterations()},                                                                       \
+         {"num_threads", state.threads},                                                                               \
+         {"sample_block_id", sample_block_id},                                                                         \
          CUPTI_STATE_COUNTER_INFO});                                                                                   \
+    AddHostEnvCounters(state);                                                                                         \
   } while (0)
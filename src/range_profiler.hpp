@@ -0,0 +1,417 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef ENABLE_CUDNN_CUPTI_RANGE_PROFILER
+#include <cupti_profiler_target.h>
+#include <cupti_target.h>
+#include <nvperf_cuda_host.h>
+#include <nvperf_host.h>
+#include <nvperf_target.h>
+
+#include "cupti_profiler.hpp"
+#endif // ENABLE_CUDNN_CUPTI_RANGE_PROFILER
+
+// Range based profiling through the CUPTI profiler (Perfworks) API.
+//
+// The legacy event/metric API used by cupti_profiler is not available from
+// compute capability 7.5 on. There the metrics are collected over a user
+// range around the benchmark block instead: the metric configuration and the
+// counter data prefix are built once per process, and every profiled
+// iteration replays the block once per pass and evaluates the range.
+// The legacy metric names accepted by --metrics are translated to their
+// Perfworks equivalent; other names are passed through unchanged.
+namespace range_profiler {
+
+static const std::unordered_map<std::string, std::string> &metric_aliases() {
+  static const std::unordered_map<std::string, std::string> aliases{
+      {"achieved_occupancy", "sm__warps_active.avg.pct_of_peak_sustained_active"},
+      {"dram_read_bytes", "dram__bytes_read.sum"},
+      {"dram_write_bytes", "dram__bytes_write.sum"},
+      {"dram_utilization", "dram__throughput.avg.pct_of_peak_sustained_elapsed"},
+      {"flop_count_dp_add", "smsp__sass_thread_inst_executed_op_dadd_pred_on.sum"},
+      {"flop_count_dp_fma", "smsp__sass_thread_inst_executed_op_dfma_pred_on.sum"},
+      {"flop_count_dp_mul", "smsp__sass_thread_inst_executed_op_dmul_pred_on.sum"},
+      {"flop_count_hp_add", "smsp__sass_thread_inst_executed_op_hadd_pred_on.sum"},
+      {"flop_count_hp_fma", "smsp__sass_thread_inst_executed_op_hfma_pred_on.sum"},
+      {"flop_count_hp_mul", "smsp__sass_thread_inst_executed_op_hmul_pred_on.sum"},
+      {"flop_count_sp_add", "smsp__sass_thread_inst_executed_op_fadd_pred_on.sum"},
+      {"flop_count_sp_fma", "smsp__sass_thread_inst_executed_op_ffma_pred_on.sum"},
+      {"flop_count_sp_mul", "smsp__sass_thread_inst_executed_op_fmul_pred_on.sum"},
+      {"gld_transactions", "l1tex__t_sectors_pipe_lsu_mem_global_op_ld.sum"},
+      {"gst_transactions", "l1tex__t_sectors_pipe_lsu_mem_global_op_st.sum"},
+      {"half_precision_fu_utilization", "sm__inst_executed_pipe_fp16.avg.pct_of_peak_sustained_active"},
+      {"inst_executed", "smsp__inst_executed.sum"},
+      {"ipc", "smsp__inst_executed.avg.per_cycle_active"},
+      {"l2_read_transactions", "lts__t_sectors_op_read.sum"},
+      {"l2_write_transactions", "lts__t_sectors_op_write.sum"},
+      {"shared_load_transactions", "l1tex__data_pipe_lsu_wavefronts_mem_shared_op_ld.sum"},
+      {"shared_store_transactions", "l1tex__data_pipe_lsu_wavefronts_mem_shared_op_st.sum"},
+      {"sm_efficiency", "smsp__cycles_active.avg.pct_of_peak_sustained_elapsed"},
+      {"tensor_precision_fu_utilization", "sm__pipe_tensor_cycles_active.avg.pct_of_peak_sustained_active"},
+  };
+  return aliases;
+}
+
+static std::string to_perfworks_metric(const std::string &name) {
+  const auto it = metric_aliases().find(name);
+  return it == metric_aliases().end() ? name : it->second;
+}
+
+// The event/metric API is not supported from Turing on.
+static bool is_required(int major, int minor) {
+  return major > 7 || (major == 7 && minor >= 5);
+}
+
+// True while profile() replays a block on this thread. Blocks that time their
+// own phases (train_step::phase_timer) skip the replays, which run after the
+// timed run of the iteration.
+inline bool &is_replaying() {
+  thread_local bool res = false;
+  return res;
+}
+
+struct replay_guard {
+  replay_guard() {
+    is_replaying() = true;
+  }
+  ~replay_guard() {
+    is_replaying() = false;
+  }
+  replay_guard(const replay_guard &) = delete;
+  replay_guard &operator=(const replay_guard &) = delete;
+};
+
+#ifdef ENABLE_CUDNN_CUPTI_RANGE_PROFILER
+
+#define NVPW_API_CALL(apiFuncCall)                                                                                     \
+  do {                                                                                                                 \
+    NVPA_Status _status = apiFuncCall;                                                                                 \
+    if (_status != NVPA_STATUS_SUCCESS) {                                                                              \
+      const auto err = fmt::format("{}:{}: error: nvperf function {} failed with error {}.\n", __FILE__, __LINE__,     \
+                                   #apiFuncCall, _status);                                                             \
+      LOG(critical, err);                                                                                              \
+      throw std::runtime_error(err);                                                                                   \
+    }                                                                                                                  \
+  } while (0)
+
+class profiler {
+public:
+  // one user range per profiled iteration
+  static const int num_ranges = 1;
+  // a cudnn call can launch several kernels inside the range
+  static const int max_launches_per_pass = 256;
+
+  profiler(const std::vector<std::string> &metrics, int device_num) : m_metric_names(metrics) {
+    for (const auto &metric : metrics) {
+      m_perfworks_names.emplace_back(to_perfworks_metric(metric));
+    }
+
+    CUpti_Profiler_Initialize_Params initialize_params = {CUpti_Profiler_Initialize_Params_STRUCT_SIZE};
+    CUPTI_CALL(cuptiProfilerInitialize(&initialize_params));
+    CUpti_Device_GetChipName_Params chip_name_params = {CUpti_Device_GetChipName_Params_STRUCT_SIZE};
+    chip_name_params.deviceIndex                     = device_num;
+    CUPTI_CALL(cuptiDeviceGetChipName(&chip_name_params));
+    m_chip_name = chip_name_params.pChipName;
+
+    NVPW_InitializeHost_Params initialize_host_params = {NVPW_InitializeHost_Params_STRUCT_SIZE};
+    NVPW_API_CALL(NVPW_InitializeHost(&initialize_host_params));
+
+    NVPW_CUDA_MetricsContext_Create_Params metrics_context_params = {
+        NVPW_CUDA_MetricsContext_Create_Params_STRUCT_SIZE};
+    metrics_context_params.pChipName = m_chip_name.c_str();
+    NVPW_API_CALL(NVPW_CUDA_MetricsContext_Create(&metrics_context_params));
+    m_metrics_context = metrics_context_params.pMetricsContext;
+
+    auto requests = raw_metric_requests();
+    build_config_image(requests);
+    build_counter_data_prefix(requests);
+  }
+
+  ~profiler() {
+    if (m_metrics_context != nullptr) {
+      NVPW_MetricsContext_Destroy_Params destroy_params = {NVPW_MetricsContext_Destroy_Params_STRUCT_SIZE};
+      destroy_params.pMetricsContext                    = m_metrics_context;
+      NVPW_MetricsContext_Destroy(&destroy_params);
+    }
+  }
+
+  profiler(const profiler &) = delete;
+  profiler &operator=(const profiler &) = delete;
+
+  // Runs block inside a user range once per profiler pass and returns the
+  // metric values keyed by the requested (not the translated) names.
+  std::map<std::string, double> profile(const std::string &range_name, const std::function<void()> &block) {
+    initialize_counter_data();
+
+    CUpti_Profiler_BeginSession_Params begin_session_params = {CUpti_Profiler_BeginSession_Params_STRUCT_SIZE};
+    begin_session_params.ctx                                = nullptr;
+    begin_session_params.counterDataImageSize               = m_counter_data_image.size();
+    begin_session_params.pCounterDataImage                  = m_counter_data_image.data();
+    begin_session_params.counterDataScratchBufferSize       = m_counter_data_scratch.size();
+    begin_session_params.pCounterDataScratchBuffer          = m_counter_data_scratch.data();
+    begin_session_params.range                              = CUPTI_UserRange;
+    begin_session_params.replayMode                         = CUPTI_UserReplay;
+    begin_session_params.maxRangesPerPass                   = num_ranges;
+    begin_session_params.maxLaunchesPerPass                 = max_launches_per_pass;
+    CUPTI_CALL(cuptiProfilerBeginSession(&begin_session_params));
+
+    CUpti_Profiler_SetConfig_Params set_config_params = {CUpti_Profiler_SetConfig_Params_STRUCT_SIZE};
+    set_config_params.pConfig                         = m_config_image.data();
+    set_config_params.configSize                      = m_config_image.size();
+    set_config_params.passIndex                       = 0;
+    try {
+      CUPTI_CALL(cuptiProfilerSetConfig(&set_config_params));
+      replay(range_name, block);
+    } catch (...) {
+      end_session();
+      throw;
+    }
+
+    CUpti_Profiler_FlushCounterData_Params flush_params = {CUpti_Profiler_FlushCounterData_Params_STRUCT_SIZE};
+    CUPTI_CALL(cuptiProfilerFlushCounterData(&flush_params));
+    CUpti_Profiler_UnsetConfig_Params unset_config_params = {CUpti_Profiler_UnsetConfig_Params_STRUCT_SIZE};
+    CUPTI_CALL(cuptiProfilerUnsetConfig(&unset_config_params));
+    CUpti_Profiler_EndSession_Params end_session_params = {CUpti_Profiler_EndSession_Params_STRUCT_SIZE};
+    CUPTI_CALL(cuptiProfilerEndSession(&end_session_params));
+
+    return evaluate();
+  }
+
+private:
+  void replay(const std::string &range_name, const std::function<void()> &block) {
+    CUpti_Profiler_EndPass_Params end_pass_params = {CUpti_Profiler_EndPass_Params_STRUCT_SIZE};
+    do {
+      CUpti_Profiler_BeginPass_Params begin_pass_params = {CUpti_Profiler_BeginPass_Params_STRUCT_SIZE};
+      CUPTI_CALL(cuptiProfilerBeginPass(&begin_pass_params));
+      CUpti_Profiler_EnableProfiling_Params enable_params = {CUpti_Profiler_EnableProfiling_Params_STRUCT_SIZE};
+      CUPTI_CALL(cuptiProfilerEnableProfiling(&enable_params));
+      CUpti_Profiler_PushRange_Params push_range_params = {CUpti_Profiler_PushRange_Params_STRUCT_SIZE};
+      push_range_params.pRangeName                      = range_name.c_str();
+      CUPTI_CALL(cuptiProfilerPushRange(&push_range_params));
+
+      {
+        const replay_guard replaying;
+        block();
+      }
+
+      CUpti_Profiler_PopRange_Params pop_range_params = {CUpti_Profiler_PopRange_Params_STRUCT_SIZE};
+      CUPTI_CALL(cuptiProfilerPopRange(&pop_range_params));
+      CUpti_Profiler_DisableProfiling_Params disable_params = {CUpti_Profiler_DisableProfiling_Params_STRUCT_SIZE};
+      CUPTI_CALL(cuptiProfilerDisableProfiling(&disable_params));
+      CUPTI_CALL(cuptiProfilerEndPass(&end_pass_params));
+    } while (!end_pass_params.allPassesSubmitted);
+  }
+
+  // Leaves the session of a failed profile() so the next benchmark can begin
+  // its own; the calls fail for the steps that were not reached.
+  void end_session() {
+    CUpti_Profiler_DisableProfiling_Params disable_params = {CUpti_Profiler_DisableProfiling_Params_STRUCT_SIZE};
+    cuptiProfilerDisableProfiling(&disable_params);
+    CUpti_Profiler_EndPass_Params end_pass_params = {CUpti_Profiler_EndPass_Params_STRUCT_SIZE};
+    cuptiProfilerEndPass(&end_pass_params);
+    CUpti_Profiler_UnsetConfig_Params unset_config_params = {CUpti_Profiler_UnsetConfig_Params_STRUCT_SIZE};
+    cuptiProfilerUnsetConfig(&unset_config_params);
+    CUpti_Profiler_EndSession_Params end_session_params = {CUpti_Profiler_EndSession_Params_STRUCT_SIZE};
+    cuptiProfilerEndSession(&end_session_params);
+  }
+
+  std::vector<NVPA_RawMetricRequest> raw_metric_requests() {
+    std::vector<NVPA_RawMetricRequest> requests;
+    for (const auto &name : m_perfworks_names) {
+      NVPW_MetricsContext_GetMetricProperties_Begin_Params begin_params = {
+          NVPW_MetricsContext_GetMetricProperties_Begin_Params_STRUCT_SIZE};
+      begin_params.pMetricsContext = m_metrics_context;
+      begin_params.pMetricName     = name.c_str();
+      if (NVPW_MetricsContext_GetMetricProperties_Begin(&begin_params) != NVPA_STATUS_SUCCESS) {
+        throw std::runtime_error(fmt::format("unknown metric {} on {}", name, m_chip_name));
+      }
+      for (auto dep = begin_params.ppRawMetricDependencies; *dep != nullptr; ++dep) {
+        m_raw_metric_names.emplace_back(*dep);
+      }
+      NVPW_MetricsContext_GetMetricProperties_End_Params end_params = {
+          NVPW_MetricsContext_GetMetricProperties_End_Params_STRUCT_SIZE};
+      end_params.pMetricsContext = m_metrics_context;
+      NVPW_API_CALL(NVPW_MetricsContext_GetMetricProperties_End(&end_params));
+    }
+    for (const auto &raw_name : m_raw_metric_names) {
+      NVPA_RawMetricRequest request = {NVPA_RAW_METRIC_REQUEST_STRUCT_SIZE};
+      request.pMetricName           = raw_name.c_str();
+      request.isolated              = true;
+      request.keepInstances         = false;
+      requests.emplace_back(request);
+    }
+    return requests;
+  }
+
+  void build_config_image(std::vector<NVPA_RawMetricRequest> &requests) {
+    NVPA_RawMetricsConfigOptions options = {NVPA_RAW_METRICS_CONFIG_OPTIONS_STRUCT_SIZE};
+    options.activityKind                 = NVPA_ACTIVITY_KIND_PROFILER;
+    options.pChipName                    = m_chip_name.c_str();
+    NVPA_RawMetricsConfig *config        = nullptr;
+    NVPW_API_CALL(NVPW_CUDA_RawMetricsConfig_Create(&options, &config));
+    const auto destroy_config = [&]() {
+      NVPW_RawMetricsConfig_Destroy_Params destroy_params = {NVPW_RawMetricsConfig_Destroy_Params_STRUCT_SIZE};
+      destroy_params.pRawMetricsConfig                    = config;
+      NVPW_RawMetricsConfig_Destroy(&destroy_params);
+    };
+    defer(destroy_config());
+
+    NVPW_RawMetricsConfig_BeginPassGroup_Params begin_group_params = {
+        NVPW_RawMetricsConfig_BeginPassGroup_Params_STRUCT_SIZE};
+    begin_group_params.pRawMetricsConfig = config;
+    NVPW_API_CALL(NVPW_RawMetricsConfig_BeginPassGroup(&begin_group_params));
+    NVPW_RawMetricsConfig_AddMetrics_Params add_params = {NVPW_RawMetricsConfig_AddMetrics_Params_STRUCT_SIZE};
+    add_params.pRawMetricsConfig                       = config;
+    add_params.pRawMetricRequests                      = requests.data();
+    add_params.numMetricRequests                       = requests.size();
+    NVPW_API_CALL(NVPW_RawMetricsConfig_AddMetrics(&add_params));
+    NVPW_RawMetricsConfig_EndPassGroup_Params end_group_params = {
+        NVPW_RawMetricsConfig_EndPassGroup_Params_STRUCT_SIZE};
+    end_group_params.pRawMetricsConfig = config;
+    NVPW_API_CALL(NVPW_RawMetricsConfig_EndPassGroup(&end_group_params));
+    NVPW_RawMetricsConfig_GenerateConfigImage_Params generate_params = {
+        NVPW_RawMetricsConfig_GenerateConfigImage_Params_STRUCT_SIZE};
+    generate_params.pRawMetricsConfig = config;
+    NVPW_API_CALL(NVPW_RawMetricsConfig_GenerateConfigImage(&generate_params));
+
+    NVPW_RawMetricsConfig_GetConfigImage_Params image_params = {
+        NVPW_RawMetricsConfig_GetConfigImage_Params_STRUCT_SIZE};
+    image_params.pRawMetricsConfig = config;
+    image_params.bytesAllocated    = 0;
+    image_params.pBuffer           = nullptr;
+    NVPW_API_CALL(NVPW_RawMetricsConfig_GetConfigImage(&image_params));
+    m_config_image.resize(image_params.bytesCopied);
+    image_params.bytesAllocated = m_config_image.size();
+    image_params.pBuffer        = m_config_image.data();
+    NVPW_API_CALL(NVPW_RawMetricsConfig_GetConfigImage(&image_params));
+  }
+
+  void build_counter_data_prefix(std::vector<NVPA_RawMetricRequest> &requests) {
+    NVPW_CounterDataBuilder_Create_Params create_params = {NVPW_CounterDataBuilder_Create_Params_STRUCT_SIZE};
+    create_params.pChipName                             = m_chip_name.c_str();
+    NVPW_API_CALL(NVPW_CounterDataBuilder_Create(&create_params));
+    const auto destroy_builder = [&]() {
+      NVPW_CounterDataBuilder_Destroy_Params destroy_params = {NVPW_CounterDataBuilder_Destroy_Params_STRUCT_SIZE};
+      destroy_params.pCounterDataBuilder                    = create_params.pCounterDataBuilder;
+      NVPW_CounterDataBuilder_Destroy(&destroy_params);
+    };
+    defer(destroy_builder());
+
+    NVPW_CounterDataBuilder_AddMetrics_Params add_params = {NVPW_CounterDataBuilder_AddMetrics_Params_STRUCT_SIZE};
+    add_params.pCounterDataBuilder                       = create_params.pCounterDataBuilder;
+    add_params.pRawMetricRequests                        = requests.data();
+    add_params.numMetricRequests                         = requests.size();
+    NVPW_API_CALL(NVPW_CounterDataBuilder_AddMetrics(&add_params));
+
+    NVPW_CounterDataBuilder_GetCounterDataPrefix_Params prefix_params = {
+        NVPW_CounterDataBuilder_GetCounterDataPrefix_Params_STRUCT_SIZE};
+    prefix_params.pCounterDataBuilder = create_params.pCounterDataBuilder;
+    prefix_params.bytesAllocated      = 0;
+    prefix_params.pBuffer             = nullptr;
+    NVPW_API_CALL(NVPW_CounterDataBuilder_GetCounterDataPrefix(&prefix_params));
+    m_counter_data_prefix.resize(prefix_params.bytesCopied);
+    prefix_params.bytesAllocated = m_counter_data_prefix.size();
+    prefix_params.pBuffer        = m_counter_data_prefix.data();
+    NVPW_API_CALL(NVPW_CounterDataBuilder_GetCounterDataPrefix(&prefix_params));
+  }
+
+  // The counter data image holds the ranges of a single session, so it is reset before every profile().
+  void initialize_counter_data() {
+    CUpti_Profiler_CounterDataImageOptions options;
+    options.pCounterDataPrefix    = m_counter_data_prefix.data();
+    options.counterDataPrefixSize = m_counter_data_prefix.size();
+    options.maxNumRanges          = num_ranges;
+    options.maxNumRangeTreeNodes  = num_ranges;
+    options.maxRangeNameLength    = 64;
+
+    CUpti_Profiler_CounterDataImage_CalculateSize_Params size_params = {
+        CUpti_Profiler_CounterDataImage_CalculateSize_Params_STRUCT_SIZE};
+    size_params.pOptions                      = &options;
+    size_params.sizeofCounterDataImageOptions = CUpti_Profiler_CounterDataImageOptions_STRUCT_SIZE;
+    CUPTI_CALL(cuptiProfilerCounterDataImageCalculateSize(&size_params));
+
+    CUpti_Profiler_CounterDataImage_Initialize_Params initialize_params = {
+        CUpti_Profiler_CounterDataImage_Initialize_Params_STRUCT_SIZE};
+    m_counter_data_image.resize(size_params.counterDataImageSize);
+    initialize_params.sizeofCounterDataImageOptions = CUpti_Profiler_CounterDataImageOptions_STRUCT_SIZE;
+    initialize_params.pOptions                      = &options;
+    initialize_params.counterDataImageSize          = m_counter_data_image.size();
+    initialize_params.pCounterDataImage             = m_counter_data_image.data();
+    CUPTI_CALL(cuptiProfilerCounterDataImageInitialize(&initialize_params));
+
+    CUpti_Profiler_CounterDataImage_CalculateScratchBufferSize_Params scratch_size_params = {
+        CUpti_Profiler_CounterDataImage_CalculateScratchBufferSize_Params_STRUCT_SIZE};
+    scratch_size_params.counterDataImageSize = m_counter_data_image.size();
+    scratch_size_params.pCounterDataImage    = m_counter_data_image.data();
+    CUPTI_CALL(cuptiProfilerCounterDataImageCalculateScratchBufferSize(&scratch_size_params));
+
+    CUpti_Profiler_CounterDataImage_InitializeScratchBuffer_Params scratch_params = {
+        CUpti_Profiler_CounterDataImage_InitializeScratchBuffer_Params_STRUCT_SIZE};
+    m_counter_data_scratch.resize(scratch_size_params.counterDataScratchBufferSize);
+    scratch_params.counterDataImageSize         = m_counter_data_image.size();
+    scratch_params.pCounterDataImage            = m_counter_data_image.data();
+    scratch_params.counterDataScratchBufferSize = m_counter_data_scratch.size();
+    scratch_params.pCounterDataScratchBuffer    = m_counter_data_scratch.data();
+    CUPTI_CALL(cuptiProfilerCounterDataImageInitializeScratchBuffer(&scratch_params));
+  }
+
+  std::map<std::string, double> evaluate() {
+    std::vector<const char *> names;
+    for (const auto &name : m_perfworks_names) {
+      names.emplace_back(name.c_str());
+    }
+    std::vector<double> values(names.size());
+
+    NVPW_MetricsContext_SetCounterData_Params counter_data_params = {
+        NVPW_MetricsContext_SetCounterData_Params_STRUCT_SIZE};
+    counter_data_params.pMetricsContext   = m_metrics_context;
+    counter_data_params.pCounterDataImage = m_counter_data_image.data();
+    counter_data_params.isolated          = true;
+    counter_data_params.rangeIndex        = 0;
+    NVPW_API_CALL(NVPW_MetricsContext_SetCounterData(&counter_data_params));
+
+    NVPW_MetricsContext_EvaluateToGpuValues_Params evaluate_params = {
+        NVPW_MetricsContext_EvaluateToGpuValues_Params_STRUCT_SIZE};
+    evaluate_params.pMetricsContext = m_metrics_context;
+    evaluate_params.numMetrics      = names.size();
+    evaluate_params.ppMetricNames   = names.data();
+    evaluate_params.pMetricValues   = values.data();
+    NVPW_API_CALL(NVPW_MetricsContext_EvaluateToGpuValues(&evaluate_params));
+
+    std::map<std::string, double> res;
+    for (size_t ii = 0; ii < m_metric_names.size(); ii++) {
+      res[m_metric_names[ii]] = values[ii];
+    }
+    return res;
+  }
+
+  std::vector<std::string> m_metric_names{};
+  std::vector<std::string> m_perfworks_names{};
+  std::vector<std::string> m_raw_metric_names{};
+  std::string m_chip_name{""};
+  NVPA_MetricsContext *m_metrics_context{nullptr};
+  std::vector<uint8_t> m_config_image{};
+  std::vector<uint8_t> m_counter_data_prefix{};
+  std::vector<uint8_t> m_counter_data_image{};
+  std::vector<uint8_t> m_counter_data_scratch{};
+};
+
+// The process wide session, created on first use with the --metrics flag.
+// Without metrics there is nothing to collect and no session: nullptr.
+inline profiler *session() {
+  if (::metrics.empty()) {
+    return nullptr;
+  }
+  static profiler instance(::metrics, cuda_device_id);
+  return &instance;
+}
+
+#endif // ENABLE_CUDNN_CUPTI_RANGE_PROFILER
+
+} // namespace range_profiler
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+#include "hash.hpp"
+
+// Reader for the google benchmark json files written by
+// `scope --benchmark_out_format=json`. Each iteration run is turned into an
+// entry_t; aggregate rows (the CUSTOM_STATS *_t statistics) are dropped since
+// they can be recomputed from the runs.
+namespace results {
+
+using json = nlohmann::json;
+
+struct entry_t {
+  // full benchmark name, e.g. LAYER_CUDNN_CONV_FWD_1_FLOAT32__BatchSize_1__48..71<ALGO>/input[0]:1/.../manual_time
+  std::string name{""};
+  // benchmark function without the batch size and signature suffix, e.g. LAYER_CUDNN_CONV_FWD_1_FLOAT32
+  std::string family{""};
+  // identifies the layer independent of the algorithm, e.g. LAYER_CUDNN_CONV_FWD_1_FLOAT32__BatchSize_1__48..71
+  std::string layer{""};
+  // template argument of the benchmark (the cudnn algorithm), empty if there is none
+  std::string algorithm{""};
+  uint64_t signature{0};
+  int64_t batch_size{-1};
+  // manual time per iteration in seconds
+  double time_s{0};
+  double iterations{0};
+  bool error_occurred{false};
+  std::string error_message{""};
+  // every numeric field of the row, including the user counters
+  std::map<std::string, double> counters{};
+
+  double counter(const std::string &key, double default_value = -1) const {
+    const auto it = counters.find(key);
+    return it == counters.end() ? default_value : it->second;
+  }
+
+  // Labels are stored as counters named "<key>:<value>" (see BENCHMARK_BLOCK).
+  std::string label(const std::string &key) const {
+    const auto prefix = key + ":";
+    const auto it     = counters.lower_bound(prefix);
+    if (it == counters.end() || it->first.compare(0, prefix.size(), prefix) != 0) {
+      return "";
+    }
+    return it->first.substr(prefix.size());
+  }
+};
+
+struct file_t {
+  std::string path{""};
+  std::map<std::string, std::string> context{};
+  std::vector<entry_t> entries{};
+};
+
+static double time_unit_to_seconds(const std::string &unit) {
+  if (unit == "ns") {
+    return 1e-9;
+  }
+  if (unit == "us") {
+    return 1e-6;
+  }
+  if (unit == "ms") {
+    return 1e-3;
+  }
+  if (unit == "s") {
+    return 1;
+  }
+  throw std::runtime_error("unknown time unit " + unit);
+}
+
+// The name of the benchmark an aggregate row summarizes ("<name>_mean" ->
+// "<name>"), "" if the name is not that of an aggregate.
+static std::string aggregate_base_name(const std::string &name) {
+  static const std::vector<std::string> suffixes{"_max_t",  "_min_t",    "_total_t", "_mean_t",
+                                                 "_median_t", "_stddev_t", "_mean",    "_median", "_stddev"};
+  for (const auto &suffix : suffixes) {
+    if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      return name.substr(0, name.size() - suffix.size());
+    }
+  }
+  return "";
+}
+
+static bool is_aggregate_name(const std::string &name) {
+  return !aggregate_base_name(name).empty();
+}
+
+static void parse_name(entry_t &entry) {
+  // generated (dlperf) benchmarks
+  static const std::regex generated_re(R"(^(\w+?)__BatchSize_(\d+)__(\d+)(?:<([^>]*)>)?)");
+  std::smatch match;
+  if (std::regex_search(entry.name, match, generated_re)) {
+    entry.family     = match[1];
+    entry.batch_size = std::stoll(match[2]);
+    entry.signature  = std::stoull(match[3]);
+    entry.algorithm  = match[4];
+    entry.layer      = entry.family + "__BatchSize_" + match[2].str() + "__" + match[3].str();
+    return;
+  }
+
+  // hand written benchmarks are identified by their arguments
+  const auto family_end = entry.name.find_first_of("</");
+  entry.family          = entry.name.substr(0, family_end);
+  auto args             = family_end == std::string::npos ? std::string("") : entry.name.substr(family_end);
+  if (!args.empty() && args[0] == '<') {
+    const auto algorithm_end = args.find('>');
+    entry.algorithm          = args.substr(1, algorithm_end - 1);
+    args                     = args.substr(algorithm_end + 1);
+  }
+  const std::string manual_time = "/manual_time";
+  if (args.size() >= manual_time.size() &&
+      args.compare(args.size() - manual_time.size(), manual_time.size(), manual_time) == 0) {
+    args = args.substr(0, args.size() - manual_time.size());
+  }
+  entry.layer      = entry.family + args;
+  entry.signature  = fnv1a_64(entry.layer);
+  entry.batch_size = static_cast<int64_t>(entry.counter("batch_size", entry.counter("input_batch_size", -1)));
+}
+
+inline file_t load(const std::string &path) {
+  std::ifstream stream(path);
+  if (!stream.is_open()) {
+    throw std::runtime_error("unable to open " + path);
+  }
+  json doc;
+  stream >> doc;
+
+  file_t file;
+  file.path = path;
+  if (doc.count("context")) {
+    for (const auto &item : doc["context"].items()) {
+      file.context[item.key()] = item.value().is_string() ? item.value().get<std::string>() : item.value().dump();
+    }
+  }
+  if (!doc.count("benchmarks")) {
+    return file;
+  }
+
+  for (const auto &row : doc["benchmarks"]) {
+    if (row.value("run_type", "iteration") == "aggregate" || row.count("aggregate_name")) {
+      continue;
+    }
+    entry_t entry;
+    entry.name = row.value("name", "");
+    if (is_aggregate_name(entry.name)) {
+      continue;
+    }
+    entry.error_occurred = row.value("error_occurred", false);
+    entry.error_message  = row.value("error_message", "");
+    for (const auto &item : row.items()) {
+      if (item.value().is_number()) {
+        entry.counters[item.key()] = item.value().get<double>();
+      }
+    }
+    entry.iterations = entry.counter("iterations", 0);
+    entry.time_s     = entry.counter("real_time", 0) * time_unit_to_seconds(row.value("time_unit", "ns"));
+    parse_name(entry);
+    file.entries.emplace_back(std::move(entry));
+  }
+  return file;
+}
+
+// Repetitions of the same benchmark are averaged into a single entry.
+static std::vector<entry_t> merge_repetitions(const std::vector<entry_t> &entries) {
+  std::map<std::string, std::pair<entry_t, int>> merged;
+  std::vector<std::string> order;
+  for (const auto &entry : entries) {
+    auto it = merged.find(entry.name);
+    if (it == merged.end()) {
+      merged.emplace(entry.name, std::make_pair(entry, 1));
+      order.emplace_back(entry.name);
+      continue;
+    }
+    auto &acc = it->second;
+    acc.first.error_occurred = acc.first.error_occurred || entry.error_occurred;
+    acc.first.time_s += entry.time_s;
+    acc.first.iterations += entry.iterations;
+    acc.second++;
+  }
+  std::vector<entry_t> res;
+  res.reserve(order.size());
+  for (const auto &name : order) {
+    auto &acc = merged[name];
+    acc.first.time_s /= acc.second;
+    res.emplace_back(std::move(acc.first));
+  }
+  return res;
+}
+
+} // namespace results
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "results.hpp"
+
+// Model level rollup of layer results.
+//
+// The dlperf manifests describe a network layer by layer. For every model and
+// batch size this picks the fastest valid algorithm of each layer (optionally
+// bounded by a workspace budget). Only the template arguments that name a
+// cudnn algorithm are chosen; the others (activation, pooling and softmax
+// modes, ...) select the computation and stay part of the layer. The
+// benchmarks hold every distinct layer once, so the layer times are weighted
+// by how often the layer occurs in the model (the layer counts) and summed
+// into the end-to-end forward latency and throughput. Layers are reported by
+// their share of the total so the critical ones are listed first. A model
+// without layer counts, with a layer that has no count or with a layer that
+// has no valid algorithm is incomplete: it reports the time of the layers it
+// has but no end-to-end latency or throughput.
+namespace rollup {
+
+struct options_t {
+  // layers whose chosen algorithm needs more workspace are not eligible; < 0 disables the budget
+  double workspace_budget_bytes{-1};
+  // the GPU forward families that make up the forward pass, matched as family prefixes; CPU references,
+  // training and backward passes and the fused CONV_BIAS_ACTIVATION variants are left out. DECONV_FWD runs
+  // on the backward data kernels but is the forward layer of the transposed convolutions of decoders
+  std::vector<std::string> include{"LAYER_CUBLAS_GEMM_FWD",
+                                   "LAYER_CUBLAS_GEMV_FWD",
+                                   "LAYER_CUDNN_ACTIVATION_FWD",
+                                   "LAYER_CUDNN_ADD_TENSOR",
+                                   "LAYER_CUDNN_BATCHNORM_FWD_INFERENCE",
+                                   "LAYER_CUDNN_CONV_FWD",
+                                   "LAYER_CUDNN_CONV_ND_FWD",
+                                   "LAYER_CUDNN_DECONV_FWD",
+                                   "LAYER_CUDNN_GROUPNORM_FWD",
+                                   "LAYER_CUDNN_INSTANCENORM_FWD",
+                                   "LAYER_CUDNN_LAYERNORM_FWD",
+                                   "LAYER_CUDNN_OP_TENSOR",
+                                   "LAYER_CUDNN_POOLING_FWD",
+                                   "LAYER_CUDNN_SOFTMAX_FWD"};
+  // number of critical layers to report, 0 reports all
+  size_t top{10};
+};
+
+// occurrences of the layers of a model, by layer name or signature
+using layer_counts_t = std::map<std::string, int64_t>;
+
+struct layer_choice_t {
+  std::string layer{""};
+  std::string family{""};
+  std::string algorithm{""};
+  double time_s{0};
+  double workspace_bytes{0};
+  // occurrences of the layer in the model, 1 if unknown
+  int64_t count{1};
+  double share{0};
+};
+
+struct model_rollup_t {
+  std::string model{""};
+  int64_t batch_size{-1};
+  // the sum of the layer times weighted by their counts, the end-to-end latency only if the model is complete
+  double latency_s{0};
+  double images_per_s{0};
+  bool complete{true};
+  bool has_layer_counts{false};
+  // layers that had results but no valid algorithm within the budget
+  std::vector<std::string> missing_layers{};
+  // layers that are not in the layer counts of the model, counted once
+  std::vector<std::string> uncounted_layers{};
+  std::vector<layer_choice_t> layers{};
+};
+
+static bool is_included(const std::string &family, const options_t &opts) {
+  for (const auto &prefix : opts.include) {
+    if (!prefix.empty() && family.compare(0, prefix.size(), prefix) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Splits the template arguments of a benchmark into the cudnn algorithm and
+// the arguments that select the computation, e.g. "CUDNN_CONVOLUTION_FWD_ALGO_GEMM, CUDNN_ACTIVATION_RELU".
+static std::pair<std::string, std::string> split_algorithm(const std::string &template_args) {
+  std::string algorithm, computation;
+  size_t begin = 0;
+  while (begin <= template_args.size()) {
+    auto end = template_args.find(',', begin);
+    if (end == std::string::npos) {
+      end = template_args.size();
+    }
+    const auto first = template_args.find_first_not_of(' ', begin);
+    const auto last  = template_args.find_last_not_of(' ', end - 1);
+    if (first < end && last != std::string::npos && last >= first) {
+      const auto arg = template_args.substr(first, last - first + 1);
+      auto &part     = arg.find("_ALGO_") != std::string::npos ? algorithm : computation;
+      part += (part.empty() ? "" : ", ") + arg;
+    }
+    begin = end + 1;
+  }
+  return {algorithm, computation};
+}
+
+// The layer an entry measures: the layer of the results plus the template
+// arguments that are not the algorithm.
+static std::string layer_of(const results::entry_t &entry) {
+  const auto computation = split_algorithm(entry.algorithm).second;
+  return computation.empty() ? entry.layer : entry.layer + "<" + computation + ">";
+}
+
+static const int64_t *count_of(const results::entry_t &entry, const layer_counts_t &counts) {
+  for (const auto &key : {layer_of(entry), entry.layer, std::to_string(entry.signature)}) {
+    const auto it = counts.find(key);
+    if (it != counts.end()) {
+      return &it->second;
+    }
+  }
+  return nullptr;
+}
+
+static std::vector<model_rollup_t> compute(const std::string &model, const std::vector<results::entry_t> &entries,
+                                           const options_t &opts, const layer_counts_t &counts = {}) {
+  // batch size -> layer -> fastest eligible choice
+  std::map<int64_t, std::map<std::string, layer_choice_t>> best;
+  // batch size -> layer -> its count in the model, -1 if it has none
+  std::map<int64_t, std::map<std::string, int64_t>> seen;
+
+  for (const auto &entry : results::merge_repetitions(entries)) {
+    if (!is_included(entry.family, opts)) {
+      continue;
+    }
+    const auto layer              = layer_of(entry);
+    const auto count              = count_of(entry, counts);
+    seen[entry.batch_size][layer] = count == nullptr ? -1 : *count;
+    if (entry.error_occurred || entry.time_s <= 0) {
+      continue;
+    }
+    const auto workspace_bytes = std::max(entry.counter("workspace_bytes", 0), 0.0);
+    if (opts.workspace_budget_bytes >= 0 && workspace_bytes > opts.workspace_budget_bytes) {
+      continue;
+    }
+    auto &layers = best[entry.batch_size];
+    auto it      = layers.find(layer);
+    if (it != layers.end() && it->second.time_s <= entry.time_s) {
+      continue;
+    }
+    layer_choice_t choice;
+    choice.layer           = layer;
+    choice.family          = entry.family;
+    choice.algorithm       = split_algorithm(entry.algorithm).first;
+    choice.time_s          = entry.time_s;
+    choice.workspace_bytes = workspace_bytes;
+    layers[layer]          = choice;
+  }
+
+  std::vector<model_rollup_t> res;
+  for (const auto &batch : seen) {
+    model_rollup_t rollup;
+    rollup.model            = model;
+    rollup.batch_size       = batch.first;
+    rollup.has_layer_counts = !counts.empty();
+
+    const auto &layers = best[batch.first];
+    for (const auto &layer : batch.second) {
+      if (layer.second < 0) {
+        rollup.uncounted_layers.emplace_back(layer.first);
+      }
+      const auto it = layers.find(layer.first);
+      if (it == layers.end()) {
+        rollup.missing_layers.emplace_back(layer.first);
+        continue;
+      }
+      auto choice  = it->second;
+      choice.count = std::max<int64_t>(layer.second, 1);
+      rollup.latency_s += choice.count * choice.time_s;
+      rollup.layers.emplace_back(choice);
+    }
+    rollup.complete = rollup.has_layer_counts && rollup.missing_layers.empty() && rollup.uncounted_layers.empty();
+    if (rollup.latency_s > 0) {
+      for (auto &layer : rollup.layers) {
+        layer.share = layer.count * layer.time_s / rollup.latency_s;
+      }
+    }
+    if (rollup.complete && rollup.latency_s > 0) {
+      const auto batch_size = std::max<int64_t>(rollup.batch_size, 1);
+      rollup.images_per_s   = batch_size / rollup.latency_s;
+    }
+    std::sort(rollup.layers.begin(), rollup.layers.end(),
+              [](const layer_choice_t &a, const layer_choice_t &b) { return a.share > b.share; });
+    res.emplace_back(std::move(rollup));
+  }
+  return res;
+}
+
+static results::json to_json(const model_rollup_t &rollup, const options_t &opts) {
+  results::json layers = results::json::array();
+  for (size_t ii = 0; ii < rollup.layers.size() && (opts.top == 0 || ii < opts.top); ii++) {
+    const auto &layer = rollup.layers[ii];
+    layers.push_back({{"layer", layer.layer},
+                      {"family", layer.family},
+                      {"algorithm", layer.algorithm},
+                      {"time_ms", layer.time_s * 1000},
+                      {"count", layer.count},
+                      {"workspace_bytes", layer.workspace_bytes},
+                      {"share", layer.share}});
+  }
+  // an incomplete model has no end-to-end numbers, only the time of the layers it has
+  const auto latency_ms     = rollup.complete ? results::json(rollup.latency_s * 1000) : results::json(nullptr);
+  const auto images_per_sec = rollup.complete ? results::json(rollup.images_per_s) : results::json(nullptr);
+  return {{"model", rollup.model},
+          {"batch_size", rollup.batch_size},
+          {"complete", rollup.complete},
+          {"has_layer_counts", rollup.has_layer_counts},
+          {"latency_ms", latency_ms},
+          {"measured_latency_ms", rollup.latency_s * 1000},
+          {"images_per_sec", images_per_sec},
+          {"num_layers", rollup.layers.size()},
+          {"missing_layers", rollup.missing_layers},
+          {"uncounted_layers", rollup.uncounted_layers},
+          {"workspace_budget_bytes", opts.workspace_budget_bytes},
+          {"critical_layers", layers}};
+}
+
+// A spec is either "model=path/to/results.json" or just the path, in which
+// case the path is used as the model name.
+static std::pair<std::string, std::string> parse_spec(const std::string &spec) {
+  const auto pos = spec.find('=');
+  if (pos == std::string::npos) {
+    return {spec, spec};
+  }
+  return {spec.substr(0, pos), spec.substr(pos + 1)};
+}
+
+// A layer counts file is a json object from layer name or signature to the
+// number of times the layer occurs in the model.
+static layer_counts_t load_layer_counts(const std::string &path) {
+  std::ifstream stream(path);
+  if (!stream.is_open()) {
+    throw std::runtime_error("unable to open " + path);
+  }
+  results::json doc;
+  stream >> doc;
+  if (!doc.is_object()) {
+    throw std::runtime_error(path + " is not an object of layer counts");
+  }
+  layer_counts_t res;
+  for (auto it = doc.begin(); it != doc.end(); ++it) {
+    if (!it.value().is_number_integer() || it.value().get<int64_t>() < 1) {
+      throw std::runtime_error(path + " has an invalid count for " + it.key());
+    }
+    res[it.key()] = it.value().get<int64_t>();
+  }
+  return res;
+}
+
+// count_specs are "model=counts.json" like the result specs.
+inline results::json run(const std::vector<std::string> &specs, const options_t &opts,
+                         const std::vector<std::string> &count_specs = {}) {
+  std::map<std::string, std::vector<results::entry_t>> models;
+  for (const auto &spec : specs) {
+    const auto model_path = parse_spec(spec);
+    auto file             = results::load(model_path.second);
+    auto &entries         = models[model_path.first];
+    entries.insert(entries.end(), file.entries.begin(), file.entries.end());
+  }
+  std::map<std::string, layer_counts_t> counts;
+  for (const auto &spec : count_specs) {
+    const auto model_path = parse_spec(spec);
+    for (const auto &count : load_layer_counts(model_path.second)) {
+      counts[model_path.first][count.first] += count.second;
+    }
+  }
+  results::json res = results::json::array();
+  for (const auto &model : models) {
+    const auto it           = counts.find(model.first);
+    const auto model_counts = it == counts.end() ? layer_counts_t{} : it->second;
+    for (const auto &rollup : compute(model.first, model.second, opts, model_counts)) {
+      res.push_back(to_json(rollup, opts));
+    }
+  }
+  return res;
+}
+
+} // namespace rollup
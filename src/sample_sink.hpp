@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Raw per-iteration sample export.
+//
+// CUSTOM_STATS only keeps aggregates of the SetIterationTime values. When
+// --sample_output is set, every timed iteration is also appended to a compact
+// binary file so that bimodal kernels or thermal throttling can be diagnosed
+// offline. The file layout (little endian, packed) is
+//
+//   file_header_t
+//   { block_record_t name[name_length] | sample_record_t }*
+//
+// A block record is written once per BENCHMARK_BLOCK and the matching
+// "sample_block_id" counter is added to the benchmark json output, so the raw
+// series can be joined back to the aggregated results.
+namespace sample_sink {
+
+static const char file_magic[8]          = {'C', 'D', 'N', 'N', 'S', 'M', 'P', '\0'};
+static const uint32_t file_format_version = 1;
+
+enum record_kind : uint32_t { record_kind_block = 1, record_kind_sample = 2 };
+
+#pragma pack(push, 1)
+struct file_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct block_record_t {
+  uint32_t kind;
+  uint32_t name_length;
+  uint64_t block_id;
+  uint64_t name_hash;
+};
+
+struct sample_record_t {
+  uint32_t kind;
+  uint32_t iteration;
+  uint64_t block_id;
+  // steady_clock time at the end of the iteration
+  uint64_t timestamp_ns;
+  float elapsed_ms;
+  // NaN when the reading is not available
+  float sm_clock_mhz;
+  float temperature_c;
+  float power_w;
+};
+#pragma pack(pop)
+
+struct environment_reading_t {
+  float sm_clock_mhz{std::numeric_limits<float>::quiet_NaN()};
+  float temperature_c{std::numeric_limits<float>::quiet_NaN()};
+  float power_w{std::numeric_limits<float>::quiet_NaN()};
+};
+
+using environment_reader_t = std::function<environment_reading_t()>;
+
+class writer {
+public:
+  writer() = default;
+  writer(const writer&) = delete;
+  writer& operator=(const writer&) = delete;
+
+  ~writer() {
+    close();
+  }
+
+  bool open(const std::string& path, size_t buffer_bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_file != nullptr) {
+      return false;
+    }
+    m_file = fopen(path.c_str(), "wb");
+    if (m_file == nullptr) {
+      return false;
+    }
+    m_capacity = std::max(buffer_bytes, sizeof(block_record_t) + sizeof(sample_record_t));
+    m_buffer.reserve(m_capacity);
+
+    file_header_t header;
+    memcpy(header.magic, file_magic, sizeof(header.magic));
+    header.version  = file_format_version;
+    header.reserved = 0;
+    append(&header, sizeof(header));
+    m_is_open = true;
+    return true;
+  }
+
+  // Lock free, so a disabled sink costs nothing per iteration; the writers
+  // check m_file again under the lock.
+  bool is_open() const {
+    return m_is_open.load(std::memory_order_relaxed);
+  }
+
+  void set_environment_reader(environment_reader_t reader) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_environment_reader = std::move(reader);
+  }
+
+  // Returns 0 when the sink is disabled; block ids start at 1.
+  uint64_t begin_block(const std::string& name, uint64_t name_hash) {
+    if (!is_open()) {
+      return 0;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_file == nullptr) {
+      return 0;
+    }
+    block_record_t record;
+    record.kind        = record_kind_block;
+    record.name_length = static_cast<uint32_t>(name.size());
+    record.block_id    = ++m_last_block_id;
+    record.name_hash   = name_hash;
+    append(&record, sizeof(record));
+    append(name.data(), name.size());
+    return record.block_id;
+  }
+
+  void record(uint64_t block_id, uint32_t iteration, float elapsed_ms) {
+    if (block_id == 0 || !is_open()) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_file == nullptr) {
+      return;
+    }
+    const auto reading = m_environment_reader ? m_environment_reader() : environment_reading_t{};
+
+    sample_record_t record;
+    record.kind          = record_kind_sample;
+    record.iteration     = iteration;
+    record.block_id      = block_id;
+    record.timestamp_ns  = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+    record.elapsed_ms    = elapsed_ms;
+    record.sm_clock_mhz  = reading.sm_clock_mhz;
+    record.temperature_c = reading.temperature_c;
+    record.power_w       = reading.power_w;
+    append(&record, sizeof(record));
+  }
+
+  void flush() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    flush_locked();
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_file == nullptr) {
+      return;
+    }
+    m_is_open = false;
+    flush_locked();
+    fclose(m_file);
+    m_file = nullptr;
+  }
+
+private:
+  // The buffer never grows past m_capacity; it is written out once full.
+  void append(const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+      if (m_buffer.size() == m_capacity) {
+        flush_locked();
+      }
+      const size_t n = std::min(size, m_capacity - m_buffer.size());
+      m_buffer.insert(m_buffer.end(), bytes, bytes + n);
+      bytes += n;
+      size -= n;
+    }
+  }
+
+  void flush_locked() {
+    if (m_file == nullptr || m_buffer.empty()) {
+      return;
+    }
+    fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+    fflush(m_file);
+    m_buffer.clear();
+  }
+
+  std::mutex m_mutex;
+  std::atomic<bool> m_is_open{false};
+  FILE* m_file{nullptr};
+  std::vector<char> m_buffer;
+  size_t m_capacity{0};
+  uint64_t m_last_block_id{0};
+  environment_reader_t m_environment_reader{};
+};
+
+// A single process-wide sink shared by all benchmark translation units.
+inline writer& instance() {
+  static writer w;
+  return w;
+}
+
+} // namespace sample_sink
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+// Cost balanced work distribution over a fixed set of workers.
+//
+// The items are sorted longest first and dealt to the worker with the least
+// assigned cost (LPT). Each worker then takes batches from the front of its
+// own deque, so the expensive items start early. A worker whose deque is
+// empty steals a batch from the back of the deque with the most remaining
+// cost, which evens out mispredicted costs at the end of the run.
+namespace scheduler {
+
+struct item_t {
+  size_t id{0};
+  double cost{0};
+};
+
+struct batch_t {
+  std::vector<item_t> items{};
+  // taken from the deque of another worker
+  bool stolen{false};
+  // owner of the deque the batch was taken from
+  size_t victim{0};
+
+  double cost() const {
+    return std::accumulate(items.begin(), items.end(), 0.0,
+                           [](double acc, const item_t &item) { return acc + item.cost; });
+  }
+};
+
+// The longest processing time first makespan, a 4/3 approximation of the
+// optimum, and the lower bound max(total / workers, largest item).
+struct estimate_t {
+  double lpt_makespan{0};
+  double lower_bound{0};
+  double total_cost{0};
+};
+
+class work_stealing {
+public:
+  // A batch holds at most max_items items, and stops growing once its cost
+  // reaches max_batch_cost (a single item may exceed it).
+  work_stealing(size_t num_workers, size_t max_items, double max_batch_cost = std::numeric_limits<double>::max())
+      : m_queues(std::max<size_t>(num_workers, 1)), m_max_items(std::max<size_t>(max_items, 1)),
+        m_max_batch_cost(max_batch_cost) {
+  }
+
+  estimate_t assign(std::vector<item_t> items) {
+    std::stable_sort(items.begin(), items.end(), [](const item_t &a, const item_t &b) { return a.cost > b.cost; });
+    std::vector<double> load(m_queues.size(), 0);
+    estimate_t res;
+    for (const auto &item : items) {
+      const auto worker = std::min_element(load.begin(), load.end()) - load.begin();
+      load[worker] += item.cost;
+      res.total_cost += item.cost;
+      std::lock_guard<std::mutex> lock(m_queues[worker].mutex);
+      m_queues[worker].items.push_back(item);
+      m_queues[worker].remaining_cost += item.cost;
+    }
+    res.lpt_makespan = load.empty() ? 0 : *std::max_element(load.begin(), load.end());
+    res.lower_bound  = std::max(res.total_cost / m_queues.size(), items.empty() ? 0 : items.front().cost);
+    return res;
+  }
+
+  // The next batch of worker; empty once there is no work left anywhere.
+  batch_t next(size_t worker) {
+    batch_t res;
+    res.victim = worker;
+    take(m_queues[worker], true, res);
+    if (!res.items.empty()) {
+      return res;
+    }
+    while (true) {
+      const auto victim = richest(worker);
+      if (victim == worker) {
+        return res;
+      }
+      res.victim = victim;
+      res.stolen = true;
+      take(m_queues[victim], false, res);
+      if (!res.items.empty()) {
+        return res;
+      }
+    }
+  }
+
+  size_t num_workers() const {
+    return m_queues.size();
+  }
+
+private:
+  struct queue_t {
+    std::mutex mutex{};
+    std::deque<item_t> items{};
+    double remaining_cost{0};
+  };
+
+  void take(queue_t &queue, bool front, batch_t &batch) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    double cost = 0;
+    while (!queue.items.empty() && batch.items.size() < m_max_items && cost < m_max_batch_cost) {
+      const auto item = front ? queue.items.front() : queue.items.back();
+      if (front) {
+        queue.items.pop_front();
+      } else {
+        queue.items.pop_back();
+      }
+      queue.remaining_cost -= item.cost;
+      cost += item.cost;
+      batch.items.emplace_back(item);
+    }
+  }
+
+  // The other worker with the most remaining cost, worker itself if all are empty.
+  size_t richest(size_t worker) {
+    size_t res     = worker;
+    double highest = 0;
+    for (size_t ii = 0; ii < m_queues.size(); ii++) {
+      if (ii == worker) {
+        continue;
+      }
+      std::lock_guard<std::mutex> lock(m_queues[ii].mutex);
+      if (!m_queues[ii].items.empty() && (res == worker || m_queues[ii].remaining_cost > highest)) {
+        res     = ii;
+        highest = m_queues[ii].remaining_cost;
+      }
+    }
+    return res;
+  }
+
+  std::vector<queue_t> m_queues;
+  const size_t m_max_items;
+  const double m_max_batch_cost;
+};
+
+} // namespace scheduler
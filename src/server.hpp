@@ -0,0 +1,431 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "json.hpp"
+
+// Benchmark daemon.
+//
+// Starting scope, creating the context and the cudnn/cublas handles and
+// setting up the profiler takes longer than most single layer benchmarks.
+// With --daemon_socket=<path> one initialized process stays around and serves
+// benchmark requests of any number of local clients over a Unix socket, so
+// the context, the handles, the profiler session and the allocations cached
+// by the driver stay warm between requests.
+//
+// The protocol is one json object per line in both directions:
+//
+//   {"id": 7, "benchmark": "LAYER_CUDNN_...", "options": {"num_warmup": 5}}
+//   {"id": 7, "ok": true, "benchmarks": [...], "queue_s": 0.01, "run_s": 1.2}
+//
+// A run request names the layer signature either as exact benchmark names
+// ("benchmark", a string or a list) or as a --benchmark_filter regex
+// ("filter"). The options are num_warmup, min_time and repetitions. Besides
+// "run" (the default command) there are "ping", "status" and "shutdown",
+// which are answered as soon as they are read, ahead of the queued runs.
+// Failed requests get "ok": false and an "error" message.
+//
+// The daemon is single threaded and reads its sockets between runs, so a
+// control request that arrives while a benchmark runs is answered once that
+// run ends; a second thread would answer it right away, but it would disturb
+// the timings just like a concurrent benchmark.
+//
+// Run requests execute one at a time, since concurrent benchmarks would
+// disturb each other's timings, and the clients are served round robin, so a
+// client that queued many requests does not starve the others. The sockets
+// are non-blocking: a response goes to the output buffer of its client and is
+// written as the client reads, so a slow client neither blocks the daemon nor
+// delays the responses of the others. Nothing in here depends on CUDA; the
+// handler that runs a request is passed in by init.cpp.
+namespace server {
+
+using clock = std::chrono::steady_clock;
+
+// Negative values keep the defaults of the daemon.
+struct options_t {
+  int num_warmup{-1};
+  double min_time{-1};
+  int repetitions{-1};
+};
+
+struct request_t {
+  nlohmann::json id{nullptr};
+  std::string command{"run"};
+  std::vector<std::string> benchmarks{};
+  std::string filter{""};
+  options_t options{};
+  int client{-1};
+  clock::time_point received{};
+};
+
+static request_t parse_request(const std::string &line) {
+  const auto js = nlohmann::json::parse(line);
+  if (!js.is_object()) {
+    throw std::invalid_argument("a request must be a json object");
+  }
+  request_t res;
+  res.id      = js.value("id", nlohmann::json(nullptr));
+  res.command = js.value("command", std::string("run"));
+  if (res.command != "run" && res.command != "ping" && res.command != "status" && res.command != "shutdown") {
+    throw std::invalid_argument("unknown command " + res.command);
+  }
+  if (js.count("benchmark") != 0) {
+    const auto &benchmark = js["benchmark"];
+    if (benchmark.is_string()) {
+      res.benchmarks.emplace_back(benchmark.get<std::string>());
+    } else {
+      res.benchmarks = benchmark.get<std::vector<std::string>>();
+    }
+  }
+  res.filter = js.value("filter", std::string(""));
+  if (res.command == "run" && res.benchmarks.empty() && res.filter.empty()) {
+    throw std::invalid_argument("a run request needs a benchmark or a filter");
+  }
+  if (js.count("options") != 0) {
+    const auto &options     = js["options"];
+    res.options.num_warmup  = options.value("num_warmup", -1);
+    res.options.min_time    = options.value("min_time", -1.0);
+    res.options.repetitions = options.value("repetitions", -1);
+  }
+  return res;
+}
+
+static nlohmann::json error_response(const nlohmann::json &id, const std::string &error) {
+  return {{"id", id}, {"ok", false}, {"error", error}};
+}
+
+// Pending run requests, one fifo per client; pop() takes the clients in turn.
+class request_queue {
+public:
+  void push(request_t request) {
+    auto &queue = m_queues[request.client];
+    if (queue.empty()) {
+      m_order.push_back(request.client);
+    }
+    queue.emplace_back(std::move(request));
+    m_size++;
+  }
+
+  request_t pop() {
+    const auto client = m_order.front();
+    m_order.pop_front();
+    auto &queue = m_queues[client];
+    auto res    = std::move(queue.front());
+    queue.pop_front();
+    if (queue.empty()) {
+      m_queues.erase(client);
+    } else {
+      m_order.push_back(client);
+    }
+    m_size--;
+    return res;
+  }
+
+  // Forgets the requests of a client that went away.
+  void drop(int client) {
+    const auto it = m_queues.find(client);
+    if (it == m_queues.end()) {
+      return;
+    }
+    m_size -= it->second.size();
+    m_queues.erase(it);
+    m_order.erase(std::remove(m_order.begin(), m_order.end(), client), m_order.end());
+  }
+
+  bool empty() const {
+    return m_size == 0;
+  }
+
+  size_t size() const {
+    return m_size;
+  }
+
+  size_t num_clients() const {
+    return m_queues.size();
+  }
+
+private:
+  std::map<int, std::deque<request_t>> m_queues{};
+  std::deque<int> m_order{};
+  size_t m_size{0};
+};
+
+class server {
+public:
+  // Returns the response of a run request; an exception fails the request.
+  using handler_t = std::function<nlohmann::json(const request_t &)>;
+
+  // An existing socket file at path is replaced; the socket is only accessible
+  // by the user. A client whose unread responses exceed max_response_bytes is
+  // closed.
+  server(const std::string &path, handler_t handler, size_t max_request_bytes = 1 << 20,
+         size_t max_response_bytes = 64 << 20)
+      : m_path(path), m_handler(std::move(handler)), m_max_request_bytes(max_request_bytes),
+        m_max_response_bytes(max_response_bytes) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+      throw std::invalid_argument("invalid socket path " + path);
+    }
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0) {
+      if (!S_ISSOCK(st.st_mode)) {
+        throw std::runtime_error(path + " exists and is not a socket");
+      }
+      unlink(path.c_str());
+    }
+    m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_fd < 0) {
+      throw std::runtime_error(std::string("unable to create a socket: ") + std::strerror(errno));
+    }
+    if (bind(m_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || chmod(path.c_str(), 0600) != 0 ||
+        listen(m_fd, 64) != 0) {
+      const auto err = std::string(std::strerror(errno));
+      close(m_fd);
+      throw std::runtime_error("unable to listen on " + path + ": " + err);
+    }
+  }
+
+  server(const server &) = delete;
+  server &operator=(const server &) = delete;
+
+  ~server() {
+    for (const auto &client : m_clients) {
+      close(client.first);
+    }
+    close(m_fd);
+    unlink(m_path.c_str());
+  }
+
+  // Serves requests until a shutdown request. The responses still buffered
+  // at shutdown get up to linger to be written.
+  void serve(std::chrono::milliseconds linger = std::chrono::milliseconds(1000)) {
+    m_start = clock::now();
+    while (!m_shutdown) {
+      std::vector<pollfd> fds{{m_fd, POLLIN, 0}};
+      for (const auto &client : m_clients) {
+        const short events = client.second.output.empty() ? POLLIN : POLLIN | POLLOUT;
+        fds.push_back({client.first, events, 0});
+      }
+      // do not block while requests are waiting
+      if (poll(fds.data(), fds.size(), m_queue.empty() ? -1 : 0) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::runtime_error(std::string("poll failed: ") + std::strerror(errno));
+      }
+      if (fds[0].revents & POLLIN) {
+        accept_client();
+      }
+      for (size_t ii = 1; ii < fds.size(); ii++) {
+        if (fds[ii].revents & POLLOUT) {
+          write_client(fds[ii].fd);
+        }
+        if (fds[ii].revents & (POLLIN | POLLHUP | POLLERR)) {
+          read_client(fds[ii].fd);
+        }
+      }
+      if (!m_queue.empty() && !m_shutdown) {
+        dispatch(m_queue.pop());
+      }
+    }
+    while (!m_queue.empty()) {
+      const auto request = m_queue.pop();
+      send_line(request.client, error_response(request.id, "the daemon is shutting down"));
+    }
+    flush(linger);
+  }
+
+  nlohmann::json status() const {
+    return {
+        {"num_clients", m_clients.size()},
+        {"num_queued", m_queue.size()},
+        {"num_served", m_num_served},
+        {"num_failed", m_num_failed},
+        {"uptime_s", std::chrono::duration<double>(clock::now() - m_start).count()},
+    };
+  }
+
+private:
+  struct client_t {
+    // partial request line
+    std::string input{""};
+    // responses not written yet
+    std::string output{""};
+  };
+
+  void accept_client() {
+    const auto fd = accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd >= 0) {
+      m_clients[fd] = client_t{};
+    }
+  }
+
+  void close_client(int fd) {
+    m_queue.drop(fd);
+    m_clients.erase(fd);
+    close(fd);
+  }
+
+  void read_client(int fd) {
+    char buffer[64 * 1024];
+    const auto num_read = recv(fd, buffer, sizeof(buffer), 0);
+    if (num_read <= 0) {
+      if (num_read < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+      }
+      close_client(fd);
+      return;
+    }
+    auto &pending = m_clients[fd].input;
+    pending.append(buffer, num_read);
+    size_t pos;
+    while (m_clients.count(fd) != 0 && (pos = pending.find('\n')) != std::string::npos) {
+      const auto line = pending.substr(0, pos);
+      pending.erase(0, pos + 1);
+      if (line.find_first_not_of(" \t\r") != std::string::npos) {
+        handle_line(fd, line);
+      }
+    }
+    if (m_clients.count(fd) != 0 && pending.size() > m_max_request_bytes) {
+      send_line(fd, error_response(nullptr, "request exceeds " + std::to_string(m_max_request_bytes) + " bytes"));
+      close_client(fd);
+    }
+  }
+
+  void handle_line(int fd, const std::string &line) {
+    request_t request;
+    try {
+      request = parse_request(line);
+    } catch (const std::exception &e) {
+      send_line(fd, error_response(nullptr, std::string("invalid request: ") + e.what()));
+      return;
+    }
+    request.client   = fd;
+    request.received = clock::now();
+    if (request.command == "run") {
+      m_queue.push(std::move(request));
+      return;
+    }
+    nlohmann::json res{{"id", request.id}, {"ok", true}};
+    if (request.command == "status") {
+      res["status"] = status();
+    } else if (request.command == "shutdown") {
+      m_shutdown = true;
+    }
+    send_line(fd, res);
+  }
+
+  void dispatch(const request_t &request) {
+    const auto start = clock::now();
+    nlohmann::json res;
+    try {
+      res       = m_handler(request);
+      res["ok"] = true;
+    } catch (const std::exception &e) {
+      res = error_response(request.id, e.what());
+      m_num_failed++;
+    }
+    res["id"]      = request.id;
+    res["queue_s"] = std::chrono::duration<double>(start - request.received).count();
+    res["run_s"]   = std::chrono::duration<double>(clock::now() - start).count();
+    m_num_served++;
+    send_line(request.client, res);
+  }
+
+  // Queues a response and writes as much of it as the socket takes.
+  void send_line(int fd, const nlohmann::json &js) {
+    const auto it = m_clients.find(fd);
+    if (it == m_clients.end()) {
+      return;
+    }
+    it->second.output += js.dump() + "\n";
+    write_client(fd);
+  }
+
+  // Writes the buffered responses until the socket would block. A client that
+  // went away or stopped reading is closed.
+  void write_client(int fd) {
+    const auto it = m_clients.find(fd);
+    if (it == m_clients.end()) {
+      return;
+    }
+    auto &output  = it->second.output;
+    size_t offset = 0;
+    while (offset < output.size()) {
+      const auto num_sent = send(fd, output.data() + offset, output.size() - offset, MSG_NOSIGNAL);
+      if (num_sent < 0 && errno == EINTR) {
+        continue;
+      }
+      if (num_sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        break;
+      }
+      if (num_sent <= 0) {
+        close_client(fd);
+        return;
+      }
+      offset += num_sent;
+    }
+    output.erase(0, offset);
+    if (output.size() > m_max_response_bytes) {
+      close_client(fd);
+    }
+  }
+
+  // Writes the buffered responses of every client until they are written or
+  // the time is up.
+  void flush(std::chrono::milliseconds linger) {
+    const auto deadline = clock::now() + linger;
+    while (clock::now() < deadline) {
+      std::vector<pollfd> fds;
+      for (const auto &client : m_clients) {
+        if (!client.second.output.empty()) {
+          fds.push_back({client.first, POLLOUT, 0});
+        }
+      }
+      if (fds.empty()) {
+        return;
+      }
+      const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now()).count();
+      if (poll(fds.data(), fds.size(), static_cast<int>(std::max<int64_t>(left, 0))) < 0 && errno != EINTR) {
+        return;
+      }
+      for (const auto &fd : fds) {
+        if (fd.revents & (POLLOUT | POLLHUP | POLLERR)) {
+          write_client(fd.fd);
+        }
+      }
+    }
+  }
+
+  const std::string m_path;
+  handler_t m_handler;
+  const size_t m_max_request_bytes;
+  const size_t m_max_response_bytes;
+  int m_fd{-1};
+  std::map<int, client_t> m_clients{};
+  request_queue m_queue{};
+  bool m_shutdown{false};
+  size_t m_num_served{0};
+  size_t m_num_failed{0};
+  clock::time_point m_start{clock::now()};
+};
+
+} // namespace server
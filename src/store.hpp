@@ -0,0 +1,589 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "results.hpp"
+
+// Embedded local result store.
+//
+// Instead of keeping one json file per batch size and GPU, runs are imported
+// into a single append-only file. The file is a header followed by records
+//
+//   uint32_t kind | uint32_t length | msgpack payload[length]
+//
+// holding environments, runs, layer signatures and samples. On open the file
+// is mapped read-only and replayed into in-memory tables that are indexed by
+// signature, device and cuDNN version, so queries do not rescan json files.
+// An import is written at once and ends with a commit record. Only committed
+// imports are replayed: the records of an import that was interrupted before
+// its commit record are cut off, so the same file can be imported again.
+// Opening and importing lock the file, so concurrent imports do not
+// interleave their records, and an import first replays what other
+// processes committed since.
+namespace store {
+
+using json = results::json;
+
+static const char file_magic[8]          = {'C', 'D', 'N', 'N', 'S', 'T', 'R', '\0'};
+static const uint32_t file_format_version = 2;
+
+enum record_kind : uint32_t {
+  record_kind_environment = 1,
+  record_kind_run         = 2,
+  record_kind_signature   = 3,
+  record_kind_sample      = 4,
+  record_kind_commit      = 5,
+};
+
+struct environment_t {
+  uint32_t id{0};
+  std::string gpu_name{""};
+  std::string host_name{""};
+  std::string cuda_driver_version{""};
+  std::string cuda_runtime_version{""};
+  std::string cudnn_version{""};
+  std::string cublas_version{""};
+  std::string compute_capability{""};
+
+  std::string key() const {
+    return gpu_name + "|" + host_name + "|" + cuda_driver_version + "|" + cuda_runtime_version + "|" + cudnn_version +
+           "|" + cublas_version + "|" + compute_capability;
+  }
+};
+
+struct run_t {
+  uint32_t id{0};
+  uint32_t environment_id{0};
+  std::string source{""};
+  uint64_t content_hash{0};
+  int64_t imported_at{0};
+};
+
+struct signature_t {
+  uint32_t id{0};
+  uint64_t hash{0};
+  std::string layer{""};
+  std::string family{""};
+  int64_t batch_size{-1};
+};
+
+struct sample_t {
+  uint32_t run_id{0};
+  uint32_t signature_id{0};
+  std::string algorithm{""};
+  double time_s{0};
+  double workspace_bytes{0};
+  bool error_occurred{false};
+};
+
+// Orders cuDNN versions such as 7.6.5 and 7.10.0 by their numeric components.
+struct version_less {
+  static std::vector<uint64_t> components(const std::string &version) {
+    std::vector<uint64_t> res;
+    bool in_number = false;
+    for (const auto c : version) {
+      if (c >= '0' && c <= '9') {
+        if (!in_number) {
+          res.emplace_back(0);
+        }
+        res.back() = res.back() * 10 + static_cast<uint64_t>(c - '0');
+        in_number  = true;
+      } else {
+        in_number = false;
+      }
+    }
+    return res;
+  }
+
+  bool operator()(const std::string &a, const std::string &b) const {
+    const auto a_components = components(a), b_components = components(b);
+    if (a_components != b_components) {
+      return a_components < b_components;
+    }
+    return a < b;
+  }
+};
+
+class database {
+public:
+  explicit database(const std::string &path) : m_path(path) {
+    replay();
+  }
+
+  // Returns false if the same file content was imported before.
+  bool import(const std::string &path) {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.is_open()) {
+      throw std::runtime_error("unable to open " + path);
+    }
+    const std::string content((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    const auto content_hash = fnv1a_64(content);
+    const auto file         = results::load(path);
+
+    const locked_file store(m_path);
+    catch_up(store.fd);
+    if (m_run_hashes.count(content_hash)) {
+      return false;
+    }
+
+    // the records of this import, written at once and applied once they are on disk
+    std::string records;
+    std::vector<std::pair<uint32_t, json>> staged;
+
+    environment_t env = environment_of(file);
+    const auto env_it = m_environment_index.find(env.key());
+    if (env_it == m_environment_index.end()) {
+      env.id = static_cast<uint32_t>(m_environments.size()) + 1;
+      append(records, staged, record_kind_environment, to_json(env));
+    } else {
+      env.id = env_it->second;
+    }
+
+    run_t run;
+    run.id             = static_cast<uint32_t>(m_runs.size()) + 1;
+    run.environment_id = env.id;
+    run.source         = path;
+    run.content_hash   = content_hash;
+    run.imported_at    = std::chrono::duration_cast<std::chrono::seconds>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count();
+    append(records, staged, record_kind_run, to_json(run));
+
+    // the signatures this import adds
+    std::unordered_map<std::string, uint32_t> new_signatures;
+    for (const auto &entry : results::merge_repetitions(file.entries)) {
+      uint32_t signature_id = 0;
+      const auto sig_it     = m_signature_index.find(entry.layer);
+      const auto new_it     = new_signatures.find(entry.layer);
+      if (sig_it != m_signature_index.end()) {
+        signature_id = sig_it->second;
+      } else if (new_it != new_signatures.end()) {
+        signature_id = new_it->second;
+      } else {
+        signature_t sig;
+        sig.id         = static_cast<uint32_t>(m_signatures.size() + new_signatures.size()) + 1;
+        sig.hash       = entry.signature;
+        sig.layer      = entry.layer;
+        sig.family     = entry.family;
+        sig.batch_size = entry.batch_size;
+        append(records, staged, record_kind_signature, to_json(sig));
+        new_signatures[sig.layer] = sig.id;
+        signature_id              = sig.id;
+      }
+
+      sample_t sample;
+      sample.run_id          = run.id;
+      sample.signature_id    = signature_id;
+      sample.algorithm       = entry.algorithm;
+      sample.time_s          = entry.time_s;
+      sample.workspace_bytes = std::max(entry.counter("workspace_bytes", 0), 0.0);
+      sample.error_occurred  = entry.error_occurred;
+      append(records, staged, record_kind_sample, to_json(sample));
+    }
+    append(records, staged, record_kind_commit, {{"run_id", run.id}});
+
+    write(store.fd, records);
+    for (const auto &record : staged) {
+      apply(record.first, record.second);
+    }
+    m_offset += records.size();
+    return true;
+  }
+
+  // Fastest valid algorithm of every layer, restricted to a device when gpu_name is not empty.
+  json best_per_layer(const std::string &gpu_name) const {
+    const auto runs = runs_of_device(gpu_name);
+    json res        = json::array();
+    for (const auto &by_sig : m_samples_by_signature) {
+      const sample_t *best = nullptr;
+      for (const auto idx : by_sig.second) {
+        const auto &sample = m_samples[idx];
+        if (sample.error_occurred || sample.time_s <= 0 || (runs && !runs->count(sample.run_id))) {
+          continue;
+        }
+        if (best == nullptr || sample.time_s < best->time_s) {
+          best = &sample;
+        }
+      }
+      if (best == nullptr) {
+        continue;
+      }
+      const auto &sig = m_signatures[by_sig.first - 1];
+      const auto &env = environment_of(best->run_id);
+      res.push_back({{"layer", sig.layer},
+                     {"batch_size", sig.batch_size},
+                     {"algorithm", best->algorithm},
+                     {"time_ms", best->time_s * 1000},
+                     {"workspace_bytes", best->workspace_bytes},
+                     {"gpu_name", env.gpu_name},
+                     {"cudnn_version", env.cudnn_version}});
+    }
+    return res;
+  }
+
+  // Best time of the matching layers on every device, ordered by cuDNN version.
+  json trend(const std::string &layer_pattern) const {
+    json res = json::array();
+    for (const auto sig_id : signatures_matching(layer_pattern)) {
+      const auto &sig = m_signatures[sig_id - 1];
+      const auto it   = m_samples_by_signature.find(sig_id);
+      if (it == m_samples_by_signature.end()) {
+        continue;
+      }
+      for (const auto &version : m_runs_by_cudnn_version) {
+        // gpu_name -> best sample of the runs with this cuDNN version
+        std::map<std::string, const sample_t *> best;
+        for (const auto idx : it->second) {
+          const auto &sample = m_samples[idx];
+          if (sample.error_occurred || sample.time_s <= 0 || !version.second.count(sample.run_id)) {
+            continue;
+          }
+          auto &slot = best[environment_of(sample.run_id).gpu_name];
+          if (slot == nullptr || sample.time_s < slot->time_s) {
+            slot = &sample;
+          }
+        }
+        for (const auto &b : best) {
+          res.push_back({{"layer", sig.layer},
+                         {"gpu_name", b.first},
+                         {"cudnn_version", version.first},
+                         {"algorithm", b.second->algorithm},
+                         {"time_ms", b.second->time_s * 1000}});
+        }
+      }
+    }
+    return res;
+  }
+
+  const std::vector<run_t> &runs() const {
+    return m_runs;
+  }
+
+  const std::vector<signature_t> &signatures() const {
+    return m_signatures;
+  }
+
+  size_t num_samples() const {
+    return m_samples.size();
+  }
+
+private:
+  static environment_t environment_of(const results::file_t &file) {
+    environment_t env;
+    for (const auto &entry : file.entries) {
+      if (entry.label("gpu_name").empty()) {
+        continue;
+      }
+      env.gpu_name             = entry.label("gpu_name");
+      env.host_name            = entry.label("host_name");
+      env.cuda_driver_version  = entry.label("cuda_driver_version");
+      env.cuda_runtime_version = entry.label("cuda_runtime_version");
+      env.cudnn_version        = entry.label("cudnn_version");
+      env.cublas_version       = entry.label("cublas_version");
+      env.compute_capability   = entry.label("compute_capability");
+      break;
+    }
+    if (env.host_name.empty() && file.context.count("host_name")) {
+      env.host_name = file.context.at("host_name");
+    }
+    return env;
+  }
+
+  // A layer name or signature hash is looked up in the indexes; anything else
+  // matches the layers that contain it.
+  std::vector<uint32_t> signatures_matching(const std::string &layer_pattern) const {
+    const auto layer_it = m_signature_index.find(layer_pattern);
+    if (layer_it != m_signature_index.end()) {
+      return {layer_it->second};
+    }
+    const auto hash_it = m_signature_by_hash.find(layer_pattern);
+    if (hash_it != m_signature_by_hash.end()) {
+      return {hash_it->second};
+    }
+    std::vector<uint32_t> res;
+    for (const auto &sig : m_signatures) {
+      if (sig.layer.find(layer_pattern) != std::string::npos) {
+        res.emplace_back(sig.id);
+      }
+    }
+    return res;
+  }
+
+  const environment_t &environment_of(uint32_t run_id) const {
+    return m_environments[m_runs[run_id - 1].environment_id - 1];
+  }
+
+  // nullptr means all runs
+  const std::set<uint32_t> *runs_of_device(const std::string &gpu_name) const {
+    if (gpu_name.empty()) {
+      return nullptr;
+    }
+    static const std::set<uint32_t> empty{};
+    const auto it = m_runs_by_device.find(gpu_name);
+    return it == m_runs_by_device.end() ? &empty : &it->second;
+  }
+
+  static json to_json(const environment_t &env) {
+    return {{"id", env.id},
+            {"gpu_name", env.gpu_name},
+            {"host_name", env.host_name},
+            {"cuda_driver_version", env.cuda_driver_version},
+            {"cuda_runtime_version", env.cuda_runtime_version},
+            {"cudnn_version", env.cudnn_version},
+            {"cublas_version", env.cublas_version},
+            {"compute_capability", env.compute_capability}};
+  }
+
+  static json to_json(const run_t &run) {
+    return {{"id", run.id},
+            {"environment_id", run.environment_id},
+            {"source", run.source},
+            {"content_hash", run.content_hash},
+            {"imported_at", run.imported_at}};
+  }
+
+  static json to_json(const signature_t &sig) {
+    return {{"id", sig.id},
+            {"hash", sig.hash},
+            {"layer", sig.layer},
+            {"family", sig.family},
+            {"batch_size", sig.batch_size}};
+  }
+
+  static json to_json(const sample_t &sample) {
+    return {{"run_id", sample.run_id},
+            {"signature_id", sample.signature_id},
+            {"algorithm", sample.algorithm},
+            {"time_s", sample.time_s},
+            {"workspace_bytes", sample.workspace_bytes},
+            {"error_occurred", sample.error_occurred}};
+  }
+
+  void apply(uint32_t kind, const json &doc) {
+    switch (kind) {
+      case record_kind_environment: {
+        environment_t env;
+        env.id                   = doc.at("id");
+        env.gpu_name             = doc.value("gpu_name", "");
+        env.host_name            = doc.value("host_name", "");
+        env.cuda_driver_version  = doc.value("cuda_driver_version", "");
+        env.cuda_runtime_version = doc.value("cuda_runtime_version", "");
+        env.cudnn_version        = doc.value("cudnn_version", "");
+        env.cublas_version       = doc.value("cublas_version", "");
+        env.compute_capability   = doc.value("compute_capability", "");
+        m_environment_index[env.key()] = env.id;
+        m_environments.emplace_back(std::move(env));
+        break;
+      }
+      case record_kind_run: {
+        run_t run;
+        run.id             = doc.at("id");
+        run.environment_id = doc.at("environment_id");
+        run.source         = doc.value("source", "");
+        run.content_hash   = doc.value("content_hash", uint64_t{0});
+        run.imported_at    = doc.value("imported_at", int64_t{0});
+        m_run_hashes.insert(run.content_hash);
+        m_runs_by_device[m_environments[run.environment_id - 1].gpu_name].insert(run.id);
+        m_runs_by_cudnn_version[m_environments[run.environment_id - 1].cudnn_version].insert(run.id);
+        m_runs.emplace_back(std::move(run));
+        break;
+      }
+      case record_kind_signature: {
+        signature_t sig;
+        sig.id         = doc.at("id");
+        sig.hash       = doc.value("hash", uint64_t{0});
+        sig.layer      = doc.value("layer", "");
+        sig.family     = doc.value("family", "");
+        sig.batch_size = doc.value("batch_size", int64_t{-1});
+        m_signature_index[sig.layer]                  = sig.id;
+        m_signature_by_hash[std::to_string(sig.hash)] = sig.id;
+        m_signatures.emplace_back(std::move(sig));
+        break;
+      }
+      case record_kind_sample: {
+        sample_t sample;
+        sample.run_id          = doc.at("run_id");
+        sample.signature_id    = doc.at("signature_id");
+        sample.algorithm       = doc.value("algorithm", "");
+        sample.time_s          = doc.value("time_s", 0.0);
+        sample.workspace_bytes = doc.value("workspace_bytes", 0.0);
+        sample.error_occurred  = doc.value("error_occurred", false);
+        m_samples_by_signature[sample.signature_id].emplace_back(m_samples.size());
+        m_samples.emplace_back(std::move(sample));
+        break;
+      }
+      default:
+        // unknown record kinds are skipped
+        break;
+    }
+  }
+
+  // The store file, opened for reading and appending and exclusively locked
+  // until it goes out of scope.
+  struct locked_file {
+    int fd{-1};
+    explicit locked_file(const std::string &path) {
+      fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+      if (fd < 0) {
+        throw std::runtime_error("unable to open " + path);
+      }
+      if (flock(fd, LOCK_EX) != 0) {
+        ::close(fd);
+        throw std::runtime_error("unable to lock " + path);
+      }
+    }
+    locked_file(const locked_file &) = delete;
+    locked_file &operator=(const locked_file &) = delete;
+    ~locked_file() {
+      ::close(fd);
+    }
+  };
+
+  static size_t header_length() {
+    return sizeof(file_magic) + sizeof(file_format_version);
+  }
+
+  void replay() {
+    const locked_file store(m_path);
+    struct stat st;
+    if (fstat(store.fd, &st) != 0) {
+      throw std::runtime_error("unable to stat " + m_path);
+    }
+    if (st.st_size == 0) {
+      std::string header(file_magic, sizeof(file_magic));
+      header.append(reinterpret_cast<const char *>(&file_format_version), sizeof(file_format_version));
+      write(store.fd, header);
+      m_offset = header.size();
+      return;
+    }
+    char header[sizeof(file_magic) + sizeof(file_format_version)];
+    if (static_cast<size_t>(st.st_size) < sizeof(header) ||
+        pread(store.fd, header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+        memcmp(header, file_magic, sizeof(file_magic)) != 0) {
+      throw std::runtime_error(m_path + " is not a result store");
+    }
+    uint32_t version;
+    memcpy(&version, header + sizeof(file_magic), sizeof(version));
+    if (version != file_format_version) {
+      throw std::runtime_error(m_path + " has format version " + std::to_string(version) + ", expected " +
+                               std::to_string(file_format_version));
+    }
+    m_offset = header_length();
+    catch_up(store.fd);
+  }
+
+  // Applies the imports committed after m_offset, the end of the last import
+  // this database has seen, and cuts off the records after the last commit
+  // record. Called with the file locked, so those records belong to an import
+  // that was interrupted.
+  void catch_up(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      throw std::runtime_error("unable to stat " + m_path);
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    if (size < m_offset) {
+      throw std::runtime_error(m_path + " was truncated by another process");
+    }
+    if (size == m_offset) {
+      return;
+    }
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      throw std::runtime_error("unable to map " + m_path);
+    }
+    const auto *data = static_cast<const uint8_t *>(addr);
+
+    // the records read since the last commit record
+    std::vector<std::pair<uint32_t, json>> pending;
+    size_t offset = m_offset;
+    while (offset + 2 * sizeof(uint32_t) <= size) {
+      uint32_t kind, length;
+      memcpy(&kind, data + offset, sizeof(kind));
+      memcpy(&length, data + offset + sizeof(kind), sizeof(length));
+      const auto payload = offset + 2 * sizeof(uint32_t);
+      if (payload + length > size) {
+        break;
+      }
+      offset = payload + length;
+      if (kind != record_kind_commit) {
+        pending.emplace_back(kind, json::from_msgpack(data + payload, data + payload + length));
+        continue;
+      }
+      for (const auto &record : pending) {
+        apply(record.first, record.second);
+      }
+      pending.clear();
+      m_offset = offset;
+    }
+    munmap(addr, size);
+
+    // the records of an interrupted import would be replayed without the rest of the import, and the
+    // content hash of its run would reject importing the file again
+    if (m_offset < size && ftruncate(fd, static_cast<off_t>(m_offset)) != 0) {
+      throw std::runtime_error("unable to truncate the interrupted import at the end of " + m_path);
+    }
+  }
+
+  static void append(std::string &records, std::vector<std::pair<uint32_t, json>> &staged, uint32_t kind,
+                     const json &doc) {
+    const auto payload = json::to_msgpack(doc);
+    const auto length  = static_cast<uint32_t>(payload.size());
+    records.append(reinterpret_cast<const char *>(&kind), sizeof(kind));
+    records.append(reinterpret_cast<const char *>(&length), sizeof(length));
+    records.append(reinterpret_cast<const char *>(payload.data()), payload.size());
+    staged.emplace_back(kind, doc);
+  }
+
+  // Appends at m_offset, the end of the committed records.
+  void write(int fd, const std::string &records) const {
+    size_t written = 0;
+    while (written < records.size()) {
+      const auto res = pwrite(fd, records.data() + written, records.size() - written,
+                              static_cast<off_t>(m_offset + written));
+      if (res < 0 && errno == EINTR) {
+        continue;
+      }
+      if (res <= 0) {
+        throw std::runtime_error("unable to append to " + m_path);
+      }
+      written += static_cast<size_t>(res);
+    }
+  }
+
+  std::string m_path{""};
+  // the end of the last committed import that was applied
+  size_t m_offset{0};
+  std::vector<environment_t> m_environments{};
+  std::vector<run_t> m_runs{};
+  std::vector<signature_t> m_signatures{};
+  std::vector<sample_t> m_samples{};
+
+  std::unordered_map<std::string, uint32_t> m_environment_index{};
+  std::unordered_map<std::string, uint32_t> m_signature_index{};
+  std::unordered_map<std::string, uint32_t> m_signature_by_hash{};
+  std::set<uint64_t> m_run_hashes{};
+  std::map<uint32_t, std::vector<size_t>> m_samples_by_signature{};
+  std::unordered_map<std::string, std::set<uint32_t>> m_runs_by_device{};
+  std::map<std::string, std::set<uint32_t>, version_less> m_runs_by_cudnn_version{};
+};
+
+} // namespace store
@@ -10,14 +10,45 @@ endif()
 include(sugar_files)
 
 sugar_files(cudnn_BENCHMARK_HEADERS
+            activity_trace.hpp
+            annotate.hpp
             args.hpp
             c_api.h
+            choice_cache.hpp
+            conv_group.hpp
+            conv_nd.hpp
+            conv_nd_problem.hpp
+            cpu_conv.hpp
+            cpu_depthwise.hpp
+            cpu_norm.hpp
+            deconv.hpp
             error.hpp
             helper.hpp
             init.hpp
+            kernel_metrics.hpp
+            metric_planner.hpp
+            norm.hpp
             cupti_profiler.hpp
+            derived.hpp
+            device_cache.hpp
             generated_benchmarks.hpp
-            utils.hpp)
+            handle_pool.hpp
+            hash.hpp
+            host_env.hpp
+            power_sampler.hpp
+            predictor.hpp
+            range_profiler.hpp
+            results.hpp
+            rollup.hpp
+            sample_sink.hpp
+            scheduler.hpp
+            server.hpp
+            store.hpp
+            sweep.hpp
+            topology.hpp
+            train_step.hpp
+            utils.hpp
+            warm_cache.hpp)
 
 if(ADD_TENSOR_ONLY)
   sugar_files(cudnn_BENCHMARK_FWD_SOURCES cudnn_add_tensor.cpp init.cpp)
@@ -34,6 +65,10 @@ else(ADD_TENSOR_ONLY)
               cudnn_conv_bias_activation_fwd_8.cpp
               cudnn_conv_bias_activation_fwd_9.cpp)
   sugar_files(cudnn_BENCHMARK_FWD_SOURCES
+              cpu_conv_nd.cpp
+              cpu_deconv.cpp
+              cpu_depthwise_conv.cpp
+              cpu_norm.cpp
               ctc_loss.cpp
               cublas_gemm_fwd.cpp
               cublas_gemv_fwd.cpp
@@ -46,7 +81,10 @@ else(ADD_TENSOR_ONLY)
               cudnn_conv_fwd_3.cpp
               cudnn_conv_fwd_4.cpp
               cudnn_conv_fwd_5.cpp
+              cudnn_conv_nd_fwd.cpp
+              cudnn_deconv_fwd.cpp
               cudnn_dropout_fwd.cpp
+              cudnn_norm_fwd.cpp
               cudnn_op_tensor.cpp
               cudnn_pooling_fwd.cpp
               cudnn_softmax_fwd.cpp
@@ -60,6 +98,11 @@ sugar_files(cudnn_BENCHMARK_BWD_SOURCES
             cudnn_conv_bwd_bias.cpp
             cudnn_conv_bwd_data.cpp
             cudnn_conv_bwd_filter.cpp
+            cudnn_conv_nd_bwd_data.cpp
+            cudnn_conv_nd_bwd_filter.cpp
+            cudnn_conv_train_step.cpp
             cudnn_dropout_bwd.cpp
+            cudnn_norm_bwd.cpp
             cudnn_pooling_bwd.cpp
             cudnn_softmax_bwd.cpp)
+sugar_files(cudnn_CAPI_SOURCES c_api.cpp)
@@ -0,0 +1,547 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "json.hpp"
+
+#include "predictor.hpp"
+#include "results.hpp"
+#include "scheduler.hpp"
+
+extern char **environ;
+
+// Multi-GPU sweeps.
+//
+// The benchmarks use a single device with process wide handles (see
+// init.cpp), so a sweep over several devices runs one worker per device (or
+// several, for CPU bound benchmarks), and each worker runs batches of
+// benchmarks in child processes of scope itself with
+// --cuda_device_ids=<device>. Every child therefore has its own context and
+// handles. The children's json outputs are merged into a single google
+// benchmark json file whose rows carry a "device" column. A benchmark that
+// crashes its child takes the whole batch down, so the benchmarks of a failed
+// batch run again one per child and only those that fail alone are reported.
+//
+// Benchmark costs differ by orders of magnitude, so the work is distributed by
+// estimated cost (prior results, the prediction model or an analytic
+// roofline) over work stealing deques (see scheduler.hpp).
+//
+// The scheduling is independent of how a batch is run: a runner_t gets a
+// device and a list of benchmark names and returns the json output, so the
+// scheduler can be driven by simulated devices.
+namespace sweep {
+
+using json = nlohmann::json;
+
+struct batch_result_t {
+  bool ok{false};
+  std::string error{""};
+  // google benchmark json output of the batch
+  json output{};
+};
+
+using runner_t = std::function<batch_result_t(int device, const std::vector<std::string> &names)>;
+
+struct worker_report_t {
+  int device{-1};
+  size_t num_benchmarks{0};
+  size_t num_batches{0};
+  size_t num_stolen_batches{0};
+  // estimated cost of the benchmarks the worker ran
+  double estimated_s{0};
+  double busy_s{0};
+};
+
+struct report_t {
+  json merged{};
+  std::vector<worker_report_t> workers{};
+  scheduler::estimate_t estimate{};
+  // benchmarks that failed when run alone
+  std::vector<std::string> failed{};
+  // errors of the failed runs, of the batches and of the benchmarks run alone
+  std::vector<std::string> errors{};
+  // benchmarks run alone again after their batch failed
+  size_t num_rerun{0};
+  // the makespan of the sweep
+  double wall_s{0};
+};
+
+struct options_t {
+  size_t batch_size{32};
+  // a batch stops growing once its estimated cost reaches this
+  double max_batch_s{60};
+};
+
+// Estimated wall time of running a benchmark.
+class cost_model {
+public:
+  struct options_t {
+    // google benchmark repeats a benchmark for at least this long
+    double min_time_s{0.5};
+    // descriptor setup, allocation and Find
+    double setup_s{0.05};
+    int num_warmup{10};
+    // roofline used when there is neither a prior result nor a model
+    double peak_flops{1e13};
+    double peak_bytes_per_s{5e11};
+    double overhead_s{1e-5};
+  };
+
+  explicit cost_model(const options_t &opts) : m_opts(opts) {
+  }
+
+  // Measured times of earlier runs, matched by benchmark name.
+  void add_prior(const std::vector<results::entry_t> &entries) {
+    for (const auto &entry : results::merge_repetitions(entries)) {
+      if (!entry.error_occurred && entry.time_s > 0) {
+        m_prior[entry.name] = entry;
+      }
+    }
+  }
+
+  void set_model(const predictor::model &m) {
+    m_model     = m;
+    m_has_model = true;
+  }
+
+  // The arguments of a benchmark are part of its name (".../input[3]:224/...").
+  static results::entry_t entry_from_name(const std::string &name) {
+    static const std::regex input_re(R"(/input\[(\d+)\]:(-?\d+))");
+    results::entry_t entry;
+    entry.name = name;
+    for (auto it = std::sregex_iterator(name.begin(), name.end(), input_re); it != std::sregex_iterator(); ++it) {
+      entry.counters["input[" + (*it)[1].str() + "]"] = std::stod((*it)[2]);
+    }
+    results::parse_name(entry);
+    return entry;
+  }
+
+  double estimate(const std::string &name) {
+    const auto prior = m_prior.find(name);
+    if (prior != m_prior.end()) {
+      m_num_estimates["prior"]++;
+      const auto &entry = prior->second;
+      return m_opts.setup_s + entry.time_s * (m_opts.num_warmup + std::max(entry.iterations, 1.0));
+    }
+    const auto entry = entry_from_name(name);
+    double time_s    = m_has_model ? m_model.predict(entry) : -1;
+    if (time_s > 0) {
+      m_num_estimates["model"]++;
+    } else {
+      m_num_estimates["roofline"]++;
+      const auto f = predictor::features_from(entry);
+      time_s       = m_opts.overhead_s + f.flops / m_opts.peak_flops + f.bytes / m_opts.peak_bytes_per_s;
+    }
+    return m_opts.setup_s + time_s * m_opts.num_warmup + std::max(m_opts.min_time_s, time_s);
+  }
+
+  // How many estimates came from prior results, the model and the roofline.
+  const std::map<std::string, size_t> &num_estimates() const {
+    return m_num_estimates;
+  }
+
+private:
+  const options_t m_opts;
+  std::map<std::string, results::entry_t> m_prior{};
+  predictor::model m_model{};
+  bool m_has_model{false};
+  std::map<std::string, size_t> m_num_estimates{};
+};
+
+// Anchored --benchmark_filter that matches exactly the given names. The
+// filter is a POSIX extended regex, where ] and } are not special.
+static std::string filter_regex(const std::vector<std::string> &names) {
+  static const std::string special = "\\^$.|?*+()[{";
+  std::string res = "^(";
+  for (size_t ii = 0; ii < names.size(); ii++) {
+    if (ii != 0) {
+      res += '|';
+    }
+    for (const auto c : names[ii]) {
+      if (special.find(c) != std::string::npos) {
+        res += '\\';
+      }
+      res += c;
+    }
+  }
+  return res + ")$";
+}
+
+// Appends the rows of a batch output to merged, tagged with the device.
+static void merge(json &merged, const json &output, int device) {
+  if (!merged.count("context") && output.count("context")) {
+    merged["context"] = output["context"];
+  }
+  if (!merged.count("benchmarks")) {
+    merged["benchmarks"] = json::array();
+  }
+  if (!output.count("benchmarks")) {
+    return;
+  }
+  for (auto row : output["benchmarks"]) {
+    row["device"] = device;
+    merged["benchmarks"].push_back(row);
+  }
+}
+
+// The benchmark a result row belongs to, matched by exact name: the run_name
+// google benchmark records, else the row name itself or, for the aggregates
+// ("<name>_mean", "<name>_median_t", ...), the name without the suffix. A
+// benchmark whose name extends another one's therefore keeps its rows.
+static std::string benchmark_name(const json &row, const std::map<std::string, size_t> &names) {
+  if (row.count("run_name") && row["run_name"].is_string()) {
+    return row["run_name"].get<std::string>();
+  }
+  const auto name         = row.value("name", "");
+  const auto is_aggregate = row.value("run_type", "") == "aggregate" || row.count("aggregate_name");
+  if (!is_aggregate && names.count(name)) {
+    return name;
+  }
+  const auto base = results::aggregate_base_name(name);
+  return base.empty() ? name : base;
+}
+
+// Runs every name once. workers[i] is the device of worker i; a device may
+// be listed several times to run several children on it. costs[i] is the
+// estimated cost of names[i].
+static report_t run(const std::vector<int> &workers, const std::vector<std::string> &names,
+                    const std::vector<double> &costs, const options_t &opts, const runner_t &runner) {
+  if (workers.empty()) {
+    throw std::runtime_error("a sweep needs at least one worker");
+  }
+  if (costs.size() != names.size()) {
+    throw std::runtime_error("a sweep needs a cost per benchmark");
+  }
+  std::vector<scheduler::item_t> items;
+  for (size_t ii = 0; ii < names.size(); ii++) {
+    items.push_back({ii, costs[ii]});
+  }
+  scheduler::work_stealing queues(workers.size(), opts.batch_size, opts.max_batch_s);
+
+  report_t res;
+  res.merged["benchmarks"] = json::array();
+  res.workers.resize(workers.size());
+  res.estimate = queues.assign(items);
+
+  std::mutex mutex;
+  // benchmark index -> output rows, so the merged output does not depend on the timing
+  std::vector<json> rows(names.size(), json::array());
+  json context;
+  // keeps the rows of the benchmarks ids of a run, with mutex held
+  const auto collect = [&](const json &output, int device, const std::vector<size_t> &ids) {
+    json tagged;
+    merge(tagged, output, device);
+    if (context.is_null() && tagged.count("context")) {
+      context = tagged["context"];
+    }
+    std::map<std::string, size_t> index;
+    for (const auto id : ids) {
+      index[names[id]] = id;
+    }
+    for (const auto &row : tagged["benchmarks"]) {
+      const auto it = index.find(benchmark_name(row, index));
+      if (it != index.end()) {
+        rows[it->second].push_back(row);
+      }
+    }
+  };
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t ii = 0; ii < workers.size(); ii++) {
+    threads.emplace_back([&, ii]() {
+      auto &report  = res.workers[ii];
+      report.device = workers[ii];
+      const auto run_timed = [&](const std::vector<std::string> &run_names) {
+        const auto run_start = std::chrono::steady_clock::now();
+        auto run_res         = runner(workers[ii], run_names);
+        report.busy_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+        return run_res;
+      };
+      while (true) {
+        const auto batch = queues.next(ii);
+        if (batch.items.empty()) {
+          return;
+        }
+        std::vector<std::string> batch_names;
+        std::vector<size_t> batch_ids;
+        for (const auto &item : batch.items) {
+          batch_names.emplace_back(names[item.id]);
+          batch_ids.emplace_back(item.id);
+        }
+        const auto batch_res = run_timed(batch_names);
+        report.estimated_s += batch.cost();
+        report.num_batches++;
+        report.num_stolen_batches += batch.stolen ? 1 : 0;
+        report.num_benchmarks += batch.items.size();
+        if (batch_res.ok) {
+          std::lock_guard<std::mutex> lock(mutex);
+          collect(batch_res.output, workers[ii], batch_ids);
+          continue;
+        }
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          res.errors.emplace_back(batch_res.error);
+          if (batch_ids.size() == 1) {
+            res.failed.emplace_back(batch_names[0]);
+            continue;
+          }
+          res.num_rerun += batch_ids.size();
+        }
+        // one benchmark that crashes its process fails the whole batch, so
+        // every benchmark of the batch runs again in a process of its own
+        for (const auto id : batch_ids) {
+          const auto single_res = run_timed({names[id]});
+          std::lock_guard<std::mutex> lock(mutex);
+          if (single_res.ok) {
+            collect(single_res.output, workers[ii], {id});
+          } else {
+            res.failed.emplace_back(names[id]);
+            res.errors.emplace_back(single_res.error);
+          }
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  res.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (!context.is_null()) {
+    res.merged["context"] = context;
+  }
+  for (const auto &benchmark_rows : rows) {
+    for (const auto &row : benchmark_rows) {
+      res.merged["benchmarks"].push_back(row);
+    }
+  }
+  return res;
+}
+
+// Makespan report: the wall time of the sweep next to the estimated LPT
+// makespan and the lower bound, and the estimated and busy time per worker.
+static json to_json(const report_t &report) {
+  json workers  = json::array();
+  double busy_s = 0;
+  for (const auto &worker : report.workers) {
+    busy_s += worker.busy_s;
+    workers.push_back({{"device", worker.device},
+                       {"num_benchmarks", worker.num_benchmarks},
+                       {"num_batches", worker.num_batches},
+                       {"num_stolen_batches", worker.num_stolen_batches},
+                       {"estimated_s", worker.estimated_s},
+                       {"busy_s", worker.busy_s}});
+  }
+  const auto capacity = report.wall_s * report.workers.size();
+  return {{"makespan_s", report.wall_s},
+          {"estimated_makespan_s", report.estimate.lpt_makespan},
+          {"estimated_lower_bound_s", report.estimate.lower_bound},
+          {"estimated_total_s", report.estimate.total_cost},
+          {"busy_s", busy_s},
+          {"utilization", capacity > 0 ? busy_s / capacity : 0},
+          {"workers", workers},
+          {"num_rerun", report.num_rerun},
+          {"failed", report.failed},
+          {"errors", report.errors}};
+}
+
+// Running scope itself in child processes.
+namespace process {
+  // The arguments scope was started with, argv[0] included.
+  inline std::vector<std::string> self_args() {
+    std::ifstream stream("/proc/self/cmdline", std::ios::binary);
+    std::vector<std::string> res;
+    std::string arg;
+    while (std::getline(stream, arg, '\0')) {
+      res.emplace_back(arg);
+    }
+    if (res.empty()) {
+      throw std::runtime_error("unable to read /proc/self/cmdline");
+    }
+    return res;
+  }
+
+  // Value of the last --name=value or --name value argument, "" if there is none.
+  inline std::string flag_value(const std::vector<std::string> &args, const std::string &name) {
+    std::string res;
+    for (size_t ii = 1; ii < args.size(); ii++) {
+      if (args[ii].compare(0, name.size() + 1, name + "=") == 0) {
+        res = args[ii].substr(name.size() + 1);
+      } else if (args[ii] == name && ii + 1 < args.size()) {
+        res = args[ii + 1];
+      }
+    }
+    return res;
+  }
+
+  // Removes --name=value and --name value arguments for every name.
+  inline std::vector<std::string> strip(const std::vector<std::string> &args, const std::vector<std::string> &names) {
+    std::vector<std::string> res;
+    for (size_t ii = 0; ii < args.size(); ii++) {
+      const auto matched = std::find_if(names.begin(), names.end(), [&](const std::string &name) {
+        return args[ii] == name || args[ii].compare(0, name.size() + 1, name + "=") == 0;
+      });
+      if (ii == 0 || matched == names.end()) {
+        res.emplace_back(args[ii]);
+        continue;
+      }
+      // a separate value follows unless it is the next option
+      if (args[ii] == *matched && ii + 1 < args.size() && args[ii + 1].compare(0, 1, "-") != 0) {
+        ii++;
+      }
+    }
+    return res;
+  }
+
+  // A temporary directory for the outputs and logs of the children. It is
+  // removed with its files unless kept, e.g. for the logs of failed batches.
+  class work_dir_t {
+  public:
+    work_dir_t() {
+      char path[] = "/tmp/cudnn_scope_sweep_XXXXXX";
+      if (mkdtemp(path) == nullptr) {
+        throw std::runtime_error("unable to create a work directory");
+      }
+      m_path = path;
+    }
+
+    ~work_dir_t() {
+      if (m_keep) {
+        return;
+      }
+      if (auto dir = opendir(m_path.c_str())) {
+        while (const auto entry = readdir(dir)) {
+          const std::string name = entry->d_name;
+          if (name != "." && name != "..") {
+            unlink((m_path + "/" + name).c_str());
+          }
+        }
+        closedir(dir);
+      }
+      rmdir(m_path.c_str());
+    }
+
+    work_dir_t(const work_dir_t &) = delete;
+    work_dir_t &operator=(const work_dir_t &) = delete;
+
+    const std::string &path() const {
+      return m_path;
+    }
+
+    void keep() {
+      m_keep = true;
+    }
+
+  private:
+    std::string m_path{""};
+    bool m_keep{false};
+  };
+
+  // Runs /proc/self/exe with args (argv[0] included) and stdout redirected
+  // to stdout_path. Returns the exit status, -1 if it did not exit normally.
+  inline int execute(const std::vector<std::string> &args, const std::string &stdout_path) {
+    std::vector<char *> argv;
+    for (const auto &arg : args) {
+      argv.emplace_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.emplace_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, stdout_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                                     0644);
+    pid_t pid;
+    const auto err = posix_spawn(&pid, "/proc/self/exe", &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) {
+      throw std::runtime_error("unable to start " + args[0]);
+    }
+    int status = 0;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+      return -1;
+    }
+    return WEXITSTATUS(status);
+  }
+
+  // The flags the sweep sets for its children.
+  inline const std::vector<std::string> &controlled_flags() {
+    static const std::vector<std::string> flags{"--cuda_device_ids",     "--benchmark_filter",
+                                                "--benchmark_out",       "--benchmark_out_format",
+                                                "--benchmark_list_tests"};
+    return flags;
+  }
+
+  // Names of the benchmarks selected by the original --benchmark_filter.
+  inline std::vector<std::string> list_benchmarks(const std::vector<std::string> &base_args,
+                                                  const std::string &filter, const std::string &work_dir) {
+    auto args = base_args;
+    args.emplace_back("--benchmark_list_tests=true");
+    if (!filter.empty()) {
+      args.emplace_back("--benchmark_filter=" + filter);
+    }
+    const auto list_path = work_dir + "/benchmarks.txt";
+    if (execute(args, list_path) != 0) {
+      throw std::runtime_error("unable to list the benchmarks");
+    }
+    std::ifstream stream(list_path);
+    std::vector<std::string> res;
+    std::string line;
+    while (std::getline(stream, line)) {
+      if (!line.empty()) {
+        res.emplace_back(line);
+      }
+    }
+    return res;
+  }
+
+  // Runs a batch as "<base_args> --cuda_device_ids=<device> --benchmark_filter=^(names)$".
+  inline runner_t runner(const std::vector<std::string> &base_args, const std::string &work_dir) {
+    auto counter = std::make_shared<std::atomic<size_t>>(0);
+    return [=](int device, const std::vector<std::string> &names) {
+      const auto id          = std::to_string((*counter)++);
+      const auto output_path = work_dir + "/batch_" + id + ".json";
+      auto args              = base_args;
+      args.emplace_back("--cuda_device_ids=" + std::to_string(device));
+      args.emplace_back("--benchmark_filter=" + filter_regex(names));
+      args.emplace_back("--benchmark_out=" + output_path);
+      args.emplace_back("--benchmark_out_format=json");
+
+      batch_result_t res;
+      const auto status = execute(args, work_dir + "/batch_" + id + ".log");
+      std::ifstream stream(output_path);
+      if (status != 0 || !stream.is_open()) {
+        res.error = "batch " + id + " on device " + std::to_string(device) + " exited with " +
+                    std::to_string(status) + ", see " + work_dir + "/batch_" + id + ".log";
+        return res;
+      }
+      try {
+        stream >> res.output;
+        res.ok = true;
+      } catch (const std::exception &e) {
+        res.error = "unable to parse " + output_path + ": " + e.what();
+      }
+      return res;
+    };
+  }
+} // namespace process
+
+} // namespace sweep
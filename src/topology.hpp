@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Host topology from sysfs.
+//
+// Finds the NUMA node of a device from its pci bus id, binds threads to the
+// cpus of a node, and allocates host memory whose pages are placed on a node.
+// The placement syscalls are issued directly, so there is no dependency on
+// libnuma; on hosts without NUMA every lookup returns -1 and every buffer is
+// placed by the kernel as usual.
+namespace topology {
+
+// from linux/mempolicy.h
+static constexpr int mpol_bind   = 2;
+static constexpr int mpol_f_node = 1 << 0;
+static constexpr int mpol_f_addr = 1 << 1;
+
+static std::string read_line(const std::string &path) {
+  std::ifstream stream(path);
+  std::string res;
+  std::getline(stream, res);
+  while (!res.empty() && std::isspace(static_cast<unsigned char>(res.back()))) {
+    res.pop_back();
+  }
+  return res;
+}
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+static std::vector<int> parse_cpu_list(const std::string &list) {
+  std::vector<int> res;
+  std::stringstream stream(list);
+  std::string range;
+  while (std::getline(stream, range, ',')) {
+    try {
+      const auto dash  = range.find('-');
+      const auto first = std::stoi(range.substr(0, dash));
+      const auto last  = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+      for (int cpu = first; cpu <= last; cpu++) {
+        res.emplace_back(cpu);
+      }
+    } catch (const std::exception &) {
+      // empty or malformed range
+    }
+  }
+  return res;
+}
+
+static std::string format_cpu_list(std::vector<int> cpus) {
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  std::string res;
+  for (size_t ii = 0; ii < cpus.size();) {
+    auto jj = ii;
+    while (jj + 1 < cpus.size() && cpus[jj + 1] == cpus[jj] + 1) {
+      jj++;
+    }
+    res += (res.empty() ? "" : ",") + std::to_string(cpus[ii]);
+    if (jj != ii) {
+      res += "-" + std::to_string(cpus[jj]);
+    }
+    ii = jj + 1;
+  }
+  return res;
+}
+
+static std::vector<int> online_nodes() {
+  return parse_cpu_list(read_line("/sys/devices/system/node/online"));
+}
+
+static std::vector<int> node_cpus(int node) {
+  if (node < 0) {
+    return {};
+  }
+  return parse_cpu_list(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+}
+
+// The cpus the calling thread may run on.
+static std::vector<int> affinity() {
+  std::vector<int> res;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+    return res;
+  }
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &set)) {
+      res.emplace_back(cpu);
+    }
+  }
+  return res;
+}
+
+// Binds the calling thread, and the threads it creates from now on, to cpus.
+static bool bind_cpus(const std::vector<int> &cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const auto cpu : cpus) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  return CPU_COUNT(&set) != 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+// The node of the cpu the calling thread is running on, -1 if unknown.
+static int current_node() {
+  const auto cpu = sched_getcpu();
+  if (cpu < 0) {
+    return -1;
+  }
+  for (const auto node : online_nodes()) {
+    const auto cpus = node_cpus(node);
+    if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()) {
+      return node;
+    }
+  }
+  return -1;
+}
+
+// sysfs directory of a pci device, pci_bus_id as returned by cudaDeviceGetPCIBusId.
+static std::string pci_device_path(std::string pci_bus_id) {
+  std::transform(pci_bus_id.begin(), pci_bus_id.end(), pci_bus_id.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return "/sys/bus/pci/devices/" + pci_bus_id;
+}
+
+// The node closest to a device, -1 if unknown (the kernel reports -1 on
+// hosts with a single node).
+static int device_node(const std::string &pci_bus_id) {
+  if (pci_bus_id.empty()) {
+    return -1;
+  }
+  const auto value = read_line(pci_device_path(pci_bus_id) + "/numa_node");
+  return value.empty() ? -1 : std::atoi(value.c_str());
+}
+
+// The cpus local to a device that the calling thread may run on.
+static std::vector<int> device_cpus(const std::string &pci_bus_id) {
+  const auto local   = parse_cpu_list(read_line(pci_device_path(pci_bus_id) + "/local_cpulist"));
+  const auto allowed = affinity();
+  std::vector<int> res;
+  std::copy_if(local.begin(), local.end(), std::back_inserter(res),
+               [&](int cpu) { return std::find(allowed.begin(), allowed.end(), cpu) != allowed.end(); });
+  return res;
+}
+
+// Binds the calling thread to the cpus of node it may run on.
+static bool bind_node(int node) {
+  const auto cpus    = node_cpus(node);
+  const auto allowed = affinity();
+  std::vector<int> res;
+  std::copy_if(cpus.begin(), cpus.end(), std::back_inserter(res),
+               [&](int cpu) { return std::find(allowed.begin(), allowed.end(), cpu) != allowed.end(); });
+  return bind_cpus(res);
+}
+
+// The node of the page at ptr, -1 if unknown.
+static int page_node(const void *ptr) {
+  int node = -1;
+  if (syscall(SYS_get_mempolicy, &node, nullptr, 0, ptr, mpol_f_node | mpol_f_addr) != 0) {
+    return -1;
+  }
+  return node;
+}
+
+// Page aligned host memory whose pages are placed on a node (any node if
+// node is -1). The pages are touched in the constructor, so they are placed
+// before the buffer is used.
+class host_buffer {
+public:
+  host_buffer(size_t size, int node) : m_size(std::max<size_t>(size, 1)) {
+    auto ptr = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+      return;
+    }
+    m_ptr = ptr;
+    if (node >= 0 && node < 8 * static_cast<int>(sizeof(unsigned long))) {
+      const unsigned long mask = 1UL << node;
+      syscall(SYS_mbind, m_ptr, m_size, mpol_bind, &mask, 8 * sizeof(mask), 0);
+    }
+    std::memset(m_ptr, 0, m_size);
+  }
+
+  host_buffer(const host_buffer &) = delete;
+  host_buffer &operator=(const host_buffer &) = delete;
+
+  ~host_buffer() {
+    if (m_ptr != nullptr) {
+      munmap(m_ptr, m_size);
+    }
+  }
+
+  void *get() const {
+    return m_ptr;
+  }
+
+  size_t size() const {
+    return m_size;
+  }
+
+  // The node the pages ended up on.
+  int node() const {
+    return m_ptr == nullptr ? -1 : page_node(m_ptr);
+  }
+
+private:
+  void *m_ptr{nullptr};
+  size_t m_size{0};
+};
+
+} // namespace topology
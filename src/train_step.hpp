@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include <cuda_runtime.h>
+#include <cudnn.h>
+
+#include "error.hpp"
+#include "range_profiler.hpp"
+
+// Training steps of a convolution layer.
+//
+// A step runs the forward, backward data, backward filter and (optionally)
+// backward bias calls back to back on the same x, w and dy and on a single
+// workspace, so the timings keep the cache effects between the calls that
+// the isolated CONV_FWD/BWD_* benchmarks lose. The algorithms come from the
+// cudnnFind results of every call under the shared workspace budget, and
+// each phase is timed with cuda events on the stream of the step.
+namespace train_step {
+
+enum phase_t : int { forward = 0, backward_data = 1, backward_filter = 2, backward_bias = 3, num_phases = 4 };
+
+static const char *phase_name(int phase) {
+  static const char *names[] = {"forward", "backward_data", "backward_filter", "backward_bias"};
+  return phase >= 0 && phase < num_phases ? names[phase] : "unknown";
+}
+
+struct choice_t {
+  int algorithm{-1};
+  size_t workspace_bytes{0};
+  float time_ms{0};
+};
+
+// The fastest successful result whose workspace fits the budget (< 0 for no
+// budget). The calls run one after the other, so they share one workspace
+// sized for the largest of them: the budget bounds each call, and the
+// fastest fitting algorithm of each call gives the fastest step.
+template <typename Perf>
+static choice_t choose(const Perf *results, int count, int64_t budget_bytes) {
+  choice_t res;
+  for (int ii = 0; ii < count; ii++) {
+    const auto &result = results[ii];
+    if (result.status != CUDNN_STATUS_SUCCESS || result.time < 0) {
+      continue;
+    }
+    if (budget_bytes >= 0 && result.memory > static_cast<size_t>(budget_bytes)) {
+      continue;
+    }
+    if (res.algorithm == -1 || result.time < res.time_ms) {
+      res.algorithm       = static_cast<int>(result.algo);
+      res.workspace_bytes = result.memory;
+      res.time_ms         = result.time;
+    }
+  }
+  return res;
+}
+
+// Per phase timings of the timed steps. mark(phase) records the start of a
+// phase and mark(num_phases) the end of the step; the first mark of a step
+// reads the events of the step before, whose end the benchmark loop has
+// already synchronized. The first num_skipped steps are the warmup. The
+// range profiler replays of a step are not timed.
+class phase_timer {
+public:
+  phase_timer(cudaStream_t stream, int num_skipped) : stream_(stream), num_skipped_(num_skipped) {
+    for (auto &event : events_) {
+      PRINT_IF_ERROR(cudaEventCreate(&event));
+    }
+  }
+
+  ~phase_timer() {
+    for (auto &event : events_) {
+      PRINT_IF_ERROR(cudaEventDestroy(event));
+    }
+  }
+
+  phase_timer(const phase_timer &) = delete;
+  phase_timer &operator=(const phase_timer &) = delete;
+
+  void mark(int phase) {
+    if (range_profiler::is_replaying()) {
+      return;
+    }
+    if (phase == 0) {
+      collect();
+    }
+    cudaEventRecord(events_[phase], stream_);
+    if (phase == num_phases) {
+      pending_ = true;
+    }
+  }
+
+  // Reads the last step; call it once more after the benchmark loop.
+  void collect() {
+    if (!pending_) {
+      return;
+    }
+    pending_ = false;
+    if (PRINT_IF_ERROR(cudaEventSynchronize(events_[num_phases]))) {
+      return;
+    }
+    if (num_seen_++ < num_skipped_) {
+      return;
+    }
+    for (int ii = 0; ii < num_phases; ii++) {
+      float msec = 0;
+      if (PRINT_IF_ERROR(cudaEventElapsedTime(&msec, events_[ii], events_[ii + 1]))) {
+        return;
+      }
+      sum_ms_[ii] += msec;
+    }
+    num_steps_++;
+  }
+
+  int64_t num_steps() const {
+    return num_steps_;
+  }
+
+  double mean_ms(int phase) const {
+    return num_steps_ == 0 ? 0 : sum_ms_[phase] / num_steps_;
+  }
+
+private:
+  cudaStream_t stream_{nullptr};
+  int num_skipped_{0};
+  int num_seen_{0};
+  int64_t num_steps_{0};
+  bool pending_{false};
+  std::array<cudaEvent_t, num_phases + 1> events_{};
+  std::array<double, num_phases> sum_ms_{};
+};
+
+// The mean time, share of the step and chosen algorithm of every phase.
+static void add_counters(benchmark::State &state, const phase_timer &timer,
+                         const std::array<choice_t, num_phases> &choices) {
+  double total_ms = 0;
+  for (int ii = 0; ii < num_phases; ii++) {
+    total_ms += timer.mean_ms(ii);
+  }
+  for (int ii = 0; ii < num_phases; ii++) {
+    const auto name = std::string(phase_name(ii));
+    state.counters.insert({{name + "_ms", timer.mean_ms(ii)},
+                           {name + "_share", total_ms == 0 ? 0 : timer.mean_ms(ii) / total_ms},
+                           {name + "_algorithm", choices[ii].algorithm},
+                           {name + "_workspace_bytes", choices[ii].workspace_bytes},
+                           {name + "_find_ms", choices[ii].time_ms}});
+  }
+  state.counters.insert({{"train_step_ms", total_ms}, {"train_step_timed_steps", timer.num_steps()}});
+}
+
+} // namespace train_step
@@ -11,6 +11,7 @@
 
 #include <cxxabi.h>
 
+#include "hash.hpp"
 #include "prettyprint.hpp"
 #include "utils/utils.hpp"
 
@@ -211,25 +212,6 @@ static inline int calc_conv_out_dim(int input_dim, int filter_dim, int padd, int
 }
 } // namespace detail
 
-static uint64_t fnv1a_64(const char* data, int len) {
-  static const uint64_t kOffset = UINT64_C(14695981039346656037);
-  static const uint64_t kPrime  = UINT64_C(1099511628211);
-
-  const uint8_t* octets = reinterpret_cast<const uint8_t*>(data);
-
-  uint64_t hash = kOffset;
-
-  for (int i = 0; i < len; ++i) {
-    hash = hash ^ octets[i];
-    hash = hash * kPrime;
-  }
-
-  return hash;
-}
-
-static uint64_t fnv1a_64(const std::string& str) {
-  return fnv1a_64(str.data(), str.length());
-}
 static inline std::string demangle(const char* name) {
   int status          = 0;
   const auto realname = abi::__cxa_demangle(name, 0, 0, &status);
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <cuda_runtime.h>
+
+#include "annotate.hpp"
+#include "choice_cache.hpp"
+#include "error.hpp"
+
+#ifndef BENCHMARK_NAME
+#define BENCHMARK_NAME "CUDNN"
+#endif // BENCHMARK_NAME
+
+// State the daemon keeps warm between requests.
+//
+// A daemon request runs the same layers again and again, so the per run
+// setup that does not depend on the timed calls is kept across runs once
+// the daemon enabled the caches (daemon_serve in init.cpp):
+//   buffers:   the device memory of the inputs and outputs; a DeviceMemory
+//              borrows an idle buffer of its benchmark thread instead of
+//              calling cudaMalloc and cudaFree (the data is still copied);
+//   workspace: a device buffer per benchmark thread that only grows, so a
+//              convolution does not cudaMalloc and memset its workspace on
+//              every run; the contents of a workspace do not matter;
+//   choices:   the algorithms picked by cudnnFind, keyed by the problem,
+//              data type, math type and workspace budget, and the results of
+//              the cudnnFind calls of the convolutions (find_results), so the
+//              benchmark does not autotune a layer again.
+// The descriptors are not cached: creating them only touches host memory and
+// takes microseconds, and they are owned by the Tensor and Filter of a run.
+// Without the daemon every run allocates and autotunes as before.
+namespace warm_cache {
+
+// Device buffers of the benchmark threads that outlive a run. A run takes the
+// smallest idle buffer of its thread that is large enough and gives it back
+// when it ends. When no idle buffer is large enough, the largest one is freed
+// before allocating, so a thread holds no more buffers than a run uses at once.
+class buffer_pool {
+public:
+  // A buffer of at least bytes for thread_index; nullptr if it can not be
+  // allocated.
+  void *acquire(int thread_index, size_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_threads.size() <= static_cast<size_t>(thread_index)) {
+      m_threads.resize(thread_index + 1);
+    }
+    auto &buffers = m_threads[thread_index];
+    auto it       = buffers.idle.lower_bound(bytes);
+    if (it == buffers.idle.end() && !buffers.idle.empty()) {
+      it = std::prev(buffers.idle.end());
+      cudaFree(it->second);
+      buffers.idle.erase(it);
+      it = buffers.idle.end();
+    }
+    if (it != buffers.idle.end()) {
+      const auto res = it->second;
+      buffers.busy.emplace(res, it->first);
+      buffers.idle.erase(it);
+      return res;
+    }
+    void *res = nullptr;
+    if (PRINT_IF_ERROR(cudaMalloc(&res, bytes))) {
+      return nullptr;
+    }
+    buffers.busy.emplace(res, bytes);
+    return res;
+  }
+
+  void release(int thread_index, void *ptr) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto &buffers = m_threads[thread_index];
+    const auto it = buffers.busy.find(ptr);
+    if (it == buffers.busy.end()) {
+      return;
+    }
+    buffers.idle.emplace(it->second, it->first);
+    buffers.busy.erase(it);
+  }
+
+private:
+  struct thread_buffers_t {
+    // by size
+    std::multimap<size_t, void *> idle{};
+    // sizes of the borrowed buffers
+    std::map<void *, size_t> busy{};
+  };
+
+  std::mutex m_mutex{};
+  std::vector<thread_buffers_t> m_threads{};
+};
+
+inline buffer_pool &buffers() {
+  static buffer_pool pool;
+  return pool;
+}
+
+class workspace_pool {
+public:
+  // The workspace of thread_index, grown to at least bytes; nullptr if it can
+  // not be allocated.
+  void *get(int thread_index, size_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_buffers.size() <= static_cast<size_t>(thread_index)) {
+      m_buffers.resize(thread_index + 1);
+    }
+    auto &buffer = m_buffers[thread_index];
+    if (buffer.size >= bytes && buffer.ptr != nullptr) {
+      return buffer.ptr;
+    }
+    if (buffer.ptr != nullptr) {
+      cudaFree(buffer.ptr);
+    }
+    buffer = buffer_t{};
+    if (PRINT_IF_ERROR(cudaMalloc(&buffer.ptr, bytes))) {
+      buffer.ptr = nullptr;
+      return nullptr;
+    }
+    buffer.size = bytes;
+    return buffer.ptr;
+  }
+
+private:
+  struct buffer_t {
+    void *ptr{nullptr};
+    size_t size{0};
+  };
+
+  std::mutex m_mutex{};
+  std::vector<buffer_t> m_buffers{};
+};
+
+inline workspace_pool &workspaces() {
+  static workspace_pool pool;
+  return pool;
+}
+
+// The workspace of a run, in place of a DeviceMemory: borrowed from the pool
+// of the benchmark thread while the caches are enabled, allocated and freed
+// by the run otherwise.
+template <typename T>
+struct alignas(128) Workspace {
+  using type = T;
+  T *ptr{nullptr};
+  bool is_valid{false};
+  size_t size;
+  Workspace(benchmark::State &state, const size_t &size0) : size(size0) {
+    ANNOTATE_RANGE("allocation");
+    if (enabled()) {
+      ptr = static_cast<T *>(workspaces().get(state.thread_index, size));
+      if (ptr == nullptr) {
+        state.SkipWithError(BENCHMARK_NAME " device memory allocation failed");
+        return;
+      }
+      is_borrowed = true;
+      is_valid    = true;
+      return;
+    }
+    if (PRINT_IF_ERROR(cudaMalloc(&ptr, size))) {
+      ptr = nullptr;
+      state.SkipWithError(BENCHMARK_NAME " device memory allocation failed");
+      return;
+    }
+    if (PRINT_IF_ERROR(cudaMemset(ptr, 0, size))) {
+      state.SkipWithError(BENCHMARK_NAME " device memory set failed");
+      return;
+    }
+    is_valid = true;
+  }
+  Workspace(const Workspace &) = delete;
+  Workspace &operator=(const Workspace &) = delete;
+  ~Workspace() {
+    if (ptr == nullptr || is_borrowed) {
+      return;
+    }
+    cudaFree(ptr);
+  }
+  T *get() {
+    return ptr;
+  }
+
+private:
+  bool is_borrowed{false};
+};
+
+// The results of the cudnnFind calls of one Perf type (the forward, backward
+// data and backward filter convolutions), shared by every benchmark that
+// finds the algorithms of a layer. The key names the benchmark family and the
+// layer, see layer_key.
+template <typename Perf>
+choice_cache<std::vector<Perf>> &find_results() {
+  static choice_cache<std::vector<Perf>> cache;
+  return cache;
+}
+
+// The key of the layer of a benchmark: the family, the first num_args
+// arguments and the data and math type.
+inline std::string layer_key(const char *family, const benchmark::State &state, int num_args, int data_type,
+                             int math_type) {
+  std::string res = key(family, data_type, math_type);
+  for (int ii = 0; ii < num_args; ii++) {
+    res += "/" + std::to_string(state.range(ii));
+  }
+  return res;
+}
+
+} // namespace warm_cache
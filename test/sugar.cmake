@@ -0,0 +1,21 @@
+# This file generated automatically by: generate_sugar_files.py see wiki for
+# more info: https://github.com/ruslo/sugar/wiki/Collecting-sources
+
+if(DEFINED SCOPES_CUDNN_SCOPE_TEST_SUGAR_CMAKE_)
+  return()
+else()
+  set(SCOPES_CUDNN_SCOPE_TEST_SUGAR_CMAKE_ 1)
+endif()
+
+include(sugar_files)
+
+sugar_files(cudnn_TEST_SOURCES
+            test_activity_trace.cpp
+            test_annotate.cpp
+            test_cpu_depthwise.cpp
+            test_metric_planner.cpp
+            test_power_sampler.cpp
+            test_rollup.cpp
+            test_scheduler.cpp
+            test_server.cpp
+            test_sweep.cpp)
@@ -0,0 +1,168 @@
+// Feeds synthetic activity records through the buffer pool, the completed
+// queue and the drain thread of activity_trace.hpp; no CUPTI involved.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "activity_trace.hpp"
+#include "check.hpp"
+
+using namespace activity_trace;
+
+// The synthetic record: a kernel id and its start and end time.
+struct synthetic_t {
+  uint32_t id;
+  uint64_t start_ns;
+  uint64_t end_ns;
+};
+
+static size_t write_records(uint8_t *buffer, size_t buffer_bytes, uint32_t first_id, size_t num_records) {
+  size_t used = 0;
+  for (size_t ii = 0; ii < num_records && used + sizeof(synthetic_t) <= buffer_bytes; ii++) {
+    const synthetic_t record{static_cast<uint32_t>(first_id + ii), 1000 * (first_id + ii), 1000 * (first_id + ii) + 10};
+    memcpy(buffer + used, &record, sizeof(record));
+    used += sizeof(record);
+  }
+  return used;
+}
+
+static drainer::parser_t synthetic_parser(collector &records) {
+  return [&records](uint8_t *data, size_t valid_size) {
+    for (size_t offset = 0; offset + sizeof(synthetic_t) <= valid_size; offset += sizeof(synthetic_t)) {
+      synthetic_t record;
+      memcpy(&record, data + offset, sizeof(record));
+      kernel_record_t r;
+      r.name           = "kernel_" + std::to_string(record.id);
+      r.correlation_id = record.id;
+      r.start_ns       = record.start_ns;
+      r.end_ns         = record.end_ns;
+      records.add(std::move(r));
+    }
+  };
+}
+
+static void test_queue() {
+  mpmc_queue<int> queue(3); // rounded up to 4
+  for (int ii = 0; ii < 4; ii++) {
+    CHECK(queue.push(ii));
+  }
+  CHECK(!queue.push(4));
+  for (int ii = 0; ii < 4; ii++) {
+    int value = -1;
+    CHECK(queue.pop(value));
+    CHECK(value == ii);
+  }
+  int value = -1;
+  CHECK(!queue.pop(value));
+}
+
+static void test_pool_exhaustion() {
+  buffer_pool pool(2, 100);
+  CHECK(pool.buffer_bytes() % buffer_pool::alignment == 0);
+  auto a = pool.acquire();
+  auto b = pool.acquire();
+  CHECK(a != nullptr && b != nullptr && a != b);
+  CHECK(pool.owns(a) && pool.owns(b));
+  CHECK(pool.acquire() == nullptr);
+  CHECK(pool.num_exhausted() == 1);
+  pool.release(a);
+  CHECK(pool.acquire() == a);
+  pool.release(a);
+  pool.release(b);
+}
+
+// Several threads play CUPTI: they take buffers, fill them and complete them.
+static void test_drain() {
+  const size_t num_buffers = 4, records_per_buffer = 16, num_threads = 4, buffers_per_thread = 64;
+  buffer_pool pool(num_buffers, records_per_buffer * sizeof(synthetic_t));
+  collector records;
+  {
+    drainer d(pool, synthetic_parser(records));
+    std::atomic<uint32_t> next_id{0};
+    std::vector<std::thread> threads;
+    for (size_t tt = 0; tt < num_threads; tt++) {
+      threads.emplace_back([&]() {
+        for (size_t ii = 0; ii < buffers_per_thread; ii++) {
+          uint8_t *buffer = nullptr;
+          while ((buffer = pool.acquire()) == nullptr) {
+            std::this_thread::yield();
+          }
+          const auto first_id = next_id.fetch_add(records_per_buffer);
+          d.complete(buffer, write_records(buffer, pool.buffer_bytes(), first_id, records_per_buffer));
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    // an empty buffer goes back to the pool without a parse
+    uint8_t *empty = nullptr;
+    while ((empty = pool.acquire()) == nullptr) {
+      std::this_thread::yield();
+    }
+    d.complete(empty, 0);
+    d.flush();
+  }
+
+  const auto res = records.take();
+  CHECK(res.size() == num_threads * buffers_per_thread * records_per_buffer);
+  for (size_t ii = 0; ii < res.size(); ii++) {
+    CHECK(res[ii].correlation_id == ii);
+    CHECK(res[ii].duration_ns() == 10);
+    CHECK(ii == 0 || res[ii - 1].start_ns < res[ii].start_ns);
+  }
+  CHECK(records.take().empty());
+
+  // every buffer is back in the pool
+  for (size_t ii = 0; ii < num_buffers; ii++) {
+    CHECK(pool.acquire() != nullptr);
+  }
+  CHECK(pool.acquire() == nullptr);
+}
+
+// A buffer the pool never handed out is parsed and freed, not added to the pool.
+static void test_foreign_buffer() {
+  const size_t num_buffers = 2;
+  buffer_pool pool(num_buffers, 4 * sizeof(synthetic_t));
+  collector records;
+  {
+    drainer d(pool, synthetic_parser(records));
+    auto foreign = static_cast<uint8_t *>(aligned_alloc(buffer_pool::alignment, pool.buffer_bytes()));
+    CHECK(!pool.owns(foreign));
+    d.complete(foreign, write_records(foreign, pool.buffer_bytes(), 7, 4));
+    d.flush();
+  }
+  const auto res = records.take();
+  CHECK(res.size() == 4);
+  CHECK(res.front().correlation_id == 7);
+  for (size_t ii = 0; ii < num_buffers; ii++) {
+    CHECK(pool.acquire() != nullptr);
+  }
+  CHECK(pool.acquire() == nullptr);
+}
+
+// Only the listed CUPTI API versions map to a layout.
+static void test_kernel_record_layout() {
+  CHECK(activity_trace::kernel_record_layout(9) == 0);
+  CHECK(activity_trace::kernel_record_layout(10) == 4);
+  CHECK(activity_trace::kernel_record_layout(12) == 4);
+  CHECK(activity_trace::kernel_record_layout(13) == 5);
+  CHECK(activity_trace::kernel_record_layout(14) == 5);
+  CHECK(activity_trace::kernel_record_layout(15) == 0);
+  CHECK(activity_trace::kernel_record_layout(18) == 0);
+}
+
+int main() {
+  test_queue();
+  test_pool_exhaustion();
+  test_drain();
+  test_foreign_buffer();
+  test_kernel_record_layout();
+  printf("test_activity_trace passed\n");
+  return 0;
+}
@@ -0,0 +1,113 @@
+// Writes chrome trace events through annotate::range and reads the file back:
+// the document is a traceEvents array of complete events, nested ranges end
+// before their parents, and the timestamps keep their nanoseconds when the
+// trace has been running for an hour.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "annotate.hpp"
+#include "check.hpp"
+
+using json = nlohmann::json;
+
+static std::string temp_path(const std::string &name) {
+  return "/tmp/test_annotate_" + std::to_string(getpid()) + "_" + name + ".json";
+}
+
+static std::string read_file(const std::string &path) {
+  std::ifstream stream(path);
+  std::stringstream res;
+  res << stream.rdbuf();
+  return res.str();
+}
+
+// Records the ranges of a benchmark into a sink whose epoch lies offset in the
+// past and returns the written file.
+static std::string trace(const std::string &path, std::chrono::steady_clock::duration offset,
+                         size_t events_per_flush) {
+  annotate::set_sink(std::unique_ptr<annotate::sink>(
+      new annotate::chrome_trace_sink(path, events_per_flush, std::chrono::steady_clock::now() - offset)));
+  {
+    const annotate::range benchmark_range(std::string("LAYER_CUDNN_CONV_FWD_FLOAT"));
+    ANNOTATE_RANGE("allocation");
+    for (int ii = 0; ii < 3; ii++) {
+      const annotate::range iteration_range("iteration");
+    }
+    std::thread([] { ANNOTATE_RANGE("other_thread"); }).join();
+  }
+  annotate::set_sink(nullptr);
+  return read_file(path);
+}
+
+static void test_json_shape() {
+  const auto path = temp_path("shape");
+  const auto doc  = json::parse(trace(path, std::chrono::seconds(0), 2));
+  CHECK(doc.count("traceEvents"));
+  const auto &events = doc["traceEvents"];
+  CHECK(events.size() == 6);
+  int iterations = 0;
+  for (const auto &event : events) {
+    CHECK(event["ph"] == "X");
+    CHECK(event["pid"] == getpid());
+    CHECK(event["ts"].is_number() && event["dur"].is_number());
+    iterations += event["name"] == "iteration";
+  }
+  CHECK(iterations == 3);
+
+  // the benchmark range of the main thread ends last and contains its other ranges
+  json benchmark, other_thread;
+  for (const auto &event : events) {
+    if (event["name"] == "LAYER_CUDNN_CONV_FWD_FLOAT") {
+      benchmark = event;
+    } else if (event["name"] == "other_thread") {
+      other_thread = event;
+    }
+  }
+  CHECK(!benchmark.is_null() && !other_thread.is_null());
+  CHECK(other_thread["tid"] != benchmark["tid"]);
+  for (const auto &event : events) {
+    if (event["tid"] == benchmark["tid"]) {
+      CHECK(event["ts"].get<double>() >= benchmark["ts"].get<double>());
+      CHECK(event["ts"].get<double>() + event["dur"].get<double>() <=
+            benchmark["ts"].get<double>() + benchmark["dur"].get<double>());
+    }
+  }
+  unlink(path.c_str());
+}
+
+// An hour into the trace a timestamp still has its three decimals and no
+// exponent.
+static void test_large_offset() {
+  const auto path    = temp_path("offset");
+  const auto content = trace(path, std::chrono::hours(1), 4096);
+  const std::regex time_re(R"re("(ts|dur)":([0-9eE+.\-]+))re");
+  const std::regex fixed_re(R"(^[0-9]+\.[0-9]{3}$)");
+  int num_times = 0;
+  for (auto it = std::sregex_iterator(content.begin(), content.end(), time_re); it != std::sregex_iterator(); ++it) {
+    const auto value = (*it)[2].str();
+    CHECK(std::regex_match(value, fixed_re));
+    if ((*it)[1] == "ts") {
+      CHECK(std::stod(value) >= 3600e6);
+    }
+    num_times++;
+  }
+  CHECK(num_times == 12);
+  unlink(path.c_str());
+}
+
+int main() {
+  test_json_shape();
+  test_large_offset();
+  printf("test_annotate passed\n");
+  return 0;
+}
@@ -0,0 +1,84 @@
+// Runs depthwise problems (group == channels) through the row kernel of
+// cpu_depthwise::forward and the generic loop nest of cpu_conv::forward and
+// compares the outputs: strides, pads, dilations, channel multipliers and
+// widths that leave a remainder.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "check.hpp"
+#include "cpu_conv.hpp"
+#include "cpu_depthwise.hpp"
+
+static conv_nd::problem_t depthwise(int batch_size, int channels, int multiplier, int height, int width, int size,
+                                    int pad, int stride, int dilation) {
+  conv_nd::problem_t res;
+  res.batch_size  = batch_size;
+  res.channels    = channels;
+  res.num_filters = channels * multiplier;
+  res.group       = channels;
+  res.input       = {{1, height, width}};
+  res.filter      = {{1, size, size}};
+  res.pad         = {{0, pad, pad}};
+  res.stride      = {{1, stride, stride}};
+  res.dilation    = {{1, dilation, dilation}};
+  return res;
+}
+
+// Small integers, so both paths sum exactly whatever their order.
+template <typename T>
+static std::vector<T> values(int64_t size, int seed) {
+  std::vector<T> res(size);
+  for (int64_t ii = 0; ii < size; ii++) {
+    res[ii] = static_cast<T>((ii * 7 + seed) % 11) - 5;
+  }
+  return res;
+}
+
+template <typename T>
+static void check_forward(const conv_nd::problem_t &p, int num_threads) {
+  CHECK(p.is_valid());
+  CHECK(cpu_depthwise::is_depthwise(p));
+  const auto x = values<T>(p.input_size(), 1);
+  const auto w = values<T>(p.filter_size(), 3);
+  std::vector<T> expected(p.output_size(), T(-1)), actual(p.output_size(), T(-1));
+  cpu_conv::forward(p, x.data(), w.data(), expected.data(), 1);
+  cpu_depthwise::forward(p, x.data(), w.data(), actual.data(), num_threads);
+  for (size_t ii = 0; ii < expected.size(); ii++) {
+    CHECK(std::abs(expected[ii] - actual[ii]) <= 1e-6 * (1 + std::abs(expected[ii])));
+  }
+}
+
+static void test_forward() {
+  for (const auto num_threads : {1, 3}) {
+    check_forward<float>(depthwise(2, 3, 1, 7, 9, 3, 1, 1, 1), num_threads);
+    check_forward<float>(depthwise(1, 4, 2, 8, 11, 3, 1, 2, 1), num_threads);
+    check_forward<float>(depthwise(1, 2, 3, 9, 13, 3, 2, 1, 2), num_threads);
+    check_forward<float>(depthwise(2, 5, 1, 6, 5, 5, 0, 1, 1), num_threads);
+    check_forward<float>(depthwise(1, 3, 1, 10, 10, 1, 0, 3, 1), num_threads);
+    check_forward<double>(depthwise(1, 2, 2, 12, 17, 7, 3, 2, 1), num_threads);
+  }
+}
+
+// Grouped problems that are not depthwise stay on the generic path.
+static void test_is_depthwise() {
+  auto p = depthwise(1, 4, 1, 8, 8, 3, 1, 1, 1);
+  CHECK(cpu_depthwise::is_depthwise(p));
+  p.group = 2;
+  CHECK(!cpu_depthwise::is_depthwise(p));
+  p             = depthwise(1, 4, 1, 8, 8, 3, 1, 1, 1);
+  p.num_filters = 6;
+  CHECK(!cpu_depthwise::is_depthwise(p));
+  p       = depthwise(1, 4, 1, 8, 8, 3, 1, 1, 1);
+  p.input = {{2, 8, 8}};
+  CHECK(!cpu_depthwise::is_depthwise(p));
+}
+
+int main() {
+  test_forward();
+  test_is_depthwise();
+  printf("test_cpu_depthwise passed\n");
+  return 0;
+}
@@ -0,0 +1,110 @@
+// Plans and schedules metric passes with a synthetic compatibility predicate:
+// every name has a weight (its trailing digit) and a pass holds a weight of at
+// most 4, so names of weight 5 and more need several passes on their own.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "metric_planner.hpp"
+
+using namespace metric_planner;
+
+static const int pass_capacity = 4;
+
+static bool fits_one_pass(const std::vector<std::string> &names) {
+  int weight = 0;
+  for (const auto &name : names) {
+    weight += name.back() - '0';
+  }
+  return weight <= pass_capacity;
+}
+
+// The number of passes the profiler of a slot makes: the passes of its
+// metrics plus those of its events, where a multi pass name counts for two.
+static size_t num_passes(const std::vector<std::string> &names) {
+  const auto res = plan(names, fits_one_pass);
+  return res.passes.size() + 2 * res.multi_pass.size();
+}
+
+static size_t num_passes(const slot_t &slot) {
+  return num_passes(slot.metrics) + num_passes(slot.events);
+}
+
+// Replay is on exactly when a slot holds more than one pass.
+static void check_replay(const std::vector<slot_t> &slots) {
+  for (const auto &slot : slots) {
+    CHECK(slot.replay == (num_passes(slot) > 1));
+  }
+}
+
+static void test_plan() {
+  const auto res = plan({"a2", "b2", "c3", "d1", "e6", "a2"}, fits_one_pass);
+  CHECK(res.multi_pass == std::vector<std::string>{"e6"});
+  // a2 + b2 and c3 + d1
+  CHECK(res.passes.size() == 2);
+  for (const auto &pass : res.passes) {
+    CHECK(fits_one_pass(pass));
+  }
+}
+
+static void test_fits_iterations() {
+  const auto slots = schedule(plan({"a3", "b3", "c3"}, fits_one_pass), plan({"x4"}, fits_one_pass), 4);
+  CHECK(slots.size() == 4);
+  for (const auto &slot : slots) {
+    CHECK(!slot.replay);
+  }
+  check_replay(slots);
+}
+
+// More single pass groups than iterations: the overflow shares the last slot.
+static void test_overflow() {
+  const auto slots = schedule(plan({"a3", "b3", "c3", "d3", "e3"}, fits_one_pass), plan({}, fits_one_pass), 3);
+  CHECK(slots.size() == 3);
+  CHECK(!slots[0].replay && !slots[1].replay);
+  CHECK(slots[2].replay);
+  CHECK(slots[2].metrics.size() == 3);
+  check_replay(slots);
+}
+
+// A metric pass and an event pass in the last slot need replay although
+// neither needs more than one pass by itself.
+static void test_overflow_metrics_and_events() {
+  const auto slots = schedule(plan({"a3", "b3"}, fits_one_pass), plan({"x3"}, fits_one_pass), 2);
+  CHECK(slots.size() == 2);
+  CHECK(slots[1].metrics == std::vector<std::string>{"b3"} || slots[1].metrics == std::vector<std::string>{"a3"});
+  CHECK(slots[1].events == std::vector<std::string>{"x3"});
+  CHECK(slots[1].replay);
+  check_replay(slots);
+}
+
+// Multi pass names are replayed even when the iterations would suffice.
+static void test_multi_pass() {
+  const auto slots = schedule(plan({"a2", "e7"}, fits_one_pass), plan({}, fits_one_pass), 4);
+  CHECK(slots.size() == 2);
+  CHECK(slots[0].metrics == std::vector<std::string>{"a2"} && !slots[0].replay);
+  CHECK(slots[1].metrics == std::vector<std::string>{"e7"} && slots[1].replay);
+  check_replay(slots);
+}
+
+// A single iteration collects everything in one replayed slot.
+static void test_single_iteration() {
+  const auto slots = schedule(plan({"a3", "b3"}, fits_one_pass), plan({"x1"}, fits_one_pass), 1);
+  CHECK(slots.size() == 1);
+  CHECK(slots[0].metrics.size() == 2 && slots[0].events.size() == 1);
+  CHECK(slots[0].replay);
+  check_replay(slots);
+}
+
+int main() {
+  test_plan();
+  test_fits_iterations();
+  test_overflow();
+  test_overflow_metrics_and_events();
+  test_multi_pass();
+  test_single_iteration();
+  printf("test_metric_planner passed\n");
+  return 0;
+}
@@ -0,0 +1,144 @@
+// The file backend of power_sampler.hpp and the energy of the timed
+// intervals of a sampling window; no NVML involved.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "check.hpp"
+#include "power_sampler.hpp"
+
+using namespace power_sampler;
+using steady = sampler::clock;
+
+static bool near(double a, double b, double tolerance = 1e-9) {
+  return std::abs(a - b) <= tolerance * std::max(1.0, std::abs(b));
+}
+
+static std::string write_file(const std::string &contents) {
+  char path[] = "/tmp/test_power_sampler_XXXXXX";
+  const auto fd = mkstemp(path);
+  CHECK(fd >= 0);
+  close(fd);
+  std::ofstream(path) << contents;
+  return path;
+}
+
+static bool throws(const std::string &contents) {
+  const auto path = write_file(contents);
+  bool res        = false;
+  try {
+    file_backend b(path);
+  } catch (const std::runtime_error &) {
+    res = true;
+  }
+  unlink(path.c_str());
+  return res;
+}
+
+static void test_file_backend() {
+  const auto path = write_file("# sm_clock_mhz temperature_c power_w [throttle_reasons]\n"
+                               "\n"
+                               "1380 60 150.5\n"
+                               "  # indented comment\n"
+                               "1200 65 180 4\r\n");
+  file_backend b(path);
+  unlink(path.c_str());
+  auto r = b.read();
+  CHECK(r.sm_clock_mhz == 1380 && r.temperature_c == 60 && r.power_w == 150.5f && r.throttle_reasons == 0);
+  r = b.read();
+  CHECK(r.sm_clock_mhz == 1200 && r.temperature_c == 65 && r.power_w == 180 && r.throttle_reasons == 4);
+  // the last reading repeats
+  r = b.read();
+  CHECK(r.sm_clock_mhz == 1200 && r.throttle_reasons == 4);
+
+  CHECK(throws("1380 60\n"));
+  CHECK(throws("# nothing\n\n"));
+  CHECK(throws("fast hot hungry\n"));
+  bool missing = false;
+  try {
+    file_backend b("/nonexistent/power_samples");
+  } catch (const std::runtime_error &) {
+    missing = true;
+  }
+  CHECK(missing);
+}
+
+static sampler::sample_t sample(steady::time_point t, float power_w) {
+  reading_t reading;
+  reading.power_w = power_w;
+  return {t, reading};
+}
+
+static steady::time_point at(steady::time_point t0, double s) {
+  return t0 + std::chrono::duration_cast<steady::duration>(std::chrono::duration<double>(s));
+}
+
+static void test_summarize() {
+  const auto t0      = steady::now();
+  const auto samples = std::vector<sampler::sample_t>{sample(t0, 100), sample(at(t0, 1), 200), sample(at(t0, 2), 100)};
+
+  // no intervals: the whole window, 150 W on average for 2 s
+  auto res = sampler::summarize(samples, {}, 2);
+  CHECK(res.num_samples == 3);
+  CHECK(near(res.timed_s, 2, 1e-6));
+  CHECK(near(res.energy_j, 300, 1e-6));
+  CHECK(res.power_w.min == 100 && res.power_w.max == 200);
+
+  // two timed intervals of 0.5 s around the peak: 87.5 J and 62.5 J
+  const auto intervals = std::vector<sampler::interval_t>{{at(t0, 0.5), at(t0, 1)}, {at(t0, 1.5), at(t0, 2)}};
+  res                  = sampler::summarize(samples, intervals, 2);
+  CHECK(near(res.timed_s, 1, 1e-6));
+  CHECK(near(res.energy_j, 150, 1e-6));
+  CHECK(near(res.duration_s, 2));
+
+  // an interval across a sample
+  res = sampler::summarize(samples, {{at(t0, 0.5), at(t0, 1.5)}}, 2);
+  CHECK(near(res.energy_j, 0.5 * (150 + 200) / 2 + 0.5 * (200 + 150) / 2, 1e-6));
+
+  // a single power reading holds for the timed intervals
+  res = sampler::summarize({sample(t0, 120)}, intervals, 2);
+  CHECK(near(res.energy_j, 120, 1e-6));
+
+  // no power readings
+  res = sampler::summarize({sampler::sample_t{t0, reading_t{}}}, intervals, 2);
+  CHECK(std::isnan(res.energy_j));
+}
+
+// A live window where most of the time is spent outside the timed interval.
+static void test_window() {
+  const auto path = write_file("1380 60 100\n");
+  sampler s(std::unique_ptr<backend>(new file_backend(path)), std::chrono::milliseconds(1));
+  unlink(path.c_str());
+
+  s.start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  s.begin_timed();
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  s.end_timed();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  const auto res = s.stop();
+
+  CHECK(res.num_samples >= 2);
+  CHECK(res.timed_s >= 0.01 && res.timed_s < res.duration_s);
+  CHECK(near(res.energy_j, 100 * res.timed_s, 1e-6));
+  CHECK(res.sm_clock_mhz.mean == 1380);
+  CHECK(s.stop().num_samples == 0);
+}
+
+int main() {
+  test_file_backend();
+  test_summarize();
+  test_window();
+  printf("test_power_sampler passed\n");
+  return 0;
+}
@@ -0,0 +1,99 @@
+// Rolls up synthetic result entries: the families that make up the forward
+// pass, the choice of the algorithm among the template arguments and the
+// weighting by the layer counts of the model.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "rollup.hpp"
+
+using results::entry_t;
+
+// An iteration row of a hand written benchmark that took time_ms.
+static entry_t entry(const std::string &name, double time_ms) {
+  entry_t res;
+  res.name                   = name;
+  res.time_s                 = time_ms / 1000;
+  res.iterations             = 1;
+  res.counters["batch_size"] = 8;
+  results::parse_name(res);
+  return res;
+}
+
+static const rollup::layer_choice_t *find_layer(const rollup::model_rollup_t &rollup, const std::string &layer) {
+  for (const auto &choice : rollup.layers) {
+    if (choice.layer == layer) {
+      return &choice;
+    }
+  }
+  return nullptr;
+}
+
+// The norm forward families are layers of the forward pass; their CPU
+// references and backward passes are not.
+static void test_norm_families() {
+  const std::vector<entry_t> entries{entry("LAYER_CUDNN_LAYERNORM_FWD_FLOAT/8/512/1/1/1/1/manual_time", 1),
+                                     entry("LAYER_CUDNN_GROUPNORM_FWD_HALF/8/256/56/56/32/1/manual_time", 2),
+                                     entry("LAYER_CUDNN_INSTANCENORM_FWD_FLOAT/8/64/128/128/64/1/manual_time", 3),
+                                     entry("LAYER_CUDNN_LAYERNORM_BWD_FLOAT/8/512/1/1/1/1/manual_time", 4),
+                                     entry("LAYER_CPU_LAYERNORM_FWD_FLOAT/8/512/1/1/1/1/manual_time", 5)};
+  const auto res = rollup::compute("norms", entries, rollup::options_t{});
+  CHECK(res.size() == 1);
+  CHECK(res[0].layers.size() == 3);
+  CHECK(find_layer(res[0], "LAYER_CUDNN_LAYERNORM_FWD_FLOAT/8/512/1/1/1/1") != nullptr);
+  CHECK(find_layer(res[0], "LAYER_CUDNN_GROUPNORM_FWD_HALF/8/256/56/56/32/1") != nullptr);
+  CHECK(find_layer(res[0], "LAYER_CUDNN_INSTANCENORM_FWD_FLOAT/8/64/128/128/64/1") != nullptr);
+  CHECK(std::abs(res[0].latency_s - 0.006) < 1e-12);
+}
+
+// The fastest algorithm is chosen per activation mode, not across modes.
+static void test_algorithm_choice() {
+  const std::vector<entry_t> entries{
+      entry("LAYER_CUDNN_CONV_FWD_FLOAT<CUDNN_CONVOLUTION_FWD_ALGO_GEMM>/8/3/224/224/64/7/7/manual_time", 2),
+      entry("LAYER_CUDNN_CONV_FWD_FLOAT<CUDNN_CONVOLUTION_FWD_ALGO_FFT>/8/3/224/224/64/7/7/manual_time", 1),
+      entry("LAYER_CUDNN_ACTIVATION_FWD_FLOAT<CUDNN_ACTIVATION_RELU>/8/64/112/112/manual_time", 4),
+      entry("LAYER_CUDNN_ACTIVATION_FWD_FLOAT<CUDNN_ACTIVATION_TANH>/8/64/112/112/manual_time", 3)};
+  const auto res = rollup::compute("convs", entries, rollup::options_t{});
+  CHECK(res.size() == 1);
+  CHECK(res[0].layers.size() == 3);
+  const auto conv = find_layer(res[0], "LAYER_CUDNN_CONV_FWD_FLOAT/8/3/224/224/64/7/7");
+  CHECK(conv != nullptr && conv->algorithm == "CUDNN_CONVOLUTION_FWD_ALGO_FFT");
+  const auto relu = find_layer(res[0], "LAYER_CUDNN_ACTIVATION_FWD_FLOAT/8/64/112/112<CUDNN_ACTIVATION_RELU>");
+  CHECK(relu != nullptr && relu->algorithm.empty() && std::abs(relu->time_s - 0.004) < 1e-12);
+  CHECK(find_layer(res[0], "LAYER_CUDNN_ACTIVATION_FWD_FLOAT/8/64/112/112<CUDNN_ACTIVATION_TANH>") != nullptr);
+}
+
+// Layer times are weighted by the layer counts, and only a model whose layers
+// all have a count has end-to-end numbers.
+static void test_layer_counts() {
+  const std::vector<entry_t> entries{entry("LAYER_CUDNN_LAYERNORM_FWD_FLOAT/8/512/1/1/1/1/manual_time", 1),
+                                     entry("LAYER_CUBLAS_GEMM_FWD_FLOAT/512/2048/64/manual_time", 2)};
+  const rollup::layer_counts_t counts{{"LAYER_CUDNN_LAYERNORM_FWD_FLOAT/8/512/1/1/1/1", 24},
+                                      {"LAYER_CUBLAS_GEMM_FWD_FLOAT/512/2048/64", 48}};
+  auto res = rollup::compute("transformer", entries, rollup::options_t{}, counts);
+  CHECK(res.size() == 1);
+  CHECK(res[0].complete && res[0].has_layer_counts);
+  CHECK(std::abs(res[0].latency_s - 0.120) < 1e-12);
+  CHECK(std::abs(res[0].images_per_s - 8 / 0.120) < 1e-9);
+  CHECK(res[0].layers[0].layer == "LAYER_CUBLAS_GEMM_FWD_FLOAT/512/2048/64" && res[0].layers[0].count == 48);
+  CHECK(std::abs(res[0].layers[0].share - 0.8) < 1e-12);
+
+  res = rollup::compute("transformer", entries, rollup::options_t{}, {{"LAYER_CUBLAS_GEMM_FWD_FLOAT/512/2048/64", 48}});
+  CHECK(!res[0].complete);
+  CHECK(res[0].uncounted_layers == std::vector<std::string>{"LAYER_CUDNN_LAYERNORM_FWD_FLOAT/8/512/1/1/1/1"});
+
+  res = rollup::compute("transformer", entries, rollup::options_t{});
+  CHECK(!res[0].complete && !res[0].has_layer_counts);
+}
+
+int main() {
+  test_norm_families();
+  test_algorithm_choice();
+  test_layer_counts();
+  printf("test_rollup passed\n");
+  return 0;
+}
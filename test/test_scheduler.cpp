@@ -0,0 +1,118 @@
+// Deals known cost vectors over scheduler::work_stealing: the LPT assignment
+// and its makespan, stealing from the tail of the richest deque, and workers
+// draining the deques concurrently.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "scheduler.hpp"
+
+static std::vector<scheduler::item_t> items_of(const std::vector<double> &costs) {
+  std::vector<scheduler::item_t> res;
+  for (size_t ii = 0; ii < costs.size(); ii++) {
+    res.push_back({ii, costs[ii]});
+  }
+  return res;
+}
+
+// The ids worker takes from its own deque, one item per batch.
+static std::vector<size_t> own_items(scheduler::work_stealing &queues, size_t worker, size_t num_items) {
+  std::vector<size_t> res;
+  for (size_t ii = 0; ii < num_items; ii++) {
+    const auto batch = queues.next(worker);
+    CHECK(batch.items.size() == 1 && !batch.stolen);
+    res.push_back(batch.items[0].id);
+  }
+  return res;
+}
+
+// LPT deals 5 3 | 4 3 3 and ends at 10, while the optimum 5 4 | 3 3 3 ends at 9.
+static void test_lpt_makespan() {
+  scheduler::work_stealing queues(2, 1);
+  const auto estimate = queues.assign(items_of({3, 5, 3, 4, 3}));
+  CHECK(std::abs(estimate.total_cost - 18) < 1e-12);
+  CHECK(std::abs(estimate.lpt_makespan - 10) < 1e-12);
+  CHECK(std::abs(estimate.lower_bound - 9) < 1e-12);
+
+  // the expensive items come first, the stable sort keeps the order of equal costs
+  CHECK((own_items(queues, 0, 2) == std::vector<size_t>{1, 2}));
+  CHECK((own_items(queues, 1, 3) == std::vector<size_t>{3, 0, 4}));
+  CHECK(queues.next(0).items.empty() && queues.next(1).items.empty());
+}
+
+// A worker that ran out of work takes the cheap end of the loaded deque, and
+// the owner keeps taking from the front.
+static void test_steal_from_tail() {
+  scheduler::work_stealing queues(2, 1);
+  queues.assign(items_of({10, 1, 2, 3, 4}));
+  CHECK(own_items(queues, 0, 1) == std::vector<size_t>{0});
+
+  auto batch = queues.next(0);
+  CHECK(batch.stolen && batch.victim == 1);
+  CHECK(batch.items.size() == 1 && batch.items[0].id == 1);
+
+  batch = queues.next(1);
+  CHECK(!batch.stolen && batch.items[0].id == 4);
+
+  // a stolen batch is limited like any other batch
+  scheduler::work_stealing limited(2, 8, 5);
+  limited.assign(items_of({20, 3, 3, 3, 3}));
+  CHECK(limited.next(0).items.size() == 1);
+  batch = limited.next(0);
+  CHECK(batch.stolen && batch.items.size() == 2 && std::abs(batch.cost() - 6) < 1e-12);
+}
+
+// Workers that drain and steal concurrently run every item exactly once.
+static void test_exactly_once() {
+  std::vector<double> costs;
+  for (int ii = 0; ii < 1000; ii++) {
+    costs.push_back(1 + (ii * 7919) % 97);
+  }
+  scheduler::work_stealing queues(4, 3, 150);
+  queues.assign(items_of(costs));
+
+  std::mutex mutex;
+  std::vector<int> num_runs(costs.size(), 0);
+  size_t num_stolen = 0;
+  std::vector<std::thread> workers;
+  for (size_t worker = 0; worker < queues.num_workers(); worker++) {
+    workers.emplace_back([&, worker] {
+      // worker 0 is slow, so the others steal its items
+      while (true) {
+        const auto batch = queues.next(worker);
+        if (batch.items.empty()) {
+          return;
+        }
+        if (worker == 0) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        num_stolen += batch.stolen ? 1 : 0;
+        for (const auto &item : batch.items) {
+          num_runs[item.id]++;
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  for (const auto runs : num_runs) {
+    CHECK(runs == 1);
+  }
+  CHECK(num_stolen > 0);
+}
+
+int main() {
+  test_lpt_makespan();
+  test_steal_from_tail();
+  test_exactly_once();
+  printf("test_scheduler passed\n");
+  return 0;
+}
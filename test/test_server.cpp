@@ -0,0 +1,179 @@
+// Talks to server::server over its unix socket with a handler that stands in
+// for the benchmarks, and checks the parsing of requests and the round robin
+// order of request_queue.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "check.hpp"
+#include "server.hpp"
+
+using json = nlohmann::json;
+
+template <typename Function>
+static bool throws(Function function) {
+  try {
+    function();
+  } catch (const std::exception &) {
+    return true;
+  }
+  return false;
+}
+
+static void test_parse_request() {
+  auto request = server::parse_request(R"({"id": 7, "benchmark": "LAYER_A", "options": {"num_warmup": 5}})");
+  CHECK(request.id == 7);
+  CHECK(request.command == "run");
+  CHECK(request.benchmarks == std::vector<std::string>{"LAYER_A"});
+  CHECK(request.options.num_warmup == 5 && request.options.min_time < 0 && request.options.repetitions < 0);
+
+  request = server::parse_request(R"({"benchmark": ["LAYER_A", "LAYER_B"]})");
+  CHECK(request.id.is_null());
+  CHECK(request.benchmarks.size() == 2);
+
+  request = server::parse_request(R"({"id": "x", "filter": "CONV_FWD"})");
+  CHECK(request.filter == "CONV_FWD" && request.benchmarks.empty());
+
+  request = server::parse_request(R"({"command": "status"})");
+  CHECK(request.command == "status");
+
+  CHECK(throws([] { server::parse_request("[1, 2]"); }));
+  CHECK(throws([] { server::parse_request("not json"); }));
+  CHECK(throws([] { server::parse_request(R"({"command": "restart"})"); }));
+  CHECK(throws([] { server::parse_request(R"({"id": 1, "options": {"num_warmup": 5}})"); }));
+}
+
+static server::request_t queued(int client, int id) {
+  server::request_t res;
+  res.client = client;
+  res.id     = id;
+  return res;
+}
+
+// The clients take turns, whatever the order their requests were queued in.
+static void test_round_robin() {
+  server::request_queue queue;
+  queue.push(queued(1, 10));
+  queue.push(queued(1, 11));
+  queue.push(queued(1, 12));
+  queue.push(queued(2, 20));
+  queue.push(queued(3, 30));
+  queue.push(queued(3, 31));
+  CHECK(queue.size() == 6 && queue.num_clients() == 3);
+
+  std::vector<int> order;
+  for (int ii = 0; ii < 3; ii++) {
+    order.push_back(queue.pop().id.get<int>());
+  }
+  CHECK((order == std::vector<int>{10, 20, 30}));
+
+  // a client that comes back goes to the end of the line
+  queue.push(queued(2, 21));
+  while (!queue.empty()) {
+    order.push_back(queue.pop().id.get<int>());
+  }
+  CHECK((order == std::vector<int>{10, 20, 30, 11, 31, 21, 12}));
+
+  queue.push(queued(1, 13));
+  queue.push(queued(2, 22));
+  queue.push(queued(2, 23));
+  queue.drop(2);
+  CHECK(queue.size() == 1 && queue.num_clients() == 1);
+  CHECK(queue.pop().id == 13);
+  CHECK(queue.empty());
+}
+
+// A blocking client that sends one request line and reads one response line.
+class client {
+public:
+  explicit client(const std::string &path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    m_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK(m_fd >= 0);
+    CHECK(connect(m_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+  }
+
+  ~client() {
+    close(m_fd);
+  }
+
+  json request(const std::string &line) {
+    const auto data = line + "\n";
+    CHECK(send(m_fd, data.data(), data.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(data.size()));
+    size_t pos;
+    while ((pos = m_input.find('\n')) == std::string::npos) {
+      char buffer[4096];
+      const auto num_read = recv(m_fd, buffer, sizeof(buffer), 0);
+      CHECK(num_read > 0);
+      m_input.append(buffer, num_read);
+    }
+    const auto res = json::parse(m_input.substr(0, pos));
+    m_input.erase(0, pos + 1);
+    return res;
+  }
+
+private:
+  int m_fd{-1};
+  std::string m_input{""};
+};
+
+static void test_protocol() {
+  const auto path = "/tmp/test_server_" + std::to_string(getpid()) + ".sock";
+  std::vector<std::string> handled;
+  server::server daemon(path, [&handled](const server::request_t &request) {
+    if (request.benchmarks[0] == "LAYER_FAIL") {
+      throw std::runtime_error("the benchmark failed");
+    }
+    handled.push_back(request.benchmarks[0]);
+    return json{{"benchmarks", request.benchmarks}, {"num_warmup", request.options.num_warmup}};
+  });
+  std::thread serving([&daemon] { daemon.serve(); });
+
+  {
+    client conn(path);
+    auto res = conn.request(R"({"id": 1, "command": "ping"})");
+    CHECK(res["id"] == 1 && res["ok"] == true);
+
+    res = conn.request(R"({"id": 2, "benchmark": "LAYER_A", "options": {"num_warmup": 3}})");
+    CHECK(res["id"] == 2 && res["ok"] == true);
+    CHECK(res["benchmarks"] == json::array({"LAYER_A"}) && res["num_warmup"] == 3);
+    CHECK(res["queue_s"].get<double>() >= 0 && res["run_s"].get<double>() >= 0);
+
+    res = conn.request(R"({"id": "b", "benchmark": "LAYER_FAIL"})");
+    CHECK(res["id"] == "b" && res["ok"] == false && res["error"] == "the benchmark failed");
+
+    res = conn.request("not json");
+    CHECK(res["id"].is_null() && res["ok"] == false);
+    CHECK(res["error"].get<std::string>().find("invalid request") == 0);
+
+    res = conn.request(R"({"id": 5, "command": "status"})");
+    CHECK(res["ok"] == true);
+    CHECK(res["status"]["num_clients"] == 1 && res["status"]["num_queued"] == 0);
+    CHECK(res["status"]["num_served"] == 2 && res["status"]["num_failed"] == 1);
+
+    res = conn.request(R"({"id": 6, "command": "shutdown"})");
+    CHECK(res["id"] == 6 && res["ok"] == true);
+  }
+  serving.join();
+  CHECK(handled == std::vector<std::string>{"LAYER_A"});
+}
+
+int main() {
+  test_parse_request();
+  test_round_robin();
+  test_protocol();
+  printf("test_server passed\n");
+  return 0;
+}
@@ -0,0 +1,203 @@
+// Drives sweep::run with simulated devices through the runner_t seam: the
+// runner answers every batch with the json google benchmark would write, so
+// the scheduling and the merging of the outputs run without child processes.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "check.hpp"
+#include "sweep.hpp"
+
+using sweep::json;
+
+// An iteration row and two aggregates per benchmark, one with the run_name
+// of recent google benchmark versions and one without.
+static json benchmark_output(const std::vector<std::string> &names, int device) {
+  json output;
+  output["context"]    = {{"host_name", "simulated"}};
+  output["benchmarks"] = json::array();
+  for (const auto &name : names) {
+    output["benchmarks"].push_back({{"name", name}, {"run_type", "iteration"}, {"real_time", 1.0}, {"on", device}});
+    output["benchmarks"].push_back(
+        {{"name", name + "_mean"}, {"run_name", name}, {"run_type", "aggregate"}, {"aggregate_name", "mean"}});
+    output["benchmarks"].push_back({{"name", name + "_median_t"}, {"run_type", "aggregate"}});
+  }
+  return output;
+}
+
+// Device 3 fails every batch.
+static sweep::runner_t simulated_devices(std::mutex &mutex, std::map<std::string, int> &ran_on) {
+  return [&](int device, const std::vector<std::string> &names) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100 * names.size()));
+    sweep::batch_result_t res;
+    if (device == 3) {
+      res.error = "device 3 is simulated to fail";
+      return res;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &name : names) {
+      ran_on[name] = device;
+    }
+    res.ok     = true;
+    res.output = benchmark_output(names, device);
+    return res;
+  };
+}
+
+static void check_rows(const json &merged, const std::vector<std::string> &names,
+                       const std::map<std::string, int> &ran_on) {
+  CHECK(merged["context"]["host_name"] == "simulated");
+  CHECK(merged["benchmarks"].size() == 3 * names.size());
+  for (size_t ii = 0; ii < names.size(); ii++) {
+    const auto &name = names[ii];
+    // the rows of a benchmark are together and in the order of the names
+    const auto &row = merged["benchmarks"][3 * ii];
+    CHECK(row["name"] == name);
+    CHECK(merged["benchmarks"][3 * ii + 1]["name"] == name + "_mean");
+    CHECK(merged["benchmarks"][3 * ii + 2]["name"] == name + "_median_t");
+    for (size_t jj = 0; jj < 3; jj++) {
+      CHECK(merged["benchmarks"][3 * ii + jj]["device"] == ran_on.at(name));
+    }
+    CHECK(row["on"] == row["device"]);
+  }
+}
+
+// Names that extend each other: every benchmark keeps its own rows.
+static void test_prefix_names() {
+  const std::vector<std::string> names{"LAYER_A/input[0]:1",        "LAYER_A/input[0]:10",
+                                       "LAYER_A/input[0]:1/threads:2", "LAYER_A/input[0]:1_mean",
+                                       "LAYER_B/input[0]:1/manual_time"};
+  std::mutex mutex;
+  std::map<std::string, int> ran_on;
+  sweep::options_t opts;
+  opts.batch_size   = names.size();
+  const auto report = sweep::run({0}, names, std::vector<double>(names.size(), 1), opts,
+                                 simulated_devices(mutex, ran_on));
+  CHECK(report.failed.empty());
+  check_rows(report.merged, names, ran_on);
+}
+
+static void test_devices() {
+  std::vector<std::string> names;
+  std::vector<double> costs;
+  for (int ii = 0; ii < 40; ii++) {
+    names.emplace_back("LAYER_C/input[0]:" + std::to_string(ii));
+    costs.emplace_back(1 + ii % 7);
+  }
+  std::mutex mutex;
+  std::map<std::string, int> ran_on;
+  sweep::options_t opts;
+  opts.batch_size   = 4;
+  const auto report = sweep::run({0, 1, 2, 0}, names, costs, opts, simulated_devices(mutex, ran_on));
+  CHECK(report.failed.empty());
+  CHECK(ran_on.size() == names.size());
+  check_rows(report.merged, names, ran_on);
+
+  size_t num_benchmarks = 0;
+  for (const auto &worker : report.workers) {
+    num_benchmarks += worker.num_benchmarks;
+  }
+  CHECK(num_benchmarks == names.size());
+  CHECK(report.estimate.total_cost > 0);
+  CHECK(sweep::to_json(report)["workers"].size() == 4);
+}
+
+// The batches of a failing device are reported, the others merged.
+static void test_failed_device() {
+  std::vector<std::string> names;
+  for (int ii = 0; ii < 16; ii++) {
+    names.emplace_back("LAYER_D/input[0]:" + std::to_string(ii));
+  }
+  std::mutex mutex;
+  std::map<std::string, int> ran_on;
+  sweep::options_t opts;
+  opts.batch_size   = 2;
+  const auto report = sweep::run({3}, names, std::vector<double>(names.size(), 1), opts,
+                                 simulated_devices(mutex, ran_on));
+  CHECK(report.failed.size() == names.size());
+  CHECK(!report.errors.empty());
+  CHECK(report.merged["benchmarks"].empty());
+}
+
+// A benchmark that crashes its child fails its batch, but only that benchmark
+// is reported once the batch ran again one benchmark per child.
+static void test_crashing_benchmark() {
+  std::vector<std::string> names;
+  for (int ii = 0; ii < 12; ii++) {
+    names.emplace_back("LAYER_E/input[0]:" + std::to_string(ii));
+  }
+  const auto crashing = names[5];
+  std::mutex mutex;
+  std::map<std::string, int> ran_on;
+  size_t num_runs              = 0;
+  const auto devices           = simulated_devices(mutex, ran_on);
+  const sweep::runner_t runner = [&](int device, const std::vector<std::string> &batch_names) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      num_runs++;
+    }
+    if (std::find(batch_names.begin(), batch_names.end(), crashing) != batch_names.end()) {
+      sweep::batch_result_t res;
+      res.error = "segmentation fault";
+      return res;
+    }
+    return devices(device, batch_names);
+  };
+  sweep::options_t opts;
+  opts.batch_size   = 4;
+  const auto report = sweep::run({0}, names, std::vector<double>(names.size(), 1), opts, runner);
+  CHECK(report.failed == std::vector<std::string>{crashing});
+  CHECK(report.errors.size() == 2);
+  CHECK(report.num_rerun == 4);
+  CHECK(num_runs == 3 + 4);
+
+  auto survivors = names;
+  survivors.erase(survivors.begin() + 5);
+  check_rows(report.merged, survivors, ran_on);
+  CHECK(sweep::to_json(report)["num_rerun"] == 4);
+}
+
+static bool exists(const std::string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0;
+}
+
+static void test_work_dir() {
+  std::string path;
+  {
+    sweep::process::work_dir_t work_dir;
+    path = work_dir.path();
+    std::ofstream(path + "/batch_0.log") << "log\n";
+    CHECK(exists(path + "/batch_0.log"));
+  }
+  CHECK(!exists(path));
+  {
+    sweep::process::work_dir_t work_dir;
+    path = work_dir.path();
+    std::ofstream(path + "/batch_0.log") << "log\n";
+    work_dir.keep();
+  }
+  CHECK(exists(path + "/batch_0.log"));
+  unlink((path + "/batch_0.log").c_str());
+  rmdir(path.c_str());
+}
+
+int main() {
+  test_prefix_names();
+  test_devices();
+  test_failed_device();
+  test_crashing_benchmark();
+  test_work_dir();
+  printf("test_sweep passed\n");
+  return 0;
+}